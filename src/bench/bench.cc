@@ -0,0 +1,266 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <cmath>
+#include <array>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Qt:
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QSemaphore>
+#include <QTemporaryDir>
+
+// SCPIDev:
+#include <scpidev/filter.h>
+#include <scpidev/pipeline.h>
+#include <scpidev/version.h>
+#include <scpidevd/json_protocol.h>
+#include <scpidevd/metrics.h>
+#include <scpidevd/requests_handler.h>
+#include <loadgen/dataset.h>
+#include <utility/file_db.h>
+
+// Local:
+#include "benchmark.h"
+
+
+using namespace scpidev;
+
+// Dataset served by the JSON protocol benchmarks:
+constexpr double kDatasetDuration = 6 * 3600.0;
+constexpr double kDatasetSamplePeriod = 0.1;
+// Distinct requests cycled through, so that not every request hits the results cache:
+constexpr std::size_t kRequestsCount = 4096;
+
+
+/**
+ * Filter<pTaps>::process on a noisy input.
+ */
+template<std::size_t pTaps>
+	Benchmark
+	filter_benchmark()
+	{
+		return Benchmark (QString ("filter/process/%1-taps").arg (pTaps), [](uint64_t iterations) {
+			std::array<double, 256> input;
+
+			for (std::size_t i = 0; i < input.size(); ++i)
+				input[i] = 1.0 + 0.01 * std::sin (i);
+
+			Filter<pTaps> filter (1.0);
+
+			for (uint64_t i = 0; i < iterations; ++i)
+				do_not_optimize (filter.process (input[i % input.size()]));
+		});
+	}
+
+
+/**
+ * Sample with all fields filled in, as log_sample() gets it.
+ */
+Sample
+make_sample (double timestamp)
+{
+	Sample sample;
+	sample.initiate_timestamp = timestamp;
+	sample.voltage = 12.003456789;
+	sample.current = 3.141592653;
+	sample.dt = kDatasetSamplePeriod;
+
+	SampleProcessor processor (sample.voltage, sample.current);
+	processor.process (sample);
+	return sample;
+}
+
+
+/**
+ * Return request lines of given type with windows spread over the dataset.
+ */
+std::vector<QByteArray>
+make_requests (Dataset const& dataset, QString const& type, double window)
+{
+	std::vector<QByteArray> requests;
+
+	for (std::size_t i = 0; i < kRequestsCount; ++i)
+	{
+		double const start = dataset.start_timestamp + (dataset.end_timestamp - dataset.start_timestamp - window) * i / kRequestsCount;
+		QJsonObject arguments;
+
+		if (type == "get")
+			arguments = QJsonObject { { "timestamp", start } };
+		else
+			arguments = QJsonObject { { "start-timestamp", start }, { "end-timestamp", start + window } };
+
+		requests.push_back (QJsonDocument (QJsonObject { { type, arguments } }).toJson (QJsonDocument::Compact));
+	}
+
+	return requests;
+}
+
+
+int main (int argc, char** argv)
+{
+	try {
+		QCoreApplication app (argc, argv);
+
+		QCommandLineParser options;
+		options.setApplicationDescription ("Runs micro-benchmarks of the hot paths and prints results as JSON, one object per line.");
+		options.addHelpOption();
+		QCommandLineOption filter_option ("filter", "Run only benchmarks whose names contain <text>.", "text");
+		QCommandLineOption min_time_option ("min-time", "Run each repetition for at least <seconds>.", "seconds", "0.2");
+		QCommandLineOption repetitions_option ("repetitions", "Repeat each benchmark <n> times and report the median.", "n", "5");
+		QCommandLineOption list_option ("list", "List benchmarks and exit.");
+		options.addOptions ({ filter_option, min_time_option, repetitions_option, list_option });
+		options.process (app);
+
+		double const min_time = options.value (min_time_option).toDouble();
+		unsigned int const repetitions = options.value (repetitions_option).toUInt();
+		QString const filter = options.value (filter_option);
+
+		QTemporaryDir log_dir;
+		QTemporaryDir data_dir;
+
+		if (!log_dir.isValid() || !data_dir.isValid())
+			throw std::runtime_error ("could not create temporary directory");
+
+		double const now = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+		Dataset const dataset = generate_dataset (QDir (data_dir.path()), now, kDatasetDuration, kDatasetSamplePeriod);
+
+		FileDB log_db { QDir (log_dir.path()) };
+		FileDB data_db { QDir (data_dir.path()) };
+		RequestsHandler requests_handler (data_db);
+		Metrics metrics;
+		JSONProtocol json_protocol (requests_handler, metrics);
+
+		std::vector<Benchmark> benchmarks;
+
+		benchmarks.push_back (filter_benchmark<8>());
+		benchmarks.push_back (filter_benchmark<kApertures[kDefaultAperture].filter_taps>());
+		benchmarks.push_back (filter_benchmark<32>());
+		benchmarks.push_back (filter_benchmark<128>());
+
+		benchmarks.emplace_back ("pipeline/log_sample", [&](uint64_t iterations) {
+			Sample sample = make_sample (now);
+
+			for (uint64_t i = 0; i < iterations; ++i)
+			{
+				sample.initiate_timestamp += kDatasetSamplePeriod;
+				log_sample (sample, log_db);
+			}
+		});
+
+		benchmarks.emplace_back ("file_db/get_file_for_timestamp", [&](uint64_t iterations) {
+			for (uint64_t i = 0; i < iterations; ++i)
+				do_not_optimize (data_db.get_file_for_timestamp (dataset.start_timestamp + (i % 1000) * kDatasetSamplePeriod));
+		});
+
+		benchmarks.emplace_back ("json/percent_decode", [&](uint64_t iterations) {
+			QString const encoded = "{\"get\":{\"timestamp\":1456789012.345678}}%0A%25%0D";
+
+			for (uint64_t i = 0; i < iterations; ++i)
+			{
+				QString string = encoded;
+				JSONProtocol::percent_decode (string);
+				do_not_optimize (string);
+			}
+		});
+
+		struct RequestBenchmark
+		{
+			char const*	name;
+			char const*	type;
+			double		window;
+		};
+
+		for (auto const& b: { RequestBenchmark { "json/handle_request/get", "get", 0.0 },
+							  RequestBenchmark { "json/handle_request/aggregate-1h", "aggregate", 3600.0 },
+							  RequestBenchmark { "json/handle_request/quantiles-1h", "quantiles", 3600.0 } })
+		{
+			auto requests = std::make_shared<std::vector<QByteArray>> (make_requests (dataset, b.type, b.window));
+
+			benchmarks.emplace_back (b.name, [&json_protocol, requests](uint64_t iterations) {
+				for (uint64_t i = 0; i < iterations; ++i)
+				{
+					QByteArray const& request = (*requests)[i % requests->size()];
+					do_not_optimize (json_protocol.handle_line (request.constData(), request.size()));
+				}
+			});
+		}
+
+		// Same handoff as between measure and log threads in scpidev: one sample per semaphore release:
+		benchmarks.emplace_back ("queue/measure_to_log", [&](uint64_t iterations) {
+			std::queue<Sample> samples_todo;
+			std::mutex samples_mutex;
+			QSemaphore samples_semaphore;
+			Sample const sample = make_sample (now);
+
+			std::thread consumer ([&] {
+				uint64_t received = 0;
+
+				while (received < iterations)
+				{
+					samples_semaphore.acquire (1);
+					std::lock_guard<std::mutex> lock (samples_mutex);
+
+					for (; !samples_todo.empty(); samples_todo.pop())
+						++received;
+				}
+			});
+
+			for (uint64_t i = 0; i < iterations; ++i)
+			{
+				{
+					std::lock_guard<std::mutex> lock (samples_mutex);
+					samples_todo.push (sample);
+				}
+				samples_semaphore.release (1);
+			}
+
+			consumer.join();
+		});
+
+		for (auto const& benchmark: benchmarks)
+		{
+			if (!filter.isEmpty() && !benchmark.name().contains (filter))
+				continue;
+
+			if (options.isSet (list_option))
+			{
+				std::cout << benchmark.name().toStdString() << "\n";
+				continue;
+			}
+
+			QJsonObject result = benchmark.run (min_time, repetitions).to_json();
+			result.insert ("commit", Version::commit);
+			std::cout << QJsonDocument (result).toJson (QJsonDocument::Compact).constData() << std::endl;
+		}
+	}
+	catch (std::exception& e)
+	{
+		std::cout << "Fatal error: " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
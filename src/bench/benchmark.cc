@@ -0,0 +1,81 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+
+// SCPIDev:
+#include <scpidev/clock.h>
+
+// Local:
+#include "benchmark.h"
+
+
+QJsonObject
+Benchmark::Result::to_json() const
+{
+	return QJsonObject {
+		{ "benchmark", name },
+		{ "iterations", static_cast<double> (iterations) },
+		{ "ns_per_op", ns_per_op },
+		{ "ns_per_op_min", ns_per_op_min },
+		{ "ops_per_s", ns_per_op > 0.0 ? 1e9 / ns_per_op : 0.0 },
+	};
+}
+
+
+Benchmark::Benchmark (QString const& name, Body body):
+	_name (name),
+	_body (body)
+{ }
+
+
+Benchmark::Result
+Benchmark::run (double min_seconds, unsigned int repetitions) const
+{
+	auto const min_ns = static_cast<int64_t> (min_seconds * 1e9);
+	uint64_t iterations = 1;
+
+	// Warm up caches and grow the iteration count until the timer resolution doesn't matter:
+	for (int64_t elapsed = measure (iterations); elapsed < min_ns; elapsed = measure (iterations))
+	{
+		// Aim a bit over the target, but never grow by more than 10× at once:
+		double const factor = elapsed > 0 ? 1.2 * min_ns / elapsed : 10.0;
+		iterations = std::max<uint64_t> (iterations + 1, iterations * std::min (factor, 10.0));
+	}
+
+	std::vector<double> ns_per_op;
+
+	for (unsigned int i = 0; i < std::max (1u, repetitions); ++i)
+		ns_per_op.push_back (static_cast<double> (measure (iterations)) / iterations);
+
+	std::sort (ns_per_op.begin(), ns_per_op.end());
+
+	Result result;
+	result.name = _name;
+	result.iterations = iterations;
+	result.ns_per_op = ns_per_op[ns_per_op.size() / 2];
+	result.ns_per_op_min = ns_per_op.front();
+	return result;
+}
+
+
+int64_t
+Benchmark::measure (uint64_t iterations) const
+{
+	auto const start = scpidev::Clock::monotonic();
+	_body (iterations);
+	return scpidev::Clock::monotonic() - start;
+}
+
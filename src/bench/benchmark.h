@@ -0,0 +1,100 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef BENCH__BENCHMARK_H__INCLUDED
+#define BENCH__BENCHMARK_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Qt:
+#include <QJsonObject>
+#include <QString>
+
+
+/**
+ * Single micro-benchmark. The body must run the measured operation exactly the given number
+ * of times; setup that shouldn't be measured belongs outside of the body.
+ */
+class Benchmark
+{
+  public:
+	typedef std::function<void (uint64_t iterations)> Body;
+
+	class Result
+	{
+	  public:
+		/**
+		 * Return result as a JSON object, one per benchmark, stable across commits.
+		 */
+		QJsonObject
+		to_json() const;
+
+	  public:
+		QString		name;
+		uint64_t	iterations		= 0;
+		// Median and the best of all repetitions:
+		double		ns_per_op		= 0.0;
+		double		ns_per_op_min	= 0.0;
+	};
+
+  public:
+	// Ctor
+	Benchmark (QString const& name, Body body);
+
+	QString const&
+	name() const noexcept;
+
+	/**
+	 * Find the number of iterations that takes at least min_seconds, then run that many
+	 * iterations given number of times.
+	 */
+	Result
+	run (double min_seconds, unsigned int repetitions) const;
+
+  private:
+	/**
+	 * Return nanoseconds taken by given number of iterations.
+	 */
+	int64_t
+	measure (uint64_t iterations) const;
+
+  private:
+	QString	_name;
+	Body	_body;
+};
+
+
+/**
+ * Make the compiler assume the value is used, so that computations producing it aren't
+ * optimized out.
+ */
+template<class pValue>
+	inline void
+	do_not_optimize (pValue const& value)
+	{
+		asm volatile ("" : : "r" (&value) : "memory");
+	}
+
+
+inline QString const&
+Benchmark::name() const noexcept
+{
+	return _name;
+}
+
+#endif
+
@@ -0,0 +1,86 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <cmath>
+#include <random>
+
+// Qt:
+#include <QString>
+
+// Local:
+#include <utility/file_db.h>
+
+#include "dataset.h"
+
+
+Dataset
+generate_dataset (QDir location, double end_timestamp, double duration, double sample_period)
+{
+	constexpr double kVoltage = 12.0;
+	constexpr double kBasePower = 40.0;
+	constexpr double kSwingPower = 15.0;
+	constexpr double kSwingPeriod = 600.0;
+	constexpr double kSpikePower = 60.0;
+	constexpr double kSpikePeriod = 97.0;
+	constexpr double kSpikeLength = 3.0;
+	constexpr double kTemperature = 32.5;
+
+	FileDB file_db { location };
+	std::minstd_rand random;
+	std::normal_distribution<double> noise (0.0, 0.5);
+
+	Dataset dataset;
+	dataset.start_timestamp = end_timestamp - duration;
+	dataset.end_timestamp = dataset.start_timestamp;
+
+	double energy = 0.0;
+	uint64_t const samples = duration / sample_period;
+
+	for (uint64_t i = 0; i < samples; ++i)
+	{
+		double const t = dataset.start_timestamp + i * sample_period;
+		double power = kBasePower + kSwingPower * std::sin (2.0 * M_PI * t / kSwingPeriod) + noise (random);
+
+		if (std::fmod (t, kSpikePeriod) < kSpikeLength)
+			power += kSpikePower;
+
+		double const current = power / kVoltage;
+		energy += power * sample_period;
+
+		// Raw, corrected and filtered columns are all the same here:
+		file_db.get_file_for_timestamp (t)->write (QString ("%1,%2,%3,%4,%5,%6,%7,%8,%9,%10,%11,%12,%13,%14\n")
+												   .arg (t, 0, 'f', 6)
+												   .arg (kVoltage, 0, 'f', 9)
+												   .arg (kTemperature, 0, 'f', 3)
+												   .arg (current, 0, 'f', 9)
+												   .arg (kTemperature, 0, 'f', 3)
+												   .arg (power, 0, 'f', 9)
+												   .arg (energy, 0, 'f', 9)
+												   .arg (kVoltage, 0, 'f', 9)
+												   .arg (power, 0, 'f', 9)
+												   .arg (energy, 0, 'f', 9)
+												   .arg (kVoltage, 0, 'f', 9)
+												   .arg (current, 0, 'f', 6)
+												   .arg (power, 0, 'f', 9)
+												   .arg (energy, 0, 'f', 9)
+												   .toUtf8());
+
+		dataset.end_timestamp = t;
+		++dataset.samples;
+	}
+
+	return dataset;
+}
+
@@ -0,0 +1,46 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef LOADGEN__DATASET_H__INCLUDED
+#define LOADGEN__DATASET_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+
+// Qt:
+#include <QDir>
+
+
+/**
+ * Time range covered by generated samples.
+ */
+class Dataset
+{
+  public:
+	double		start_timestamp	= 0.0;
+	double		end_timestamp	= 0.0;
+	uint64_t	samples			= 0;
+};
+
+
+/**
+ * Write synthetic samples to FileDB CSV files in given directory, one sample every
+ * sample_period seconds, ending at end_timestamp. Power follows a slow sine wave with
+ * periodic load spikes and noise, so range queries see non-trivial data.
+ */
+Dataset
+generate_dataset (QDir location, double end_timestamp, double duration, double sample_period);
+
+#endif
+
@@ -0,0 +1,126 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+
+// Local:
+#include "load_client.h"
+
+
+void
+LoadResults::reset()
+{
+	latency.reset();
+	sent = 0;
+	completed = 0;
+	errors = 0;
+	connection_errors = 0;
+}
+
+
+LoadClient::LoadClient (QHostAddress const& address, uint16_t port, LoadResults& results,
+						RequestGenerator request_generator, ResponseCallback response_callback):
+	_results (results),
+	_request_generator (request_generator),
+	_response_callback (response_callback),
+	_socket (std::make_unique<QTcpSocket>())
+{
+	_socket->setSocketOption (QAbstractSocket::LowDelayOption, 1);
+
+	QObject::connect (_socket.get(), &QTcpSocket::connected, [this] {
+		_connected = true;
+	});
+
+	QObject::connect (_socket.get(), &QTcpSocket::readyRead, [this] {
+		handle_ready_read();
+	});
+
+	QObject::connect (_socket.get(), &QTcpSocket::disconnected, [this] {
+		_connected = false;
+		_sent_times.clear();
+		++_results.connection_errors;
+	});
+
+	QObject::connect (_socket.get(), static_cast<void (QAbstractSocket::*)(QAbstractSocket::SocketError)> (&QAbstractSocket::error), [this] {
+		if (!_connected)
+			++_results.connection_errors;
+	});
+
+	// Writes done before the connection is established are buffered by the socket:
+	_socket->connectToHost (address, port);
+}
+
+
+LoadClient::~LoadClient()
+{
+	// Don't let the socket call back into partially destroyed object:
+	_socket->disconnect();
+}
+
+
+void
+LoadClient::send (Clock::time_point intended_time)
+{
+	QByteArray request = _request_generator();
+	percent_encode (request);
+	request += '\n';
+
+	_socket->write (request);
+	_sent_times.push_back (intended_time);
+	++_results.sent;
+}
+
+
+void
+LoadClient::handle_ready_read()
+{
+	_input += _socket->readAll();
+	auto const now = Clock::now();
+
+	int p = 0;
+	int n = 0;
+
+	for (; (n = _input.indexOf ('\n', p)) != -1; p = n + 1)
+	{
+		if (_sent_times.empty())
+		{
+			// Response to nothing; server is confused, but keep counting:
+			++_results.errors;
+			continue;
+		}
+
+		auto latency = std::chrono::duration_cast<std::chrono::nanoseconds> (now - _sent_times.front());
+		_sent_times.pop_front();
+		_results.latency.record (latency.count());
+
+		// Error responses are { "error": { … } }:
+		if (QByteArray::fromRawData (_input.constData() + p, n - p).startsWith ("{\"error\""))
+			++_results.errors;
+		else
+			++_results.completed;
+
+		_response_callback (*this);
+	}
+
+	_input.remove (0, p);
+}
+
+
+void
+LoadClient::percent_encode (QByteArray& string)
+{
+	string.replace ("%", "%25");
+	string.replace ("\n", "%0a");
+}
+
@@ -0,0 +1,131 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef LOADGEN__LOAD_CLIENT_H__INCLUDED
+#define LOADGEN__LOAD_CLIENT_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+
+// Qt:
+#include <QByteArray>
+#include <QHostAddress>
+#include <QTcpSocket>
+
+// Local:
+#include <utility/latency_histogram.h>
+
+
+/**
+ * Results shared by all clients.
+ */
+class LoadResults
+{
+  public:
+	// Request-response latencies in nanoseconds:
+	LatencyHistogram	latency;
+	uint64_t			sent				= 0;
+	uint64_t			completed			= 0;
+	// Responses with { error: … }:
+	uint64_t			errors				= 0;
+	// Connections closed by server or failed to connect:
+	uint64_t			connection_errors	= 0;
+
+  public:
+	/**
+	 * Forget everything recorded so far (eg. after warm-up).
+	 */
+	void
+	reset();
+};
+
+
+/**
+ * Single connection to scpidevd speaking the JSON protocol.
+ * Requests are pipelined: any number may be in flight and responses come back in order.
+ */
+class LoadClient
+{
+  public:
+	typedef std::chrono::steady_clock Clock;
+	typedef std::function<QByteArray()> RequestGenerator;
+	// Called after each response:
+	typedef std::function<void (LoadClient&)> ResponseCallback;
+
+  public:
+	// Ctor
+	LoadClient (QHostAddress const& address, uint16_t port, LoadResults&, RequestGenerator, ResponseCallback);
+
+	// Dtor
+	~LoadClient();
+
+	/**
+	 * Return true if connection is established and usable.
+	 */
+	bool
+	connected() const noexcept;
+
+	/**
+	 * Number of requests sent but not yet answered.
+	 */
+	std::size_t
+	in_flight() const noexcept;
+
+	/**
+	 * Send next request. Latency is measured from intended_time, so requests delayed by the
+	 * client itself (coordinated omission) are accounted for.
+	 */
+	void
+	send (Clock::time_point intended_time = Clock::now());
+
+  private:
+	void
+	handle_ready_read();
+
+	/**
+	 * Percent-encode newline and '%' characters inline.
+	 */
+	static void
+	percent_encode (QByteArray&);
+
+  private:
+	LoadResults&					_results;
+	RequestGenerator				_request_generator;
+	ResponseCallback				_response_callback;
+	std::unique_ptr<QTcpSocket>		_socket;
+	bool							_connected	= false;
+	QByteArray						_input;
+	std::deque<Clock::time_point>	_sent_times;
+};
+
+
+inline bool
+LoadClient::connected() const noexcept
+{
+	return _connected;
+}
+
+
+inline std::size_t
+LoadClient::in_flight() const noexcept
+{
+	return _sent_times.size();
+}
+
+#endif
+
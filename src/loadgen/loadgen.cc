@@ -0,0 +1,361 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+// Boost:
+#include <boost/format.hpp>
+
+// Qt:
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QTimer>
+
+// Local:
+#include "dataset.h"
+#include "load_client.h"
+
+
+namespace {
+
+typedef LoadClient::Clock Clock;
+
+constexpr uint16_t kDefaultServerPort = 15026;
+constexpr int kServerStartTimeoutMs = 10000;
+
+
+class Options
+{
+  public:
+	QHostAddress		server_address		{ QHostAddress::LocalHost };
+	uint16_t			server_port			= kDefaultServerPort;
+	bool				spawn_server		= true;
+	QString				scpidevd_path;
+	std::size_t			connections			= 64;
+	std::size_t			pipeline			= 1;
+	// Requests per second for all connections; 0 means closed loop:
+	double				rate				= 0.0;
+	double				warmup				= 2.0;
+	double				duration			= 10.0;
+	double				window				= 3600.0;
+	double				dataset_duration	= 2 * 3600.0;
+	double				sample_rate			= 10.0;
+	std::vector<QString>
+						request_types		{ "get" };
+};
+
+
+double
+to_positive_double (QString const& string, char const* option_name)
+{
+	bool ok = false;
+	double result = string.toDouble (&ok);
+
+	if (!ok || result < 0.0)
+		throw std::runtime_error (std::string ("invalid --") + option_name + " value");
+
+	return result;
+}
+
+
+Options
+parse_options (QCoreApplication& app)
+{
+	QCommandLineParser parser;
+	parser.setApplicationDescription ("Load generator for scpidevd. Unless --server is given, generates a synthetic "
+									  "dataset and runs a local scpidevd instance over it.");
+	parser.addHelpOption();
+
+	QCommandLineOption server_option ("server", "Use already running server at <address:port>.", "address:port");
+	QCommandLineOption scpidevd_option ("scpidevd", "Path to scpidevd binary to spawn.", "path", app.applicationDirPath() + "/scpidevd");
+	QCommandLineOption port_option ("port", "Port for the spawned scpidevd.", "port", QString::number (kDefaultServerPort));
+	QCommandLineOption connections_option ("connections", "Number of concurrent connections.", "n", "64");
+	QCommandLineOption pipeline_option ("pipeline", "Requests in flight per connection in closed-loop mode.", "n", "1");
+	QCommandLineOption rate_option ("rate", "Total requests per second (open loop). 0 runs closed loop.", "requests/s", "0");
+	QCommandLineOption warmup_option ("warmup", "Warm-up time excluded from results.", "seconds", "2");
+	QCommandLineOption duration_option ("duration", "Measurement time.", "seconds", "10");
+	QCommandLineOption requests_option ("requests", "Comma-separated request types to send (get, aggregate, quantiles), picked uniformly.", "types", "get");
+	QCommandLineOption window_option ("window", "Time range of aggregate and quantiles requests.", "seconds", "3600");
+	QCommandLineOption dataset_hours_option ("dataset-hours", "Length of the generated dataset.", "hours", "2");
+	QCommandLineOption sample_rate_option ("sample-rate", "Samples per second in the generated dataset.", "Hz", "10");
+
+	parser.addOptions ({
+		server_option, scpidevd_option, port_option, connections_option, pipeline_option, rate_option, warmup_option,
+		duration_option, requests_option, window_option, dataset_hours_option, sample_rate_option,
+	});
+	parser.process (app);
+
+	Options options;
+
+	if (parser.isSet (server_option))
+	{
+		auto parts = parser.value (server_option).split (':');
+
+		if (parts.size() != 2 || !options.server_address.setAddress (parts[0]))
+			throw std::runtime_error ("invalid --server value, expected address:port");
+
+		options.server_port = to_positive_double (parts[1], "server");
+		options.spawn_server = false;
+	}
+	else
+		options.server_port = to_positive_double (parser.value (port_option), "port");
+
+	options.scpidevd_path = parser.value (scpidevd_option);
+	options.connections = to_positive_double (parser.value (connections_option), "connections");
+	options.pipeline = to_positive_double (parser.value (pipeline_option), "pipeline");
+	options.rate = to_positive_double (parser.value (rate_option), "rate");
+	options.warmup = to_positive_double (parser.value (warmup_option), "warmup");
+	options.duration = to_positive_double (parser.value (duration_option), "duration");
+	options.window = to_positive_double (parser.value (window_option), "window");
+	options.dataset_duration = 3600.0 * to_positive_double (parser.value (dataset_hours_option), "dataset-hours");
+	options.sample_rate = to_positive_double (parser.value (sample_rate_option), "sample-rate");
+
+	options.request_types.clear();
+	for (auto const& type: parser.value (requests_option).split (','))
+	{
+		if (type != "get" && type != "aggregate" && type != "quantiles")
+			throw std::runtime_error ("unknown request type '" + type.toStdString() + "'");
+		options.request_types.push_back (type);
+	}
+
+	if (options.connections == 0 || options.pipeline == 0 || options.duration == 0.0 || options.sample_rate == 0.0)
+		throw std::runtime_error ("--connections, --pipeline, --duration and --sample-rate must be positive");
+
+	return options;
+}
+
+
+/**
+ * Try connecting to the server until it accepts connections.
+ */
+void
+wait_for_server (QHostAddress const& address, uint16_t port, QProcess& server)
+{
+	auto const deadline = Clock::now() + std::chrono::milliseconds (kServerStartTimeoutMs);
+
+	while (Clock::now() < deadline)
+	{
+		if (server.state() == QProcess::NotRunning)
+			throw std::runtime_error ("scpidevd exited during startup with code " + std::to_string (server.exitCode()));
+
+		QTcpSocket probe;
+		probe.connectToHost (address, port);
+
+		if (probe.waitForConnected (100))
+			return;
+
+		QThread::msleep (50);
+	}
+
+	throw std::runtime_error ("scpidevd didn't start listening in time");
+}
+
+
+/**
+ * Ask server for its statistics with a separate connection.
+ */
+QByteArray
+fetch_server_stats (QHostAddress const& address, uint16_t port)
+{
+	QTcpSocket socket;
+	socket.connectToHost (address, port);
+
+	if (!socket.waitForConnected (1000))
+		return "(unavailable)";
+
+	socket.write ("{\"stats\":{}}\n");
+
+	while (!socket.canReadLine())
+		if (!socket.waitForReadyRead (1000))
+			return "(unavailable)";
+
+	return socket.readLine().trimmed();
+}
+
+
+void
+print_report (Options const& options, LoadResults const& results, double measured_seconds, QByteArray const& server_stats)
+{
+	auto const us = [&](uint64_t ns) { return ns / 1000.0; };
+	auto const& latency = results.latency;
+	uint64_t const responses = results.completed + results.errors;
+
+	std::cout << "Mode:            ";
+	if (options.rate > 0.0)
+		std::cout << boost::format ("open loop, %.0f req/s over %u connections\n") % options.rate % options.connections;
+	else
+		std::cout << boost::format ("closed loop, %u connections × %u in flight\n") % options.connections % options.pipeline;
+
+	std::cout << "Request types:   ";
+	for (auto const& type: options.request_types)
+		std::cout << type.toStdString() << " ";
+	std::cout << "\n";
+
+	std::cout << boost::format ("Requests:        sent %u, completed %u, errors %u, connection errors %u\n")
+		% results.sent % results.completed % results.errors % results.connection_errors;
+	std::cout << boost::format ("Throughput:      %.1f req/s\n") % (responses / measured_seconds);
+	std::cout << boost::format ("Latency [µs]:    mean %.1f   p50 %.1f   p99 %.1f   p999 %.1f   max %.1f\n")
+		% (latency.mean() / 1000.0) % us (latency.quantile (0.5)) % us (latency.quantile (0.99))
+		% us (latency.quantile (0.999)) % us (latency.max());
+	std::cout << "Server stats:    " << server_stats.constData() << std::endl;
+}
+
+} // namespace
+
+
+int main (int argc, char** argv)
+{
+	try {
+		auto event_loop = std::make_unique<QCoreApplication> (argc, argv);
+		Options options = parse_options (*event_loop);
+
+		double const now = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+		Dataset dataset;
+		dataset.start_timestamp = now - options.dataset_duration;
+		dataset.end_timestamp = now;
+
+		QTemporaryDir data_dir;
+		QProcess server;
+
+		if (options.spawn_server)
+		{
+			if (!data_dir.isValid())
+				throw std::runtime_error ("could not create temporary directory");
+
+			std::cout << "Generating dataset in " << data_dir.path().toStdString() << "…" << std::endl;
+			dataset = generate_dataset (QDir (data_dir.path()), now, options.dataset_duration, 1.0 / options.sample_rate);
+			std::cout << "Generated " << dataset.samples << " samples." << std::endl;
+
+			server.setProcessChannelMode (QProcess::ForwardedErrorChannel);
+			// scpidevd logs every connection; keep that out of the report:
+			server.setStandardOutputFile (QProcess::nullDevice());
+			server.start (options.scpidevd_path, { "--data-dir", data_dir.path(), "--port", QString::number (options.server_port) });
+
+			if (!server.waitForStarted())
+				throw std::runtime_error ("could not start " + options.scpidevd_path.toStdString() + ": " + server.errorString().toStdString());
+
+			wait_for_server (options.server_address, options.server_port, server);
+		}
+
+		std::minstd_rand random;
+		std::uniform_real_distribution<double> timestamp_distribution (dataset.start_timestamp, dataset.end_timestamp);
+		std::uniform_int_distribution<std::size_t> type_distribution (0, options.request_types.size() - 1);
+
+		auto generate_request = [&]() -> QByteArray {
+			auto const& type = options.request_types[type_distribution (random)];
+			double t = timestamp_distribution (random);
+
+			if (type == "get")
+				return (boost::format ("{\"get\":{\"timestamp\":%.6f}}") % t).str().c_str();
+			else
+				return (boost::format ("{\"%s\":{\"start-timestamp\":%.6f,\"end-timestamp\":%.6f}}")
+						% type.toStdString() % (t - options.window) % t).str().c_str();
+		};
+
+		LoadResults results;
+		bool running = true;
+		bool const closed_loop = options.rate == 0.0;
+
+		auto on_response = [&](LoadClient& client) {
+			if (running && closed_loop)
+				client.send();
+		};
+
+		std::vector<std::unique_ptr<LoadClient>> clients;
+
+		for (std::size_t i = 0; i < options.connections; ++i)
+			clients.push_back (std::make_unique<LoadClient> (options.server_address, options.server_port, results, generate_request, on_response));
+
+		if (closed_loop)
+		{
+			for (auto& client: clients)
+				for (std::size_t i = 0; i < options.pipeline; ++i)
+					client->send();
+		}
+
+		// Open loop: send requests on schedule, regardless of responses:
+		QTimer rate_timer;
+		auto const start_time = Clock::now();
+		uint64_t issued = 0;
+		std::size_t next_client = 0;
+
+		if (!closed_loop)
+		{
+			QObject::connect (&rate_timer, &QTimer::timeout, [&] {
+				auto const elapsed = std::chrono::duration<double> (Clock::now() - start_time).count();
+				auto const due = static_cast<uint64_t> (elapsed * options.rate);
+
+				for (; issued < due; ++issued)
+				{
+					auto const intended_time = start_time + std::chrono::duration_cast<Clock::duration> (std::chrono::duration<double> (issued / options.rate));
+
+					// Skip connections that are not (yet) usable:
+					for (std::size_t tries = 0; tries < clients.size() && !clients[next_client]->connected(); ++tries)
+						next_client = (next_client + 1) % clients.size();
+
+					clients[next_client]->send (intended_time);
+					next_client = (next_client + 1) % clients.size();
+				}
+			});
+			rate_timer.setTimerType (Qt::PreciseTimer);
+			rate_timer.start (1);
+		}
+
+		Clock::time_point measurement_start;
+		Clock::time_point measurement_end;
+
+		QTimer::singleShot (options.warmup * 1000.0, [&] {
+			results.reset();
+			measurement_start = Clock::now();
+		});
+
+		QTimer::singleShot ((options.warmup + options.duration) * 1000.0, [&] {
+			measurement_end = Clock::now();
+			running = false;
+			rate_timer.stop();
+			event_loop->quit();
+		});
+
+		event_loop->exec();
+
+		auto const measured_seconds = std::chrono::duration<double> (measurement_end - measurement_start).count();
+		print_report (options, results, measured_seconds, fetch_server_stats (options.server_address, options.server_port));
+
+		clients.clear();
+
+		if (options.spawn_server)
+		{
+			server.terminate();
+			server.waitForFinished();
+		}
+	}
+	catch (std::exception& e)
+	{
+		std::cout << "Fatal error: " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
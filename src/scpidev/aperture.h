@@ -0,0 +1,93 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__APERTURE_H__INCLUDED
+#define SCPIDEV__APERTURE_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+
+
+namespace scpidev {
+
+constexpr double kACFrequencyHz = 50.0;
+
+
+/**
+ * Integration time of meters and taps of filters spanning the same time.
+ */
+class Aperture
+{
+  public:
+	// Power line cycles per reading:
+	double		nplc;
+	std::size_t	filter_taps;
+};
+
+
+/**
+ * Apertures supported by 34461A, shortest first. Filters span half a second at the nominal sample
+ * rate of the aperture (25 taps at 1 PLC), but at least 3 taps, since Hann window of fewer taps is
+ * all zeros. Short apertures don't reach their nominal rate, see SwitchedLowPass.
+ */
+constexpr Aperture kApertures[] = {
+	{ 0.02,		1250 },
+	{ 0.2,		125 },
+	{ 1.0,		25 },
+	{ 10.0,		3 },
+	{ 100.0,	3 },
+};
+
+constexpr std::size_t kAperturesCount = sizeof (kApertures) / sizeof (kApertures[0]);
+
+// 1 PLC:
+constexpr std::size_t kDefaultAperture = 2;
+
+
+/**
+ * Return index in kApertures of given NPLC, or kAperturesCount if it's not supported.
+ */
+constexpr std::size_t
+find_aperture (double nplc) noexcept
+{
+	for (std::size_t i = 0; i < kAperturesCount; ++i)
+		if (kApertures[i].nplc == nplc)
+			return i;
+
+	return kAperturesCount;
+}
+
+
+/**
+ * Return true if given filter lengths are the filter_taps of kApertures, in order.
+ */
+template<std::size_t ...pTaps>
+	constexpr bool
+	matches_apertures() noexcept
+	{
+		std::size_t const taps[] = { pTaps... };
+
+		if (sizeof... (pTaps) != kAperturesCount)
+			return false;
+
+		for (std::size_t i = 0; i < kAperturesCount; ++i)
+			if (taps[i] != kApertures[i].filter_taps)
+				return false;
+
+		return true;
+	}
+
+} // namespace scpidev
+
+#endif
+
@@ -0,0 +1,48 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <limits>
+
+// Local:
+#include "clock.h"
+
+
+namespace scpidev {
+
+Clock::Clock()
+{
+	constexpr int kAnchorAttempts = 16;
+
+	// Read wall time between two monotonic readings and keep the tightest bracket,
+	// so a preemption during anchoring doesn't skew all timestamps:
+	Nanoseconds best_gap = std::numeric_limits<Nanoseconds>::max();
+
+	for (int i = 0; i < kAnchorAttempts; ++i)
+	{
+		Nanoseconds before = read (CLOCK_MONOTONIC);
+		Nanoseconds wall = read (CLOCK_REALTIME);
+		Nanoseconds after = read (CLOCK_MONOTONIC);
+
+		if (after - before < best_gap)
+		{
+			best_gap = after - before;
+			_anchor_monotonic = before + (after - before) / 2;
+			_anchor_unix = wall;
+		}
+	}
+}
+
+} // namespace scpidev
+
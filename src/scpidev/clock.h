@@ -0,0 +1,119 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__CLOCK_H__INCLUDED
+#define SCPIDEV__CLOCK_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+
+// Linux:
+#include <time.h>
+
+
+namespace scpidev {
+
+/**
+ * CLOCK_MONOTONIC timebase anchored once to wall time.
+ *
+ * Intervals (dt) should be computed from monotonic() readings: they have nanosecond resolution
+ * and don't jump when wall clock is set. unix_time() converts monotonic readings to UNIX timestamps
+ * for storage, so stored timestamps stay consistent with the intervals.
+ */
+class Clock
+{
+  public:
+	typedef int64_t Nanoseconds;
+
+  public:
+	/**
+	 * Anchor monotonic time to current wall time.
+	 */
+	Clock();
+
+	/**
+	 * Current CLOCK_MONOTONIC time.
+	 */
+	static Nanoseconds
+	monotonic() noexcept;
+
+	/**
+	 * Convert monotonic time to UNIX timestamp in seconds.
+	 */
+	double
+	unix_time (Nanoseconds monotonic_time) const noexcept;
+
+	/**
+	 * Current UNIX timestamp in seconds, derived from monotonic time.
+	 */
+	double
+	now() const noexcept;
+
+	/**
+	 * Convert nanoseconds interval to seconds.
+	 */
+	static double
+	seconds (Nanoseconds) noexcept;
+
+  private:
+	static Nanoseconds
+	read (clockid_t) noexcept;
+
+  private:
+	Nanoseconds	_anchor_monotonic;
+	Nanoseconds	_anchor_unix;
+};
+
+
+inline Clock::Nanoseconds
+Clock::monotonic() noexcept
+{
+	return read (CLOCK_MONOTONIC);
+}
+
+
+inline double
+Clock::unix_time (Nanoseconds monotonic_time) const noexcept
+{
+	// Subtract integers first to keep nanosecond precision:
+	return (_anchor_unix + (monotonic_time - _anchor_monotonic)) * 1e-9;
+}
+
+
+inline double
+Clock::now() const noexcept
+{
+	return unix_time (monotonic());
+}
+
+
+inline double
+Clock::seconds (Nanoseconds interval) noexcept
+{
+	return interval * 1e-9;
+}
+
+
+inline Clock::Nanoseconds
+Clock::read (clockid_t clock_id) noexcept
+{
+	struct timespec ts;
+	::clock_gettime (clock_id, &ts);
+	return static_cast<Nanoseconds> (ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+} // namespace scpidev
+
+#endif
+
@@ -0,0 +1,148 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <string>
+
+// Local:
+#include "configuration.h"
+
+
+namespace scpidev {
+
+namespace {
+
+// Keep program messages well below the meters' input buffer size:
+constexpr int kMaxMessageLength = 256;
+
+
+class Message
+{
+  public:
+	QString									text;
+	// Entries that produce a response, in order:
+	std::vector<ConfigurationEntry const*>	queries;
+};
+
+
+std::vector<Message>
+pack (Configuration const& configuration)
+{
+	std::vector<Message> result;
+	Message current;
+
+	for (auto const& entry: configuration)
+	{
+		// Use absolute headers, so that joined commands don't resolve relative to the previous one:
+		QString text = entry.text.startsWith ("*") || entry.text.startsWith (":") ? entry.text : ":" + entry.text;
+
+		if (!current.text.isEmpty() && current.text.size() + 1 + text.size() > kMaxMessageLength)
+		{
+			result.push_back (current);
+			current = Message();
+		}
+
+		if (!current.text.isEmpty())
+			current.text += ";";
+
+		current.text += text;
+
+		if (entry.kind != ConfigurationEntry::kCommand)
+			current.queries.push_back (&entry);
+	}
+
+	if (!current.text.isEmpty())
+		result.push_back (current);
+
+	return result;
+}
+
+} // namespace
+
+
+void
+configure (std::vector<std::pair<SCPIDevice*, Configuration const*>> const& devices)
+{
+	std::vector<std::vector<Message>> messages;
+
+	for (auto const& device: devices)
+		messages.push_back (pack (*device.second));
+
+	// Send everything first, so that devices work in parallel and there's no round trip per message:
+	for (std::size_t d = 0; d < devices.size(); ++d)
+	{
+		for (auto const& message: messages[d])
+			devices[d].first->send (message.text);
+
+		devices[d].first->flush();
+	}
+
+	for (std::size_t d = 0; d < devices.size(); ++d)
+	{
+		auto const& device = *devices[d].first;
+
+		for (auto const& message: messages[d])
+		{
+			if (message.queries.empty())
+				continue;
+
+			QString const reply = devices[d].first->ask();
+			auto responses = split_responses (reply);
+
+			if (static_cast<std::size_t> (responses.size()) != message.queries.size())
+				throw SCPIDevice::Error (device.name(), "expected " + std::to_string (message.queries.size()) + " responses to " +
+										 message.text.toStdString() + ", got '" + reply.toStdString() + "'");
+
+			for (std::size_t i = 0; i < message.queries.size(); ++i)
+			{
+				auto const& entry = *message.queries[i];
+
+				if (entry.kind == ConfigurationEntry::kVerify && responses[i] != entry.expected)
+					throw SCPIDevice::Error (device.name(), "failed to verify " + entry.text.toStdString() + " is " +
+											 entry.expected.toStdString() + ", reply is '" + responses[i].toStdString() + "'");
+			}
+		}
+	}
+}
+
+
+QStringList
+split_responses (QString const& response)
+{
+	QStringList result;
+	QString current;
+	bool quoted = false;
+
+	for (int i = 0; i < response.size(); ++i)
+	{
+		QChar c = response[i];
+
+		if (c == '"')
+			quoted = !quoted;
+
+		if (c == ';' && !quoted)
+		{
+			result << current.trimmed();
+			current.clear();
+		}
+		else
+			current += c;
+	}
+
+	result << current.trimmed();
+	return result;
+}
+
+} // namespace scpidev
+
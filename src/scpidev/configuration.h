@@ -0,0 +1,89 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__CONFIGURATION_H__INCLUDED
+#define SCPIDEV__CONFIGURATION_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Qt:
+#include <QString>
+#include <QStringList>
+
+// SCPIDev:
+#include <scpidev/scpi_device.h>
+
+
+namespace scpidev {
+
+/**
+ * Single step of device configuration.
+ */
+class ConfigurationEntry
+{
+  public:
+	enum Kind
+	{
+		// Command without a response:
+		kCommand,
+		// Query whose response is only logged:
+		kQuery,
+		// Query whose response must equal 'expected':
+		kVerify,
+	};
+
+  public:
+	// Ctor
+	ConfigurationEntry (Kind kind, QString const& text, QString const& expected = QString()):
+		kind (kind),
+		text (text),
+		expected (expected)
+	{ }
+
+  public:
+	Kind	kind;
+	// Full SCPI header with arguments, eg. "SENSE:VOLTAGE:DC:NPLC 1":
+	QString	text;
+	QString	expected;
+};
+
+
+/**
+ * Ordered list of configuration steps for a single device.
+ */
+typedef std::vector<ConfigurationEntry> Configuration;
+
+
+/**
+ * Configure all devices at once. Steps are joined with ';' into as few program messages as possible
+ * and all messages are sent to all devices before any response is awaited, so the whole bring-up
+ * takes about one round trip, with devices working in parallel.
+ *
+ * Throw SCPIDevice::Error naming the command and the device's reply if a verification fails.
+ */
+void
+configure (std::vector<std::pair<SCPIDevice*, Configuration const*>> const& devices);
+
+/**
+ * Split a response to a compound query on ';' outside of quoted strings.
+ */
+QStringList
+split_responses (QString const& response);
+
+} // namespace scpidev
+
+#endif
+
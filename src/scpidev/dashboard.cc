@@ -0,0 +1,311 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <cstdarg>
+#include <cstdio>
+#include <algorithm>
+
+// Linux:
+#include <unistd.h>
+
+// Local:
+#include "dashboard.h"
+
+
+namespace scpidev {
+
+// Dashboard dt histogram range [s]:
+constexpr double kDtHistogramMinimum = 0.001;
+constexpr double kDtHistogramMaximum = 10.0;
+constexpr unsigned int kDtHistogramBinsPerDecade = 8;
+constexpr unsigned int kDtHistogramBarWidth = 40;
+// Longest formatted line, including escape sequences:
+constexpr std::size_t kLineBufferSize = 512;
+// Lines preallocated for a frame (fixed part + histogram rows):
+constexpr std::size_t kPreallocatedLines = 64;
+
+// Terminal escape sequences:
+#define BOLD		"\x1B[1;39;49m"
+#define GREEN		"\x1B[0;32;49m"
+#define IMPORTANT	"\x1B[1;39;44m"
+#define ERRONEOUS	"\x1B[1;39;41m"
+#define RESET		"\x1B[0m"
+// High and low precision:
+#define HS			"%+11.6f"
+#define LS			"%+8.3f"
+
+
+Dashboard::Dashboard (double refresh_rate_hz, std::vector<Channel> const& channels):
+	_channels (channels),
+	_latest (channels.size()),
+	_dt_histogram (kDtHistogramMinimum, kDtHistogramMaximum, kDtHistogramBinsPerDecade),
+	_period (static_cast<int64_t> (1e9 / refresh_rate_hz)),
+	_samples (channels.size()),
+	_histogram (_dt_histogram),
+	_lines (kPreallocatedLines),
+	_previous_lines (kPreallocatedLines),
+	_buffer (kLineBufferSize)
+{
+	for (auto* lines: { &_lines, &_previous_lines })
+		for (auto& line: *lines)
+			line.reserve (kLineBufferSize);
+
+	_output.reserve (kPreallocatedLines * kLineBufferSize);
+	_thread = std::thread (&Dashboard::run, this);
+}
+
+
+Dashboard::~Dashboard()
+{
+	stop();
+}
+
+
+void
+Dashboard::stop()
+{
+	if (!_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock (_mutex);
+		_quit = true;
+	}
+	_quit_condition.notify_all();
+	_thread.join();
+}
+
+
+void
+Dashboard::update (std::vector<Sample> const& samples, std::size_t queue_length)
+{
+	if (samples.empty())
+		return;
+
+	std::lock_guard<std::mutex> lock (_mutex);
+
+	for (auto const& sample: samples)
+	{
+		if (sample.channel >= _latest.size())
+			continue;
+
+		if (sample.channel == 0 && sample.dt > 0.0)
+			_dt_histogram.record (sample.dt);
+
+		_latest[sample.channel] = sample;
+	}
+
+	_queue_length = queue_length;
+	++_generation;
+}
+
+
+std::thread::native_handle_type
+Dashboard::native_handle()
+{
+	return _thread.native_handle();
+}
+
+
+void
+Dashboard::run()
+{
+	uint64_t drawn_generation = 0;
+	auto next_frame = std::chrono::steady_clock::now();
+
+	while (true)
+	{
+		std::size_t queue_length;
+
+		{
+			std::unique_lock<std::mutex> lock (_mutex);
+
+			next_frame += _period;
+			if (_quit_condition.wait_until (lock, next_frame, [&] { return _quit; }))
+				break;
+
+			if (_generation == drawn_generation)
+				continue;
+
+			// Copy under the lock, format outside of it. Assignments reuse already allocated storage:
+			drawn_generation = _generation;
+			_samples = _latest;
+			_histogram = _dt_histogram;
+			queue_length = _queue_length;
+		}
+
+		format (_samples, queue_length, _histogram);
+		draw();
+	}
+
+	if (_cleared)
+	{
+		// Leave the cursor below the dashboard:
+		_output.clear();
+		_output += "\x1B[";
+		_output += std::to_string (_previous_lines_count + 1);
+		_output += ";1H";
+		write_output();
+	}
+}
+
+
+void
+Dashboard::format (std::vector<Sample> const& channel_samples, std::size_t queue_length, LogHistogram const& dt_histogram)
+{
+	_lines_count = 0;
+
+	if (channel_samples.empty())
+		return;
+
+	Sample const& sample = channel_samples[0];
+
+	line ("now = " BOLD "%-.3f" RESET " s   elapsed = " BOLD "%+6.1f" RESET " s   since last autozero = " BOLD "%+6.1f" RESET " s",
+		  sample.initiate_timestamp, sample.initiate_timestamp - sample.start_timestamp, sample.initiate_timestamp - sample.auto_zero_timestamp);
+
+	if (sample.timing_errors > 0)
+		line (" dt = " BOLD "%+.6f" RESET " s            max dt = " BOLD "%+.6f" RESET " s         timing errors = " ERRONEOUS "%llu" RESET,
+			  sample.dt, sample.max_dt, static_cast<unsigned long long> (sample.timing_errors));
+	else
+		line (" dt = " BOLD "%+.6f" RESET " s            max dt = " BOLD "%+.6f" RESET " s         timing errors = 0", sample.dt, sample.max_dt);
+
+	line (" queue = %zu", queue_length);
+	line ("%s", "");
+	line ("    PLC/sample                        = %g", kApertures[sample.aperture].nplc);
+	line ("    Voltmeter-motherboard resistance  = %g Ω", _channels[0].burden_resistance);
+	line ("%s", "");
+	line ("    Voltmeter temperature             = " GREEN "%.3f" RESET "°C", sample.voltmeter_temperature);
+	line ("    Ammeter temperature               = " GREEN "%.3f" RESET "°C", sample.ammeter_temperature);
+	line ("    Samples                           = %llu", static_cast<unsigned long long> (sample.number));
+	line ("%s", "");
+	line ("    Raw measurements:");
+	line ("        U           = " HS " V", sample.voltage);
+	line ("        I           = " IMPORTANT HS RESET " A", sample.current);
+	line ("        P           = " HS " W", sample.power);
+	line ("       ∫P dt        = " HS " Ws = " HS " Wh", sample.energy, sample.energy / 3600.0);
+	line ("%s", "");
+	line ("    Corrected measurements:");
+	line ("        U           = " IMPORTANT HS RESET " V (error = " HS " V)", sample.voltage_corrected, sample.voltage_error);
+	line ("        P           = " IMPORTANT HS RESET " W (error = " HS " W)", sample.power_corrected, sample.power - sample.power_corrected);
+	line ("       ∫P dt        = " HS " Ws = " IMPORTANT HS RESET " Wh", sample.energy_corrected, sample.energy_corrected / 3600.0);
+	line ("%s", "");
+	line ("    Filtered measurements (%zu taps, Hann):", sample.filter_taps);
+	line ("        U           = " IMPORTANT LS RESET " V", sample.voltage_corrected_filtered);
+	line ("        I           = " IMPORTANT LS RESET " A", sample.current_filtered);
+	line ("        P           = " IMPORTANT LS RESET " W", sample.power_corrected_filtered);
+	line ("%s", "");
+
+	if (channel_samples.size() > 1)
+	{
+		line ("    Channels (corrected):      U [V]        I [A]        P [W]   ∫P dt [Wh]");
+
+		for (std::size_t i = 0; i < channel_samples.size(); ++i)
+		{
+			Sample const& s = channel_samples[i];
+			line ("        %-16.16s " HS "  " HS "  " HS "  " HS,
+				  _channels[i].name.c_str(), s.voltage_corrected, s.current, s.power_corrected, s.energy_corrected / 3600.0);
+		}
+
+		line ("%s", "");
+	}
+
+	line ("    dt histogram (%llu samples):", static_cast<unsigned long long> (dt_histogram.count()));
+
+	for (std::size_t row = 0, n = dt_histogram.rows(); row < n; ++row)
+	{
+		dt_histogram.render_row (row, kDtHistogramBarWidth, 1000.0, "ms", _buffer.data(), _buffer.size());
+		line ("%s", _buffer.data());
+	}
+}
+
+
+void
+Dashboard::line (char const* format, ...)
+{
+	char buffer[kLineBufferSize];
+
+	va_list args;
+	va_start (args, format);
+	int length = std::vsnprintf (buffer, sizeof (buffer), format, args);
+	va_end (args);
+
+	length = std::max (0, std::min<int> (length, sizeof (buffer) - 1));
+
+	if (_lines_count == _lines.size())
+	{
+		_lines.emplace_back();
+		_lines.back().reserve (kLineBufferSize);
+	}
+
+	_lines[_lines_count++].assign (buffer, length);
+}
+
+
+void
+Dashboard::draw()
+{
+	_output.clear();
+
+	if (!_cleared)
+	{
+		_output += "\x1B[H\x1B[2J";
+		_cleared = true;
+		_previous_lines_count = 0;
+	}
+
+	char cursor[32];
+
+	for (std::size_t i = 0; i < _lines_count; ++i)
+	{
+		if (i < _previous_lines_count && _lines[i] == _previous_lines[i])
+			continue;
+
+		// Move to the line, rewrite it and erase what's left of the old one:
+		int length = std::snprintf (cursor, sizeof (cursor), "\x1B[%zu;1H", i + 1);
+		_output.append (cursor, length);
+		_output += _lines[i];
+		_output += "\x1B[K";
+	}
+
+	// Erase lines left over from a longer previous frame:
+	if (_lines_count < _previous_lines_count)
+	{
+		int length = std::snprintf (cursor, sizeof (cursor), "\x1B[%zu;1H\x1B[J", _lines_count + 1);
+		_output.append (cursor, length);
+	}
+
+	write_output();
+
+	std::swap (_lines, _previous_lines);
+	_previous_lines_count = _lines_count;
+}
+
+
+void
+Dashboard::write_output()
+{
+	std::size_t written = 0;
+
+	while (written < _output.size())
+	{
+		auto n = ::write (STDOUT_FILENO, _output.data() + written, _output.size() - written);
+		if (n <= 0)
+			break;
+		written += n;
+	}
+}
+
+} // namespace scpidev
+
@@ -0,0 +1,140 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__DASHBOARD_H__INCLUDED
+#define SCPIDEV__DASHBOARD_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// SCPIDev:
+#include <scpidev/log_histogram.h>
+#include <scpidev/pipeline.h>
+
+
+namespace scpidev {
+
+/**
+ * Terminal dashboard showing the latest sample of the first channel in detail and a summary line
+ * for each channel. Runs in its own thread at a fixed refresh rate, so its cost doesn't depend on
+ * the sample rate. Lines are formatted into reused buffers and only lines that differ from the
+ * previous frame are redrawn.
+ */
+class Dashboard
+{
+  public:
+	class Channel
+	{
+	  public:
+		std::string	name;
+		double		burden_resistance;
+	};
+
+  public:
+	/**
+	 * Start renderer thread.
+	 */
+	Dashboard (double refresh_rate_hz, std::vector<Channel> const& channels);
+
+	// Dtor
+	~Dashboard();
+
+	/**
+	 * Stop renderer thread and move the cursor below the dashboard.
+	 */
+	void
+	stop();
+
+	/**
+	 * Publish a batch of logged samples. Only the last one of each channel gets displayed, but dt
+	 * of all samples of the first channel goes to the dt histogram. Called by the log thread.
+	 */
+	void
+	update (std::vector<Sample> const& samples, std::size_t queue_length);
+
+	/**
+	 * Renderer thread handle, eg. for setting CPU affinity.
+	 */
+	std::thread::native_handle_type
+	native_handle();
+
+  private:
+	void
+	run();
+
+	/**
+	 * Format all lines of a frame.
+	 */
+	void
+	format (std::vector<Sample> const& channel_samples, std::size_t queue_length, LogHistogram const& dt_histogram);
+
+	/**
+	 * Append printf-formatted line to the current frame.
+	 */
+	void
+	line (char const* format, ...) __attribute__ ((format (printf, 2, 3)));
+
+	/**
+	 * Write lines that changed since the previous frame.
+	 */
+	void
+	draw();
+
+	/**
+	 * Write the output buffer to stdout, retrying partial writes.
+	 */
+	void
+	write_output();
+
+  private:
+	std::vector<Channel>	_channels;
+
+	// Shared with the log thread:
+	std::mutex				_mutex;
+	std::condition_variable	_quit_condition;
+	bool					_quit				= false;
+	uint64_t				_generation			= 0;
+	// Latest sample of each channel:
+	std::vector<Sample>		_latest;
+	std::size_t				_queue_length		= 0;
+	LogHistogram			_dt_histogram;
+
+	// Renderer thread only:
+	std::chrono::nanoseconds
+							_period;
+	std::vector<Sample>		_samples;
+	LogHistogram			_histogram;
+	std::vector<std::string>
+							_lines;
+	std::vector<std::string>
+							_previous_lines;
+	std::size_t				_lines_count		= 0;
+	std::size_t				_previous_lines_count = 0;
+	std::vector<char>		_buffer;
+	std::string				_output;
+	bool					_cleared			= false;
+
+	std::thread				_thread;
+};
+
+} // namespace scpidev
+
+#endif
+
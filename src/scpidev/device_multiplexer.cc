@@ -0,0 +1,154 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+// Linux:
+#include <errno.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+// Local:
+#include "device_multiplexer.h"
+
+
+namespace scpidev {
+
+// Give up on devices that don't respond for this long:
+constexpr int kResponseTimeoutMs = 30000;
+constexpr int kMaxEvents = 64;
+
+
+DeviceMultiplexer::DeviceMultiplexer (std::vector<SCPIDevice*> const& devices):
+	_devices (devices),
+	_pending (devices.size(), false)
+{
+	_epoll_fd = ::epoll_create1 (EPOLL_CLOEXEC);
+
+	if (_epoll_fd == -1)
+		throw std::runtime_error (std::string ("epoll_create1(): ") + ::strerror (errno));
+
+	for (std::size_t i = 0; i < _devices.size(); ++i)
+	{
+		epoll_event event;
+		std::memset (&event, 0, sizeof (event));
+		event.events = EPOLLIN;
+		event.data.u64 = i;
+
+		if (::epoll_ctl (_epoll_fd, EPOLL_CTL_ADD, _devices[i]->fd(), &event) != 0)
+		{
+			int error = errno;
+			::close (_epoll_fd);
+			throw std::runtime_error ("epoll_ctl() for " + _devices[i]->name().toStdString() + ": " + ::strerror (error));
+		}
+	}
+}
+
+
+DeviceMultiplexer::~DeviceMultiplexer()
+{
+	::close (_epoll_fd);
+}
+
+
+void
+DeviceMultiplexer::ask_all (std::vector<SCPIDevice::Command const*> const& commands)
+{
+	std::size_t pending_count = 0;
+
+	for (std::size_t i = 0; i < _devices.size(); ++i)
+	{
+		_pending[i] = false;
+
+		if (!commands[i])
+			continue;
+
+		_devices[i]->send (*commands[i]);
+		_devices[i]->flush();
+		_pending[i] = true;
+		++pending_count;
+	}
+
+	// Some responses might have been received along with earlier ones:
+	for (std::size_t i = 0; i < _devices.size(); ++i)
+	{
+		if (_pending[i] && _devices[i]->has_line())
+		{
+			_devices[i]->take_reply();
+			_pending[i] = false;
+			--pending_count;
+		}
+	}
+
+	epoll_event events[kMaxEvents];
+
+	while (pending_count > 0)
+	{
+		int n = ::epoll_wait (_epoll_fd, events, kMaxEvents, kResponseTimeoutMs);
+
+		if (n == 0)
+		{
+			for (std::size_t i = 0; i < _devices.size(); ++i)
+				if (_pending[i])
+					throw SCPIDevice::Error (_devices[i]->name(), "timeout");
+		}
+		else if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			throw std::runtime_error (std::string ("epoll_wait(): ") + ::strerror (errno));
+		}
+
+		for (int e = 0; e < n; ++e)
+		{
+			std::size_t i = events[e].data.u64;
+			SCPIDevice* device = _devices[i];
+
+			if (device->receive() && _pending[i])
+			{
+				device->take_reply();
+				_pending[i] = false;
+				--pending_count;
+			}
+		}
+	}
+}
+
+
+void
+DeviceMultiplexer::send_all (QString const& command)
+{
+	for (auto* device: _devices)
+		device->send (command);
+
+	for (auto* device: _devices)
+		device->flush();
+}
+
+
+void
+DeviceMultiplexer::send_all (SCPIDevice::Command const& command)
+{
+	for (auto* device: _devices)
+		device->send (command);
+
+	for (auto* device: _devices)
+		device->flush();
+}
+
+} // namespace scpidev
+
@@ -0,0 +1,77 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__DEVICE_MULTIPLEXER_H__INCLUDED
+#define SCPIDEV__DEVICE_MULTIPLEXER_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <vector>
+
+// Qt:
+#include <QString>
+
+// SCPIDev:
+#include <scpidev/scpi_device.h>
+
+
+namespace scpidev {
+
+/**
+ * Queries many SCPI devices at once from a single thread: sends to all of them first and then
+ * collects responses in whatever order they arrive, using epoll. Time of a round of queries is
+ * that of the slowest device, not the sum over all devices.
+ */
+class DeviceMultiplexer
+{
+  public:
+	/**
+	 * Throw std::runtime_error if epoll can't be set up.
+	 */
+	explicit DeviceMultiplexer (std::vector<SCPIDevice*> const& devices);
+
+	// Dtor
+	~DeviceMultiplexer();
+
+	/**
+	 * Send *commands[i] to device i and wait for one response line from each of them.
+	 * Responses are left in each device's reply buffer (SCPIDevice::reply()).
+	 * Devices with nullptr command are skipped and their reply is left untouched.
+	 * Doesn't allocate. Throw SCPIDevice::Error on device failure or timeout.
+	 */
+	void
+	ask_all (std::vector<SCPIDevice::Command const*> const& commands);
+
+	/**
+	 * Send the same command to all devices, without waiting for responses.
+	 */
+	void
+	send_all (QString const& command);
+
+	/**
+	 * Same as send_all (QString), but without any allocations.
+	 */
+	void
+	send_all (SCPIDevice::Command const& command);
+
+  private:
+	std::vector<SCPIDevice*>	_devices;
+	int							_epoll_fd;
+	// Reused by ask_all():
+	std::vector<bool>			_pending;
+};
+
+} // namespace scpidev
+
+#endif
+
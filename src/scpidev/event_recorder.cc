@@ -0,0 +1,91 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+
+// SCPIDev:
+#include <scpidev/pipeline.h>
+
+// Local:
+#include "event_recorder.h"
+
+
+namespace scpidev {
+
+constexpr char EventRecorder::kPrefix[];
+
+
+EventRecorder::EventRecorder (QDir location, std::size_t pre_trigger_samples):
+	_file_db (location, kPrefix, header()),
+	_ring (pre_trigger_samples)
+{ }
+
+
+void
+EventRecorder::add (Sample const& sample)
+{
+	if (sample.event == 0)
+	{
+		// End of burst:
+		if (_event != 0 && _file)
+			_file->flush();
+
+		_event = 0;
+
+		if (!_ring.empty())
+		{
+			_ring[_ring_head] = sample;
+			_ring_head = (_ring_head + 1) % _ring.size();
+			_ring_size = std::min (_ring_size + 1, _ring.size());
+		}
+
+		return;
+	}
+
+	if (sample.event != _event)
+	{
+		_event = sample.event;
+		_event_id = QByteArray::number (sample.initiate_timestamp, 'f', 6);
+		++_events;
+
+		// Oldest sample first:
+		for (std::size_t i = 0; i < _ring_size; ++i)
+			write (_ring[(_ring_head + _ring.size() - _ring_size + i) % _ring.size()], false);
+
+		_ring_size = 0;
+	}
+
+	write (sample, true);
+}
+
+
+void
+EventRecorder::write (Sample const& sample, bool burst)
+{
+	_file = _file_db.get_file_for_timestamp (sample.initiate_timestamp);
+	_file->write (_event_id);
+	_file->write (burst ? ",1," : ",0,");
+	_file->write (format_sample (sample));
+}
+
+
+QByteArray
+EventRecorder::header()
+{
+	return QByteArray ("#event,#burst,") + FileDB::kHeader;
+}
+
+} // namespace scpidev
+
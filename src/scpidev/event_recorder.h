@@ -0,0 +1,96 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__EVENT_RECORDER_H__INCLUDED
+#define SCPIDEV__EVENT_RECORDER_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Qt:
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+
+// SCPIDev:
+#include <scpidev/sample.h>
+#include <utility/file_db.h>
+
+
+namespace scpidev {
+
+/**
+ * Saves trigger events (see Trigger) to an "events" FileDB series. Keeps the last
+ * pre_trigger_samples normal samples in a fixed-size ring; when the first burst sample of an
+ * event arrives, the ring is written out, followed by all burst samples of the event.
+ *
+ * Rows are sample rows prefixed with the event's timestamp (of its first burst sample) and 0 for
+ * pre-trigger or 1 for burst samples.
+ */
+class EventRecorder
+{
+  public:
+	static constexpr char kPrefix[] = "events";
+
+  public:
+	// Ctor
+	EventRecorder (QDir location, std::size_t pre_trigger_samples);
+
+	/**
+	 * Add sample, in order.
+	 */
+	void
+	add (Sample const&);
+
+	/**
+	 * Number of events written so far.
+	 */
+	uint64_t
+	events() const noexcept;
+
+  private:
+	void
+	write (Sample const&, bool burst);
+
+	/**
+	 * Return the first line of event files.
+	 */
+	static QByteArray
+	header();
+
+  private:
+	FileDB					_file_db;
+	std::vector<Sample>		_ring;
+	std::size_t				_ring_head		= 0;
+	std::size_t				_ring_size		= 0;
+	// Sample::event of the event being written, 0 if none:
+	uint64_t				_event			= 0;
+	QByteArray				_event_id;
+	uint64_t				_events			= 0;
+	std::shared_ptr<QFile>	_file;
+};
+
+
+inline uint64_t
+EventRecorder::events() const noexcept
+{
+	return _events;
+}
+
+} // namespace scpidev
+
+#endif
+
@@ -24,6 +24,13 @@
 
 namespace scpidev {
 
+/**
+ * Fill given array with Hann window of given length.
+ */
+void
+hann_window (double* window, std::size_t length);
+
+
 /**
  * Implements moving-average with Hann window.
  *
@@ -22,6 +22,15 @@
 
 namespace scpidev {
 
+inline void
+hann_window (double* window, std::size_t length)
+{
+	std::size_t N = length;
+	for (std::size_t n = 0; n < N; ++n)
+		window[n] = 0.5 * (1.0 - std::cos (2.0 * M_PI * n / (N - 1)));
+}
+
+
 template<std::size_t L>
 	inline
 	Filter<L>::Filter (double initial_value):
@@ -65,10 +74,7 @@ template<std::size_t L>
 	inline void
 	Filter<L>::compute_window()
 	{
-		// Hann window function:
-		std::size_t N = _window.size();
-		for (std::size_t n = 0; n < N; ++n)
-			_window[n] = 0.5 * (1.0 - std::cos (2.0 * M_PI * n / (N - 1)));
+		hann_window (_window.data(), _window.size());
 	}
 
 } // namespace scpidev
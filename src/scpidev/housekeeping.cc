@@ -0,0 +1,45 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+
+// Local:
+#include "housekeeping.h"
+
+
+namespace scpidev {
+
+HousekeepingScheduler::HousekeepingScheduler (uint64_t period_samples, std::size_t meters):
+	_period (std::max<uint64_t> (period_samples, 2 * std::max<std::size_t> (meters, 1))),
+	_meters (std::max<std::size_t> (meters, 1))
+{ }
+
+
+HousekeepingScheduler::Tasks
+HousekeepingScheduler::tasks (uint64_t sample_number, std::size_t meter) const noexcept
+{
+	uint64_t const slot = (sample_number - 1) % _period;
+	uint64_t const auto_zero_slot = meter * _period / _meters;
+	uint64_t const next_auto_zero_slot = (meter + 1) * _period / _meters;
+	Tasks result;
+
+	result.auto_zero = slot == auto_zero_slot;
+	result.temperature = slot == (auto_zero_slot + next_auto_zero_slot) / 2;
+
+	return result;
+}
+
+} // namespace scpidev
+
@@ -0,0 +1,68 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__HOUSEKEEPING_H__INCLUDED
+#define SCPIDEV__HOUSEKEEPING_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+
+
+namespace scpidev {
+
+/**
+ * Decides which housekeeping commands (auto-zero, temperature read) go with which sample.
+ *
+ * Each period of N samples is split evenly among M meters. Meter m takes a zero reading at slot
+ * m·N/M and reads its temperature half-way to the next meter's slot. For two meters that's:
+ *   0:		voltmeter auto-zero,
+ *   N/4:	voltmeter temperature,
+ *   N/2:	ammeter auto-zero,
+ *   3N/4:	ammeter temperature.
+ * So as long as N ≥ 2M, meters never zero in the same iteration.
+ */
+class HousekeepingScheduler
+{
+  public:
+	class Tasks
+	{
+	  public:
+		bool	auto_zero	= false;
+		bool	temperature	= false;
+	};
+
+  public:
+	/**
+	 * \param	period_samples
+	 *			Number of samples between auto-zeros of the same meter. Raised to at least 2·meters.
+	 * \param	meters
+	 *			Number of meters.
+	 */
+	HousekeepingScheduler (uint64_t period_samples, std::size_t meters);
+
+	/**
+	 * Return tasks for given meter to do with given sample (numbered from 1).
+	 */
+	Tasks
+	tasks (uint64_t sample_number, std::size_t meter) const noexcept;
+
+  private:
+	uint64_t	_period;
+	std::size_t	_meters;
+};
+
+} // namespace scpidev
+
+#endif
+
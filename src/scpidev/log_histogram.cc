@@ -0,0 +1,127 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// Local:
+#include "log_histogram.h"
+
+
+namespace scpidev {
+
+// Enough for the range column of a row:
+constexpr std::size_t kRowPrefixSize = 96;
+
+
+LogHistogram::LogHistogram (double minimum, double maximum, unsigned int bins_per_decade):
+	_minimum (minimum),
+	_log_minimum (std::log10 (minimum)),
+	_bins_per_decade (bins_per_decade),
+	_bins (std::ceil ((std::log10 (maximum) - _log_minimum) * bins_per_decade) + 2, 0)
+{ }
+
+
+void
+LogHistogram::record (double value) noexcept
+{
+	std::size_t bin = 0;
+
+	if (value >= _minimum)
+	{
+		double position = (std::log10 (value) - _log_minimum) * _bins_per_decade;
+		bin = std::min<std::size_t> (static_cast<std::size_t> (position) + 1, _bins.size() - 1);
+	}
+
+	++_bins[bin];
+	++_count;
+}
+
+
+uint64_t
+LogHistogram::count() const noexcept
+{
+	return _count;
+}
+
+
+std::size_t
+LogHistogram::rows() const noexcept
+{
+	std::size_t first = first_bin();
+
+	if (first == _bins.size())
+		return 0;
+
+	std::size_t last = _bins.size() - 1;
+	while (_bins[last] == 0)
+		--last;
+
+	return last - first + 1;
+}
+
+
+int
+LogHistogram::render_row (std::size_t row, unsigned int bar_width, double unit_scale, char const* unit, char* buffer, std::size_t size) const noexcept
+{
+	std::size_t first = first_bin();
+	std::size_t bin = first + row;
+
+	if (bin >= _bins.size())
+		return std::snprintf (buffer, size, "%s", "");
+
+	uint64_t max_count = 0;
+	for (std::size_t i = first; i < _bins.size(); ++i)
+		max_count = std::max (max_count, _bins[i]);
+
+	char range[kRowPrefixSize];
+
+	if (bin == 0)
+		std::snprintf (range, sizeof (range), "%11s < %9.3f %s", "", _minimum * unit_scale, unit);
+	else if (bin == _bins.size() - 1)
+		std::snprintf (range, sizeof (range), "%11s ≥ %9.3f %s", "", bin_lower_bound (bin) * unit_scale, unit);
+	else
+		std::snprintf (range, sizeof (range), "%9.3f … %9.3f %s", bin_lower_bound (bin) * unit_scale, bin_lower_bound (bin + 1) * unit_scale, unit);
+
+	auto bar_length = static_cast<unsigned int> (std::lround (bar_width * std::log10 (1.0 + _bins[bin]) / std::log10 (1.0 + max_count)));
+
+	int prefix = std::snprintf (buffer, size, "        %s  ", range);
+	if (prefix < 0 || static_cast<std::size_t> (prefix) + bar_width >= size)
+		return prefix;
+
+	std::fill_n (buffer + prefix, bar_length, '#');
+	std::fill_n (buffer + prefix + bar_length, bar_width - bar_length, ' ');
+
+	return prefix + bar_width + std::snprintf (buffer + prefix + bar_width, size - prefix - bar_width, " %llu",
+											   static_cast<unsigned long long> (_bins[bin]));
+}
+
+
+std::size_t
+LogHistogram::first_bin() const noexcept
+{
+	return std::find_if (_bins.begin(), _bins.end(), [](uint64_t n) { return n > 0; }) - _bins.begin();
+}
+
+
+double
+LogHistogram::bin_lower_bound (std::size_t bin) const noexcept
+{
+	return std::pow (10.0, _log_minimum + (bin - 1) / _bins_per_decade);
+}
+
+} // namespace scpidev
+
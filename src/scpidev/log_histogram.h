@@ -0,0 +1,78 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__LOG_HISTOGRAM_H__INCLUDED
+#define SCPIDEV__LOG_HISTOGRAM_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace scpidev {
+
+/**
+ * Histogram with logarithmically spaced bins, for displaying eg. sample intervals on the dashboard.
+ * Values below minimum or above maximum go to underflow and overflow bins.
+ */
+class LogHistogram
+{
+  public:
+	// Ctor
+	LogHistogram (double minimum, double maximum, unsigned int bins_per_decade);
+
+	void
+	record (double value) noexcept;
+
+	uint64_t
+	count() const noexcept;
+
+	/**
+	 * Number of rows, one per bin from the lowest to the highest non-empty one.
+	 */
+	std::size_t
+	rows() const noexcept;
+
+	/**
+	 * Format single row (without newline) into buffer, like snprintf(). Bar lengths are
+	 * log-scaled too, so rare outliers stay visible next to the main peak.
+	 * Values are shown multiplied by unit_scale (eg. 1000 for seconds → ms).
+	 * Doesn't allocate, so it can be used by the dashboard renderer.
+	 */
+	int
+	render_row (std::size_t row, unsigned int bar_width, double unit_scale, char const* unit, char* buffer, std::size_t size) const noexcept;
+
+  private:
+	/**
+	 * Index of the first non-empty bin, or _bins.size() if there's none.
+	 */
+	std::size_t
+	first_bin() const noexcept;
+
+	double
+	bin_lower_bound (std::size_t bin) const noexcept;
+
+  private:
+	double					_minimum;
+	double					_log_minimum;
+	double					_bins_per_decade;
+	// [0] is underflow, back() is overflow:
+	std::vector<uint64_t>	_bins;
+	uint64_t				_count		= 0;
+};
+
+} // namespace scpidev
+
+#endif
+
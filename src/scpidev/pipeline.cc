@@ -0,0 +1,97 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+
+// Local:
+#include "pipeline.h"
+
+
+namespace scpidev {
+
+SampleProcessor::SampleProcessor (double initial_voltage, double initial_current, double burden_resistance):
+	_derived_quantities ({}, {}, BurdenCorrection (burden_resistance), {}, {}, VoltageFilter (initial_voltage), CurrentFilter (initial_current), {}, {})
+{ }
+
+
+void
+SampleProcessor::process (Sample& sample)
+{
+	_derived_quantities.process (sample);
+	sample.filter_taps = kApertures[sample.aperture].filter_taps;
+}
+
+
+void
+SampleProcessor::process (Sample* samples, std::size_t count)
+{
+	_derived_quantities.process (samples, count);
+
+	for (std::size_t i = 0; i < count; ++i)
+		samples[i].filter_taps = kApertures[samples[i].aperture].filter_taps;
+}
+
+
+std::array<double, FileDB::kColumnsCount>
+sample_columns (Sample const& sample)
+{
+	return {{
+		sample.initiate_timestamp,
+		sample.voltage,
+		sample.voltmeter_temperature,
+		sample.current,
+		sample.ammeter_temperature,
+		sample.power,
+		sample.energy,
+		sample.voltage_corrected,
+		sample.power_corrected,
+		sample.energy_corrected,
+		sample.voltage_corrected_filtered,
+		sample.current_filtered,
+		sample.power_corrected_filtered,
+		sample.energy_corrected_filtered,
+	}};
+}
+
+
+QByteArray
+format_sample (Sample const& sample)
+{
+	return QString ("%1,%2,%3,%4,%5,%6,%7,%8,%9,%10,%11,%12,%13,%14\n")
+		.arg (sample.initiate_timestamp, 0, 'f', 6)
+		.arg (sample.voltage, 0, 'f', 9)
+		.arg (sample.voltmeter_temperature, 0, 'f', 3)
+		.arg (sample.current, 0, 'f', 9)
+		.arg (sample.ammeter_temperature, 0, 'f', 3)
+		.arg (sample.power, 0, 'f', 18)
+		.arg (sample.energy, 0, 'f', 18)
+		.arg (sample.voltage_corrected, 0, 'f', 18)
+		.arg (sample.power_corrected, 0, 'f', 18)
+		.arg (sample.energy_corrected, 0, 'f', 18)
+		.arg (sample.voltage_corrected_filtered, 0, 'f', 9)
+		.arg (sample.current_filtered, 0, 'f', 6)
+		.arg (sample.power_corrected_filtered, 0, 'f', 18)
+		.arg (sample.energy_corrected_filtered, 0, 'f', 18)
+		.toUtf8();
+}
+
+
+void
+log_sample (Sample const& sample, FileDB& file_db)
+{
+	file_db.get_file_for_timestamp (sample.initiate_timestamp)->write (format_sample (sample));
+}
+
+} // namespace scpidev
+
@@ -0,0 +1,114 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__PIPELINE_H__INCLUDED
+#define SCPIDEV__PIPELINE_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <array>
+
+// Qt:
+#include <QByteArray>
+#include <QString>
+
+// SCPIDev:
+#include <scpidev/sample.h>
+#include <scpidev/stages.h>
+#include <utility/file_db.h>
+
+
+namespace scpidev {
+
+constexpr double kTotalVoltmeterBurdenResitanceOhms = 0.025666;
+
+
+/**
+ * Computes derived values (power, corrections, filtering, energy integrals) from raw measurements.
+ * Shared by live measurement and replay, so both produce identical results from identical inputs.
+ * A derived quantity is added by appending a stage to DerivedQuantities. Filter length follows
+ * Sample::aperture; integrals only depend on dt, so they stay continuous when aperture changes.
+ */
+class SampleProcessor
+{
+  public:
+	/**
+	 * \param	initial_voltage, initial_current
+	 *			Initial output values of the filters.
+	 * \param	burden_resistance
+	 *			Resistance in series with the voltmeter, used to correct voltage for the current.
+	 */
+	SampleProcessor (double initial_voltage, double initial_current, double burden_resistance = kTotalVoltmeterBurdenResitanceOhms);
+
+	/**
+	 * Fill in derived fields of the sample. Needs voltage, current and dt to be set.
+	 */
+	void
+	process (Sample&);
+
+	/**
+	 * Same as process() called on each sample in order.
+	 */
+	void
+	process (Sample* samples, std::size_t count);
+
+  private:
+	typedef SeriesCorrection<&Sample::voltage_error, &Sample::voltage_corrected, &Sample::voltage, &Sample::current>
+		BurdenCorrection;
+	typedef SwitchedLowPass<&Sample::voltage_corrected_filtered, &Sample::voltage_corrected, 1250, 125, 25, 3, 3>
+		VoltageFilter;
+	typedef SwitchedLowPass<&Sample::current_filtered, &Sample::current, 1250, 125, 25, 3, 3>
+		CurrentFilter;
+
+	static_assert (matches_apertures<1250, 125, 25, 3, 3>(), "filter taps must follow kApertures");
+
+	typedef Pipeline<
+		Product<&Sample::power, &Sample::voltage, &Sample::current>,
+		Integrator<&Sample::energy, &Sample::power>,
+		BurdenCorrection,
+		Product<&Sample::power_corrected, &Sample::voltage_corrected, &Sample::current>,
+		Integrator<&Sample::energy_corrected, &Sample::power_corrected>,
+		VoltageFilter,
+		CurrentFilter,
+		Product<&Sample::power_corrected_filtered, &Sample::voltage_corrected_filtered, &Sample::current_filtered>,
+		Integrator<&Sample::energy_corrected_filtered, &Sample::power_corrected_filtered>
+	> DerivedQuantities;
+
+  private:
+	DerivedQuantities		_derived_quantities;
+};
+
+
+/**
+ * Return values of a sample in FileDB::Column order, as written by log_sample().
+ */
+std::array<double, FileDB::kColumnsCount>
+sample_columns (Sample const& sample);
+
+/**
+ * Return CSV row (with the newline) for a sample, in FileDB::Column order.
+ */
+QByteArray
+format_sample (Sample const& sample);
+
+/**
+ * Log single sample to an output file.
+ */
+void
+log_sample (Sample const& sample, FileDB& file_db);
+
+} // namespace scpidev
+
+#endif
+
@@ -0,0 +1,117 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+
+// Qt:
+#include <QSaveFile>
+
+// Local:
+#include "plot_feed.h"
+
+
+namespace scpidev {
+
+constexpr char PlotFeed::kSamplesFile[];
+constexpr char PlotFeed::kCandlesticksFile[];
+
+// Same layout as tools/make_stats output:
+constexpr char kCandlesticksHeader[] = "#timestamp,#min,#p25,#mean,#p75,#max,\n";
+
+
+PlotFeed::PlotFeed (QDir directory, std::size_t window_rows, std::size_t bucket_rows, FileDB::Column column, double refresh_period):
+	_directory (directory),
+	_window_rows (std::max<std::size_t> (1, window_rows)),
+	_bucket_rows (std::max<std::size_t> (1, bucket_rows)),
+	_column (column),
+	_refresh_period (refresh_period * 1e9)
+{
+	if (!_directory.mkpath ("."))
+		throw Error ("couldn't create directory " + _directory.path().toStdString());
+}
+
+
+void
+PlotFeed::add (Sample const& sample)
+{
+	_samples.push_back (format_sample (sample));
+
+	if (_samples.size() > _window_rows)
+		_samples.pop_front();
+
+	auto const columns = sample_columns (sample);
+	_bucket.append (sample.initiate_timestamp, &columns[_column]);
+
+	if (_bucket.rows() == _bucket_rows)
+	{
+		auto const statistics = compute_statistics (_bucket.columns[0]);
+		QByteArray line;
+
+		for (double value: { _bucket.timestamps_sum / _bucket.rows(), statistics.min, statistics.p25, statistics.mean, statistics.p75, statistics.max })
+		{
+			line += QByteArray::number (value, 'g', 17);
+			line += ',';
+		}
+
+		line += '\n';
+		_candlesticks.push_back (line);
+
+		// As many candlesticks as fit in the window:
+		if (_candlesticks.size() > _window_rows / _bucket_rows)
+			_candlesticks.pop_front();
+
+		_bucket = Slice (1);
+	}
+
+	_changed = true;
+}
+
+
+void
+PlotFeed::refresh()
+{
+	Clock::Nanoseconds const now = Clock::monotonic();
+
+	if (!_changed || now - _last_refresh < _refresh_period)
+		return;
+
+	write (kSamplesFile, FileDB::kHeader, _samples);
+	write (kCandlesticksFile, kCandlesticksHeader, _candlesticks);
+	_last_refresh = now;
+	_changed = false;
+}
+
+
+void
+PlotFeed::write (QString const& name, QByteArray const& header, std::deque<QByteArray> const& lines)
+{
+	QString const path = _directory.filePath (name);
+	// Writes to a temporary file and renames it over the old one on commit():
+	QSaveFile file (path);
+
+	if (!file.open (QIODevice::WriteOnly))
+		throw Error ("couldn't open " + path.toStdString() + ": " + file.errorString().toStdString());
+
+	file.write (header);
+
+	for (auto const& line: lines)
+		file.write (line);
+
+	if (!file.commit())
+		throw Error ("couldn't write " + path.toStdString() + ": " + file.errorString().toStdString());
+}
+
+} // namespace scpidev
+
@@ -0,0 +1,104 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__PLOT_FEED_H__INCLUDED
+#define SCPIDEV__PLOT_FEED_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <deque>
+#include <stdexcept>
+
+// Qt:
+#include <QByteArray>
+#include <QDir>
+#include <QString>
+
+// SCPIDev:
+#include <scpidev/clock.h>
+#include <scpidev/pipeline.h>
+#include <utility/file_db.h>
+#include <utility/slice_statistics.h>
+
+
+namespace scpidev {
+
+/**
+ * Keeps data files for tools/visualize-power-last.gp up to date as samples arrive: the last
+ * window_rows CSV rows and candlesticks (min, p25, mean, p75, max of one column) over consecutive
+ * buckets of bucket_rows samples.
+ *
+ * Each sample is formatted and each bucket summarized once, when they arrive, so a refresh only
+ * concatenates ready lines. Files are replaced atomically, gnuplot never sees a partial file.
+ */
+class PlotFeed
+{
+  public:
+	static constexpr char kSamplesFile[]		= "visualize-power-last.dat";
+	static constexpr char kCandlesticksFile[]	= "visualize-power-last-candlesticks.dat";
+
+	class Error: public std::runtime_error
+	{
+	  public:
+		// Ctor:
+		Error (std::string const& message):
+			std::runtime_error ("plot feed: " + message)
+		{ }
+	};
+
+  public:
+	/**
+	 * \param	column
+	 *			Column summarized by candlesticks.
+	 * \param	refresh_period
+	 *			Minimum time between rewrites of the files, in seconds.
+	 */
+	PlotFeed (QDir directory, std::size_t window_rows, std::size_t bucket_rows, FileDB::Column column, double refresh_period);
+
+	/**
+	 * Add sample to the window and to the current bucket.
+	 */
+	void
+	add (Sample const&);
+
+	/**
+	 * Rewrite files if anything changed and the refresh period has passed.
+	 * Throw Error on failure.
+	 */
+	void
+	refresh();
+
+  private:
+	/**
+	 * Atomically replace file with header followed by lines.
+	 */
+	void
+	write (QString const& name, QByteArray const& header, std::deque<QByteArray> const& lines);
+
+  private:
+	QDir					_directory;
+	std::size_t				_window_rows;
+	std::size_t				_bucket_rows;
+	FileDB::Column			_column;
+	Clock::Nanoseconds		_refresh_period;
+	Clock::Nanoseconds		_last_refresh	= 0;
+	bool					_changed		= false;
+	std::deque<QByteArray>	_samples;
+	std::deque<QByteArray>	_candlesticks;
+	Slice					_bucket			{ 1 };
+};
+
+} // namespace scpidev
+
+#endif
+
@@ -0,0 +1,168 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+// Linux:
+#include <errno.h>
+#include <malloc.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Boost:
+#include <boost/format.hpp>
+
+// Local:
+#include "realtime.h"
+
+
+namespace scpidev {
+
+constexpr std::size_t kPrefaultStackSize = 512 * 1024;
+
+
+void
+RealTimeReport::add (QString const& setting, bool ok, QString const& detail)
+{
+	_entries.push_back ({ setting, ok, detail });
+}
+
+
+bool
+RealTimeReport::all_ok() const
+{
+	return std::all_of (_entries.begin(), _entries.end(), [](Entry const& e) { return e.ok; });
+}
+
+
+QString
+RealTimeReport::render() const
+{
+	QString result = "Real-time mode:\n";
+
+	for (auto const& entry: _entries)
+	{
+		char const* status = entry.ok ? "ok" : "FAILED";
+		auto line = (boost::format ("    %-40s %s") % entry.setting.toStdString() % status).str();
+
+		if (!entry.detail.isEmpty())
+			line += " (" + entry.detail.toStdString() + ")";
+
+		result += QString::fromStdString (line) + "\n";
+	}
+
+	return result;
+}
+
+
+int
+online_cpus()
+{
+	return std::max<long> (1, ::sysconf (_SC_NPROCESSORS_ONLN));
+}
+
+
+void
+lock_memory (RealTimeReport& report)
+{
+	if (::mlockall (MCL_CURRENT | MCL_FUTURE) == 0)
+		report.add ("mlockall (current and future)", true);
+	else
+		report.add ("mlockall (current and future)", false, ::strerror (errno));
+
+	// Keep freed memory in the process instead of unmapping it, and serve large allocations from
+	// the heap, so later allocations reuse already locked pages:
+	bool malloc_ok = ::mallopt (M_TRIM_THRESHOLD, -1) == 1 && ::mallopt (M_MMAP_MAX, 0) == 1;
+	report.add ("malloc: no trimming, no mmap", malloc_ok);
+}
+
+
+void
+prefault_stack()
+{
+	volatile char stack[kPrefaultStackSize];
+	std::size_t const page_size = ::sysconf (_SC_PAGESIZE);
+
+	for (std::size_t i = 0; i < kPrefaultStackSize; i += page_size)
+		stack[i] = 0;
+}
+
+
+void
+set_fifo_scheduling (pthread_t thread, QString const& thread_name, int priority, RealTimeReport& report)
+{
+	QString setting = QString ("%1: SCHED_FIFO priority %2").arg (thread_name).arg (priority);
+	int min = ::sched_get_priority_min (SCHED_FIFO);
+	int max = ::sched_get_priority_max (SCHED_FIFO);
+
+	if (priority < min || priority > max)
+	{
+		report.add (setting, false, QString ("priority must be in %1…%2").arg (min).arg (max));
+		return;
+	}
+
+	struct sched_param param;
+	std::memset (&param, 0, sizeof (param));
+	param.sched_priority = priority;
+	int error = ::pthread_setschedparam (thread, SCHED_FIFO, &param);
+	report.add (setting, error == 0, error == 0 ? QString() : QString (::strerror (error)));
+}
+
+
+void
+pin_to_cpu (pthread_t thread, QString const& thread_name, int cpu, RealTimeReport& report)
+{
+	QString setting = QString ("%1: CPU %2").arg (thread_name).arg (cpu);
+
+	if (cpu < 0 || cpu >= online_cpus())
+	{
+		report.add (setting, false, QString ("only %1 CPUs online").arg (online_cpus()));
+		return;
+	}
+
+	cpu_set_t set;
+	CPU_ZERO (&set);
+	CPU_SET (cpu, &set);
+	int error = ::pthread_setaffinity_np (thread, sizeof (set), &set);
+	report.add (setting, error == 0, error == 0 ? QString() : QString (::strerror (error)));
+}
+
+
+void
+exclude_cpu (pthread_t thread, QString const& thread_name, int cpu, RealTimeReport& report)
+{
+	QString setting = QString ("%1: all CPUs except %2").arg (thread_name).arg (cpu);
+	int cpus = online_cpus();
+
+	if (cpus < 2)
+	{
+		report.add (setting, false, "only one CPU online");
+		return;
+	}
+
+	cpu_set_t set;
+	CPU_ZERO (&set);
+	for (int i = 0; i < cpus; ++i)
+		if (i != cpu)
+			CPU_SET (i, &set);
+
+	int error = ::pthread_setaffinity_np (thread, sizeof (set), &set);
+	report.add (setting, error == 0, error == 0 ? QString() : QString (::strerror (error)));
+}
+
+} // namespace scpidev
+
@@ -0,0 +1,104 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__REALTIME_H__INCLUDED
+#define SCPIDEV__REALTIME_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <vector>
+
+// Linux:
+#include <pthread.h>
+
+// Qt:
+#include <QString>
+
+
+namespace scpidev {
+
+/**
+ * Outcome of each real-time setting, printed at startup.
+ */
+class RealTimeReport
+{
+  public:
+	class Entry
+	{
+	  public:
+		QString	setting;
+		bool	ok;
+		QString	detail;
+	};
+
+  public:
+	void
+	add (QString const& setting, bool ok, QString const& detail = QString());
+
+	/**
+	 * Return true if all settings succeeded.
+	 */
+	bool
+	all_ok() const;
+
+	QString
+	render() const;
+
+  private:
+	std::vector<Entry>	_entries;
+};
+
+
+/**
+ * Number of online CPUs.
+ */
+int
+online_cpus();
+
+/**
+ * Lock current and future memory with mlockall() and stop malloc from returning memory
+ * to the kernel, so that the measure loop doesn't take page faults.
+ */
+void
+lock_memory (RealTimeReport&);
+
+/**
+ * Touch a stack area of kPrefaultStackSize bytes, so that its pages are faulted in (and locked,
+ * after lock_memory()) before time-critical work starts. Must be called from the thread
+ * whose stack is to be prefaulted.
+ */
+void
+prefault_stack();
+
+/**
+ * Switch thread to SCHED_FIFO with given priority.
+ */
+void
+set_fifo_scheduling (pthread_t, QString const& thread_name, int priority, RealTimeReport&);
+
+/**
+ * Pin thread to a single CPU.
+ */
+void
+pin_to_cpu (pthread_t, QString const& thread_name, int cpu, RealTimeReport&);
+
+/**
+ * Allow thread to run on any CPU except the given one.
+ */
+void
+exclude_cpu (pthread_t, QString const& thread_name, int cpu, RealTimeReport&);
+
+} // namespace scpidev
+
+#endif
+
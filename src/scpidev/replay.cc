@@ -0,0 +1,320 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+// Qt:
+#include <QFileInfo>
+
+// Boost:
+#include <boost/format.hpp>
+
+// Local:
+#include "replay.h"
+
+
+namespace scpidev {
+
+constexpr char SampleRecorder::kMagic[8];
+constexpr uint32_t SampleRecorder::kVersion;
+
+// Samples processed per stage at a time when replaying at full speed. Timing each stage once per
+// batch keeps clock reads from dominating the cheap stages:
+constexpr std::size_t kReplayBatchSize = 1024;
+
+
+SampleRecorder::SampleRecorder (QString const& path):
+	_file (path)
+{
+	if (!_file.open (QIODevice::WriteOnly | QIODevice::Truncate))
+		throw Error ("couldn't open " + path.toStdString() + ": " + _file.errorString().toStdString());
+}
+
+
+void
+SampleRecorder::begin (double start_timestamp, double initial_voltage, double initial_current, double burden_resistance)
+{
+	Header header;
+	std::memcpy (header.magic, kMagic, sizeof (kMagic));
+	header.version = kVersion;
+	header.record_size = sizeof (Record);
+	header.start_timestamp = start_timestamp;
+	header.initial_voltage = initial_voltage;
+	header.initial_current = initial_current;
+	header.burden_resistance = burden_resistance;
+
+	_file.write (reinterpret_cast<char const*> (&header), sizeof (header));
+	_file.flush();
+}
+
+
+void
+SampleRecorder::append (Sample const& sample)
+{
+	Record record;
+	record.number = sample.number;
+	record.timing_errors = sample.timing_errors;
+	record.flags = sample.trace.flags;
+	record.aperture = sample.aperture;
+	record.initiate_timestamp = sample.initiate_timestamp;
+	record.auto_zero_timestamp = sample.auto_zero_timestamp;
+	record.dt = sample.dt;
+	record.max_dt = sample.max_dt;
+	record.voltage = sample.voltage;
+	record.voltmeter_temperature = sample.voltmeter_temperature;
+	record.current = sample.current;
+	record.ammeter_temperature = sample.ammeter_temperature;
+
+	_file.write (reinterpret_cast<char const*> (&record), sizeof (record));
+}
+
+
+QString
+ReplayStatistics::report() const
+{
+	auto row = [&](char const* stage, Clock::Nanoseconds time) {
+		double seconds = Clock::seconds (time);
+		double rate = seconds > 0.0 ? samples / seconds : 0.0;
+		double ns_per_sample = samples > 0 ? static_cast<double> (time) / samples : 0.0;
+		return QString::fromStdString ((boost::format ("    %-10s %14.0f %14.1f %12.3f\n") % stage % rate % ns_per_sample % seconds).str());
+	};
+
+	QString result;
+	result += QString::fromStdString ((boost::format ("    %-10s %14s %14s %12s\n") % "stage" % "samples/s" % "ns/sample" % "total [s]").str());
+	result += row ("read", read_time);
+	result += row ("decode", decode_time);
+	result += row ("compute", compute_time);
+	result += row ("log", log_time);
+	result += row ("pipeline", total_time);
+	return result;
+}
+
+
+SampleRecorder::Header
+read_recording_header (QIODevice& device, QString const& name)
+{
+	typedef SampleRecorder::Error Error;
+
+	SampleRecorder::Header header;
+
+	if (device.read (reinterpret_cast<char*> (&header), sizeof (header)) != sizeof (header) ||
+		std::memcmp (header.magic, SampleRecorder::kMagic, sizeof (SampleRecorder::kMagic)) != 0)
+	{
+		throw Error (name.toStdString() + " is not a sample recording");
+	}
+
+	if (header.version != SampleRecorder::kVersion || header.record_size != sizeof (SampleRecorder::Record))
+		throw Error (name.toStdString() + " has unsupported version or record layout");
+
+	return header;
+}
+
+
+void
+decode_record (SampleRecorder::Record const& record, double start_timestamp, Sample& sample)
+{
+	if (record.aperture >= kAperturesCount)
+		throw SampleRecorder::Error ("record " + std::to_string (record.number) + " has invalid aperture index");
+
+	sample = Sample();
+	sample.number = record.number;
+	sample.timing_errors = record.timing_errors;
+	sample.trace.sample_number = record.number;
+	sample.trace.flags = record.flags;
+	sample.start_timestamp = start_timestamp;
+	sample.initiate_timestamp = record.initiate_timestamp;
+	sample.auto_zero_timestamp = record.auto_zero_timestamp;
+	sample.dt = record.dt;
+	sample.max_dt = record.max_dt;
+	sample.aperture = record.aperture;
+	sample.voltage = record.voltage;
+	sample.voltmeter_temperature = record.voltmeter_temperature;
+	sample.current = record.current;
+	sample.ammeter_temperature = record.ammeter_temperature;
+}
+
+
+ReplayInput
+read_recording (QString const& path)
+{
+	typedef SampleRecorder::Error Error;
+	typedef SampleRecorder::Record Record;
+
+	Clock::Nanoseconds start = Clock::monotonic();
+	QFile file (path);
+
+	if (!file.open (QIODevice::ReadOnly))
+		throw Error ("couldn't open " + path.toStdString() + ": " + file.errorString().toStdString());
+
+	auto const header = read_recording_header (file, path);
+
+	ReplayInput result;
+	result.source = path;
+	result.start_timestamp = header.start_timestamp;
+	result.initial_voltage = header.initial_voltage;
+	result.initial_current = header.initial_current;
+	result.burden_resistance = header.burden_resistance;
+	// A partially written last record (eg. after a crash) is ignored:
+	result.records.resize ((file.size() - sizeof (header)) / sizeof (Record));
+
+	auto bytes = static_cast<qint64> (result.records.size() * sizeof (Record));
+
+	if (file.read (reinterpret_cast<char*> (result.records.data()), bytes) != bytes)
+		throw Error ("couldn't read " + path.toStdString() + ": " + file.errorString().toStdString());
+
+	result.read_time = Clock::monotonic() - start;
+	return result;
+}
+
+
+ReplayInput
+read_csv (QString const& path)
+{
+	Clock::Nanoseconds start = Clock::monotonic();
+	QFileInfo info (path);
+	std::vector<QString> files;
+
+	if (info.isDir())
+	{
+		for (auto const& file: FileDB (QDir (path)).files())
+			files.push_back (file.second);
+	}
+	else
+		files.push_back (path);
+
+	ReplayInput result;
+	result.source = path;
+
+	uint64_t timing_errors = 0;
+	double max_dt = 0.0;
+
+	for (auto const& file_path: files)
+	{
+		QFile file (file_path);
+
+		if (!file.open (QIODevice::ReadOnly))
+			throw std::runtime_error ("couldn't open " + file_path.toStdString() + ": " + file.errorString().toStdString());
+
+		while (!file.atEnd())
+		{
+			QByteArray line = file.readLine().trimmed();
+
+			if (line.isEmpty() || line.startsWith ('#'))
+				continue;
+
+			QList<QByteArray> columns = line.split (',');
+
+			if (columns.size() < FileDB::kColumnsCount)
+				throw std::runtime_error ("malformed line in " + file_path.toStdString() + ": " + line.constData());
+
+			SampleRecorder::Record record;
+			record.number = result.records.size() + 1;
+			record.initiate_timestamp = columns[FileDB::kTimestamp].toDouble();
+			record.voltage = columns[FileDB::kVoltage].toDouble();
+			record.voltmeter_temperature = columns[FileDB::kVoltmeterTemperature].toDouble();
+			record.current = columns[FileDB::kCurrent].toDouble();
+			record.ammeter_temperature = columns[FileDB::kAmmeterTemperature].toDouble();
+
+			if (result.records.empty())
+			{
+				result.start_timestamp = record.initiate_timestamp;
+				result.initial_voltage = record.voltage - record.current * kTotalVoltmeterBurdenResitanceOhms;
+				result.initial_current = record.current;
+			}
+			else
+			{
+				record.dt = record.initiate_timestamp - result.records.back().initiate_timestamp;
+
+				if (record.dt > 2.0 * kApertures[kDefaultAperture].nplc / kACFrequencyHz)
+				{
+					++timing_errors;
+					record.flags |= StageTrace::kTimingError;
+				}
+			}
+
+			max_dt = std::max (max_dt, record.dt);
+			record.max_dt = max_dt;
+			record.timing_errors = timing_errors;
+			record.auto_zero_timestamp = result.start_timestamp;
+			result.records.push_back (record);
+		}
+	}
+
+	result.read_time = Clock::monotonic() - start;
+	return result;
+}
+
+
+ReplayStatistics
+replay (ReplayInput const& input, FileDB& file_db, bool real_time, std::atomic<bool> const& quit)
+{
+	ReplayStatistics statistics;
+	statistics.read_time = input.read_time;
+
+	if (input.records.empty())
+		return statistics;
+
+	SampleProcessor processor (input.initial_voltage, input.initial_current, input.burden_resistance);
+	// Pace by recorded timestamps, relative to the first one:
+	double const first_timestamp = input.records.front().initiate_timestamp;
+	std::size_t const batch_size = real_time ? 1 : kReplayBatchSize;
+	std::vector<Sample> batch (batch_size);
+	Clock::Nanoseconds const replay_start = Clock::monotonic();
+
+	for (std::size_t offset = 0; offset < input.records.size() && !quit.load(); offset += batch_size)
+	{
+		std::size_t const n = std::min (batch_size, input.records.size() - offset);
+
+		if (real_time)
+		{
+			auto target = replay_start + static_cast<Clock::Nanoseconds> (1e9 * (input.records[offset].initiate_timestamp - first_timestamp));
+			auto delay = target - Clock::monotonic();
+
+			if (delay > 0)
+				std::this_thread::sleep_for (std::chrono::nanoseconds (delay));
+		}
+
+		Clock::Nanoseconds t0 = Clock::monotonic();
+
+		for (std::size_t i = 0; i < n; ++i)
+			decode_record (input.records[offset + i], input.start_timestamp, batch[i]);
+
+		Clock::Nanoseconds t1 = Clock::monotonic();
+
+		processor.process (batch.data(), n);
+
+		Clock::Nanoseconds t2 = Clock::monotonic();
+
+		for (std::size_t i = 0; i < n; ++i)
+			log_sample (batch[i], file_db);
+
+		Clock::Nanoseconds t3 = Clock::monotonic();
+
+		statistics.samples += n;
+		statistics.decode_time += t1 - t0;
+		statistics.compute_time += t2 - t1;
+		statistics.log_time += t3 - t2;
+	}
+
+	statistics.total_time = statistics.decode_time + statistics.compute_time + statistics.log_time;
+	return statistics;
+}
+
+} // namespace scpidev
+
@@ -0,0 +1,198 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__REPLAY_H__INCLUDED
+#define SCPIDEV__REPLAY_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+// Qt:
+#include <QFile>
+#include <QString>
+
+// SCPIDev:
+#include <scpidev/aperture.h>
+#include <scpidev/clock.h>
+#include <scpidev/pipeline.h>
+#include <utility/file_db.h>
+
+
+namespace scpidev {
+
+/**
+ * Binary recording of the pipeline inputs: everything the measure thread reads from the meters
+ * and the clock, stored with full double precision. Replaying a recording reproduces the CSV
+ * output bit for bit.
+ *
+ * File layout: Header, followed by Records until the end of file. All fields are native-endian.
+ */
+class SampleRecorder
+{
+  public:
+	static constexpr char		kMagic[8]	= "SCPIREC";
+	static constexpr uint32_t	kVersion	= 4;
+
+	class Header
+	{
+	  public:
+		char		magic[8];
+		uint32_t	version;
+		uint32_t	record_size;
+		double		start_timestamp;
+		// Initial filter outputs:
+		double		initial_voltage;
+		double		initial_current;
+		double		burden_resistance;
+	};
+
+	class Record
+	{
+	  public:
+		uint64_t	number					= 0;
+		uint64_t	timing_errors			= 0;
+		// StageTrace::Flags:
+		uint32_t	flags					= 0;
+		// Index in kApertures:
+		uint32_t	aperture				= kDefaultAperture;
+		double		initiate_timestamp		= 0.0;
+		double		auto_zero_timestamp		= 0.0;
+		double		dt						= 0.0;
+		double		max_dt					= 0.0;
+		double		voltage					= 0.0;
+		double		voltmeter_temperature	= 0.0;
+		double		current					= 0.0;
+		double		ammeter_temperature		= 0.0;
+	};
+
+	class Error: public std::runtime_error
+	{
+	  public:
+		// Ctor:
+		Error (std::string const& message):
+			std::runtime_error ("sample recording: " + message)
+		{ }
+	};
+
+  public:
+	/**
+	 * Create (or truncate) recording file.
+	 * Throw Error on failure.
+	 */
+	explicit SampleRecorder (QString const& path);
+
+	/**
+	 * Write file header. Must be called once, before the first append().
+	 */
+	void
+	begin (double start_timestamp, double initial_voltage, double initial_current, double burden_resistance);
+
+	/**
+	 * Append inputs of a sample.
+	 */
+	void
+	append (Sample const&);
+
+  private:
+	QFile	_file;
+};
+
+
+/**
+ * Pipeline inputs loaded for replay.
+ */
+class ReplayInput
+{
+  public:
+	QString									source;
+	double									start_timestamp	= 0.0;
+	double									initial_voltage	= 0.0;
+	double									initial_current	= 0.0;
+	double									burden_resistance	= kTotalVoltmeterBurdenResitanceOhms;
+	std::vector<SampleRecorder::Record>		records;
+	// Time spent reading and parsing the source:
+	Clock::Nanoseconds						read_time		= 0;
+};
+
+
+/**
+ * Throughput of each replay stage.
+ */
+class ReplayStatistics
+{
+  public:
+	/**
+	 * Return human-readable table with samples/s of each stage.
+	 */
+	QString
+	report() const;
+
+  public:
+	uint64_t			samples			= 0;
+	Clock::Nanoseconds	read_time		= 0;
+	Clock::Nanoseconds	decode_time		= 0;
+	Clock::Nanoseconds	compute_time	= 0;
+	Clock::Nanoseconds	log_time		= 0;
+	Clock::Nanoseconds	total_time		= 0;
+};
+
+
+/**
+ * Read and validate recording header, leaving the device positioned at the first record.
+ * Throw SampleRecorder::Error on failure.
+ *
+ * \param	name
+ *			Used in error messages.
+ */
+SampleRecorder::Header
+read_recording_header (QIODevice&, QString const& name);
+
+/**
+ * Fill in sample inputs from a record. Derived fields are left for SampleProcessor.
+ * Throw SampleRecorder::Error if the record's aperture is not in kApertures.
+ */
+void
+decode_record (SampleRecorder::Record const&, double start_timestamp, Sample&);
+
+/**
+ * Load a recording made by SampleRecorder.
+ * Throw SampleRecorder::Error on failure.
+ */
+ReplayInput
+read_recording (QString const& path);
+
+/**
+ * Load raw measurements from a samples.*.csv file or from a directory of such files.
+ * The CSV doesn't store dt, auto-zero times or initial filter state, so dt is reconstructed from
+ * microsecond timestamps and derived columns only match the original within CSV precision.
+ * Throw std::runtime_error on failure.
+ */
+ReplayInput
+read_csv (QString const& path);
+
+/**
+ * Feed inputs through SampleProcessor and log_sample(). If real_time is set, samples are paced
+ * by their recorded timestamps, otherwise they're processed as fast as possible.
+ * Stops early when quit is set.
+ */
+ReplayStatistics
+replay (ReplayInput const&, FileDB&, bool real_time, std::atomic<bool> const& quit);
+
+} // namespace scpidev
+
+#endif
+
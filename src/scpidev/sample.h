@@ -0,0 +1,77 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__SAMPLE_H__INCLUDED
+#define SCPIDEV__SAMPLE_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+
+// SCPIDev:
+#include <scpidev/aperture.h>
+#include <utility/stage_trace.h>
+
+
+namespace scpidev {
+
+/**
+ * Single sample from all DMMs.
+ */
+class Sample
+{
+  public:
+	uint64_t	number						= 0;
+	// Index in Topology::channels:
+	std::size_t	channel						= 0;
+	uint64_t	timing_errors				= 0;
+	double		start_timestamp				= 0.0;
+	double		initiate_timestamp			= 0.0;
+	double		auto_zero_timestamp			= 0.0;
+	double		dt							= 0.0;
+	double		max_dt						= 0.0;
+	// Index in kApertures of the aperture readings were taken with:
+	std::size_t	aperture					= kDefaultAperture;
+	std::size_t	filter_taps					= 0;
+	// Trigger event whose burst the sample belongs to, 0 outside of bursts:
+	uint64_t	event						= 0;
+
+	// Measurements:
+	double		power						= 0.0;
+	double		energy						= 0.0;
+	double		voltage_error				= 0.0;
+	double		voltage_corrected			= 0.0;
+	double		power_corrected				= 0.0;
+	double		energy_corrected			= 0.0;
+	double		voltage_corrected_filtered	= 0.0;
+	double		current_filtered			= 0.0;
+	double		power_corrected_filtered	= 0.0;
+	double		energy_corrected_filtered	= 0.0;
+
+	// Voltmeter:
+	double		voltage					 	= 0.0;
+	double		voltmeter_temperature		= 0.0;
+
+	// Ammeter:
+	double		current						= 0.0;
+	double		ammeter_temperature			= 0.0;
+
+	// Stage timestamps:
+	StageTrace::Record
+				trace;
+};
+
+} // namespace scpidev
+
+#endif
+
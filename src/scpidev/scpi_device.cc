@@ -13,6 +13,18 @@
 
 // Standard:
 #include <cstddef>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+// Linux:
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 // Local:
 #include "scpi_device.h"
@@ -20,49 +32,106 @@
 
 namespace scpidev {
 
-SCPIDevice::SCPIDevice (QString const& name, QHostAddress const& ip_address, uint16_t tcp_port, QString const& log_filename):
+// Give up on a device that doesn't respond for this long:
+constexpr int kTimeoutMs = 30000;
+constexpr std::size_t kReceiveChunkSize = 4096;
+// Longer replies (eg. *IDN?) still work, they just make the buffer grow once:
+constexpr std::size_t kReplyCapacity = 256;
+
+
+SCPIDevice::SCPIDevice (QString const& name, QHostAddress const& ip_address, uint16_t tcp_port, DeviceTrace::Source* trace):
 	_name (name),
-	_log_file (log_filename)
+	_trace (trace)
 {
-	_log_file.open (QIODevice::ReadWrite);
-	_log_stream.setDevice (&_log_file);
-	_log_stream << "Opening device '" << _name << "'" << "\n";
+	_output.reserve (kReceiveChunkSize);
+	_input.reserve (kReceiveChunkSize);
+	_reply.reserve (kReplyCapacity);
+
+	sockaddr_storage address;
+	socklen_t address_size;
+	std::memset (&address, 0, sizeof (address));
+
+	if (ip_address.protocol() == QAbstractSocket::IPv6Protocol)
+	{
+		auto* a6 = reinterpret_cast<sockaddr_in6*> (&address);
+		a6->sin6_family = AF_INET6;
+		a6->sin6_port = htons (tcp_port);
+		Q_IPV6ADDR ip6 = ip_address.toIPv6Address();
+		std::memcpy (&a6->sin6_addr, &ip6, sizeof (a6->sin6_addr));
+		address_size = sizeof (sockaddr_in6);
+	}
+	else
+	{
+		auto* a4 = reinterpret_cast<sockaddr_in*> (&address);
+		a4->sin_family = AF_INET;
+		a4->sin_port = htons (tcp_port);
+		a4->sin_addr.s_addr = htonl (ip_address.toIPv4Address());
+		address_size = sizeof (sockaddr_in);
+	}
 
-	_socket.connectToHost (ip_address, tcp_port, QIODevice::ReadWrite);
-	_socket.waitForConnected();
-	_socket.setSocketOption (QAbstractSocket::LowDelayOption, 1);
+	_fd = ::socket (address.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
 
-	_stream.setDevice (&_socket);
+	if (_fd == -1)
+		throw Error (_name, std::string ("socket(): ") + ::strerror (errno));
+
+	if (::connect (_fd, reinterpret_cast<sockaddr*> (&address), address_size) != 0)
+	{
+		int error = errno;
+		::close (_fd);
+		throw Error (_name, "couldn't connect to " + ip_address.toString().toStdString() + ":" + std::to_string (tcp_port) + ": " + ::strerror (error));
+	}
+
+	int one = 1;
+	::setsockopt (_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+	::fcntl (_fd, F_SETFL, ::fcntl (_fd, F_GETFL) | O_NONBLOCK);
 }
 
 
 SCPIDevice::~SCPIDevice()
 {
 	// Force-push all pending data:
-	_socket.flush();
+	try {
+		flush();
+	}
+	catch (Error const&)
+	{ }
+
+	::close (_fd);
 }
 
 
 void
 SCPIDevice::send (QString const& command)
 {
-	_log_stream << _name << " << " << command << "\n";
-	_stream << command << "\n";
-	_stream.flush();
+	int const start = _output.size();
+	_output += command.toUtf8();
+
+	if (_trace)
+		_trace->sent (_output.constData() + start, _output.size() - start);
+
+	_output += '\n';
+	write_some();
 }
 
 
-QString
-SCPIDevice::ask()
+void
+SCPIDevice::send (Command const& command)
 {
-	while (!_socket.canReadLine())
-		_socket.waitForReadyRead();
+	_output.append (command.data(), command.size());
 
-	auto result = _stream.readLine().trimmed();
-	_log_stream << _name << " >> " << result << "\n";
-	_log_stream.flush();
+	if (_trace)
+		_trace->sent (command.data(), command.size());
 
-	return result;
+	_output += '\n';
+	write_some();
+}
+
+
+QString
+SCPIDevice::ask()
+{
+	wait_for_line();
+	return take_line();
 }
 
 
@@ -77,7 +146,144 @@ SCPIDevice::ask (QString const& command)
 void
 SCPIDevice::flush()
 {
-	_socket.flush();
+	write_some();
+
+	while (!_output.isEmpty())
+	{
+		wait_for (POLLOUT);
+		write_some();
+	}
+}
+
+
+bool
+SCPIDevice::receive()
+{
+	char buffer[kReceiveChunkSize];
+
+	while (true)
+	{
+		auto n = ::recv (_fd, buffer, sizeof (buffer), 0);
+
+		if (n > 0)
+			_input.append (buffer, n);
+		else if (n == 0)
+			throw Error (_name, "connection closed by device");
+		else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			break;
+		else if (errno != EINTR)
+			throw Error (_name, std::string ("recv(): ") + ::strerror (errno));
+	}
+
+	return has_line();
+}
+
+
+QString
+SCPIDevice::take_line()
+{
+	take_reply();
+	return QString::fromUtf8 (_reply.data(), _reply.size());
+}
+
+
+void
+SCPIDevice::take_reply()
+{
+	int const end = _input.indexOf ('\n');
+
+	if (_trace)
+		_trace->received (_input.constData(), end);
+
+	char const* begin = _input.constData();
+	char const* stop = begin + end;
+
+	while (begin < stop && std::isspace (static_cast<unsigned char> (*begin)))
+		++begin;
+
+	while (stop > begin && std::isspace (static_cast<unsigned char> (stop[-1])))
+		--stop;
+
+	// assign() reuses capacity, remove() moves remaining data in place:
+	_reply.assign (begin, stop);
+	_input.remove (0, end + 1);
+}
+
+
+std::size_t
+SCPIDevice::reply_numbers (double* values, std::size_t max_values) const noexcept
+{
+	char const* position = _reply.c_str();
+	std::size_t count = 0;
+
+	while (count < max_values)
+	{
+		char* end;
+		// strtod() depends on LC_NUMERIC, which scpidev never changes from "C":
+		values[count] = std::strtod (position, &end);
+
+		if (end == position)
+			break;
+
+		++count;
+		position = end;
+
+		if (*position != ';')
+			break;
+
+		++position;
+	}
+
+	return count;
+}
+
+
+void
+SCPIDevice::write_some()
+{
+	while (!_output.isEmpty())
+	{
+		auto n = ::send (_fd, _output.constData(), _output.size(), MSG_NOSIGNAL);
+
+		if (n > 0)
+			_output.remove (0, n);
+		else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			break;
+		else if (errno != EINTR)
+			throw Error (_name, std::string ("send(): ") + ::strerror (errno));
+	}
+}
+
+
+void
+SCPIDevice::wait_for_line()
+{
+	flush();
+
+	while (!has_line() && !receive())
+		wait_for (POLLIN);
+}
+
+
+void
+SCPIDevice::wait_for (short events)
+{
+	pollfd pfd;
+	pfd.fd = _fd;
+	pfd.events = events;
+	pfd.revents = 0;
+
+	while (true)
+	{
+		int result = ::poll (&pfd, 1, kTimeoutMs);
+
+		if (result > 0)
+			return;
+		else if (result == 0)
+			throw Error (_name, "timeout");
+		else if (errno != EINTR)
+			throw Error (_name, std::string ("poll(): ") + ::strerror (errno));
+	}
 }
 
 } // namespace scpidev
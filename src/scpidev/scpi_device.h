@@ -16,39 +16,103 @@
 
 // Standard:
 #include <cstddef>
+#include <stdexcept>
+#include <string>
 
 // Qt:
+#include <QByteArray>
 #include <QHostAddress>
-#include <QFile>
-#include <QTcpSocket>
-#include <QTextStream>
+
+// SCPIDev:
+#include <utility/device_trace.h>
 
 
 namespace scpidev {
 
+/**
+ * SCPI device connected over TCP (raw socket, port 5025).
+ *
+ * The socket is non-blocking, so that many devices can be served by a single thread (see
+ * DeviceMultiplexer). Blocking calls (ask(), flush()) wait with poll().
+ */
 class SCPIDevice
 {
+  public:
+	class Error: public std::runtime_error
+	{
+	  public:
+		// Ctor:
+		Error (QString const& device_name, std::string const& message):
+			std::runtime_error ("SCPI device '" + device_name.toStdString() + "': " + message)
+		{ }
+	};
+
+	/**
+	 * ASCII command known at compile time. Sending it is a plain byte copy, without building
+	 * a QString and encoding it.
+	 */
+	class Command
+	{
+	  public:
+		// Ctor
+		template<std::size_t pSize>
+			explicit constexpr
+			Command (char const (&text)[pSize]) noexcept;
+
+		/**
+		 * Command built at run time. Data must outlive the Command.
+		 */
+		constexpr
+		Command (char const* data, std::size_t size) noexcept;
+
+		constexpr char const*
+		data() const noexcept;
+
+		constexpr std::size_t
+		size() const noexcept;
+
+	  private:
+		char const*	_data;
+		std::size_t	_size;
+	};
+
   public:
 	/**
+	 * Connect to the device.
+	 * Throw Error on failure.
+	 *
 	 * \param	name
-	 *			Device identifier to use in logs.
-	 * \param	log
-	 *			Log stream to use.
+	 *			Device identifier to use in error messages.
+	 * \param	trace
+	 *			Where to log all exchanged messages; may be nullptr.
 	 */
-	SCPIDevice (QString const& name, QHostAddress const& ip_address, uint16_t tcp_port, QString const& log_filename);
+	SCPIDevice (QString const& name, QHostAddress const& ip_address, uint16_t tcp_port, DeviceTrace::Source* trace);
 
 	// Dtor
 	~SCPIDevice();
 
 	/**
-	 * Send command or semicolon-separated SCPI commands.
-	 * Automatically appends newline at the end.
+	 * Device name.
+	 */
+	QString const&
+	name() const noexcept;
+
+	/**
+	 * Queue command or semicolon-separated SCPI commands for sending. Automatically appends newline
+	 * at the end. Data is written to the socket as far as it doesn't block; use flush() to make sure
+	 * everything has been sent.
 	 */
 	void
 	send (QString const& command);
 
 	/**
-	 * Return single line result from the SCPI device.
+	 * Same as send(QString), but without any allocations.
+	 */
+	void
+	send (Command const& command);
+
+	/**
+	 * Return single line result from the SCPI device. Blocks until it's received.
 	 */
 	QString
 	ask();
@@ -60,21 +124,146 @@ class SCPIDevice
 	ask (QString const& command);
 
 	/**
-	 * Force-flush output TCP buffer.
+	 * Block until all queued data is written to the socket.
 	 */
 	void
 	flush();
 
+	/**
+	 * Socket descriptor, for use with poll/epoll.
+	 */
+	int
+	fd() const noexcept;
+
+	/**
+	 * Read whatever is available on the socket without blocking.
+	 * Throw Error if connection is closed.
+	 *
+	 * \return	true if a complete line is buffered.
+	 */
+	bool
+	receive();
+
+	/**
+	 * Return true if a complete line is buffered.
+	 */
+	bool
+	has_line() const noexcept;
+
+	/**
+	 * Remove and return the first buffered line. Must only be called if has_line().
+	 */
+	QString
+	take_line();
+
+	/**
+	 * Move the first buffered line to the reply buffer (see reply()), reusing its storage.
+	 * Must only be called if has_line().
+	 */
+	void
+	take_reply();
+
+	/**
+	 * Return the last line taken by take_reply(), trimmed and nul-terminated.
+	 * Valid until the next take_reply().
+	 */
+	char const*
+	reply() const noexcept;
+
+	/**
+	 * Parse the last reply as semicolon-separated numbers, eg. response to "FETCH?;:SYSTEM:TEMPERATURE?".
+	 *
+	 * \return	number of values parsed, at most max_values.
+	 */
+	std::size_t
+	reply_numbers (double* values, std::size_t max_values) const noexcept;
+
+  private:
+	/**
+	 * Write as much of output buffer as possible without blocking.
+	 */
+	void
+	write_some();
+
+	/**
+	 * Wait for the socket to become readable or writable.
+	 */
+	void
+	wait_for (short events);
+
+	/**
+	 * Flush output and block until a complete line is buffered.
+	 */
+	void
+	wait_for_line();
+
   private:
 	QString			_name;
-	QTcpSocket		_socket;
-	// Depends on _socket:
-	QTextStream		_stream;
-	QFile			_log_file;
-	// Depends on _log_file:
-	QTextStream		_log_stream;
+	int				_fd				= -1;
+	QByteArray		_output;
+	QByteArray		_input;
+	std::string		_reply;
+	DeviceTrace::Source*
+					_trace;
 };
 
+
+inline QString const&
+SCPIDevice::name() const noexcept
+{
+	return _name;
+}
+
+
+inline int
+SCPIDevice::fd() const noexcept
+{
+	return _fd;
+}
+
+
+inline bool
+SCPIDevice::has_line() const noexcept
+{
+	return _input.contains ('\n');
+}
+
+
+template<std::size_t pSize>
+	constexpr
+	SCPIDevice::Command::Command (char const (&text)[pSize]) noexcept:
+		_data (text),
+		_size (pSize - 1)
+	{ }
+
+
+constexpr
+SCPIDevice::Command::Command (char const* data, std::size_t size) noexcept:
+	_data (data),
+	_size (size)
+{ }
+
+
+constexpr char const*
+SCPIDevice::Command::data() const noexcept
+{
+	return _data;
+}
+
+
+constexpr std::size_t
+SCPIDevice::Command::size() const noexcept
+{
+	return _size;
+}
+
+
+inline char const*
+SCPIDevice::reply() const noexcept
+{
+	return _reply.c_str();
+}
+
 } // namespace scpidev
 
 #endif
@@ -15,7 +15,9 @@
 #include <cstddef>
 #include <iostream>
 #include <memory>
+#include <algorithm>
 #include <atomic>
+#include <cmath>
 #include <queue>
 #include <mutex>
 #include <thread>
@@ -30,332 +32,485 @@
 #include <QTextStream>
 #include <QSemaphore>
 #include <QDir>
+#include <QCommandLineParser>
+#include <QFileInfo>
 
 // Boost:
 #include <boost/optional.hpp>
 
 // SCPIDev:
-#include <scpidev/filter.h>
+#include <scpidev/configuration.h>
+#include <scpidev/dashboard.h>
+#include <scpidev/device_multiplexer.h>
+#include <scpidev/event_recorder.h>
+#include <scpidev/housekeeping.h>
+#include <scpidev/pipeline.h>
+#include <scpidev/plot_feed.h>
+#include <scpidev/realtime.h>
+#include <scpidev/replay.h>
 #include <scpidev/scpi_device.h>
+#include <scpidev/spectrum.h>
+#include <scpidev/topology.h>
+#include <scpidev/trigger.h>
 #include <scpidev/utils.h>
+#include <utility/device_trace.h>
 #include <utility/file_db.h>
+#include <utility/stage_trace.h>
 
 
 using namespace scpidev;
 
 constexpr char kVoltmeterIP[] = "11.0.0.100";
 constexpr char kAmmeterIP[] = "11.0.0.101";
-constexpr char kOutputDir[] = "scpidev.log";
+constexpr uint16_t kSCPIPort = 5025;
+
+constexpr char kReplayOutputDir[] = "scpidev.replay";
+constexpr char kDeviceTraceFile[] = "scpidev.devices";
 
-constexpr float kNPLC = 1;
 constexpr double kAutoZeroPeriodSeconds = 10;
-constexpr double kACFrequencyHz = 50.0;
-constexpr double kTotalVoltmeterBurdenResitanceOhms = 0.025666;
+// Warm-up ends when kWarmupWindow consecutive iterations differ by at most kWarmupTolerance,
+// or after one second of samples:
+constexpr std::size_t kWarmupWindow = 5;
+constexpr double kWarmupTolerance = 0.1;
+constexpr double kDefaultDashboardRateHz = 10.0;
+// Redrawing faster only burns CPU:
+constexpr double kMaxDashboardRateHz = 100.0;
+constexpr int kDefaultRealTimePriority = 80;
+// About 1.5 h at 50 samples/s:
+constexpr uint64_t kDefaultTraceCapacity = 1 << 18;
+// Same as tools/visualize-power-last.gp used to get from 'tail -n 1000 log | make_stats 8 20':
+constexpr std::size_t kDefaultPlotWindow = 1000;
+constexpr std::size_t kDefaultPlotBucket = 20;
+constexpr double kPlotRefreshPeriodSeconds = 1.0;
+// 256 samples is about 5 s at 50 samples/s, which gives 0.2 Hz resolution:
+constexpr std::size_t kDefaultSpectrumSegment = 256;
+constexpr double kDefaultSpectrumIntervalSeconds = 60.0;
+// 0.2 PLC is 4 ms per reading; a burst of 500 readings takes a couple of seconds, limited by round trips:
+constexpr double kDefaultTriggerNPLC = 0.2;
+constexpr uint64_t kDefaultTriggerBurst = 500;
+// 5 s at 50 samples/s:
+constexpr std::size_t kDefaultTriggerPreSamples = 250;
+constexpr uint64_t kDefaultTriggerHoldoff = 250;
+// Upper band ends at the Nyquist frequency of samples at the default aperture:
+SpectrumAnalyzer::Band const kSpectrumBands[] = {
+	{ 0.0, 0.1 },
+	{ 0.1, 1.0 },
+	{ 1.0, 5.0 },
+	{ 5.0, kACFrequencyHz / kApertures[kDefaultAperture].nplc / 2.0 },
+};
+
+// Commands sent by the measure loop:
+constexpr SCPIDevice::Command kInitiate ("INITIATE");
+constexpr SCPIDevice::Command kFetch ("FETCH?");
+constexpr SCPIDevice::Command kFetchWithTemperature ("FETCH?;:SYSTEM:TEMPERATURE?");
+constexpr SCPIDevice::Command kTemperature ("SYSTEM:TEMPERATURE?");
+constexpr SCPIDevice::Command kVoltageAutoZero ("SENSE:VOLTAGE:DC:ZERO:AUTO ONCE");
+constexpr SCPIDevice::Command kCurrentAutoZero ("SENSE:CURRENT:DC:ZERO:AUTO ONCE");
 
 std::atomic<bool> g_quit_signal { false };
+// Set when measurements stopped on a device error:
+std::atomic<bool> g_measure_failed { false };
+// Aperture change requested with SIGUSR1 (shorter) and SIGUSR2 (longer), in kApertures steps:
+std::atomic<int> g_aperture_step { 0 };
 
 
 /**
- * Single sample from all DMMs.
+ * Return true if the last few warm-up iterations took about the same time.
  */
-class Sample
+bool
+warmup_settled (std::vector<double> const& iteration_times)
 {
-  public:
-	uint64_t	number						= 0;
-	uint64_t	timing_errors				= 0;
-	QString		timing_errors_s;
-	double		start_timestamp				= 0.0;
-	double		initiate_timestamp			= 0.0;
-	double		auto_zero_timestamp			= 0.0;
-	double		dt							= 0.0;
-	double		max_dt						= 0.0;
-	std::size_t	filter_taps					= 0;
-
-	// Measurements:
-	double		power						= 0.0;
-	double		energy						= 0.0;
-	double		voltage_error				= 0.0;
-	double		voltage_corrected			= 0.0;
-	double		power_corrected				= 0.0;
-	double		energy_corrected			= 0.0;
-	double		voltage_corrected_filtered	= 0.0;
-	double		current_filtered			= 0.0;
-	double		power_corrected_filtered	= 0.0;
-	double		energy_corrected_filtered	= 0.0;
-
-	// Voltmeter:
-	double		voltage					 	= 0.0;
-	double		voltmeter_temperature		= 0.0;
-
-	// Ammeter:
-	double		current						= 0.0;
-	double		ammeter_temperature			= 0.0;
-};
+	if (iteration_times.size() < kWarmupWindow)
+		return false;
+
+	auto window = std::minmax_element (iteration_times.end() - kWarmupWindow, iteration_times.end());
+	return *window.second - *window.first <= kWarmupTolerance * *window.first;
+}
 
 
 void
-configure_voltmeter (SCPIDevice& voltmeter)
+catch_sigint (int)
 {
-	constexpr const char kVoltmeterSystemIdentifier[] = "AT34461A";
-	constexpr const char kVoltmeterHostname[] = "A-34461A-09358";
-	constexpr const char kVoltmeterLabel[] = "Voltage";
-	constexpr const char kVoltmeterRange[] = "100";
-
-	voltmeter.send ("ABORT");
-	voltmeter.ask ("*IDN?");
-
-	verify (voltmeter, "SYSTEM:IDENTIFY?", kVoltmeterSystemIdentifier);
-	verify (voltmeter, "UNIT:TEMP?", "C");
-	verify (voltmeter, "SYSTEM:COMMUNICATE:LAN:HOSTNAME?", "\"" + QString (kVoltmeterHostname) + "\"");
-
-	voltmeter.ask ("CALIBRATION:DATE?; TIME?");
-	voltmeter.ask ("CALIBRATION:TEMPERATURE?");
-
-	voltmeter.send ("SYSTEM:LABEL \"" + QString (kVoltmeterLabel) + "\"");
-	// Fixed range:
-	voltmeter.send ("CONFIGURE:VOLTAGE:DC " + QString (kVoltmeterRange));
-	// Zeroing will be done manually every couple of samples by the script.
-	voltmeter.send ("SENSE:VOLTAGE:DC:ZERO:AUTO OFF");
-	// Aperture:
-	voltmeter.send ("SENSE:VOLTAGE:DC:NPLC " + QString::number (kNPLC));
-	// Impedance: 10 MΩ
-	voltmeter.send ("SENSE:VOLTAGE:DC:IMPEDANCE:AUTO OFF");
-	// Trigger: 1, auto-delay, internal trigger
-	voltmeter.send ("TRIGGER:COUNT 1");
-	voltmeter.send ("TRIGGER:DELAY:AUTO ON");
-	voltmeter.send ("TRIGGER:SOURCE IMMEDIATE");
-	// Samples at a time:
-	voltmeter.send ("SAMPLE:COUNT 1");
-
-	voltmeter.flush();
+	g_quit_signal.store (true);
 }
 
 
 void
-configure_ammeter (SCPIDevice& ammeter)
+catch_sigusr1 (int)
 {
-	constexpr const char kAmmeterSystemIdentifier[] = "AT34461A";
-	constexpr const char kAmmeterHostname[] = "K-34461A-18230";
-	constexpr const char kAmmeterLabel[] = "Current";
-	constexpr const char kAmmeterRange[] = "10";
-
-	ammeter.send ("ABORT");
-	ammeter.ask ("*IDN?");
-
-	verify (ammeter, "SYSTEM:IDENTIFY?", kAmmeterSystemIdentifier);
-	verify (ammeter, "UNIT:TEMP?", "C");
-	verify (ammeter, "SYSTEM:COMMUNICATE:LAN:HOSTNAME?", "\"" + QString (kAmmeterHostname) + "\"");
-
-	ammeter.ask ("CALIBRATION:DATE?; TIME?");
-	ammeter.ask ("CALIBRATION:TEMPERATURE?");
-
-	ammeter.send ("SYSTEM:LABEL \"" + QString (kAmmeterLabel) + "\"");
-
-	// Fixed range:
-	ammeter.send ("CONFIGURE:CURRENT:DC " + QString (kAmmeterRange));
-	// Zeroing will be done manually every couple of samples by the script.
-	ammeter.send ("SENSE:CURRENT:DC:ZERO:AUTO OFF");
-	// Aperture:
-	ammeter.send ("SENSE:CURRENT:DC:NPLC " + QString::number (kNPLC));
-	// Trigger: 1, auto-delay, internal trigger
-	ammeter.send ("TRIGGER:COUNT 1");
-	ammeter.send ("TRIGGER:DELAY:AUTO ON");
-	ammeter.send ("TRIGGER:SOURCE IMMEDIATE");
-	// Samples at a time:
-	ammeter.send ("SAMPLE:COUNT 1");
-
-	ammeter.flush();
+	g_aperture_step.fetch_sub (1);
 }
 
 
 void
-catch_sigint (int)
+catch_sigusr2 (int)
 {
-	g_quit_signal.store (true);
+	g_aperture_step.fetch_add (1);
+}
+
+
+/**
+ * Return number of samples between auto-zeros of a meter, at given aperture.
+ */
+uint64_t
+auto_zero_period (std::size_t aperture)
+{
+	return kAutoZeroPeriodSeconds * kACFrequencyHz / kApertures[aperture].nplc;
+}
+
+
+/**
+ * Parse device's reply to kFetch or kFetchWithTemperature. Temperature is only updated
+ * if it was present in the response.
+ */
+double
+parse_fetch (SCPIDevice const& device, double& temperature)
+{
+	double values[2] = { 0.0, 0.0 };
+
+	if (device.reply_numbers (values, 2) == 2)
+		temperature = values[1];
+
+	return values[0];
 }
 
 
 /**
- * Thread for communication with DMMs.
+ * Communication with DMMs, run on the measure thread by measure_function(). All meters are
+ * queried concurrently through a single DeviceMultiplexer, so an iteration takes as long as
+ * the slowest meter, regardless of their number.
+ *
+ * Aperture starts at initial_aperture and steps through kApertures on g_aperture_step. A new
+ * aperture is sent to all meters right before the same INITIATE, so they switch together.
  */
 void
-measure_function (SCPIDevice& voltmeter, SCPIDevice& ammeter, std::queue<Sample>& samples_todo, std::mutex& samples_mutex, QSemaphore& samples_semaphore)
+measure_loop (Topology const& topology, std::vector<std::unique_ptr<SCPIDevice>>& devices,
+			  std::queue<Sample>& samples_todo, std::mutex& samples_mutex, QSemaphore& samples_semaphore,
+			  SampleRecorder* recorder, Trigger* trigger, std::size_t initial_aperture, bool real_time)
 {
-	if (setpriority(PRIO_PROCESS, 0, -20) == -1)
+	// In real-time mode scheduling is set up by main(), just make sure the loop won't fault on its stack:
+	if (real_time)
+		prefault_stack();
+	else if (setpriority(PRIO_PROCESS, 0, -20) == -1)
 		std::cout << "Could not set 'nice' to -20." << std::endl;
 
-	voltmeter.send ("DISPLAY:TEXT \"Configuring for test...\"");
-	voltmeter.flush();
-	ammeter.send ("DISPLAY:TEXT \"Configuring for test...\"");
-	ammeter.flush();
+	std::size_t const meters = devices.size();
+	std::vector<SCPIDevice*> device_pointers;
+	std::vector<Configuration> configurations;
+	std::vector<SCPIDevice::Command const*> auto_zero_commands;
+	// Command for meter m and aperture a is at m * kAperturesCount + a; commands point into the byte arrays.
+	// Each sets the aperture and reads it back, since meters round unsupported values:
+	std::vector<QByteArray> aperture_texts;
+	std::vector<SCPIDevice::Command> aperture_commands;
+	std::vector<SCPIDevice::Command const*> aperture_queries (meters);
+
+	for (std::size_t m = 0; m < meters; ++m)
+	{
+		device_pointers.push_back (devices[m].get());
+		configurations.push_back (Topology::configuration (topology.instruments[m]));
+		auto_zero_commands.push_back (topology.instruments[m].function == InstrumentSpec::kVoltage ? &kVoltageAutoZero : &kCurrentAutoZero);
+
+		for (auto const& aperture: kApertures)
+			aperture_texts.push_back ((topology.instruments[m].aperture_command (aperture.nplc) + ";:" +
+									   topology.instruments[m].sense_subsystem() + ":NPLC?").toLatin1());
+	}
+
+	for (auto const& text: aperture_texts)
+		aperture_commands.emplace_back (text.constData(), text.size());
+
+	std::vector<std::pair<SCPIDevice*, Configuration const*>> configure_list;
+
+	for (std::size_t m = 0; m < meters; ++m)
+		configure_list.emplace_back (device_pointers[m], &configurations[m]);
+
+	// Throws on a failed verification, which stops measurements with the device's reply:
+	configure (configure_list);
+
+	DeviceMultiplexer multiplexer (device_pointers);
+
+	// Configuration sets the default aperture:
+	std::size_t meters_aperture = kDefaultAperture;
+
+	auto set_aperture = [&] (std::size_t aperture) {
+		for (std::size_t m = 0; m < meters; ++m)
+			aperture_queries[m] = &aperture_commands[m * kAperturesCount + aperture];
+
+		multiplexer.ask_all (aperture_queries);
+
+		for (std::size_t m = 0; m < meters; ++m)
+		{
+			double nplc = 0.0;
+
+			if (devices[m]->reply_numbers (&nplc, 1) != 1 || std::abs (nplc - kApertures[aperture].nplc) > 1e-6 * kApertures[aperture].nplc)
+				throw SCPIDevice::Error (devices[m]->name(), "aperture set to " + QString::number (kApertures[aperture].nplc).toStdString() +
+										 " NPLC, meter reports '" + devices[m]->reply() + "'");
+		}
+
+		meters_aperture = aperture;
+	};
+
+	std::size_t normal_aperture = initial_aperture;
 
-	configure_voltmeter (voltmeter);
-	configure_ammeter (ammeter);
+	if (normal_aperture != meters_aperture)
+		set_aperture (normal_aperture);
 
 	std::cout << "TCP warmup..." << std::endl;
-	auto kTCPWarmupMessageCommand = "DISPLAY:TEXT \"     TCP warmup...     \"";
-	voltmeter.send (kTCPWarmupMessageCommand);
-	voltmeter.flush();
-	ammeter.send (kTCPWarmupMessageCommand);
-	ammeter.flush();
+	multiplexer.send_all ("DISPLAY:TEXT \"     TCP warmup...     \"");
 
-	double initial_voltage = 0.0;
-	double initial_current = 0.0;
+	// Everything used by the loop is allocated up front:
+	std::vector<SCPIDevice::Command const*> const fetch_commands (meters, &kFetch);
+	std::vector<SCPIDevice::Command const*> commands (meters);
+	std::vector<double> readings (meters, 0.0);
+	std::vector<double> temperatures (meters, 0.0);
 
-	// Initial burst of packets for TCP to adapt:
-	for (int i = 0; i < kACFrequencyHz / kNPLC; ++i)
+	// Initial burst of packets for TCP to adapt, until round trips settle:
+	std::vector<double> warmup_times;
+
+	std::size_t const max_warmup_iterations = std::max<std::size_t> (kWarmupWindow, kACFrequencyHz / kApertures[normal_aperture].nplc);
+
+	while (warmup_times.size() < max_warmup_iterations && !warmup_settled (warmup_times))
 	{
-		voltmeter.send ("INITIATE");
-		ammeter.send ("INITIATE");
+		Clock::Nanoseconds iteration_start = Clock::monotonic();
+
+		multiplexer.send_all (kInitiate);
+		multiplexer.ask_all (fetch_commands);
 
-		initial_voltage = voltmeter.ask ("FETCH?").toDouble();
-		initial_current = ammeter.ask ("FETCH?").toDouble();
+		warmup_times.push_back (Clock::seconds (Clock::monotonic() - iteration_start));
 	}
 
-	auto kTestMessageCommand = "DISPLAY:TEXT \"Test in progress (voltage)...\"";
-	voltmeter.send (kTestMessageCommand);
-	ammeter.send (kTestMessageCommand);
+	// Fastest iteration less the integration time is the round trip that no iteration can beat;
+	// the timing check allows for it on top of aperture slots:
+	double const round_trip_floor = std::max (0.0, *std::min_element (warmup_times.begin(), warmup_times.end()) -
+													kApertures[normal_aperture].nplc / kACFrequencyHz);
 
-	// Reset:
-	voltmeter.send ("ABORT");
-	ammeter.send ("ABORT");
-	// Start measuring:
-	voltmeter.send ("INITIATE");
-	ammeter.send ("INITIATE");
+	std::cout << "TCP warmup took " << warmup_times.size() << " iterations, round trip floor "
+			  << round_trip_floor * 1e3 << " ms." << std::endl;
 
-	double start_timestamp = now();
-	double auto_zero_timestamp = start_timestamp - kAutoZeroPeriodSeconds - 1.0;
+	for (std::size_t m = 0; m < meters; ++m)
+		readings[m] = parse_fetch (*devices[m], temperatures[m]);
 
-	double voltmeter_temperature = 0.0;
-	double ammeter_temperature = 0.0;
+	// Initial temperatures, later ones are read by the housekeeping scheduler:
+	multiplexer.ask_all (std::vector<SCPIDevice::Command const*> (meters, &kTemperature));
 
-	double energy = 0.0;
-	double energy_corrected = 0.0;
-	double energy_corrected_filtered = 0.0;
+	for (std::size_t m = 0; m < meters; ++m)
+		devices[m]->reply_numbers (&temperatures[m], 1);
 
-	double prev_initiate_timestamp = start_timestamp;
-	int timing_errors = 0;
-	QString timing_errors_s = "0";
+	multiplexer.send_all ("DISPLAY:TEXT \"Test in progress (voltage)...\"");
+	// Reset:
+	multiplexer.send_all ("ABORT");
+	// Start measuring:
+	multiplexer.send_all (kInitiate);
+
+	Clock const& clock = wall_clock();
+	Clock::Nanoseconds start_time = Clock::monotonic();
+	double start_timestamp = clock.unix_time (start_time);
+	double auto_zero_timestamp = start_timestamp;
+	HousekeepingScheduler housekeeping (auto_zero_period (normal_aperture), meters);
+	std::vector<HousekeepingScheduler::Tasks> tasks (meters);
+	// Whether a meter took a zero reading during the previous iteration:
+	bool zeroing_delay = false;
+	// Aperture of the reading initiated last:
+	std::size_t initiated_aperture = meters_aperture;
+
+	Clock::Nanoseconds prev_initiate_time = start_time;
+	uint64_t timing_errors = 0;
 	double max_dt = 0.0;
 	uint64_t samples_number = 0;
 
-	double initiate_timestamp;
-	double dt;
+	Clock::Nanoseconds initiate_time = start_time;
+	double initiate_timestamp = start_timestamp;
+	double dt = 0.0;
+
+	std::vector<SampleProcessor> processors;
+	std::vector<Sample> channel_samples (topology.channels.size());
+
+	for (auto const& channel: topology.channels)
+		processors.emplace_back (readings[channel.voltmeter], readings[channel.ammeter], channel.burden_resistance);
 
-	constexpr std::size_t filter_taps = 25 / kNPLC;
-	Filter<filter_taps> voltage_corrected_filter (initial_voltage);
-	Filter<filter_taps> current_filter (initial_current);
+	if (recorder)
+	{
+		auto const& channel = topology.channels[0];
+		recorder->begin (start_timestamp, readings[channel.voltmeter], readings[channel.ammeter], channel.burden_resistance);
+	}
 
 	while (!g_quit_signal.load())
 	{
-		Sample sample;
-		sample.number = ++samples_number;
-		sample.voltage = voltmeter.ask ("FETCH?").toDouble();
-		sample.current = ammeter.ask ("FETCH?").toDouble();
+		// Fields common to all channels:
+		Sample common;
+		common.trace.mark (StageTrace::kLoopStart);
+		common.number = ++samples_number;
+		common.trace.sample_number = common.number;
 
-		// Auto-zero and temperature read:
-		if (initiate_timestamp - auto_zero_timestamp >= kAutoZeroPeriodSeconds)
+		int const aperture_step = g_aperture_step.exchange (0);
+
+		if (aperture_step != 0)
 		{
-			voltmeter.send ("SENSE:VOLTAGE:DC:ZERO:AUTO ONCE");
-			ammeter.send ("SENSE:CURRENT:DC:ZERO:AUTO ONCE");
+			int const requested = static_cast<int> (normal_aperture) + aperture_step;
+			normal_aperture = std::min<int> (std::max (requested, 0), kAperturesCount - 1);
+			// Keep auto-zero period in seconds:
+			housekeeping = HousekeepingScheduler (auto_zero_period (normal_aperture), meters);
+		}
 
-			voltmeter_temperature = voltmeter.ask ("SYSTEM:TEMPERATURE?").toDouble();
-			ammeter_temperature = ammeter.ask ("SYSTEM:TEMPERATURE?").toDouble();
+		// Burst mode is about the sample rate, so it skips housekeeping:
+		bool const burst = trigger && trigger->burst();
+		std::size_t const aperture = burst ? trigger->burst_aperture() : normal_aperture;
+		// Reading fetched in this iteration was initiated in the previous one:
+		std::size_t const fetched_aperture = initiated_aperture;
 
-			prev_initiate_timestamp = now();
-			auto_zero_timestamp = prev_initiate_timestamp;
+		// Temperatures are read in the same round trip as the reading:
+		for (std::size_t m = 0; m < meters; ++m)
+		{
+			tasks[m] = burst ? HousekeepingScheduler::Tasks() : housekeeping.tasks (common.number, m);
+			commands[m] = tasks[m].temperature ? &kFetchWithTemperature : &kFetch;
 		}
-		else if (dt > 2.0 * kNPLC / kACFrequencyHz)
+
+		multiplexer.ask_all (commands);
+		common.trace.mark (StageTrace::kFetched);
+
+		for (std::size_t m = 0; m < meters; ++m)
+			readings[m] = parse_fetch (*devices[m], temperatures[m]);
+
+		// Zero reading is taken right away, before the next INITIATE, so it costs the meter
+		// one sample slot. The scheduler never zeroes two meters in the same iteration:
+		bool const previous_zeroing_delay = zeroing_delay;
+		zeroing_delay = false;
+
+		for (std::size_t m = 0; m < meters; ++m)
 		{
-			timing_errors += 1;
-			timing_errors_s = erroneous (QString::number (timing_errors));
+			if (tasks[m].auto_zero)
+			{
+				devices[m]->send (*auto_zero_commands[m]);
+				zeroing_delay = true;
+			}
 		}
 
-		sample.voltmeter_temperature = voltmeter_temperature;
-		sample.ammeter_temperature = ammeter_temperature;
-		sample.timing_errors = timing_errors;
-		sample.timing_errors_s = timing_errors_s;
+		if (zeroing_delay)
+		{
+			auto_zero_timestamp = clock.now();
+			common.trace.flags |= StageTrace::kAutoZero;
+		}
+
+		// Meters are idle after FETCH?, so aperture can be changed before the next INITIATE.
+		// Reading it back costs a round trip, but the iteration isn't timing-checked anyway:
+		bool const aperture_switched = aperture != meters_aperture;
+
+		if (aperture_switched)
+			set_aperture (aperture);
+
+		common.trace.mark (StageTrace::kHousekeepingDone);
 
 		// Initiate single measurement:
-		voltmeter.send ("INITIATE");
-		voltmeter.flush();
-		ammeter.send ("INITIATE");
-		ammeter.flush();
+		multiplexer.send_all (kInitiate);
+		initiated_aperture = aperture;
 
 		// Timestamp @ INITIATE command:
-		initiate_timestamp = now();
-		dt = initiate_timestamp - prev_initiate_timestamp;
+		initiate_time = Clock::monotonic();
+		common.trace.mark (StageTrace::kInitiated);
+		initiate_timestamp = clock.unix_time (initiate_time);
+		dt = Clock::seconds (initiate_time - prev_initiate_time);
 		max_dt = std::max (dt, max_dt);
 
-		// Calculations:
-		sample.power = sample.voltage * sample.current;
-		energy += sample.power * dt;
-		sample.energy = energy;
-		// Corrections:
-		sample.voltage_error = sample.current * kTotalVoltmeterBurdenResitanceOhms;
-		sample.voltage_corrected = sample.voltage - sample.voltage_error;
-		sample.power_corrected = sample.voltage_corrected * sample.current;
-		energy_corrected += sample.power_corrected * dt;
-		sample.energy_corrected = energy_corrected;
-		// Filtering:
-		sample.voltage_corrected_filtered = voltage_corrected_filter.process (sample.voltage_corrected);
-		sample.current_filtered = current_filter.process (sample.current);
-		sample.power_corrected_filtered = sample.voltage_corrected_filtered * sample.current_filtered;
-		energy_corrected_filtered += sample.power_corrected_filtered * dt;
-		sample.energy_corrected_filtered = energy_corrected_filtered;
-
-		sample.dt = dt;
-		sample.max_dt = max_dt;
-		sample.start_timestamp = start_timestamp;
-		sample.initiate_timestamp = initiate_timestamp;
-		sample.auto_zero_timestamp = auto_zero_timestamp;
-		sample.filter_taps = filter_taps;
+		// Zero reading in the previous iteration is allowed to delay this one by a single slot.
+		// The interval since the previous INITIATE was taken by the fetched reading; changing
+		// the aperture delays an iteration, so it's not checked. At short apertures the round trip
+		// dominates, so it's added to the limit:
+		if (!aperture_switched &&
+			dt > (previous_zeroing_delay ? 3.0 : 2.0) * kApertures[fetched_aperture].nplc / kACFrequencyHz + round_trip_floor)
+		{
+			timing_errors += 1;
+			common.trace.flags |= StageTrace::kTimingError;
+		}
+
+		common.timing_errors = timing_errors;
+
+		common.dt = dt;
+		common.max_dt = max_dt;
+		common.start_timestamp = start_timestamp;
+		common.initiate_timestamp = initiate_timestamp;
+		common.auto_zero_timestamp = auto_zero_timestamp;
+		common.aperture = fetched_aperture;
+
+		if (trigger)
+		{
+			common.event = trigger->event();
+
+			if (common.event != 0)
+				common.trace.flags |= StageTrace::kBurst;
+		}
+
+		for (std::size_t c = 0; c < topology.channels.size(); ++c)
+		{
+			auto const& channel = topology.channels[c];
+			Sample& sample = channel_samples[c];
+			sample = common;
+			sample.channel = c;
+			sample.voltage = readings[channel.voltmeter];
+			sample.voltmeter_temperature = temperatures[channel.voltmeter];
+			sample.current = readings[channel.ammeter];
+			sample.ammeter_temperature = temperatures[channel.ammeter];
+			processors[c].process (sample);
+			sample.trace.mark (StageTrace::kComputed);
+		}
+
+		// Decides aperture for the next iteration's INITIATE:
+		if (trigger)
+			trigger->update (channel_samples[0]);
 
 		{
 			std::lock_guard<std::mutex> lock (samples_mutex);
-			samples_todo.push (sample);
+
+			for (auto const& sample: channel_samples)
+			{
+				samples_todo.push (sample);
+				samples_todo.back().trace.mark (StageTrace::kQueued);
+			}
 		}
 		samples_semaphore.release (1);
 
-		prev_initiate_timestamp = initiate_timestamp;
+		prev_initiate_time = initiate_time;
 	}
 }
 
 
 /**
- * Log single sample to an output file.
+ * Runs measure_loop(). A device that times out or closes the connection, or any other error,
+ * stops measurements: the error (naming the device, if any) is reported and the log thread and
+ * main() are told to quit.
  */
 void
-log_sample (Sample const& sample, FileDB& file_db)
+measure_function (Topology const& topology, std::vector<std::unique_ptr<SCPIDevice>>& devices,
+				  std::queue<Sample>& samples_todo, std::mutex& samples_mutex, QSemaphore& samples_semaphore,
+				  SampleRecorder* recorder, Trigger* trigger, std::size_t initial_aperture, bool real_time)
 {
-	auto output_log = file_db.get_file_for_timestamp (sample.initiate_timestamp);
-
-	output_log->write (QString("%1,%2,%3,%4,%5,%6,%7,%8,%9,%10,%11,%12,%13,%14\n")
-					   .arg (sample.initiate_timestamp, 0, 'f', 6)
-					   .arg (sample.voltage, 0, 'f', 9)
-					   .arg (sample.voltmeter_temperature, 0, 'f', 3)
-					   .arg (sample.current, 0, 'f', 9)
-					   .arg (sample.ammeter_temperature, 0, 'f', 3)
-					   .arg (sample.power, 0, 'f', 18)
-					   .arg (sample.energy, 0, 'f', 18)
-					   .arg (sample.voltage_corrected, 0, 'f', 18)
-					   .arg (sample.power_corrected, 0, 'f', 18)
-					   .arg (sample.energy_corrected, 0, 'f', 18)
-					   .arg (sample.voltage_corrected_filtered, 0, 'f', 9)
-					   .arg (sample.current_filtered, 0, 'f', 6)
-					   .arg (sample.power_corrected_filtered, 0, 'f', 18)
-					   .arg (sample.energy_corrected_filtered, 0, 'f', 18)
-					   .toUtf8());
+	try {
+		measure_loop (topology, devices, samples_todo, samples_mutex, samples_semaphore, recorder, trigger, initial_aperture, real_time);
+	}
+	// SCPIDevice::Error, but also epoll failures in DeviceMultiplexer:
+	catch (std::exception const& e)
+	{
+		std::cout << "\nMeasurements stopped: " << e.what() << std::endl;
+		g_measure_failed.store (true);
+		g_quit_signal.store (true);
+	}
+
+	// Wake up the log thread, so that it notices g_quit_signal:
+	samples_semaphore.release (1);
 }
 
 
 /**
- * Thread for writing log file and updating screen (on stdout).
+ * Thread for writing log files and updating screen (on stdout).
+ * Each channel is logged to its own directory. Stage trace, recording, plot feed, spectrum and trigger events cover
+ * the first channel.
  */
 void
-log_function (std::queue<Sample>& samples_todo, std::mutex& samples_mutex, QSemaphore& samples_semaphore)
+log_function (Topology const& topology, std::queue<Sample>& samples_todo, std::mutex& samples_mutex, QSemaphore& samples_semaphore, StageTrace* stage_trace,
+			  SampleRecorder* recorder, PlotFeed* plot_feed, SpectrumAnalyzer* spectrum, EventRecorder* events, Dashboard& dashboard)
 {
-	FileDB file_db { QDir (kOutputDir) };
+	std::vector<std::unique_ptr<FileDB>> file_dbs;
+
+	for (auto const& channel: topology.channels)
+		file_dbs.push_back (std::make_unique<FileDB> (QDir (channel.output_dir)));
 
 	do {
 		samples_semaphore.acquire (1);
@@ -366,65 +521,248 @@ log_function (std::queue<Sample>& samples_todo, std::mutex& samples_mutex, QSema
 			while (!samples_todo.empty())
 			{
 				samples.push_back (samples_todo.front());
+				samples.back().trace.mark (StageTrace::kDequeued);
 				samples_todo.pop();
 			}
 		}
 
 		for (auto& sample: samples)
-			log_sample (sample, file_db);
+		{
+			log_sample (sample, *file_dbs[sample.channel]);
+
+			if (sample.channel != 0)
+				continue;
+
+			if (recorder)
+				recorder->append (sample);
+
+			if (plot_feed)
+				plot_feed->add (sample);
+
+			// Spectrum needs evenly spaced samples:
+			if (spectrum && sample.event == 0)
+				spectrum->add (sample);
+
+			if (events)
+				events->add (sample);
 
-		if (!samples.empty())
+			if (stage_trace)
+			{
+				sample.trace.mark (StageTrace::kLogged);
+				stage_trace->append (sample.trace);
+			}
+		}
+
+		if (plot_feed)
 		{
-			// Only display the latest sample:
-			auto& sample = samples.back();
-
-			QString out;
-			out += "\x1B[H\x1B[2J";
-			out += QString ("now = %1 s   elapsed = %2 s   since last autozero = %3 s\n").arg (bold ("%-.3f", sample.initiate_timestamp))
-				.arg (bold ("%+6.1f", sample.initiate_timestamp - sample.start_timestamp)).arg (bold ("%+6.1f", sample.initiate_timestamp - sample.auto_zero_timestamp));
-			out += QString (" dt = %1 s            max dt = %2 s         timing errors = %3\n")
-				.arg (bold ("%+.3f", sample.dt)).arg (bold ("%+.3f", sample.max_dt)).arg (sample.timing_errors_s);
-			out += QString (" queue = %1\n").arg (samples_semaphore.available());
-			out += "\n";
-			out += QString ("    PLC/sample                        = %1\n").arg (kNPLC);
-			out += QString ("    Voltmeter-motherboard resistance  = %1 Ω\n").arg (kTotalVoltmeterBurdenResitanceOhms);
-			out += "\n";
-			out += QString ("    Voltmeter temperature             = %1°C\n").arg (green ("%.3f", sample.voltmeter_temperature));
-			out += QString ("    Ammeter temperature               = %1°C\n").arg (green ("%.3f", sample.ammeter_temperature));
-			out += QString ("    Samples                           = %1\n").arg (sample.number);
-			out += "\n";
-			out += QString ("    Raw measurements:\n");
-			out += QString ("        U           = %1 V\n").arg (hs (sample.voltage));
-			out += QString ("        I           = %1 A\n").arg (important (hs (sample.current)));
-			out += QString ("        P           = %1 W\n").arg (hs (sample.power));
-			out += QString ("       ∫P dt        = %1 Ws = %2 Wh\n").arg (hs (sample.energy)).arg (hs (sample.energy / 3600.0));
-			out += "\n";
-			out += QString ("    Corrected measurements:\n");
-			out += QString ("        U           = %1 V (error = %2 V)\n").arg (important (hs (sample.voltage_corrected))).arg (hs (sample.voltage_error));
-			out += QString ("        P           = %1 W (error = %2 W)\n").arg (important (hs (sample.power_corrected))).arg (hs (sample.power - sample.power_corrected));
-			out += QString ("       ∫P dt        = %1 Ws = %2 Wh\n").arg (hs (sample.energy_corrected)).arg (important (hs (sample.energy_corrected / 3600.0)));
-			out += "\n";
-			out += QString ("    Filtered measurements (%1 taps, Hann):\n").arg (sample.filter_taps);
-			out += QString ("        U           = %1 V\n").arg (important (ls (sample.voltage_corrected_filtered)));
-			out += QString ("        I           = %1 A\n").arg (important (ls (sample.current_filtered)));
-			out += QString ("        P           = %1 W\n").arg (important (ls (sample.power_corrected_filtered)));
-
-			std::cout << out.toStdString() << std::flush;
+			try {
+				plot_feed->refresh();
+			}
+			catch (PlotFeed::Error const& e)
+			{
+				std::cerr << e.what() << std::endl;
+			}
 		}
+
+		dashboard.update (samples, samples_semaphore.available());
 	} while (!g_quit_signal.load());
 }
 
 
-int main()
+/**
+ * Parse "address[:port]".
+ */
+std::pair<QHostAddress, uint16_t>
+parse_endpoint (QString const& endpoint)
+{
+	auto parts = endpoint.split (':');
+	QHostAddress address;
+	uint16_t port = kSCPIPort;
+	bool ok = parts.size() <= 2 && address.setAddress (parts[0]);
+
+	if (ok && parts.size() == 2)
+		port = parts[1].toUShort (&ok);
+
+	if (!ok)
+		throw std::runtime_error ("invalid device address '" + endpoint.toStdString() + "', expected address[:port]");
+
+	return { address, port };
+}
+
+
+/**
+ * Replay recorded measurements through the processing pipeline and report its throughput.
+ */
+int
+replay_main (QString const& source, QString const& output_dir, bool real_time)
+{
+	if (QFileInfo (source).isDir() && QDir (source).canonicalPath() == QDir (output_dir).canonicalPath())
+		throw std::runtime_error ("replay output directory must differ from the replayed one");
+
+	bool is_csv = QFileInfo (source).isDir() || source.endsWith (".csv");
+	std::cout << "Reading " << source.toStdString() << "..." << std::endl;
+	ReplayInput input = is_csv ? read_csv (source) : read_recording (source);
+
+	if (is_csv)
+		std::cout << "Note: CSV doesn't store exact dt, derived columns will only match within CSV precision." << std::endl;
+
+	::signal (SIGINT, catch_sigint);
+
+	std::cout << "Replaying " << input.records.size() << " samples to " << output_dir.toStdString() << (real_time ? " at recorded pace" : "") << "..." << std::endl;
+	ReplayStatistics statistics;
+
+	{
+		FileDB file_db { QDir (output_dir) };
+		statistics = replay (input, file_db, real_time, g_quit_signal);
+	}
+
+	std::cout << "Replayed " << statistics.samples << " samples.\n\n" << statistics.report().toStdString() << std::flush;
+	return EXIT_SUCCESS;
+}
+
+
+int main (int argc, char** argv)
 {
 	if (!g_quit_signal.is_lock_free())
 		throw std::runtime_error ("this platform or binary doesn't have lock-free atomics");
 
+	QStringList arguments;
+	for (int i = 0; i < argc; ++i)
+		arguments << QString::fromLocal8Bit (argv[i]);
+
+	QCommandLineParser options;
+	options.setApplicationDescription ("Logs power measured by 34461A meters.");
+	options.addHelpOption();
+	QCommandLineOption voltmeter_option ("voltmeter", "Voltmeter <address[:port]>.", "address[:port]", kVoltmeterIP);
+	QCommandLineOption ammeter_option ("ammeter", "Ammeter <address[:port]>.", "address[:port]", kAmmeterIP);
+	QCommandLineOption config_option ("config", "Load instruments and channels from JSON <file> instead of using --voltmeter and --ammeter.", "file");
+	QCommandLineOption trace_option ("trace", "Record per-sample stage timestamps to <file> (read it with scpitrace).", "file");
+	QCommandLineOption trace_capacity_option ("trace-capacity", "Keep last <n> samples in the trace file.", "n", QString::number (kDefaultTraceCapacity));
+	QCommandLineOption device_trace_option ("device-trace", "Log messages exchanged with meters to <file> (read it with scpidevtrace).", "file", kDeviceTraceFile);
+	QCommandLineOption device_trace_keep_option ("device-trace-keep", "Keep only last <seconds> of the device trace (0: everything).", "seconds", "0");
+	QCommandLineOption record_option ("record", "Record raw measurements to <file> for later --replay.", "file");
+	QCommandLineOption replay_option ("replay", "Don't connect to meters, replay <source> instead: a --record file, a samples.*.csv file or a directory of them.", "source");
+	QCommandLineOption replay_output_option ("replay-output", "Write replayed samples to <directory>.", "directory", kReplayOutputDir);
+	QCommandLineOption real_time_option ("real-time", "Replay at recorded pace instead of as fast as possible.");
+	QCommandLineOption plot_dir_option ("plot-dir", "Keep data files for tools/visualize-power-last.gp up to date in <directory>.", "directory");
+	QCommandLineOption plot_window_option ("plot-window", "Plot last <n> samples.", "n", QString::number (kDefaultPlotWindow));
+	QCommandLineOption plot_bucket_option ("plot-bucket", "Summarize each <n> samples as a candlestick.", "n", QString::number (kDefaultPlotBucket));
+	QCommandLineOption plot_column_option ("plot-column", "Summarize CSV <column> in candlesticks (default: corrected power).", "column", QString::number (FileDB::kPowerCorrected));
+	QCommandLineOption spectrum_option ("spectrum", "Write band powers and dominant frequency of the first channel's corrected power to spectrum.*.csv.");
+	QCommandLineOption spectrum_segment_option ("spectrum-segment", "Samples per FFT for --spectrum, a power of two.", "n", QString::number (kDefaultSpectrumSegment));
+	QCommandLineOption spectrum_interval_option ("spectrum-interval", "Write a --spectrum row every <seconds>.", "seconds", QString::number (kDefaultSpectrumIntervalSeconds));
+	QCommandLineOption nplc_option ("nplc", "Initial aperture in power line cycles (0.02, 0.2, 1, 10 or 100); SIGUSR1 and SIGUSR2 make it shorter or longer at run time.", "nplc",
+									QString::number (kApertures[kDefaultAperture].nplc));
+	QCommandLineOption trigger_option ("trigger", "Capture events when <condition> holds for the first channel, eg. 'power>5' or 'd(current)<-0.5'"
+									   " (d() is rate of change per second). Events are written to events.*.csv.", "condition");
+	QCommandLineOption trigger_nplc_option ("trigger-nplc", "Aperture of meters during an event burst, in power line cycles (see --nplc).", "nplc", QString::number (kDefaultTriggerNPLC));
+	QCommandLineOption trigger_burst_option ("trigger-burst", "Take <n> readings in burst mode after a trigger.", "n", QString::number (kDefaultTriggerBurst));
+	QCommandLineOption trigger_pre_option ("trigger-pre", "Save <n> samples preceding each event.", "n", QString::number (kDefaultTriggerPreSamples));
+	QCommandLineOption trigger_holdoff_option ("trigger-holdoff", "Ignore the trigger for <n> samples after a burst.", "n", QString::number (kDefaultTriggerHoldoff));
+	QCommandLineOption dashboard_rate_option ("dashboard-rate", "Dashboard refresh rate, up to " + QString::number (kMaxDashboardRateHz) + " Hz.", "Hz", QString::number (kDefaultDashboardRateHz));
+	QCommandLineOption rt_option ("rt", "Run measure thread with SCHED_FIFO on a dedicated CPU, with locked memory.");
+	QCommandLineOption rt_priority_option ("rt-priority", "SCHED_FIFO priority for --rt.", "priority", QString::number (kDefaultRealTimePriority));
+	QCommandLineOption rt_cpu_option ("rt-cpu", "CPU for the measure thread in --rt mode (default: the last one).", "cpu");
+	options.addOptions ({ voltmeter_option, ammeter_option, config_option, trace_option, trace_capacity_option, device_trace_option, device_trace_keep_option,
+						  record_option, replay_option, replay_output_option, real_time_option, plot_dir_option, plot_window_option, plot_bucket_option,
+						  plot_column_option, nplc_option, spectrum_option, spectrum_segment_option, spectrum_interval_option, trigger_option,
+						  trigger_nplc_option, trigger_burst_option, trigger_pre_option, trigger_holdoff_option, dashboard_rate_option, rt_option, rt_priority_option, rt_cpu_option });
+	options.process (arguments);
+
+	if (options.isSet (replay_option))
+		return replay_main (options.value (replay_option), options.value (replay_output_option), options.isSet (real_time_option));
+
+	std::unique_ptr<SampleRecorder> recorder;
+
+	if (options.isSet (record_option))
+		recorder = std::make_unique<SampleRecorder> (options.value (record_option));
+
+	std::unique_ptr<StageTrace> stage_trace;
+
+	if (options.isSet (trace_option))
+		stage_trace = std::make_unique<StageTrace> (options.value (trace_option), options.value (trace_capacity_option).toULongLong());
+
+	std::unique_ptr<PlotFeed> plot_feed;
+
+	if (options.isSet (plot_dir_option))
+	{
+		int const column = options.value (plot_column_option).toInt();
+
+		if (column < 0 || column >= FileDB::kColumnsCount)
+			throw std::runtime_error ("invalid --plot-column value");
+
+		plot_feed = std::make_unique<PlotFeed> (QDir (options.value (plot_dir_option)), options.value (plot_window_option).toULongLong(),
+												options.value (plot_bucket_option).toULongLong(), static_cast<FileDB::Column> (column),
+												kPlotRefreshPeriodSeconds);
+	}
+
+	bool dashboard_rate_ok = false;
+	double const dashboard_rate = options.value (dashboard_rate_option).toDouble (&dashboard_rate_ok);
+
+	// Also rejects NaN:
+	if (!dashboard_rate_ok || !(dashboard_rate > 0.0 && dashboard_rate <= kMaxDashboardRateHz))
+		throw std::runtime_error ("invalid --dashboard-rate value");
+
+	Topology topology;
+
+	if (options.isSet (config_option))
+		topology = Topology::load (options.value (config_option));
+	else
+	{
+		auto voltmeter_endpoint = parse_endpoint (options.value (voltmeter_option));
+		auto ammeter_endpoint = parse_endpoint (options.value (ammeter_option));
+		topology = Topology::single_pair (voltmeter_endpoint.first, voltmeter_endpoint.second, ammeter_endpoint.first, ammeter_endpoint.second);
+	}
+
+	std::unique_ptr<SpectrumAnalyzer> spectrum;
+
+	if (options.isSet (spectrum_option))
+		spectrum = std::make_unique<SpectrumAnalyzer> (QDir (topology.channels[0].output_dir), options.value (spectrum_segment_option).toULongLong(),
+													   options.value (spectrum_interval_option).toDouble(),
+													   std::vector<SpectrumAnalyzer::Band> (std::begin (kSpectrumBands), std::end (kSpectrumBands)));
+
+	std::size_t const initial_aperture = find_aperture (options.value (nplc_option).toDouble());
+
+	if (initial_aperture == kAperturesCount)
+		throw std::runtime_error ("unsupported --nplc value");
+
+	std::unique_ptr<Trigger> trigger;
+	std::unique_ptr<EventRecorder> events;
+
+	if (options.isSet (trigger_option))
+	{
+		std::size_t const burst_aperture = find_aperture (options.value (trigger_nplc_option).toDouble());
+
+		if (burst_aperture == kAperturesCount)
+			throw std::runtime_error ("unsupported --trigger-nplc value");
+
+		trigger = std::make_unique<Trigger> (Trigger::Condition::parse (options.value (trigger_option)), burst_aperture,
+											 options.value (trigger_burst_option).toULongLong(), options.value (trigger_holdoff_option).toULongLong());
+		events = std::make_unique<EventRecorder> (QDir (topology.channels[0].output_dir), options.value (trigger_pre_option).toULongLong());
+	}
+
+	bool const rt = options.isSet (rt_option);
+	int const rt_cpu = options.isSet (rt_cpu_option) ? options.value (rt_cpu_option).toInt() : online_cpus() - 1;
+	RealTimeReport rt_report;
+
+	// Before any thread starts, so that their stacks get locked too:
+	if (rt)
+		lock_memory (rt_report);
+
 	std::cout << "Connecting..." << std::endl;
-	SCPIDevice voltmeter ("voltmeter", QHostAddress (kVoltmeterIP), 5025, "log.v");
-	SCPIDevice ammeter ("ammeter", QHostAddress (kAmmeterIP), 5025, "log.a");
+	// Must outlive the devices:
+	DeviceTrace device_trace (options.value (device_trace_option), options.value (device_trace_keep_option).toDouble());
+	std::vector<std::unique_ptr<SCPIDevice>> devices;
+
+	for (auto const& instrument: topology.instruments)
+		devices.push_back (std::make_unique<SCPIDevice> (instrument.name, instrument.address, instrument.port, device_trace.add_source (instrument.name)));
 
 	::signal (SIGINT, catch_sigint);
+	::signal (SIGUSR1, catch_sigusr1);
+	::signal (SIGUSR2, catch_sigusr2);
+
+	// Anchor monotonic clock to wall time before measurements start:
+	wall_clock();
 
 	std::cout << "Press C-c to stop.\n" << std::endl;
 	std::cout << "Configuring for test..." << std::endl;
@@ -433,21 +771,55 @@ int main()
 	std::mutex samples_mutex;
 
 	std::thread measure_thread (measure_function,
-								std::ref (voltmeter), std::ref (ammeter),
+								std::cref (topology), std::ref (devices),
 								std::ref (samples_queue), std::ref (samples_mutex),
-								std::ref (samples_semaphore));
+								std::ref (samples_semaphore), recorder.get(), trigger.get(), initial_aperture, rt);
+
+	std::vector<Dashboard::Channel> dashboard_channels;
+
+	for (auto const& channel: topology.channels)
+		dashboard_channels.push_back ({ channel.name.toStdString(), channel.burden_resistance });
+
+	Dashboard dashboard (dashboard_rate, dashboard_channels);
 
 	std::thread log_thread (log_function,
-							std::ref (samples_queue), std::ref (samples_mutex), std::ref (samples_semaphore));
+							std::cref (topology), std::ref (samples_queue), std::ref (samples_mutex), std::ref (samples_semaphore), stage_trace.get(), recorder.get(),
+							plot_feed.get(), spectrum.get(), events.get(), std::ref (dashboard));
+
+	if (rt)
+	{
+		set_fifo_scheduling (measure_thread.native_handle(), "measure thread", options.value (rt_priority_option).toInt(), rt_report);
+		pin_to_cpu (measure_thread.native_handle(), "measure thread", rt_cpu, rt_report);
+		exclude_cpu (log_thread.native_handle(), "log thread", rt_cpu, rt_report);
+		exclude_cpu (dashboard.native_handle(), "dashboard thread", rt_cpu, rt_report);
+
+		if (spectrum)
+			exclude_cpu (spectrum->native_handle(), "spectrum thread", rt_cpu, rt_report);
+
+		std::cout << rt_report.render().toStdString() << std::flush;
+
+		if (!rt_report.all_ok())
+			std::cout << "Some real-time settings failed (missing CAP_SYS_NICE/CAP_IPC_LOCK or RLIMIT_RTPRIO/RLIMIT_MEMLOCK?)." << std::endl;
+	}
 
 	measure_thread.join();
 	log_thread.join();
+	dashboard.stop();
 
 	std::cout << "\nQuitting.\n";
 
-	voltmeter.send ("DISPLAY:TEXT:CLEAR");
-	ammeter.send ("DISPLAY:TEXT:CLEAR");
+	for (auto& device: devices)
+	{
+		try {
+			device->send ("DISPLAY:TEXT:CLEAR");
+			device->flush();
+		}
+		catch (SCPIDevice::Error const&)
+		{
+			// Device that failed the measurements.
+		}
+	}
 
-	return EXIT_SUCCESS;
+	return g_measure_failed.load() ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
@@ -0,0 +1,329 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <utility>
+
+// Qt:
+#include <QString>
+
+// SCPIDev:
+#include <scpidev/filter.h>
+
+// Local:
+#include "spectrum.h"
+
+
+namespace scpidev {
+
+constexpr char SpectrumAnalyzer::kPrefix[];
+
+// How often the worker picks up queued samples:
+constexpr std::chrono::milliseconds kSpectrumWakeupPeriod { 200 };
+
+
+WelchEstimator::WelchEstimator (std::size_t segment_length):
+	_length (segment_length)
+{
+	if (_length < 4 || (_length & (_length - 1)) != 0)
+		throw std::invalid_argument ("spectrum segment length must be a power of two, at least 4");
+
+	_window.resize (_length);
+	hann_window (_window.data(), _length);
+
+	for (double w: _window)
+		_window_energy += w * w;
+
+	_history.resize (_length);
+	_buffer.resize (_length);
+	_sum.resize (_length / 2 + 1);
+}
+
+
+void
+WelchEstimator::add (double value)
+{
+	_history[_history_head] = value;
+	_history_head = (_history_head + 1) % _length;
+	_history_size = std::min (_history_size + 1, _length);
+	++_since_fft;
+
+	// Segments overlap by half:
+	if (_history_size == _length && _since_fft >= _length / 2)
+	{
+		transform();
+		_since_fft = 0;
+	}
+}
+
+
+std::vector<double>
+WelchEstimator::density (double sample_rate) const
+{
+	std::vector<double> result (_sum.size(), 0.0);
+
+	if (_segments == 0 || sample_rate <= 0.0)
+		return result;
+
+	double const scale = 1.0 / (_segments * sample_rate * _window_energy);
+
+	for (std::size_t k = 0; k < _sum.size(); ++k)
+	{
+		// Fold negative frequencies onto positive ones, except DC and Nyquist which have no mirror:
+		double const fold = (k == 0 || k == _length / 2) ? 1.0 : 2.0;
+		result[k] = _sum[k] * scale * fold;
+	}
+
+	return result;
+}
+
+
+void
+WelchEstimator::reset()
+{
+	std::fill (_sum.begin(), _sum.end(), 0.0);
+	_segments = 0;
+}
+
+
+void
+WelchEstimator::clear()
+{
+	reset();
+	_history_head = 0;
+	_history_size = 0;
+	_since_fft = 0;
+}
+
+
+void
+WelchEstimator::transform()
+{
+	double mean = 0.0;
+
+	for (double value: _history)
+		mean += value;
+
+	mean /= _length;
+
+	// Oldest value is at the head of the ring:
+	for (std::size_t i = 0; i < _length; ++i)
+		_buffer[i] = (_history[(_history_head + i) % _length] - mean) * _window[i];
+
+	fft (_buffer);
+
+	for (std::size_t k = 0; k < _sum.size(); ++k)
+		_sum[k] += std::norm (_buffer[k]);
+
+	++_segments;
+}
+
+
+void
+WelchEstimator::fft (std::vector<std::complex<double>>& data)
+{
+	std::size_t const n = data.size();
+
+	// Bit-reversal permutation:
+	for (std::size_t i = 1, j = 0; i < n; ++i)
+	{
+		std::size_t bit = n >> 1;
+
+		for (; j & bit; bit >>= 1)
+			j ^= bit;
+
+		j ^= bit;
+
+		if (i < j)
+			std::swap (data[i], data[j]);
+	}
+
+	for (std::size_t length = 2; length <= n; length <<= 1)
+	{
+		std::complex<double> const step = std::polar (1.0, -2.0 * M_PI / length);
+
+		for (std::size_t i = 0; i < n; i += length)
+		{
+			std::complex<double> w (1.0, 0.0);
+
+			for (std::size_t k = 0; k < length / 2; ++k)
+			{
+				std::complex<double> const even = data[i + k];
+				std::complex<double> const odd = data[i + k + length / 2] * w;
+				data[i + k] = even + odd;
+				data[i + k + length / 2] = even - odd;
+				w *= step;
+			}
+		}
+	}
+}
+
+
+SpectrumAnalyzer::SpectrumAnalyzer (QDir location, std::size_t segment_length, double interval, std::vector<Band> const& bands):
+	_interval (interval),
+	_bands (bands),
+	_file_db (location, kPrefix, header (bands)),
+	_estimator (segment_length)
+{
+	_thread = std::thread (&SpectrumAnalyzer::run, this);
+}
+
+
+SpectrumAnalyzer::~SpectrumAnalyzer()
+{
+	{
+		std::lock_guard<std::mutex> lock (_mutex);
+		_quit = true;
+	}
+	_condition.notify_all();
+	_thread.join();
+}
+
+
+void
+SpectrumAnalyzer::add (Sample const& sample)
+{
+	std::lock_guard<std::mutex> lock (_mutex);
+	_pending.push_back ({ sample.initiate_timestamp, sample.dt, sample.power_corrected, sample.aperture });
+}
+
+
+std::thread::native_handle_type
+SpectrumAnalyzer::native_handle()
+{
+	return _thread.native_handle();
+}
+
+
+void
+SpectrumAnalyzer::run()
+{
+	bool quit = false;
+
+	while (!quit)
+	{
+		{
+			std::unique_lock<std::mutex> lock (_mutex);
+			quit = _condition.wait_for (lock, kSpectrumWakeupPeriod, [&] { return _quit; });
+			// Swap buffers, so that the log thread keeps appending to already allocated memory:
+			std::swap (_pending, _processing);
+		}
+
+		for (auto const& input: _processing)
+			process (input);
+
+		_processing.clear();
+	}
+
+	// Partial interval, if it has at least one segment:
+	publish();
+}
+
+
+void
+SpectrumAnalyzer::process (Input const& input)
+{
+	// A failed reading shouldn't smear over the whole segment:
+	double const value = std::isfinite (input.value) ? input.value : _last_value;
+	_last_value = value;
+
+	// Sample rate changes with aperture; segments and sample rate of the interval must not mix them:
+	if (input.aperture != _aperture)
+	{
+		publish();
+		_estimator.clear();
+		_aperture = input.aperture;
+	}
+
+	if (_interval_samples == 0)
+		_interval_start = input.timestamp;
+
+	_estimator.add (value);
+	_dt_sum += input.dt;
+	_last_timestamp = input.timestamp;
+	++_interval_samples;
+
+	if (_last_timestamp - _interval_start >= _interval)
+		publish();
+}
+
+
+void
+SpectrumAnalyzer::publish()
+{
+	if (_estimator.segments() > 0 && _dt_sum > 0.0)
+	{
+		double const sample_rate = _interval_samples / _dt_sum;
+		double const bin_width = sample_rate / _estimator.segment_length();
+		auto const density = _estimator.density (sample_rate);
+
+		QByteArray row = QByteArray::number (_last_timestamp, 'f', 6);
+		row += ',';
+		row += QByteArray::number (sample_rate, 'f', 6);
+		row += ',';
+		row += QByteArray::number (static_cast<qint64> (_estimator.segments()));
+
+		for (auto const& band: _bands)
+		{
+			double power = 0.0;
+
+			for (std::size_t k = 0; k < density.size(); ++k)
+			{
+				double const frequency = k * bin_width;
+
+				if (frequency >= band.low_hz && frequency < band.high_hz)
+					power += density[k] * bin_width;
+			}
+
+			row += ',';
+			row += QByteArray::number (power, 'g', 9);
+		}
+
+		// Dominant frequency, excluding DC:
+		auto const dominant = std::max_element (density.begin() + 1, density.end());
+		row += ',';
+		row += QByteArray::number ((dominant - density.begin()) * bin_width, 'f', 6);
+		row += ',';
+		row += QByteArray::number (*dominant, 'g', 9);
+		row += '\n';
+
+		auto file = _file_db.get_file_for_timestamp (_last_timestamp);
+		file->write (row);
+		file->flush();
+	}
+
+	_estimator.reset();
+	_interval_samples = 0;
+	_dt_sum = 0.0;
+}
+
+
+QByteArray
+SpectrumAnalyzer::header (std::vector<Band> const& bands)
+{
+	QString result = "#timestamp,#sample_rate_Hz,#segments";
+
+	// Band powers are variance of power within the band, in W²:
+	for (auto const& band: bands)
+		result += QString (",#band_%1-%2Hz_W2").arg (band.low_hz).arg (band.high_hz);
+
+	result += ",#dominant_frequency_Hz,#dominant_density_W2_per_Hz\n";
+	return result.toUtf8();
+}
+
+} // namespace scpidev
+
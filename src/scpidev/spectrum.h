@@ -0,0 +1,230 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__SPECTRUM_H__INCLUDED
+#define SCPIDEV__SPECTRUM_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <complex>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Qt:
+#include <QDir>
+
+// SCPIDev:
+#include <scpidev/sample.h>
+#include <utility/file_db.h>
+
+
+namespace scpidev {
+
+/**
+ * Power spectral density of a signal estimated with Welch's method: the signal is cut into
+ * segments overlapping by half, each segment is detrended (mean removed), Hann-windowed and
+ * transformed, and squared magnitudes are averaged over all segments in an interval.
+ */
+class WelchEstimator
+{
+  public:
+	/**
+	 * \param	segment_length
+	 *			Samples per FFT, must be a power of two.
+	 *			Throw std::invalid_argument if it's not.
+	 */
+	explicit WelchEstimator (std::size_t segment_length);
+
+	std::size_t
+	segment_length() const noexcept;
+
+	/**
+	 * Append a value. Runs an FFT each segment_length / 2 values.
+	 */
+	void
+	add (double value);
+
+	/**
+	 * Number of segments averaged since the last reset().
+	 */
+	std::size_t
+	segments() const noexcept;
+
+	/**
+	 * Return one-sided PSD (units²/Hz) for bins 0…segment_length / 2, averaged over segments
+	 * added since the last reset().
+	 */
+	std::vector<double>
+	density (double sample_rate) const;
+
+	/**
+	 * Start a new average. Samples of an unfinished segment are kept.
+	 */
+	void
+	reset();
+
+	/**
+	 * Start a new average and drop samples of an unfinished segment,
+	 * eg. when sample rate changes.
+	 */
+	void
+	clear();
+
+  private:
+	/**
+	 * In-place iterative radix-2 FFT.
+	 */
+	static void
+	fft (std::vector<std::complex<double>>&);
+
+	/**
+	 * Transform the last segment_length values and add them to the average.
+	 */
+	void
+	transform();
+
+  private:
+	std::size_t							_length;
+	std::vector<double>					_window;
+	double								_window_energy	= 0.0;
+	// Ring of the last segment_length values:
+	std::vector<double>					_history;
+	std::size_t							_history_head	= 0;
+	std::size_t							_history_size	= 0;
+	// Values since the last FFT:
+	std::size_t							_since_fft		= 0;
+	std::vector<std::complex<double>>	_buffer;
+	std::vector<double>					_sum;
+	std::size_t							_segments		= 0;
+};
+
+
+/**
+ * Background spectral analysis of a channel's corrected power. The log thread hands samples over
+ * with add(); FFTs run on a worker thread, which every interval appends a row with band powers
+ * and the dominant frequency to a "spectrum" FileDB series. Nothing runs on the measure thread.
+ *
+ * Segments must be evenly sampled, so when meters' aperture changes, the interval is published
+ * early and the unfinished segment is dropped.
+ */
+class SpectrumAnalyzer
+{
+  public:
+	static constexpr char kPrefix[] = "spectrum";
+
+	class Band
+	{
+	  public:
+		double	low_hz;
+		double	high_hz;
+	};
+
+  public:
+	/**
+	 * Start worker thread.
+	 * Throw std::invalid_argument if segment_length is not a power of two.
+	 *
+	 * \param	interval
+	 *			Seconds of samples averaged into each published row.
+	 */
+	SpectrumAnalyzer (QDir location, std::size_t segment_length, double interval, std::vector<Band> const& bands);
+
+	// Dtor
+	~SpectrumAnalyzer();
+
+	/**
+	 * Queue sample for analysis.
+	 */
+	void
+	add (Sample const&);
+
+	/**
+	 * Worker thread handle, eg. for setting CPU affinity.
+	 */
+	std::thread::native_handle_type
+	native_handle();
+
+  private:
+	class Input
+	{
+	  public:
+		double		timestamp;
+		double		dt;
+		double		value;
+		std::size_t	aperture;
+	};
+
+  private:
+	void
+	run();
+
+	void
+	process (Input const&);
+
+	/**
+	 * Write a row for the current interval and start the next one.
+	 */
+	void
+	publish();
+
+	/**
+	 * Return the first line of spectrum files, describing the bands.
+	 */
+	static QByteArray
+	header (std::vector<Band> const&);
+
+  private:
+	double						_interval;
+	std::vector<Band>			_bands;
+	FileDB						_file_db;
+	WelchEstimator				_estimator;
+
+	std::mutex					_mutex;
+	std::condition_variable		_condition;
+	bool						_quit				= false;
+	// Guarded by _mutex:
+	std::vector<Input>			_pending;
+
+	// Worker thread only:
+	std::vector<Input>			_processing;
+	double						_interval_start		= 0.0;
+	double						_last_timestamp		= 0.0;
+	double						_dt_sum				= 0.0;
+	std::size_t					_interval_samples	= 0;
+	double						_last_value			= 0.0;
+	std::size_t					_aperture			= kDefaultAperture;
+
+	std::thread					_thread;
+};
+
+
+inline std::size_t
+WelchEstimator::segment_length() const noexcept
+{
+	return _length;
+}
+
+
+inline std::size_t
+WelchEstimator::segments() const noexcept
+{
+	return _segments;
+}
+
+} // namespace scpidev
+
+#endif
+
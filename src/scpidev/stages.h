@@ -0,0 +1,196 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__STAGES_H__INCLUDED
+#define SCPIDEV__STAGES_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// SCPIDev:
+#include <scpidev/filter.h>
+#include <scpidev/sample.h>
+
+
+namespace scpidev {
+
+/**
+ * Building blocks for computing derived quantities of a Sample.
+ *
+ * Each stage reads some fields of a Sample and writes one or more others; fields are selected
+ * with pointers to members given as template parameters. A Pipeline runs stages in order. Stage
+ * types are known at compile time and all calls are inline, so a pipeline compiles to a single
+ * straight-line kernel, and adding a stage costs only the arithmetic it does.
+ *
+ * A stage must provide:
+ *
+ *	void
+ *	process (Sample&);
+ */
+typedef double Sample::* Field;
+
+
+/**
+ * out = a × b.
+ */
+template<Field pOut, Field pA, Field pB>
+	class Product
+	{
+	  public:
+		void
+		process (Sample&) const noexcept;
+	};
+
+
+/**
+ * Running integral of input over sample.dt.
+ */
+template<Field pOut, Field pIn>
+	class Integrator
+	{
+	  public:
+		void
+		process (Sample&) noexcept;
+
+	  private:
+		double	_sum = 0.0;
+	};
+
+
+/**
+ * Voltage drop on a series resistance carrying the current, and voltage corrected for it:
+ * error = current × resistance, corrected = voltage - error.
+ */
+template<Field pError, Field pCorrected, Field pVoltage, Field pCurrent>
+	class SeriesCorrection
+	{
+	  public:
+		// Ctor
+		explicit SeriesCorrection (double resistance) noexcept;
+
+		void
+		process (Sample&) const noexcept;
+
+	  private:
+		double	_resistance;
+	};
+
+
+/**
+ * Filter<pTaps> applied to input.
+ */
+template<Field pOut, Field pIn, std::size_t pTaps>
+	class LowPass
+	{
+	  public:
+		// Ctor
+		explicit LowPass (double initial_value);
+
+		void
+		process (Sample&);
+
+	  private:
+		Filter<pTaps>	_filter;
+	};
+
+
+/**
+ * Like LowPass, but with a filter for each aperture: Sample::aperture selects the filter (pTaps
+ * are in kApertures order), so filter length follows sample rate changes. When aperture changes,
+ * the newly selected filter is reset to the last output, so filtered values don't jump.
+ *
+ * Taps are sized for the nominal rate of an aperture, 1 / aperture time. At short apertures the
+ * loop is limited by the network round trip instead (0.02 PLC is nominally 2500 samples/s,
+ * measured rate is a fraction of that), so the filter spans proportionally more time.
+ */
+template<Field pOut, Field pIn, std::size_t ...pTaps>
+	class SwitchedLowPass
+	{
+	  public:
+		// Ctor
+		explicit SwitchedLowPass (double initial_value);
+
+		void
+		process (Sample&);
+
+	  private:
+		/**
+		 * Call function with the filter at given index. Instantiated for each index, so the calls
+		 * compile to a jump table.
+		 */
+		template<class pFunction, std::size_t pIndex>
+			void
+			apply (std::size_t index, pFunction&&, std::integral_constant<std::size_t, pIndex>);
+
+		template<class pFunction>
+			void
+			apply (std::size_t index, pFunction&&, std::integral_constant<std::size_t, sizeof... (pTaps)>);
+
+	  private:
+		std::tuple<Filter<pTaps>...>	_filters;
+		std::size_t						_selected;
+		double							_output;
+	};
+
+
+/**
+ * Runs stages in given order. Stages are stored by value, without any indirection.
+ */
+template<class ...pStages>
+	class Pipeline
+	{
+	  public:
+		// Ctor
+		explicit Pipeline (pStages ...stages);
+
+		/**
+		 * Run all stages on a sample.
+		 */
+		void
+		process (Sample&);
+
+		/**
+		 * Run all stages on consecutive samples. Each stage runs over the whole span before the
+		 * next one. Results are the same as processing samples one by one, because a stage
+		 * depends only on earlier stages and its own state, but loops of stateless stages can
+		 * be vectorized.
+		 */
+		void
+		process (Sample* samples, std::size_t count);
+
+	  private:
+		template<std::size_t ...pIndexes>
+			void
+			process (Sample&, std::index_sequence<pIndexes...>);
+
+		template<std::size_t ...pIndexes>
+			void
+			process (Sample* samples, std::size_t count, std::index_sequence<pIndexes...>);
+
+		template<class pStage>
+			static void
+			process_span (pStage&, Sample* samples, std::size_t count);
+
+	  private:
+		std::tuple<pStages...>	_stages;
+	};
+
+} // namespace scpidev
+
+#endif
+
+#include "stages.tcc"
+
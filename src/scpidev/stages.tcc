@@ -0,0 +1,177 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__STAGES_TCC__INCLUDED
+#define SCPIDEV__STAGES_TCC__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <utility>
+
+
+namespace scpidev {
+
+template<Field pOut, Field pA, Field pB>
+	inline void
+	Product<pOut, pA, pB>::process (Sample& sample) const noexcept
+	{
+		sample.*pOut = sample.*pA * sample.*pB;
+	}
+
+
+template<Field pOut, Field pIn>
+	inline void
+	Integrator<pOut, pIn>::process (Sample& sample) noexcept
+	{
+		_sum += sample.*pIn * sample.dt;
+		sample.*pOut = _sum;
+	}
+
+
+template<Field pError, Field pCorrected, Field pVoltage, Field pCurrent>
+	inline
+	SeriesCorrection<pError, pCorrected, pVoltage, pCurrent>::SeriesCorrection (double resistance) noexcept:
+		_resistance (resistance)
+	{ }
+
+
+template<Field pError, Field pCorrected, Field pVoltage, Field pCurrent>
+	inline void
+	SeriesCorrection<pError, pCorrected, pVoltage, pCurrent>::process (Sample& sample) const noexcept
+	{
+		sample.*pError = sample.*pCurrent * _resistance;
+		sample.*pCorrected = sample.*pVoltage - sample.*pError;
+	}
+
+
+template<Field pOut, Field pIn, std::size_t pTaps>
+	inline
+	LowPass<pOut, pIn, pTaps>::LowPass (double initial_value):
+		_filter (initial_value)
+	{ }
+
+
+template<Field pOut, Field pIn, std::size_t pTaps>
+	inline void
+	LowPass<pOut, pIn, pTaps>::process (Sample& sample)
+	{
+		sample.*pOut = _filter.process (sample.*pIn);
+	}
+
+
+template<Field pOut, Field pIn, std::size_t ...pTaps>
+	inline
+	SwitchedLowPass<pOut, pIn, pTaps...>::SwitchedLowPass (double initial_value):
+		_filters (Filter<pTaps> (initial_value)...),
+		_selected (0),
+		_output (initial_value)
+	{ }
+
+
+template<Field pOut, Field pIn, std::size_t ...pTaps>
+	inline void
+	SwitchedLowPass<pOut, pIn, pTaps...>::process (Sample& sample)
+	{
+		if (sample.aperture != _selected)
+		{
+			double const last_output = _output;
+			apply (sample.aperture, [last_output] (auto& filter) { filter.reset (last_output); }, std::integral_constant<std::size_t, 0>());
+			_selected = sample.aperture;
+		}
+
+		double const input = sample.*pIn;
+		double output = _output;
+		apply (_selected, [input, &output] (auto& filter) { output = filter.process (input); }, std::integral_constant<std::size_t, 0>());
+		_output = output;
+		sample.*pOut = output;
+	}
+
+
+template<Field pOut, Field pIn, std::size_t ...pTaps>
+	template<class pFunction, std::size_t pIndex>
+		inline void
+		SwitchedLowPass<pOut, pIn, pTaps...>::apply (std::size_t index, pFunction&& function, std::integral_constant<std::size_t, pIndex>)
+		{
+			if (index == pIndex)
+				function (std::get<pIndex> (_filters));
+			else
+				apply (index, std::forward<pFunction> (function), std::integral_constant<std::size_t, pIndex + 1>());
+		}
+
+
+template<Field pOut, Field pIn, std::size_t ...pTaps>
+	template<class pFunction>
+		inline void
+		SwitchedLowPass<pOut, pIn, pTaps...>::apply (std::size_t, pFunction&&, std::integral_constant<std::size_t, sizeof... (pTaps)>)
+		{
+			// Index out of range, nothing to do.
+		}
+
+
+template<class ...pStages>
+	inline
+	Pipeline<pStages...>::Pipeline (pStages ...stages):
+		_stages (std::move (stages)...)
+	{ }
+
+
+template<class ...pStages>
+	inline void
+	Pipeline<pStages...>::process (Sample& sample)
+	{
+		process (sample, std::index_sequence_for<pStages...>());
+	}
+
+
+template<class ...pStages>
+	inline void
+	Pipeline<pStages...>::process (Sample* samples, std::size_t count)
+	{
+		process (samples, count, std::index_sequence_for<pStages...>());
+	}
+
+
+template<class ...pStages>
+	template<std::size_t ...pIndexes>
+		inline void
+		Pipeline<pStages...>::process (Sample& sample, std::index_sequence<pIndexes...>)
+		{
+			// Initializer list elements are evaluated in order:
+			int expand[] = { 0, (std::get<pIndexes> (_stages).process (sample), 0)... };
+			static_cast<void> (expand);
+		}
+
+
+template<class ...pStages>
+	template<std::size_t ...pIndexes>
+		inline void
+		Pipeline<pStages...>::process (Sample* samples, std::size_t count, std::index_sequence<pIndexes...>)
+		{
+			int expand[] = { 0, (process_span (std::get<pIndexes> (_stages), samples, count), 0)... };
+			static_cast<void> (expand);
+		}
+
+
+template<class ...pStages>
+	template<class pStage>
+		inline void
+		Pipeline<pStages...>::process_span (pStage& stage, Sample* samples, std::size_t count)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+				stage.process (samples[i]);
+		}
+
+} // namespace scpidev
+
+#endif
+
@@ -0,0 +1,244 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <map>
+
+// Qt:
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonParseError>
+
+// SCPIDev:
+#include <scpidev/pipeline.h>
+
+// Local:
+#include "topology.h"
+
+
+namespace scpidev {
+
+constexpr char kSystemIdentifier[] = "AT34461A";
+constexpr char kNoError[] = "+0,\"No error\"";
+constexpr char kDefaultOutputDir[] = "scpidev.log";
+constexpr char kDefaultVoltageRange[] = "100";
+constexpr char kDefaultCurrentRange[] = "10";
+
+
+namespace {
+
+QString
+get_string (QJsonObject const& object, QString const& key, QString const& context)
+{
+	auto value = object.value (key);
+
+	if (!value.isString() || value.toString().isEmpty())
+		throw Topology::Error (context.toStdString() + ": missing string '" + key.toStdString() + "'");
+
+	return value.toString();
+}
+
+} // namespace
+
+
+QString
+InstrumentSpec::sense_subsystem() const
+{
+	return function == kVoltage ? "SENSE:VOLTAGE:DC" : "SENSE:CURRENT:DC";
+}
+
+
+QString
+InstrumentSpec::aperture_command (double nplc) const
+{
+	return sense_subsystem() + ":NPLC " + QString::number (nplc);
+}
+
+
+Topology
+Topology::load (QString const& path)
+{
+	QFile file (path);
+
+	if (!file.open (QIODevice::ReadOnly))
+		throw Error ("couldn't open " + path.toStdString() + ": " + file.errorString().toStdString());
+
+	QJsonParseError error;
+	QJsonDocument json_doc = QJsonDocument::fromJson (file.readAll(), &error);
+
+	if (error.error != QJsonParseError::NoError)
+		throw Error (path.toStdString() + ": " + error.errorString().toStdString());
+
+	if (!json_doc.isObject())
+		throw Error (path.toStdString() + ": expected top-level object");
+
+	QJsonObject root = json_doc.object();
+	Topology result;
+	std::map<QString, std::size_t> instrument_indexes;
+
+	for (auto const& value: root.value ("instruments").toArray())
+	{
+		QJsonObject object = value.toObject();
+		InstrumentSpec instrument;
+		instrument.name = get_string (object, "name", "instrument");
+		QString context = "instrument '" + instrument.name + "'";
+
+		if (!instrument.address.setAddress (get_string (object, "address", context)))
+			throw Error (context.toStdString() + ": invalid address");
+
+		instrument.port = object.value ("port").toInt (instrument.port);
+
+		QString function = object.value ("function").toString ("voltage");
+
+		if (function == "voltage")
+			instrument.function = InstrumentSpec::kVoltage;
+		else if (function == "current")
+			instrument.function = InstrumentSpec::kCurrent;
+		else
+			throw Error (context.toStdString() + ": function must be 'voltage' or 'current'");
+
+		instrument.range = object.value ("range").toString (instrument.function == InstrumentSpec::kVoltage ? kDefaultVoltageRange : kDefaultCurrentRange);
+		instrument.hostname = object.value ("hostname").toString();
+		instrument.label = object.value ("label").toString (instrument.name);
+
+		if (instrument_indexes.count (instrument.name))
+			throw Error (context.toStdString() + ": duplicate name");
+
+		instrument_indexes[instrument.name] = result.instruments.size();
+		result.instruments.push_back (instrument);
+	}
+
+	auto find_instrument = [&](QJsonObject const& object, QString const& key, InstrumentSpec::Function function, QString const& context) {
+		QString name = get_string (object, key, context);
+		auto it = instrument_indexes.find (name);
+
+		if (it == instrument_indexes.end())
+			throw Error (context.toStdString() + ": unknown instrument '" + name.toStdString() + "'");
+
+		if (result.instruments[it->second].function != function)
+			throw Error (context.toStdString() + ": instrument '" + name.toStdString() + "' has wrong function for " + key.toStdString());
+
+		return it->second;
+	};
+
+	for (auto const& value: root.value ("channels").toArray())
+	{
+		QJsonObject object = value.toObject();
+		ChannelSpec channel;
+		channel.name = get_string (object, "name", "channel");
+		QString context = "channel '" + channel.name + "'";
+		channel.voltmeter = find_instrument (object, "voltmeter", InstrumentSpec::kVoltage, context);
+		channel.ammeter = find_instrument (object, "ammeter", InstrumentSpec::kCurrent, context);
+		channel.burden_resistance = object.value ("burden-resistance").toDouble (kTotalVoltmeterBurdenResitanceOhms);
+		channel.output_dir = object.value ("output").toString (QString (kDefaultOutputDir) + "." + channel.name);
+		result.channels.push_back (channel);
+	}
+
+	if (result.channels.empty())
+		throw Error (path.toStdString() + ": no channels defined");
+
+	return result;
+}
+
+
+Topology
+Topology::single_pair (QHostAddress const& voltmeter_address, uint16_t voltmeter_port,
+					   QHostAddress const& ammeter_address, uint16_t ammeter_port)
+{
+	InstrumentSpec voltmeter;
+	voltmeter.name = "voltmeter";
+	voltmeter.address = voltmeter_address;
+	voltmeter.port = voltmeter_port;
+	voltmeter.function = InstrumentSpec::kVoltage;
+	voltmeter.range = kDefaultVoltageRange;
+	voltmeter.hostname = "A-34461A-09358";
+	voltmeter.label = "Voltage";
+
+	InstrumentSpec ammeter;
+	ammeter.name = "ammeter";
+	ammeter.address = ammeter_address;
+	ammeter.port = ammeter_port;
+	ammeter.function = InstrumentSpec::kCurrent;
+	ammeter.range = kDefaultCurrentRange;
+	ammeter.hostname = "K-34461A-18230";
+	ammeter.label = "Current";
+
+	ChannelSpec channel;
+	channel.name = "main";
+	channel.voltmeter = 0;
+	channel.ammeter = 1;
+	channel.burden_resistance = kTotalVoltmeterBurdenResitanceOhms;
+	channel.output_dir = kDefaultOutputDir;
+
+	Topology result;
+	result.instruments = { voltmeter, ammeter };
+	result.channels = { channel };
+	return result;
+}
+
+
+Configuration
+Topology::configuration (InstrumentSpec const& instrument)
+{
+	typedef ConfigurationEntry E;
+
+	QString const sense = instrument.sense_subsystem();
+	QString const configure = instrument.function == InstrumentSpec::kVoltage ? "CONFIGURE:VOLTAGE:DC " : "CONFIGURE:CURRENT:DC ";
+
+	Configuration result {
+		{ E::kCommand,	"DISPLAY:TEXT \"Configuring for test...\"" },
+		{ E::kCommand,	"ABORT" },
+		{ E::kQuery,	"*IDN?" },
+		{ E::kVerify,	"SYSTEM:IDENTIFY?", kSystemIdentifier },
+		{ E::kVerify,	"UNIT:TEMP?", "C" },
+	};
+
+	if (!instrument.hostname.isEmpty())
+		result.push_back ({ E::kVerify, "SYSTEM:COMMUNICATE:LAN:HOSTNAME?", "\"" + instrument.hostname + "\"" });
+
+	result.insert (result.end(), {
+		{ E::kQuery,	"CALIBRATION:DATE?" },
+		{ E::kQuery,	"CALIBRATION:TIME?" },
+		{ E::kQuery,	"CALIBRATION:TEMPERATURE?" },
+		{ E::kCommand,	"SYSTEM:LABEL \"" + instrument.label + "\"" },
+		// Fixed range:
+		{ E::kCommand,	configure + instrument.range },
+		// Zeroing will be done manually every couple of samples by the script.
+		{ E::kCommand,	sense + ":ZERO:AUTO OFF" },
+		// Aperture:
+		{ E::kCommand,	instrument.aperture_command (kApertures[kDefaultAperture].nplc) },
+	});
+
+	// Impedance: 10 MΩ
+	if (instrument.function == InstrumentSpec::kVoltage)
+		result.push_back ({ E::kCommand, sense + ":IMPEDANCE:AUTO OFF" });
+
+	result.insert (result.end(), {
+		// Trigger: 1, auto-delay, internal trigger
+		{ E::kCommand,	"TRIGGER:COUNT 1" },
+		{ E::kCommand,	"TRIGGER:DELAY:AUTO ON" },
+		{ E::kCommand,	"TRIGGER:SOURCE IMMEDIATE" },
+		// Samples at a time:
+		{ E::kCommand,	"SAMPLE:COUNT 1" },
+		// All of the above must have been accepted:
+		{ E::kVerify,	"SYSTEM:ERROR?", kNoError },
+	});
+
+	return result;
+}
+
+} // namespace scpidev
+
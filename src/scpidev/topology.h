@@ -0,0 +1,144 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__TOPOLOGY_H__INCLUDED
+#define SCPIDEV__TOPOLOGY_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+// Qt:
+#include <QHostAddress>
+#include <QString>
+
+// SCPIDev:
+#include <scpidev/configuration.h>
+
+
+namespace scpidev {
+
+/**
+ * Single 34461A meter.
+ */
+class InstrumentSpec
+{
+  public:
+	enum Function
+	{
+		kVoltage,
+		kCurrent,
+	};
+
+  public:
+	QString			name;
+	QHostAddress	address;
+	uint16_t		port		= 5025;
+	Function		function	= kVoltage;
+	QString			range;
+	// Expected LAN hostname; not verified if empty:
+	QString			hostname;
+	QString			label;
+
+  public:
+	/**
+	 * Return SCPI subsystem of the measured function, eg. "SENSE:VOLTAGE:DC".
+	 */
+	QString
+	sense_subsystem() const;
+
+	/**
+	 * Return command setting integration time to given number of power line cycles.
+	 */
+	QString
+	aperture_command (double nplc) const;
+};
+
+
+/**
+ * Voltage/current meter pair measuring power of a single load.
+ * A meter may be shared by many channels (eg. one voltmeter for loads on a common rail).
+ */
+class ChannelSpec
+{
+  public:
+	QString			name;
+	// Indexes in Topology::instruments:
+	std::size_t		voltmeter			= 0;
+	std::size_t		ammeter				= 0;
+	double			burden_resistance	= 0.0;
+	QString			output_dir;
+};
+
+
+/**
+ * All instruments and channels of a rig.
+ *
+ * Configuration file format (JSON):
+ *
+ *   {
+ *     "instruments": [
+ *       { "name": "v1", "address": "11.0.0.100", "port": 5025, "function": "voltage", "range": "100",
+ *         "hostname": "A-34461A-09358", "label": "Voltage" },
+ *       { "name": "a1", "address": "11.0.0.101", "function": "current", "range": "10" }
+ *     ],
+ *     "channels": [
+ *       { "name": "main", "voltmeter": "v1", "ammeter": "a1", "burden-resistance": 0.025666, "output": "scpidev.log" }
+ *     ]
+ *   }
+ *
+ * Only "name" and "address" of instruments and "voltmeter" and "ammeter" of channels are mandatory.
+ */
+class Topology
+{
+  public:
+	class Error: public std::runtime_error
+	{
+	  public:
+		// Ctor:
+		Error (std::string const& message):
+			std::runtime_error ("topology: " + message)
+		{ }
+	};
+
+  public:
+	/**
+	 * Load topology from a JSON file.
+	 * Throw Error on failure.
+	 */
+	static Topology
+	load (QString const& path);
+
+	/**
+	 * The classic rig: a single voltmeter and a single ammeter.
+	 */
+	static Topology
+	single_pair (QHostAddress const& voltmeter_address, uint16_t voltmeter_port,
+				 QHostAddress const& ammeter_address, uint16_t ammeter_port);
+
+	/**
+	 * Return configuration table for given instrument.
+	 */
+	static Configuration
+	configuration (InstrumentSpec const&);
+
+  public:
+	std::vector<InstrumentSpec>	instruments;
+	std::vector<ChannelSpec>	channels;
+};
+
+} // namespace scpidev
+
+#endif
+
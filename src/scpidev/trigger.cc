@@ -0,0 +1,120 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+
+// Local:
+#include "trigger.h"
+
+
+namespace scpidev {
+
+Trigger::Condition
+Trigger::Condition::parse (QString const& string)
+{
+	QString const text = string.trimmed();
+	int const op = std::max (text.indexOf ('>'), text.indexOf ('<'));
+
+	if (op <= 0)
+		throw Error ("expected <quantity>'>'<threshold> or <quantity>'<'<threshold> in '" + string.toStdString() + "'");
+
+	Condition result;
+	QString quantity = text.left (op).trimmed();
+	result.kind = text[op] == '>' ? kAbove : kBelow;
+
+	if (quantity.startsWith ("d(") && quantity.endsWith (")"))
+	{
+		result.slope = true;
+		quantity = quantity.mid (2, quantity.size() - 3).trimmed();
+	}
+
+	if (quantity == "power")
+		result.field = &Sample::power_corrected;
+	else if (quantity == "current")
+		result.field = &Sample::current;
+	else
+		throw Error ("unknown quantity '" + quantity.toStdString() + "', expected 'power' or 'current'");
+
+	bool ok = false;
+	result.threshold = text.mid (op + 1).trimmed().toDouble (&ok);
+
+	if (!ok)
+		throw Error ("invalid threshold in '" + string.toStdString() + "'");
+
+	return result;
+}
+
+
+Trigger::Trigger (Condition const& condition, std::size_t burst_aperture, uint64_t burst_samples, uint64_t holdoff_samples):
+	_condition (condition),
+	_burst_aperture (burst_aperture),
+	_burst_samples (std::max<uint64_t> (1, burst_samples)),
+	_holdoff_samples (holdoff_samples)
+{ }
+
+
+void
+Trigger::update (Sample const& sample) noexcept
+{
+	// Evaluated on every sample, so that slope has a fresh previous value:
+	bool const matched = matches (sample);
+	bool next = false;
+
+	if (_remaining > 0)
+	{
+		next = true;
+		--_remaining;
+	}
+	else if (_in_flight || _fetched)
+	{
+		// Burst readings still coming back.
+	}
+	else if (_holdoff > 0)
+		--_holdoff;
+	else if (matched)
+	{
+		++_events;
+		next = true;
+		_remaining = _burst_samples - 1;
+		_holdoff = _holdoff_samples;
+	}
+
+	_fetched = _in_flight;
+	_in_flight = next;
+}
+
+
+bool
+Trigger::matches (Sample const& sample) noexcept
+{
+	double value = sample.*_condition.field;
+
+	if (_condition.slope)
+	{
+		double const current = value;
+		bool const valid = _has_previous && sample.dt > 0.0;
+		value = valid ? (current - _previous_value) / sample.dt : 0.0;
+		_previous_value = current;
+		_has_previous = true;
+
+		if (!valid)
+			return false;
+	}
+
+	return _condition.kind == Condition::kAbove ? value > _condition.threshold : value < _condition.threshold;
+}
+
+} // namespace scpidev
+
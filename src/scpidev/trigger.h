@@ -0,0 +1,158 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEV__TRIGGER_H__INCLUDED
+#define SCPIDEV__TRIGGER_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+// Qt:
+#include <QString>
+
+// SCPIDev:
+#include <scpidev/sample.h>
+#include <scpidev/stages.h>
+
+
+namespace scpidev {
+
+/**
+ * Decides when meters measure in burst mode (shorter aperture, higher sample rate).
+ *
+ * Runs on the measure thread. The loop initiates a reading before the previous one is processed,
+ * so a decision made from sample k applies to the reading initiated in the next iteration, and
+ * comes back as sample k + 2. Trigger tracks which readings were taken in burst mode, so that
+ * samples can be tagged with their event.
+ *
+ * After an event fires, meters stay in burst mode for burst_samples readings; then the condition
+ * is ignored for another holdoff_samples samples measured in normal mode.
+ */
+class Trigger
+{
+  public:
+	class Error: public std::runtime_error
+	{
+	  public:
+		// Ctor:
+		Error (std::string const& message):
+			std::runtime_error ("trigger: " + message)
+		{ }
+	};
+
+	class Condition
+	{
+	  public:
+		enum Kind
+		{
+			kAbove,
+			kBelow,
+		};
+
+	  public:
+		/**
+		 * Parse "<quantity><op><threshold>", where quantity is "power" (corrected power) or
+		 * "current", or "d(<quantity>)" for its rate of change per second, and op is '>' or '<'.
+		 * Eg. "power>5", "d(current)<-0.5".
+		 * Throw Error if the string doesn't parse.
+		 */
+		static Condition
+		parse (QString const&);
+
+	  public:
+		Field	field		= &Sample::power_corrected;
+		bool	slope		= false;
+		Kind	kind		= kAbove;
+		double	threshold	= 0.0;
+	};
+
+  public:
+	/**
+	 * \param	burst_aperture
+	 *			Index in kApertures of meters' aperture in burst mode.
+	 */
+	Trigger (Condition const&, std::size_t burst_aperture, uint64_t burst_samples, uint64_t holdoff_samples);
+
+	std::size_t
+	burst_aperture() const noexcept;
+
+	/**
+	 * Return true if the next INITIATE should measure in burst mode.
+	 */
+	bool
+	burst() const noexcept;
+
+	/**
+	 * Return event of the last fetched reading, 0 if it wasn't taken in burst mode.
+	 */
+	uint64_t
+	event() const noexcept;
+
+	/**
+	 * Evaluate condition on a sample computed from the last fetched reading and decide the mode
+	 * for the next INITIATE. Must be called once per iteration, after this iteration's INITIATE.
+	 */
+	void
+	update (Sample const&) noexcept;
+
+  private:
+	/**
+	 * Return true if the condition holds for the sample.
+	 */
+	bool
+	matches (Sample const&) noexcept;
+
+  private:
+	Condition	_condition;
+	std::size_t	_burst_aperture;
+	uint64_t	_burst_samples;
+	uint64_t	_holdoff_samples;
+	uint64_t	_events				= 0;
+	// Burst readings yet to be initiated:
+	uint64_t	_remaining			= 0;
+	uint64_t	_holdoff			= 0;
+	// Mode of the reading initiated last, and of the one initiated before it:
+	bool		_in_flight			= false;
+	bool		_fetched			= false;
+	// For slope conditions:
+	bool		_has_previous		= false;
+	double		_previous_value		= 0.0;
+};
+
+
+inline std::size_t
+Trigger::burst_aperture() const noexcept
+{
+	return _burst_aperture;
+}
+
+
+inline bool
+Trigger::burst() const noexcept
+{
+	return _in_flight;
+}
+
+
+inline uint64_t
+Trigger::event() const noexcept
+{
+	return _fetched ? _events : 0;
+}
+
+} // namespace scpidev
+
+#endif
+
@@ -14,76 +14,20 @@
 #ifndef SCPIDEV__UTILS_H__INCLUDED
 #define SCPIDEV__UTILS_H__INCLUDED
 
-// Standard:
-#include <cstddef>
-#include <iostream>
-
-// Boost:
-#include <boost/format.hpp>
-
-// Qt:
-#include <QDateTime>
+// SCPIDev:
+#include <scpidev/clock.h>
 
 
 namespace scpidev {
 
-inline void
-verify (SCPIDevice& scpi_device, QString const& command, QString const& expected_result)
-{
-	auto actual_result = scpi_device.ask (command);
-	if (actual_result != expected_result)
-		std::cerr << "Failed to verify " << command.toStdString() << " is " << expected_result.toStdString() << ", result is " << actual_result.toStdString() << std::endl;
-}
-
-
-inline QString
-important (QString const& str)
-{
-	return "\x1B[1;39;44m" + str + "\x1B[0m";
-}
-
-
-inline QString
-erroneous (QString const& str)
-{
-	return "\x1B[1;39;41m" + str + "\x1B[0m";
-}
-
-
-template<class Value>
-	inline QString
-	green (QString const& format, Value&& value)
-	{
-		return QString::fromStdString ("\x1B[0;32;49m" + (boost::format (format.toStdString()) % value).str() + "\x1B[0m");
-	}
-
-
-template<class Value>
-	inline QString
-	bold (QString const& format, Value&& value)
-	{
-		return QString::fromStdString ("\x1B[1;39;49m" + (boost::format (format.toStdString()) % value).str() + "\x1B[0m");
-	}
-
-
-double
-now()
-{
-	return QDateTime::currentMSecsSinceEpoch() / 1000.0;
-}
-
-
-QString
-hs (double value)
-{
-	return QString::fromStdString ((boost::format ("%+11.6f") % value).str());
-}
-
-
-QString
-ls (double value)
+/**
+ * Process-wide clock, anchored to wall time on first use.
+ */
+inline Clock const&
+wall_clock()
 {
-	return QString::fromStdString ((boost::format ("%+8.3f") % value).str());
+	static Clock clock;
+	return clock;
 }
 
 } // namespace scpidev
@@ -0,0 +1,323 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <cstring>
+#include <functional>
+
+// Qt:
+#include <QtEndian>
+
+// Local:
+#include "binary_protocol.h"
+
+
+constexpr char BinaryProtocol::kMagic[];
+
+constexpr BinaryProtocol::Connections::Limits kConnectionLimits {
+	kMaxConnections,					// max_connections
+	BinaryProtocol::kMaxFrameSize + 4,	// max_input_size (largest frame)
+	1024 * 1024,						// max_output_backlog
+	kIdleTimeout,						// idle_timeout
+};
+
+
+namespace {
+
+/**
+ * Sequential little-endian reader over request payload.
+ */
+class PayloadReader
+{
+  public:
+	explicit
+	PayloadReader (QByteArray const& payload):
+		_payload (payload)
+	{ }
+
+	uint8_t
+	read_u8()
+	{
+		require (1);
+		return static_cast<uint8_t> (_payload[_position++]);
+	}
+
+	double
+	read_double()
+	{
+		require (sizeof (uint64_t));
+		auto bits = qFromLittleEndian<quint64> (reinterpret_cast<uchar const*> (_payload.constData() + _position));
+		_position += sizeof (uint64_t);
+
+		double result;
+		std::memcpy (&result, &bits, sizeof (result));
+		return result;
+	}
+
+	void
+	expect_end() const
+	{
+		if (_position != _payload.size())
+			throw BinaryProtocol::InvalidFrame ("trailing bytes in request");
+	}
+
+  private:
+	void
+	require (int bytes) const
+	{
+		if (_position + bytes > _payload.size())
+			throw BinaryProtocol::InvalidFrame ("request too short");
+	}
+
+  private:
+	QByteArray const&	_payload;
+	int					_position	= 0;
+};
+
+
+void
+append_u8 (QByteArray& output, uint8_t value)
+{
+	output.append (static_cast<char> (value));
+}
+
+
+void
+append_u32 (QByteArray& output, uint32_t value)
+{
+	uchar bytes[sizeof (value)];
+	qToLittleEndian<quint32> (value, bytes);
+	output.append (reinterpret_cast<char const*> (bytes), sizeof (bytes));
+}
+
+
+void
+append_u64 (QByteArray& output, uint64_t value)
+{
+	uchar bytes[sizeof (value)];
+	qToLittleEndian<quint64> (value, bytes);
+	output.append (reinterpret_cast<char const*> (bytes), sizeof (bytes));
+}
+
+
+void
+append_double (QByteArray& output, double value)
+{
+	quint64 bits;
+	std::memcpy (&bits, &value, sizeof (bits));
+	uchar bytes[sizeof (bits)];
+	qToLittleEndian<quint64> (bits, bytes);
+	output.append (reinterpret_cast<char const*> (bytes), sizeof (bytes));
+}
+
+
+/**
+ * Append a frame header and payload to output.
+ */
+void
+append_frame (QByteArray& output, QByteArray const& payload)
+{
+	append_u32 (output, payload.size());
+	output.append (payload);
+}
+
+} // namespace
+
+
+BinaryProtocol::BinaryProtocol (RequestsHandler& requests_handler, Metrics& metrics):
+	_requests_handler (requests_handler),
+	_metrics (metrics),
+	_connections (kConnectionLimits, metrics, std::bind (&BinaryProtocol::handle_input, this, std::placeholders::_1))
+{
+}
+
+
+bool
+BinaryProtocol::matches_greeting (QByteArray const& initial_data)
+{
+	auto n = std::min<std::size_t> (initial_data.size(), kMagicSize);
+	return std::memcmp (initial_data.constData(), kMagic, n) == 0;
+}
+
+
+void
+BinaryProtocol::new_connection (QTcpSocket* socket)
+{
+	_connections.add (socket);
+}
+
+
+void
+BinaryProtocol::handle_input (Connections::Connection& connection)
+{
+	auto& input = connection.input;
+	int p = 0;
+
+	try {
+		if (!connection.state.greeted)
+		{
+			if (input.size() < static_cast<int> (kMagicSize + 1))
+				return;
+
+			if (!matches_greeting (input))
+				throw InvalidFrame ("bad greeting");
+
+			if (static_cast<uint8_t> (input[kMagicSize]) != kVersion)
+				throw InvalidFrame ("unsupported protocol version");
+
+			connection.output.append (kMagic, kMagicSize);
+			append_u8 (connection.output, kVersion);
+			connection.state.greeted = true;
+			p = kMagicSize + 1;
+		}
+
+		// Stop at the backlog limit, the rest is handled once the client picks up responses:
+		while (!connection.output_full() && input.size() - p >= static_cast<int> (sizeof (uint32_t)))
+		{
+			auto length = qFromLittleEndian<quint32> (reinterpret_cast<uchar const*> (input.constData() + p));
+
+			if (length > kMaxFrameSize)
+				throw InvalidFrame ("frame too large");
+
+			if (input.size() - p - static_cast<int> (sizeof (uint32_t)) < static_cast<int> (length))
+				break;
+
+			handle_frame (QByteArray::fromRawData (input.constData() + p + sizeof (uint32_t), length), connection.output);
+			p += sizeof (uint32_t) + length;
+		}
+	}
+	catch (InvalidFrame const&)
+	{
+		// Framing is lost, there's no way to recover:
+		connection.close_requested = true;
+		return;
+	}
+
+	input.remove (0, p);
+}
+
+
+void
+BinaryProtocol::handle_frame (QByteArray const& payload, QByteArray& output)
+{
+	Metrics::RequestTimer timer (_metrics);
+	Metrics::RequestType request_type = Metrics::kInvalid;
+	QByteArray response;
+	QString error_message;
+
+	try {
+		PayloadReader reader (payload);
+
+		switch (reader.read_u8())
+		{
+			case kRequestGet:
+			{
+				RequestsHandler::Request request;
+				request.timestamp = reader.read_double();
+				reader.expect_end();
+				timer.parsed();
+				request_type = Metrics::kGet;
+
+				RequestsHandler::Response result = _requests_handler.handle_request (request);
+				timer.handled();
+
+				append_u8 (response, kStatusResult);
+				append_double (response, result.previous_sample_dt);
+				append_double (response, result.next_sample_dt);
+				append_double (response, result.sample_timestamp);
+				append_double (response, result.energy_J);
+				break;
+			}
+
+			case kRequestAggregate:
+			{
+				RequestsHandler::AggregateRequest request;
+				request.start_timestamp = reader.read_double();
+				request.end_timestamp = reader.read_double();
+				reader.expect_end();
+				timer.parsed();
+				request_type = Metrics::kAggregate;
+
+				RequestsHandler::AggregateResponse result = _requests_handler.handle_request (request);
+				timer.handled();
+
+				append_u8 (response, kStatusResult);
+				append_double (response, result.start_timestamp);
+				append_double (response, result.end_timestamp);
+				append_u64 (response, result.samples);
+				append_double (response, result.energy_J);
+				append_double (response, result.mean_power_W);
+				append_double (response, result.min_power_W);
+				append_double (response, result.max_power_W);
+				break;
+			}
+
+			case kRequestQuantiles:
+			{
+				RequestsHandler::QuantilesRequest request;
+				request.start_timestamp = reader.read_double();
+				request.end_timestamp = reader.read_double();
+				request.quantiles.resize (reader.read_u8());
+				for (auto& q: request.quantiles)
+					q = reader.read_double();
+				reader.expect_end();
+				timer.parsed();
+				request_type = Metrics::kQuantiles;
+
+				RequestsHandler::QuantilesResponse result = _requests_handler.handle_request (request);
+				timer.handled();
+
+				append_u8 (response, kStatusResult);
+				append_double (response, result.start_timestamp);
+				append_double (response, result.end_timestamp);
+				append_u64 (response, result.samples);
+				append_u8 (response, result.power_W.size());
+				for (double value: result.power_W)
+					append_double (response, value);
+				break;
+			}
+
+			default:
+				throw QString ("unknown request type");
+		}
+	}
+	catch (QString const& message)
+	{
+		error_message = message;
+	}
+	catch (std::exception const& e)
+	{
+		error_message = e.what();
+	}
+	catch (...)
+	{
+		error_message = "unknown exception occured";
+	}
+
+	if (!error_message.isEmpty())
+	{
+		timer.failed();
+		_metrics.errors.fetch_add (1, std::memory_order_relaxed);
+
+		auto utf8_message = error_message.toUtf8();
+		response.clear();
+		append_u8 (response, kStatusError);
+		append_u32 (response, utf8_message.size());
+		response.append (utf8_message);
+	}
+
+	append_frame (output, response);
+	timer.finish (request_type);
+}
+
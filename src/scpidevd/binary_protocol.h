@@ -0,0 +1,128 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEVD__BINARY_PROTOCOL_H__INCLUDED
+#define SCPIDEVD__BINARY_PROTOCOL_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+// Qt:
+#include <QByteArray>
+#include <QTcpSocket>
+
+// Local:
+#include "connection_pool.h"
+#include "metrics.h"
+#include "requests_handler.h"
+
+
+/**
+ * Length-prefixed binary protocol.
+ *
+ * Client starts the session by sending kMagic followed by a single byte with the protocol version.
+ * Server acknowledges with the same five bytes. After that every message in both directions is
+ * a frame: 32-bit little-endian payload length followed by the payload.
+ *
+ * Request payload: uint8 request type, followed by request fields.
+ * Response payload: uint8 status (kStatusResult or kStatusError), followed by result fields or,
+ * for errors, a 32-bit length and UTF-8 message.
+ *
+ * All integers and IEEE-754 doubles are little-endian.
+ */
+class BinaryProtocol
+{
+  public:
+	static constexpr char		kMagic[]			= "SCPB";
+	static constexpr std::size_t kMagicSize			= 4;
+	static constexpr uint8_t	kVersion			= 1;
+	static constexpr uint32_t	kMaxFrameSize		= 64 * 1024;
+
+	enum RequestType: uint8_t
+	{
+		// Fields: double timestamp.
+		// Result: double previous_sample_dt, double next_sample_dt, double sample_timestamp, double energy_J.
+		kRequestGet			= 1,
+		// Fields: double start_timestamp, double end_timestamp.
+		// Result: double start_timestamp, double end_timestamp, uint64 samples, double energy_J,
+		// double mean_power_W, double min_power_W, double max_power_W.
+		kRequestAggregate	= 2,
+		// Fields: double start_timestamp, double end_timestamp, uint8 count, count × double quantile.
+		// Result: double start_timestamp, double end_timestamp, uint64 samples, uint8 count, count × double power_W.
+		kRequestQuantiles	= 3,
+	};
+
+	enum Status: uint8_t
+	{
+		kStatusResult		= 0,
+		kStatusError		= 1,
+	};
+
+	class InvalidFrame: public std::runtime_error
+	{
+	  public:
+		// Ctor:
+		InvalidFrame (std::string const& reason):
+			std::runtime_error ("invalid frame: " + reason)
+		{ }
+	};
+
+	class ConnectionState
+	{
+	  public:
+		bool greeted = false;
+	};
+
+	typedef ConnectionPool<ConnectionState> Connections;
+
+  public:
+	// Ctor:
+	BinaryProtocol (RequestsHandler&, Metrics&);
+
+	/**
+	 * Return true if given initial bytes of a connection start the binary protocol greeting.
+	 * If there's not enough data to decide, return true if data so far matches.
+	 */
+	static bool
+	matches_greeting (QByteArray const& initial_data);
+
+	/**
+	 * Add new connection.
+	 * This object takes ownership of the socket argument.
+	 */
+	void
+	new_connection (QTcpSocket* socket);
+
+  private:
+	/**
+	 * Handle greeting and all complete frames in connection's input buffer.
+	 */
+	void
+	handle_input (Connections::Connection&);
+
+	/**
+	 * Decode single request payload and append response frame to the output buffer.
+	 */
+	void
+	handle_frame (QByteArray const& payload, QByteArray& output);
+
+  private:
+	RequestsHandler&				_requests_handler;
+	Metrics&						_metrics;
+	Connections						_connections;
+};
+
+#endif
+
@@ -0,0 +1,178 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEVD__CONNECTION_POOL_H__INCLUDED
+#define SCPIDEVD__CONNECTION_POOL_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+// Qt:
+#include <QByteArray>
+#include <QTcpSocket>
+#include <QTimer>
+
+// Local:
+#include "metrics.h"
+
+
+// Limits of client connections, shared by all protocols and by protocol negotiation:
+constexpr std::size_t kMaxConnections = 1024;
+constexpr std::chrono::seconds kIdleTimeout { 60 };
+
+
+/**
+ * Fixed-size pool of client connections with bounded buffers.
+ *
+ * Connection slots live in a flat vector allocated once, and their buffers keep
+ * their initial capacity when a slot is reused, so memory stays flat no matter
+ * how many short-lived clients come and go. Sockets are released as soon as
+ * they disconnect; connections idle for too long are closed.
+ *
+ * \param	pState
+ *			Protocol-specific per-connection state. Reset to default-constructed
+ *			value for each new connection.
+ */
+template<class pState>
+	class ConnectionPool
+	{
+	  public:
+		typedef pState State;
+
+		class Limits
+		{
+		  public:
+			std::size_t					max_connections;
+			// Max unprocessed input (partial request) per connection:
+			std::size_t					max_input_size;
+			// Max response bytes waiting to be sent per connection;
+			// handling of requests is suspended at this:
+			std::size_t					max_output_backlog;
+			std::chrono::milliseconds	idle_timeout;
+		};
+
+		class Connection
+		{
+		  public:
+			QTcpSocket*	socket			= nullptr;
+			// Incremented every time the slot is reused:
+			uint32_t	generation		= 0;
+			std::chrono::steady_clock::time_point
+						last_activity;
+			QByteArray	input;
+			QByteArray	output;
+			// Set by input handler on unrecoverable protocol errors:
+			bool		close_requested	= false;
+			// Reading suspended due to output backlog:
+			bool		suspended		= false;
+			State		state;
+			std::size_t	max_output_backlog	= 0;
+
+		  public:
+			/**
+			 * Return true if responses waiting to be sent reached the backlog limit.
+			 */
+			bool
+			output_full() const;
+		};
+
+		/**
+		 * Called when connection.input may hold complete requests.
+		 * Should consume complete requests from input and append responses to output,
+		 * checking output_full() before each one and leaving the rest in input once it's true.
+		 */
+		typedef std::function<void (Connection&)> InputHandler;
+
+	  public:
+		// Ctor
+		ConnectionPool (Limits const&, Metrics&, InputHandler);
+
+		// Dtor
+		~ConnectionPool();
+
+		/**
+		 * Take ownership of the socket and start serving it.
+		 * If the pool is full, the socket is closed and false is returned.
+		 */
+		bool
+		add (QTcpSocket* socket);
+
+		/**
+		 * Number of connections being served.
+		 */
+		std::size_t
+		size() const noexcept;
+
+	  private:
+		/**
+		 * Run input handler on buffered input.
+		 */
+		void
+		handle_input (Connection&);
+
+		/**
+		 * Move as much of the output buffer to the socket as its write buffer allows.
+		 */
+		void
+		write_output (Connection&);
+
+		void
+		handle_ready_read (std::size_t slot, uint32_t generation);
+
+		void
+		handle_bytes_written (std::size_t slot, uint32_t generation);
+
+		void
+		handle_disconnected (std::size_t slot, uint32_t generation);
+
+		/**
+		 * Abort connection and release its slot.
+		 */
+		void
+		close (std::size_t slot, uint32_t generation);
+
+		/**
+		 * Return connection if it's still the one identified by generation, or nullptr.
+		 */
+		Connection*
+		connection (std::size_t slot, uint32_t generation);
+
+		/**
+		 * Return bytes waiting to be sent, both in output buffer and in socket.
+		 */
+		static int64_t
+		output_backlog (Connection const&);
+
+		void
+		release (Connection&);
+
+		void
+		reap_idle_connections();
+
+	  private:
+		Limits						_limits;
+		Metrics&					_metrics;
+		InputHandler				_input_handler;
+		std::vector<Connection>		_connections;
+		std::vector<std::size_t>	_free_slots;
+		QTimer						_idle_timer;
+	};
+
+#endif
+
+#include "connection_pool.tcc"
+
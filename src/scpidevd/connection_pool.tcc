@@ -0,0 +1,311 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEVD__CONNECTION_POOL_TCC__INCLUDED
+#define SCPIDEVD__CONNECTION_POOL_TCC__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+
+
+// Initial capacity of per-connection buffers:
+constexpr int kConnectionBufferReserve = 512;
+// Max bytes handed over to the socket's own write buffer at a time:
+constexpr int64_t kSocketWriteChunk = 64 * 1024;
+
+
+template<class S>
+	inline
+	ConnectionPool<S>::ConnectionPool (Limits const& limits, Metrics& metrics, InputHandler input_handler):
+		_limits (limits),
+		_metrics (metrics),
+		_input_handler (input_handler),
+		_connections (limits.max_connections)
+	{
+		_free_slots.reserve (_connections.size());
+
+		for (std::size_t slot = _connections.size(); slot > 0; --slot)
+		{
+			auto& connection = _connections[slot - 1];
+			connection.input.reserve (kConnectionBufferReserve);
+			connection.output.reserve (kConnectionBufferReserve);
+			connection.max_output_backlog = limits.max_output_backlog;
+			_free_slots.push_back (slot - 1);
+		}
+
+		_idle_timer.setInterval (std::max<int> (_limits.idle_timeout.count() / 4, 100));
+		QObject::connect (&_idle_timer, &QTimer::timeout, [this] { reap_idle_connections(); });
+		_idle_timer.start();
+	}
+
+
+template<class S>
+	inline
+	ConnectionPool<S>::~ConnectionPool()
+	{
+		for (auto& connection: _connections)
+		{
+			if (connection.socket)
+			{
+				// Disconnect signals first, they refer to this object:
+				connection.socket->disconnect();
+				delete connection.socket;
+			}
+		}
+	}
+
+
+template<class S>
+	inline bool
+	ConnectionPool<S>::add (QTcpSocket* socket)
+	{
+		if (_free_slots.empty())
+		{
+			socket->abort();
+			socket->deleteLater();
+			return false;
+		}
+
+		std::size_t slot = _free_slots.back();
+		_free_slots.pop_back();
+
+		auto& connection = _connections[slot];
+		auto generation = ++connection.generation;
+		connection.socket = socket;
+		connection.last_activity = std::chrono::steady_clock::now();
+		connection.close_requested = false;
+		connection.suspended = false;
+		connection.state = State();
+		_metrics.connections.fetch_add (1, std::memory_order_relaxed);
+
+		// Let the kernel apply backpressure instead of buffering unbounded input in Qt:
+		socket->setReadBufferSize (_limits.max_input_size);
+
+		QObject::connect (socket, &QTcpSocket::readyRead, [this, slot, generation] {
+			handle_ready_read (slot, generation);
+		});
+		QObject::connect (socket, &QTcpSocket::bytesWritten, [this, slot, generation] {
+			handle_bytes_written (slot, generation);
+		});
+		QObject::connect (socket, &QTcpSocket::disconnected, [this, slot, generation] {
+			handle_disconnected (slot, generation);
+		});
+
+		// Data might have already arrived during protocol negotiation:
+		if (socket->bytesAvailable() > 0)
+			handle_ready_read (slot, generation);
+
+		return true;
+	}
+
+
+template<class S>
+	inline bool
+	ConnectionPool<S>::Connection::output_full() const
+	{
+		return output_backlog (*this) >= static_cast<int64_t> (max_output_backlog);
+	}
+
+
+template<class S>
+	inline void
+	ConnectionPool<S>::handle_input (Connection& connection)
+	{
+		auto const output_size = connection.output.size();
+		_input_handler (connection);
+		_metrics.output_backlog.fetch_add (connection.output.size() - output_size, std::memory_order_relaxed);
+	}
+
+
+template<class S>
+	inline void
+	ConnectionPool<S>::write_output (Connection& connection)
+	{
+		if (connection.output.isEmpty())
+			return;
+
+		int64_t room = kSocketWriteChunk - connection.socket->bytesToWrite();
+
+		if (room > 0)
+		{
+			auto n = connection.socket->write (connection.output.constData(), std::min<int64_t> (room, connection.output.size()));
+			if (n > 0)
+			{
+				connection.output.remove (0, n);
+				_metrics.bytes_out.fetch_add (n, std::memory_order_relaxed);
+				_metrics.output_backlog.fetch_sub (n, std::memory_order_relaxed);
+			}
+		}
+	}
+
+
+template<class S>
+	inline std::size_t
+	ConnectionPool<S>::size() const noexcept
+	{
+		return _connections.size() - _free_slots.size();
+	}
+
+
+template<class S>
+	inline void
+	ConnectionPool<S>::handle_ready_read (std::size_t slot, uint32_t generation)
+	{
+		auto* connection = this->connection (slot, generation);
+
+		if (!connection)
+			return;
+
+		// Requests left in input when the backlog limit was reached go first:
+		handle_input (*connection);
+
+		// Read more only below the limit; until the client picks up responses, unread data
+		// stays in socket buffers:
+		if (!connection->output_full() && !connection->close_requested && connection->socket->bytesAvailable() > 0)
+		{
+			auto const input_size = connection->input.size();
+			connection->last_activity = std::chrono::steady_clock::now();
+			connection->input += connection->socket->readAll();
+			_metrics.bytes_in.fetch_add (connection->input.size() - input_size, std::memory_order_relaxed);
+
+			handle_input (*connection);
+		}
+
+		bool const suspend = connection->output_full();
+
+		if (suspend != connection->suspended)
+		{
+			connection->suspended = suspend;
+			_metrics.suspended_connections.fetch_add (suspend ? 1 : -1, std::memory_order_relaxed);
+		}
+
+		if (connection->close_requested || connection->input.size() > static_cast<int> (_limits.max_input_size))
+		{
+			close (slot, generation);
+			return;
+		}
+
+		write_output (*connection);
+	}
+
+
+template<class S>
+	inline void
+	ConnectionPool<S>::handle_bytes_written (std::size_t slot, uint32_t generation)
+	{
+		auto* connection = this->connection (slot, generation);
+
+		if (!connection)
+			return;
+
+		connection->last_activity = std::chrono::steady_clock::now();
+		write_output (*connection);
+
+		// Resume handling requests if it was suspended:
+		if (connection->suspended || connection->socket->bytesAvailable() > 0)
+			handle_ready_read (slot, generation);
+	}
+
+
+template<class S>
+	inline void
+	ConnectionPool<S>::handle_disconnected (std::size_t slot, uint32_t generation)
+	{
+		if (auto* connection = this->connection (slot, generation))
+		{
+			release (*connection);
+			_free_slots.push_back (slot);
+		}
+	}
+
+
+template<class S>
+	inline void
+	ConnectionPool<S>::close (std::size_t slot, uint32_t generation)
+	{
+		if (auto* connection = this->connection (slot, generation))
+		{
+			connection->socket->abort();
+			// Does nothing if abort() has already emitted disconnected():
+			handle_disconnected (slot, generation);
+		}
+	}
+
+
+template<class S>
+	inline typename ConnectionPool<S>::Connection*
+	ConnectionPool<S>::connection (std::size_t slot, uint32_t generation)
+	{
+		auto& connection = _connections[slot];
+
+		if (connection.generation != generation || !connection.socket)
+			return nullptr;
+
+		return &connection;
+	}
+
+
+template<class S>
+	inline int64_t
+	ConnectionPool<S>::output_backlog (Connection const& connection)
+	{
+		return connection.output.size() + connection.socket->bytesToWrite();
+	}
+
+
+template<class S>
+	inline void
+	ConnectionPool<S>::release (Connection& connection)
+	{
+		// Socket is deleted from the event loop, we may be inside its signal handler:
+		connection.socket->disconnect();
+		connection.socket->deleteLater();
+		connection.socket = nullptr;
+
+		_metrics.connections.fetch_sub (1, std::memory_order_relaxed);
+		_metrics.output_backlog.fetch_sub (connection.output.size(), std::memory_order_relaxed);
+		if (connection.suspended)
+			_metrics.suspended_connections.fetch_sub (1, std::memory_order_relaxed);
+
+		// Keep the initial capacity, but don't hold on to buffers grown by a big client:
+		for (QByteArray* buffer: { &connection.input, &connection.output })
+		{
+			if (buffer->capacity() > 4 * kConnectionBufferReserve)
+			{
+				buffer->clear();
+				buffer->reserve (kConnectionBufferReserve);
+			}
+			else
+				buffer->resize (0);
+		}
+	}
+
+
+template<class S>
+	inline void
+	ConnectionPool<S>::reap_idle_connections()
+	{
+		auto const now = std::chrono::steady_clock::now();
+
+		for (std::size_t slot = 0; slot < _connections.size(); ++slot)
+		{
+			auto const& connection = _connections[slot];
+
+			if (connection.socket && now - connection.last_activity > _limits.idle_timeout)
+				close (slot, connection.generation);
+		}
+	}
+
+#endif
+
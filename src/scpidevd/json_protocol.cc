@@ -13,165 +13,312 @@
 
 // Standard:
 #include <cstddef>
-#include <iostream> // XXX
 #include <functional>
 
 // Qt:
 #include <QTcpSocket>
 #include <QJsonParseError>
 #include <QJsonDocument>
+#include <QJsonArray>
 #include <QJsonObject>
 
 // Local:
 #include "json_protocol.h"
 
 
-JSONProtocol::JSONProtocol (RequestsHandler& requests_handler):
-	_requests_handler (requests_handler)
-{
-}
+constexpr JSONProtocol::Connections::Limits kConnectionLimits {
+	kMaxConnections,					// max_connections
+	64 * 1024,							// max_input_size (max request line length)
+	1024 * 1024,						// max_output_backlog
+	kIdleTimeout,						// idle_timeout
+};
 
 
-JSONProtocol::~JSONProtocol()
+JSONProtocol::JSONProtocol (RequestsHandler& requests_handler, Metrics& metrics):
+	_requests_handler (requests_handler),
+	_metrics (metrics),
+	_connections (kConnectionLimits, metrics, std::bind (&JSONProtocol::handle_request, this, std::placeholders::_1))
 {
-	// Delete all sockets to disconnect signals:
-	for (auto& pair: _buffers)
-		delete pair.first;
 }
 
 
 void
 JSONProtocol::new_connection (QTcpSocket* socket)
 {
-	auto& buffers = _buffers[socket];
-	buffers.input.reserve (100);
-	buffers.output.reserve (300);
-
-	QObject::connect (socket, &QTcpSocket::readyRead, std::bind (&JSONProtocol::handle_request, this, std::ref (*socket), std::ref (buffers)));
-	QObject::connect (socket, &QTcpSocket::bytesWritten, std::bind (&JSONProtocol::write_output, this, std::ref (*socket), std::ref (buffers), std::placeholders::_1));
-	QObject::connect (socket, &QTcpSocket::aboutToClose, std::bind (&JSONProtocol::delete_connection, this, std::ref (*socket)));
+	_connections.add (socket);
 }
 
 
 void
-JSONProtocol::handle_request (QTcpSocket& socket, Buffers& buffers)
+JSONProtocol::handle_request (Connections::Connection& connection)
 {
 	// All newline and percent characters are %-encoded (newline is %0a, '%' is "%25").
 	// All other characters may be %-encoded.
 	// Newline literal (0xa, \n) separates requests.
 	// Same rules apply for responses from server.
 
-	buffers.input += socket.readAll();
-
 	int p = 0;
 	int n = 0;
 
-	for (; (n = buffers.input.indexOf ('\n', p)) != -1; p = n + 1)
+	// Stop at the backlog limit, the rest is handled once the client picks up responses:
+	for (; !connection.output_full() && (n = connection.input.indexOf ('\n', p)) != -1; p = n + 1)
 	{
-		QString request_str = buffers.input.mid (p, n - p - 1);
-		percent_decode (request_str);
+		int line_end = n;
 
-		QString error_message;
+		// Accept CRLF line endings as well:
+		if (line_end > p && connection.input[line_end - 1] == '\r')
+			--line_end;
 
-		try {
-			QJsonParseError error;
-			// Try to read a valid JSON:
-			QJsonDocument json_doc = QJsonDocument::fromJson (request_str.toUtf8(), &error);
-
-			if (error.error != QJsonParseError::NoError)
-				throw "parse error: " + error.errorString();
-
-			RequestsHandler::Request request;
+		connection.output += handle_line (connection.input.constData() + p, line_end - p);
+		connection.output += '\n';
+	}
 
-			// Process JSON:
-			// Format: { get: { timestamp: xxx } }
-			if (!json_doc.isObject())
-				throw QString ("expected top-level object");
+	connection.input.remove (0, p);
+}
 
-			QJsonObject json_obj = json_doc.object();
-			auto it_get = json_obj.find ("get");
 
-			if (it_get == json_obj.end())
-				throw QString ("invalid request (missing 'get')");
+QByteArray
+JSONProtocol::handle_line (char const* data, int size)
+{
+	Metrics::RequestTimer timer (_metrics);
+	Metrics::RequestType request_type = Metrics::kInvalid;
+	QString request_str = QString::fromLatin1 (data, size);
+	QJsonObject response_json_object;
+	QString error_message;
 
-			if (!it_get.value().isObject())
-				throw QString ("invalid request ('get' is not object)");
+	try {
+		percent_decode (request_str);
 
-			QJsonObject inner_obj = it_get.value().toObject();
-			auto it_timestamp = inner_obj.find ("timestamp");
+		QJsonParseError error;
+		// Try to read a valid JSON:
+		QJsonDocument json_doc = QJsonDocument::fromJson (request_str.toLatin1(), &error);
 
-			if (it_timestamp == inner_obj.end())
-				throw QString ("invalid request (missing 'timestamp')");
+		if (error.error != QJsonParseError::NoError)
+			throw "parse error: " + error.errorString();
 
-			if (!it_timestamp.value().isDouble())
-				throw QString ("invalid request ('timestamp' is not numeric)");
+		// Process JSON:
+		// Format: { <request-type>: { … } }
+		if (!json_doc.isObject())
+			throw QString ("expected top-level object");
 
-			request.timestamp = it_timestamp.value().toDouble();
-			RequestsHandler::Response response = _requests_handler.handle_request (request);
+		QJsonObject json_obj = json_doc.object();
+		QJsonObject result;
 
-			QJsonObject result_json_object {
-				{ "result", QJsonObject {
-					{ "previous-sample-dt", response.previous_sample_dt },
-					{ "next-sample-dt", response.next_sample_dt },
-					{ "interpolated-sample", QJsonObject {
-						{ "timestamp", response.sample_timestamp },
-						{ "energy.J", response.energy_J },
-					} }
-				} }
-			};
+		timer.parsed();
 
-			buffers.output += QJsonDocument (result_json_object).toJson (QJsonDocument::Compact);
-		}
-		catch (QString const& message)
+		if (json_obj.contains ("get"))
 		{
-			error_message = message;
+			request_type = Metrics::kGet;
+			result = handle_get (get_object (json_obj, "get"));
 		}
-		catch (std::exception const& e)
+		else if (json_obj.contains ("aggregate"))
 		{
-			error_message = e.what();
+			request_type = Metrics::kAggregate;
+			result = handle_aggregate (get_object (json_obj, "aggregate"));
 		}
-		catch (...)
+		else if (json_obj.contains ("quantiles"))
 		{
-			error_message = "unknown exception occured";
+			request_type = Metrics::kQuantiles;
+			result = handle_quantiles (get_object (json_obj, "quantiles"));
 		}
-
-		if (!error_message.isEmpty())
+		else if (json_obj.contains ("stats"))
 		{
-			// { error: { message: "" } }
-			QJsonObject result_json_object {
-				{ "error", QJsonObject {
-					{ "message", error_message }
-				} }
-			};
-			buffers.output += QJsonDocument (result_json_object).toJson (QJsonDocument::Compact);
+			request_type = Metrics::kStats;
+			result = handle_stats (get_object (json_obj, "stats"));
 		}
+		else
+			throw QString ("invalid request (missing 'get', 'aggregate', 'quantiles' or 'stats')");
+
+		timer.handled();
 
-		// Initiate writing of output buffers:
-		write_output (socket, buffers);
+		response_json_object = QJsonObject {
+			{ "result", result }
+		};
+	}
+	catch (QString const& message)
+	{
+		error_message = message;
+	}
+	catch (std::exception const& e)
+	{
+		error_message = e.what();
+	}
+	catch (...)
+	{
+		error_message = "unknown exception occured";
 	}
 
-	buffers.input = buffers.input.mid (p);
+	if (!error_message.isEmpty())
+	{
+		timer.failed();
+		_metrics.errors.fetch_add (1, std::memory_order_relaxed);
+
+		// { error: { message: "" } }
+		response_json_object = QJsonObject {
+			{ "error", QJsonObject {
+				{ "message", error_message }
+			} }
+		};
+	}
+
+	QByteArray response = QJsonDocument (response_json_object).toJson (QJsonDocument::Compact);
+	percent_encode (response);
+	timer.finish (request_type);
+	return response;
 }
 
 
-void
-JSONProtocol::write_output (QTcpSocket& socket, Buffers& buffers, int64_t)
+QJsonObject
+JSONProtocol::handle_get (QJsonObject const& request_obj)
 {
-	if (!buffers.output.isEmpty())
+	// Format: { get: { timestamp: xxx } }
+	RequestsHandler::Request request;
+	request.timestamp = get_number (request_obj, "timestamp");
+
+	RequestsHandler::Response response = _requests_handler.handle_request (request);
+
+	return QJsonObject {
+		{ "previous-sample-dt", response.previous_sample_dt },
+		{ "next-sample-dt", response.next_sample_dt },
+		{ "interpolated-sample", QJsonObject {
+			{ "timestamp", response.sample_timestamp },
+			{ "energy.J", response.energy_J },
+		} }
+	};
+}
+
+
+QJsonObject
+JSONProtocol::handle_aggregate (QJsonObject const& request_obj)
+{
+	// Format: { aggregate: { start-timestamp: xxx, end-timestamp: xxx } }
+	RequestsHandler::AggregateRequest request;
+	request.start_timestamp = get_number (request_obj, "start-timestamp");
+	request.end_timestamp = get_number (request_obj, "end-timestamp");
+
+	RequestsHandler::AggregateResponse response = _requests_handler.handle_request (request);
+
+	return QJsonObject {
+		{ "start-timestamp", response.start_timestamp },
+		{ "end-timestamp", response.end_timestamp },
+		{ "samples", static_cast<double> (response.samples) },
+		{ "energy.J", response.energy_J },
+		{ "mean-power.W", response.mean_power_W },
+		{ "min-power.W", response.min_power_W },
+		{ "max-power.W", response.max_power_W },
+	};
+}
+
+
+QJsonObject
+JSONProtocol::handle_quantiles (QJsonObject const& request_obj)
+{
+	// Format: { quantiles: { start-timestamp: xxx, end-timestamp: xxx, quantiles: [0.5, 0.95, 0.99] } }
+	// Quantiles default to p50, p95 and p99.
+	RequestsHandler::QuantilesRequest request;
+	request.start_timestamp = get_number (request_obj, "start-timestamp");
+	request.end_timestamp = get_number (request_obj, "end-timestamp");
+
+	auto it_quantiles = request_obj.find ("quantiles");
+
+	if (it_quantiles == request_obj.end())
+		request.quantiles = { 0.5, 0.95, 0.99 };
+	else
+	{
+		if (!it_quantiles.value().isArray())
+			throw QString ("invalid request ('quantiles' is not array)");
+
+		for (auto const& value: it_quantiles.value().toArray())
+		{
+			if (!value.isDouble())
+				throw QString ("invalid request (quantile is not numeric)");
+
+			request.quantiles.push_back (value.toDouble());
+		}
+	}
+
+	RequestsHandler::QuantilesResponse response = _requests_handler.handle_request (request);
+
+	QJsonArray quantiles;
+	QJsonArray power_W;
+
+	for (std::size_t i = 0; i < request.quantiles.size(); ++i)
 	{
-		auto n = socket.write (buffers.output.toUtf8());
-		buffers.output = buffers.output.mid (n);
+		quantiles.append (request.quantiles[i]);
+		power_W.append (response.power_W[i]);
 	}
+
+	return QJsonObject {
+		{ "start-timestamp", response.start_timestamp },
+		{ "end-timestamp", response.end_timestamp },
+		{ "samples", static_cast<double> (response.samples) },
+		{ "quantiles", quantiles },
+		{ "power.W", power_W },
+	};
 }
 
 
-void
-JSONProtocol::delete_connection (QTcpSocket& socket)
+QJsonObject
+JSONProtocol::statistics() const
+{
+	auto statistics = _requests_handler.statistics();
+
+	auto cache_json = [](RequestsHandler::CacheStatistics const& cache) {
+		return QJsonObject {
+			{ "hits", static_cast<double> (cache.hits) },
+			{ "misses", static_cast<double> (cache.misses) },
+			{ "evictions", static_cast<double> (cache.evictions) },
+			{ "invalidations", static_cast<double> (cache.invalidations) },
+			{ "size", static_cast<double> (cache.size) },
+			{ "capacity", static_cast<double> (cache.capacity) },
+		};
+	};
+
+	QJsonObject result = _metrics.to_json();
+	result.insert ("cache", QJsonObject {
+		{ "blocks", cache_json (statistics.blocks_cache) },
+		{ "rollups", cache_json (statistics.rollups_cache) },
+		{ "results", cache_json (statistics.results_cache) },
+	});
+	return result;
+}
+
+
+QJsonObject
+JSONProtocol::handle_stats (QJsonObject const&)
+{
+	// Format: { stats: { } }
+	return statistics();
+}
+
+
+QJsonObject
+JSONProtocol::get_object (QJsonObject const& object, QString const& key)
 {
-	// TODO why not called?
-	std::cout << "closed\n";
-	_buffers.erase (&socket);
-	delete &socket;
+	auto it = object.find (key);
+
+	if (it == object.end())
+		throw QString ("invalid request (missing '%1')").arg (key);
+
+	if (!it.value().isObject())
+		throw QString ("invalid request ('%1' is not object)").arg (key);
+
+	return it.value().toObject();
+}
+
+
+double
+JSONProtocol::get_number (QJsonObject const& object, QString const& key)
+{
+	auto it = object.find (key);
+
+	if (it == object.end())
+		throw QString ("invalid request (missing '%1')").arg (key);
+
+	if (!it.value().isDouble())
+		throw QString ("invalid request ('%1' is not numeric)").arg (key);
+
+	return it.value().toDouble();
 }
 
 
@@ -212,3 +359,32 @@ JSONProtocol::percent_decode (QString& string)
 	string.resize (trim_to);
 }
 
+
+
+void
+JSONProtocol::percent_encode (QByteArray& string)
+{
+	int extra = string.count ('%') + string.count ('\n');
+
+	if (extra == 0)
+		return;
+
+	int s = string.size();
+	int t = s + 2 * extra;
+	string.resize (t);
+
+	// Work backwards so that the string can be expanded in place:
+	while (s > 0)
+	{
+		char c = string[--s];
+
+		if (c == '%' || c == '\n')
+		{
+			string[--t] = (c == '%') ? '5' : 'a';
+			string[--t] = (c == '%') ? '2' : '0';
+			string[--t] = '%';
+		}
+		else
+			string[--t] = c;
+	}
+}
@@ -16,8 +16,15 @@
 
 // Standard:
 #include <cstddef>
+#include <stdexcept>
+
+// Qt:
+#include <QJsonObject>
+#include <QTcpSocket>
 
 // Local:
+#include "connection_pool.h"
+#include "metrics.h"
 #include "requests_handler.h"
 
 
@@ -42,20 +49,15 @@ class JSONProtocol
 		{ }
 	};
 
-  private:
-	class Buffers
-	{
-	  public:
-		QString input;
-		QString output;
-	};
+  public:
+	class ConnectionState
+	{ };
+
+	typedef ConnectionPool<ConnectionState> Connections;
 
   public:
 	// Ctor:
-	JSONProtocol (RequestsHandler&);
-
-	// Dtor:
-	~JSONProtocol();
+	JSONProtocol (RequestsHandler&, Metrics&);
 
 	/**
 	 * Add new connection.
@@ -64,29 +66,66 @@ class JSONProtocol
 	void
 	new_connection (QTcpSocket* socket);
 
+	/**
+	 * Handle single request line (without the newline) and return percent-encoded response line
+	 * (without the newline). Doesn't depend on any connection, so it can be benchmarked on its own.
+	 */
+	QByteArray
+	handle_line (char const* data, int size);
+
 	/**
 	 * Percent-decode string inline.
 	 */
 	static void
 	percent_decode (QString& string);
 
+	/**
+	 * Percent-encode newline and '%' characters inline.
+	 */
+	static void
+	percent_encode (QByteArray& string);
+
+	/**
+	 * Return server metrics and cache statistics, as served by the 'stats' request.
+	 */
+	QJsonObject
+	statistics() const;
+
   private:
+	/**
+	 * Handle all complete requests in connection's input buffer.
+	 */
 	void
-	handle_request (QTcpSocket&, Buffers&);
+	handle_request (Connections::Connection&);
+
+	QJsonObject
+	handle_get (QJsonObject const& request);
+
+	QJsonObject
+	handle_aggregate (QJsonObject const& request);
+
+	QJsonObject
+	handle_quantiles (QJsonObject const& request);
+
+	QJsonObject
+	handle_stats (QJsonObject const& request);
 
 	/**
-	 * Write output buffers to the socket.
-	 * Called-back when socket is ready for writing.
+	 * Return nested object stored under given key or throw an error message.
 	 */
-	void
-	write_output (QTcpSocket&, Buffers&, int64_t bytes_written = 0);
+	static QJsonObject
+	get_object (QJsonObject const&, QString const& key);
 
-	void
-	delete_connection (QTcpSocket&);
+	/**
+	 * Return number stored under given key or throw an error message.
+	 */
+	static double
+	get_number (QJsonObject const&, QString const& key);
 
   private:
-	std::map<QTcpSocket*, Buffers>	_buffers;
 	RequestsHandler&				_requests_handler;
+	Metrics&						_metrics;
+	Connections						_connections;
 };
 
 #endif
@@ -0,0 +1,139 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+
+// Local:
+#include "metrics.h"
+
+
+Metrics::RequestTimer::RequestTimer (Metrics& metrics) noexcept:
+	_metrics (metrics),
+	_start (Clock::now()),
+	_parsed (_start),
+	_handled (_start)
+{ }
+
+
+void
+Metrics::RequestTimer::parsed() noexcept
+{
+	_parsed = Clock::now();
+	_handled = _parsed;
+	_stage = kHandle;
+}
+
+
+void
+Metrics::RequestTimer::handled() noexcept
+{
+	_handled = Clock::now();
+	_stage = kSerialize;
+}
+
+
+void
+Metrics::RequestTimer::failed() noexcept
+{
+	if (_stage == kParse)
+		parsed();
+	else if (_stage == kHandle)
+		handled();
+}
+
+
+void
+Metrics::RequestTimer::finish (RequestType request_type) noexcept
+{
+	using std::chrono::duration_cast;
+	using std::chrono::nanoseconds;
+
+	auto finished = Clock::now();
+
+	_metrics.latency (request_type, kParse).record (duration_cast<nanoseconds> (_parsed - _start).count());
+	_metrics.latency (request_type, kHandle).record (duration_cast<nanoseconds> (_handled - _parsed).count());
+	_metrics.latency (request_type, kSerialize).record (duration_cast<nanoseconds> (finished - _handled).count());
+}
+
+
+char const*
+Metrics::request_type_name (RequestType request_type)
+{
+	switch (request_type)
+	{
+		case kGet:			return "get";
+		case kAggregate:	return "aggregate";
+		case kQuantiles:	return "quantiles";
+		case kStats:		return "stats";
+		case kInvalid:		return "invalid";
+		default:			return "unknown";
+	}
+}
+
+
+char const*
+Metrics::stage_name (Stage stage)
+{
+	switch (stage)
+	{
+		case kParse:		return "parse";
+		case kHandle:		return "handle";
+		case kSerialize:	return "serialize";
+		default:			return "unknown";
+	}
+}
+
+
+QJsonObject
+Metrics::to_json() const
+{
+	auto histogram_json = [](LatencyHistogram const& histogram) {
+		return QJsonObject {
+			{ "mean.us", histogram.mean() / 1e3 },
+			{ "p50.us", histogram.quantile (0.5) / 1e3 },
+			{ "p90.us", histogram.quantile (0.9) / 1e3 },
+			{ "p99.us", histogram.quantile (0.99) / 1e3 },
+			{ "p999.us", histogram.quantile (0.999) / 1e3 },
+			{ "max.us", histogram.max() / 1e3 },
+		};
+	};
+
+	QJsonObject requests;
+
+	for (int r = 0; r < kRequestTypesCount; ++r)
+	{
+		auto request_type = static_cast<RequestType> (r);
+		QJsonObject request_json {
+			{ "count", static_cast<double> (_latencies[r][kParse].count()) },
+		};
+
+		for (int s = 0; s < kStagesCount; ++s)
+			request_json.insert (stage_name (static_cast<Stage> (s)), histogram_json (_latencies[r][s]));
+
+		requests.insert (request_type_name (request_type), request_json);
+	}
+
+	return QJsonObject {
+		{ "connections", static_cast<double> (connections.load (std::memory_order_relaxed)) },
+		{ "negotiating-connections", static_cast<double> (negotiating_connections.load (std::memory_order_relaxed)) },
+		{ "suspended-connections", static_cast<double> (suspended_connections.load (std::memory_order_relaxed)) },
+		{ "output-backlog-bytes", static_cast<double> (output_backlog.load (std::memory_order_relaxed)) },
+		{ "bytes-in", static_cast<double> (bytes_in.load (std::memory_order_relaxed)) },
+		{ "bytes-out", static_cast<double> (bytes_out.load (std::memory_order_relaxed)) },
+		{ "errors", static_cast<double> (errors.load (std::memory_order_relaxed)) },
+		{ "requests", requests },
+	};
+}
+
@@ -0,0 +1,149 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPIDEVD__METRICS_H__INCLUDED
+#define SCPIDEVD__METRICS_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <chrono>
+
+// Qt:
+#include <QJsonObject>
+
+// Local:
+#include <utility/latency_histogram.h>
+
+
+/**
+ * Server counters, gauges and per-request-type latency histograms.
+ * All updates are lock-free.
+ */
+class Metrics
+{
+  public:
+	enum RequestType
+	{
+		kGet,
+		kAggregate,
+		kQuantiles,
+		kStats,
+		// Requests that couldn't be parsed:
+		kInvalid,
+		kRequestTypesCount,
+	};
+
+	enum Stage
+	{
+		kParse,
+		kHandle,
+		kSerialize,
+		kStagesCount,
+	};
+
+	/**
+	 * Measures time spent in each stage of a single request.
+	 */
+	class RequestTimer
+	{
+		typedef std::chrono::steady_clock Clock;
+
+	  public:
+		// Ctor
+		explicit RequestTimer (Metrics&) noexcept;
+
+		/**
+		 * Mark the end of the parse stage.
+		 */
+		void
+		parsed() noexcept;
+
+		/**
+		 * Mark the end of the handle stage.
+		 */
+		void
+		handled() noexcept;
+
+		/**
+		 * Mark the end of the stage in progress (parse, or handle after parsed()),
+		 * so that formatting an error response is timed as the serialize stage.
+		 */
+		void
+		failed() noexcept;
+
+		/**
+		 * Mark the end of the serialize stage and record all stages.
+		 * Stages that weren't marked are recorded as zero-length.
+		 */
+		void
+		finish (RequestType) noexcept;
+
+	  private:
+		Metrics&			_metrics;
+		Clock::time_point	_start;
+		Clock::time_point	_parsed;
+		Clock::time_point	_handled;
+		Stage				_stage		= kParse;
+	};
+
+  public:
+	/**
+	 * Latencies in nanoseconds.
+	 */
+	LatencyHistogram&
+	latency (RequestType, Stage) noexcept;
+
+	static char const*
+	request_type_name (RequestType);
+
+	static char const*
+	stage_name (Stage);
+
+	/**
+	 * Return all metrics as JSON. Latencies are in microseconds.
+	 */
+	QJsonObject
+	to_json() const;
+
+  public:
+	// Gauges:
+	std::atomic<int64_t>	connections				{ 0 };
+	// Connections that haven't picked a protocol yet:
+	std::atomic<int64_t>	negotiating_connections	{ 0 };
+	// Connections not being read because their responses are not picked up:
+	std::atomic<int64_t>	suspended_connections	{ 0 };
+	// Response bytes not yet handed over to sockets, over all connections:
+	std::atomic<int64_t>	output_backlog			{ 0 };
+
+	// Counters:
+	std::atomic<uint64_t>	bytes_in				{ 0 };
+	std::atomic<uint64_t>	bytes_out				{ 0 };
+	std::atomic<uint64_t>	errors					{ 0 };
+
+  private:
+	std::array<std::array<LatencyHistogram, kStagesCount>, kRequestTypesCount>
+							_latencies;
+};
+
+
+inline LatencyHistogram&
+Metrics::latency (RequestType request_type, Stage stage) noexcept
+{
+	return _latencies[request_type][stage];
+}
+
+#endif
+
@@ -13,17 +13,625 @@
 
 // Standard:
 #include <cstddef>
-
-// Qt:
-#include <QJsonDocument>
+#include <algorithm>
+#include <iterator>
+#include <limits>
 
 // Local:
 #include "requests_handler.h"
 
 
+// How often to look for new files in FileDB:
+constexpr std::chrono::seconds kFilesScanPeriod { 1 };
+// Memory for decoded blocks of past days (the latest day is kept decoded whole):
+constexpr std::size_t kBlocksCacheBytes = 64 * 1024 * 1024;
+// Number of days of loaded rollups (summary and hour buckets):
+constexpr std::size_t kRollupsCacheSize = 62;
+// Number of cached query results:
+constexpr std::size_t kResultsCacheSize = 1024;
+
+
+namespace {
+
+template<class Cache>
+	RequestsHandler::CacheStatistics
+	cache_statistics (Cache const& cache)
+	{
+		RequestsHandler::CacheStatistics result;
+		result.hits = cache.statistics().hits;
+		result.misses = cache.statistics().misses;
+		result.evictions = cache.statistics().evictions;
+		result.invalidations = cache.statistics().invalidations;
+		result.size = cache.size();
+		result.capacity = cache.capacity();
+		return result;
+	}
+
+/**
+ * Return energy integrated over the part of [start, end] between the last sample of one day
+ * and the first sample of the next one.
+ */
+double
+energy_between (Segment::Summary const& before, Segment::Summary const& after, double start, double end)
+{
+	double const dt = after.first_timestamp - before.last_timestamp;
+	double const covered = std::min (end, after.first_timestamp) - std::max (start, before.last_timestamp);
+
+	if (!(dt > 0.0) || !(covered > 0.0))
+		return 0.0;
+
+	return Segment::interval_energy (dt, after.first_power_W, before.last_logged_energy, after.first_logged_energy) * covered / dt;
+}
+
+} // namespace
+
+
+RequestsHandler::RequestsHandler (FileDB& file_db):
+	_file_db (file_db),
+	_blocks_cache (kBlocksCacheBytes),
+	_rollups_cache (kRollupsCacheSize),
+	_results_cache (kResultsCacheSize)
+{ }
+
+
+template<class pResponse, class Compute>
+	inline pResponse
+	RequestsHandler::cached (QueryKey const& key, Compute&& compute)
+	{
+		if (auto* cached_response = _results_cache.find (key))
+			return boost::get<pResponse> (*cached_response);
+
+		pResponse response = compute();
+		_results_cache.insert (key, response);
+		return response;
+	}
+
+
 RequestsHandler::Response
 RequestsHandler::handle_request (Request const& request)
 {
-	return { };
+	update_segments();
+	return cached<Response> (QueryKey (kQueryGet, request.timestamp, request.timestamp, { }), [&] {
+		return compute (request);
+	});
+}
+
+
+RequestsHandler::AggregateResponse
+RequestsHandler::handle_request (AggregateRequest const& request)
+{
+	if (!(request.end_timestamp >= request.start_timestamp))
+		throw std::invalid_argument ("window end is before window start");
+
+	update_segments();
+	return cached<AggregateResponse> (QueryKey (kQueryAggregate, request.start_timestamp, request.end_timestamp, { }), [&] {
+		return compute (request);
+	});
+}
+
+
+RequestsHandler::QuantilesResponse
+RequestsHandler::handle_request (QuantilesRequest const& request)
+{
+	if (!(request.end_timestamp >= request.start_timestamp))
+		throw std::invalid_argument ("window end is before window start");
+
+	for (double q: request.quantiles)
+		if (!(q >= 0.0 && q <= 1.0))
+			throw std::invalid_argument ("quantile out of range 0…1");
+
+	update_segments();
+	return cached<QuantilesResponse> (QueryKey (kQueryQuantiles, request.start_timestamp, request.end_timestamp, request.quantiles), [&] {
+		return compute (request);
+	});
+}
+
+
+RequestsHandler::Statistics
+RequestsHandler::statistics() const
+{
+	Statistics result;
+	result.blocks_cache = cache_statistics (_blocks_cache);
+	result.rollups_cache = cache_statistics (_rollups_cache);
+	result.results_cache = cache_statistics (_results_cache);
+	return result;
+}
+
+
+void
+RequestsHandler::update_segments()
+{
+	auto now = std::chrono::steady_clock::now();
+	// Energy at a window end past the last sample is interpolated from the next sample,
+	// so new samples change results of all windows ending after the previous end of data:
+	double const data_end = _latest_segment && _latest_segment->size() > 0
+		? _latest_segment->timestamp (_latest_segment->size() - 1)
+		: std::numeric_limits<double>::lowest();
+
+	if (_files.empty() || now - _last_files_scan >= kFilesScanPeriod)
+	{
+		_last_files_scan = now;
+		auto files = _file_db.files();
+
+		for (auto const& pair: files)
+			if (_files.find (pair.first) == _files.end())
+				invalidate_results (std::min (pair.first, data_end));
+
+		_files = std::move (files);
+	}
+
+	if (_files.empty())
+		return;
+
+	// Only the latest file is being appended to:
+	auto latest = std::prev (_files.end());
+
+	if (!_latest_segment || _latest_segment_key != latest->first)
+	{
+		if (_latest_segment)
+		{
+			// Samples written to the previous day's file since the last update:
+			if (_latest_segment->update())
+				invalidate_results (data_end);
+
+			_days[_latest_segment_key] = { _latest_segment->summary(), _latest_segment->blocks() };
+
+			// The day is closed, store its rollups:
+			try {
+				RollupsFile::save (*_latest_segment);
+			}
+			catch (RollupsFile::Error const&)
+			{
+				// Read-only database, past days will be decoded from CSV.
+			}
+		}
+
+		_latest_segment = std::make_shared<Segment> (latest->second);
+		_latest_segment_key = latest->first;
+	}
+
+	if (_latest_segment->update())
+		invalidate_results (data_end);
+}
+
+
+RequestsHandler::Files::const_iterator
+RequestsHandler::file_for (double unix_timestamp) const
+{
+	auto it = _files.upper_bound (unix_timestamp);
+
+	if (it != _files.begin())
+		--it;
+
+	return it;
+}
+
+
+bool
+RequestsHandler::is_latest (Files::const_iterator file) const
+{
+	return _latest_segment && _latest_segment_key == file->first;
+}
+
+
+std::shared_ptr<Segment>
+RequestsHandler::block (Files::const_iterator file, std::size_t block_index)
+{
+	BlockKey const key (file->first, block_index);
+
+	if (auto* cached_block = _blocks_cache.find (key))
+		return *cached_block;
+
+	auto loaded_block = std::make_shared<Segment> (file->second, day (file).blocks[block_index]);
+	loaded_block->update();
+	_blocks_cache.insert (key, loaded_block, loaded_block->memory_size());
+	return loaded_block;
+}
+
+
+std::shared_ptr<RollupsFile>
+RequestsHandler::rollups (Files::const_iterator file)
+{
+	if (auto* cached_rollups = _rollups_cache.find (file->first))
+		return *cached_rollups;
+
+	auto loaded_rollups = std::make_shared<RollupsFile> (file->second);
+
+	if (!loaded_rollups->load())
+	{
+		// Decoded whole only to compute rollups, not kept:
+		Segment segment (file->second);
+		segment.update();
+
+		try {
+			RollupsFile::save (segment);
+		}
+		catch (RollupsFile::Error const&)
+		{
+			return nullptr;
+		}
+
+		if (!loaded_rollups->load())
+			return nullptr;
+	}
+
+	_rollups_cache.insert (file->first, loaded_rollups);
+	return loaded_rollups;
+}
+
+
+RequestsHandler::Day const&
+RequestsHandler::day (Files::const_iterator file)
+{
+	auto found = _days.find (file->first);
+
+	if (found == _days.end())
+	{
+		Day result;
+
+		if (auto const stored = rollups (file))
+			result = { stored->summary(), stored->blocks() };
+		else
+		{
+			// Rollups can't be stored, index the file once:
+			Segment segment (file->second);
+			segment.update();
+			result = { segment.summary(), segment.blocks() };
+		}
+
+		found = _days.emplace (file->first, std::move (result)).first;
+	}
+
+	return found->second;
+}
+
+
+Segment::Summary
+RequestsHandler::summary (Files::const_iterator file)
+{
+	if (is_latest (file))
+		return _latest_segment->summary();
+
+	return day (file).summary;
+}
+
+
+boost::optional<Segment::Summary>
+RequestsHandler::previous_summary (Files::const_iterator file)
+{
+	while (file != _files.begin())
+	{
+		auto result = summary (--file);
+
+		if (result.samples > 0)
+			return result;
+	}
+
+	return boost::none;
+}
+
+
+boost::optional<Segment::Summary>
+RequestsHandler::next_summary (Files::const_iterator file)
+{
+	for (; file != _files.end(); ++file)
+	{
+		auto result = summary (file);
+
+		if (result.samples > 0)
+			return result;
+	}
+
+	return boost::none;
+}
+
+
+void
+RequestsHandler::invalidate_results (double since_timestamp)
+{
+	_results_cache.invalidate_if ([&](QueryKey const& key, CachedResponse const&) {
+		return std::get<2> (key) >= since_timestamp;
+	});
+}
+
+
+boost::optional<RequestsHandler::Point>
+RequestsHandler::sample_at_or_before (Files::const_iterator file, double unix_timestamp)
+{
+	auto segment = _latest_segment;
+
+	if (!is_latest (file))
+	{
+		auto const& blocks = day (file).blocks;
+		// Last block starting at or before the timestamp:
+		auto found = std::upper_bound (blocks.begin(), blocks.end(), unix_timestamp, [](double t, Segment::Block const& b) {
+			return t < b.first_timestamp;
+		});
+
+		if (found == blocks.begin())
+			return boost::none;
+
+		segment = block (file, std::distance (blocks.begin(), found) - 1);
+	}
+
+	if (auto index = segment->neighbours (unix_timestamp).previous)
+		return Point { segment->timestamp (*index), segment->logged_energy (*index) };
+
+	return boost::none;
+}
+
+
+boost::optional<RequestsHandler::Point>
+RequestsHandler::sample_at_or_after (Files::const_iterator file, double unix_timestamp)
+{
+	auto segment = _latest_segment;
+
+	if (!is_latest (file))
+	{
+		auto const& blocks = day (file).blocks;
+		// First block ending at or after the timestamp:
+		auto found = std::lower_bound (blocks.begin(), blocks.end(), unix_timestamp, [](Segment::Block const& b, double t) {
+			return b.last_timestamp < t;
+		});
+
+		if (found == blocks.end())
+			return boost::none;
+
+		segment = block (file, std::distance (blocks.begin(), found));
+	}
+
+	if (auto index = segment->neighbours (unix_timestamp).next)
+		return Point { segment->timestamp (*index), segment->logged_energy (*index) };
+
+	return boost::none;
+}
+
+
+double
+RequestsHandler::energy_until (Files::const_iterator file, double unix_timestamp)
+{
+	if (is_latest (file))
+		return _latest_segment->energy_until (unix_timestamp);
+
+	auto const& current_day = day (file);
+	auto const& blocks = current_day.blocks;
+
+	if (blocks.empty() || unix_timestamp <= blocks.front().first_timestamp)
+		return 0.0;
+
+	// First block ending at or after the timestamp, its first decoded sample is at or before it:
+	auto found = std::lower_bound (blocks.begin(), blocks.end(), unix_timestamp, [](Segment::Block const& b, double t) {
+		return b.last_timestamp < t;
+	});
+
+	if (found == blocks.end())
+		return current_day.summary.energy_J;
+
+	return found->energy_base + block (file, std::distance (blocks.begin(), found))->energy_until (unix_timestamp);
+}
+
+
+Segment::Aggregate
+RequestsHandler::aggregate (Files::const_iterator file, double start_timestamp, double end_timestamp)
+{
+	if (is_latest (file))
+		return _latest_segment->aggregate (start_timestamp, end_timestamp);
+
+	auto const& blocks = day (file).blocks;
+	Segment::Aggregate result;
+	result.min_power_W = std::numeric_limits<double>::max();
+	result.max_power_W = std::numeric_limits<double>::lowest();
+
+	// First block ending at or after window start:
+	auto first = std::lower_bound (blocks.begin(), blocks.end(), start_timestamp, [](Segment::Block const& b, double t) {
+		return b.last_timestamp < t;
+	});
+
+	for (auto it = first; it != blocks.end() && it->first_timestamp <= end_timestamp; ++it)
+	{
+		Segment::Aggregate part;
+
+		if (start_timestamp <= it->first_timestamp && it->last_timestamp <= end_timestamp)
+		{
+			part.samples = it->samples;
+			part.min_power_W = it->min_power_W;
+			part.max_power_W = it->max_power_W;
+		}
+		else
+		{
+			// Only the block's own samples, the first decoded one belongs to the previous block:
+			part = block (file, std::distance (blocks.begin(), it))->aggregate (std::max (start_timestamp, it->first_timestamp), end_timestamp);
+		}
+
+		if (part.samples > 0)
+		{
+			result.samples += part.samples;
+			result.min_power_W = std::min (result.min_power_W, part.min_power_W);
+			result.max_power_W = std::max (result.max_power_W, part.max_power_W);
+		}
+	}
+
+	if (result.samples == 0)
+		result.min_power_W = result.max_power_W = 0.0;
+
+	result.energy_J = energy_until (file, end_timestamp) - energy_until (file, start_timestamp);
+	return result;
+}
+
+
+void
+RequestsHandler::add_power_quantiles (Files::const_iterator file, double start_timestamp, double end_timestamp, QuantileSketch& sketch)
+{
+	if (is_latest (file))
+		return _latest_segment->add_power_quantiles (start_timestamp, end_timestamp, sketch);
+
+	if (auto const stored = rollups (file))
+		return stored->add_power_quantiles (start_timestamp, end_timestamp, sketch);
+
+	// Rollups can't be stored, go through blocks:
+	auto const& blocks = day (file).blocks;
+
+	auto first = std::lower_bound (blocks.begin(), blocks.end(), start_timestamp, [](Segment::Block const& b, double t) {
+		return b.last_timestamp < t;
+	});
+
+	for (auto it = first; it != blocks.end() && it->first_timestamp <= end_timestamp; ++it)
+		block (file, std::distance (blocks.begin(), it))->add_power_quantiles (std::max (start_timestamp, it->first_timestamp), end_timestamp, sketch);
+}
+
+
+RequestsHandler::Response
+RequestsHandler::compute (Request const& request)
+{
+	if (_files.empty())
+		throw NoData ("no samples in database");
+
+	double const t = request.timestamp;
+	boost::optional<Point> previous;
+	boost::optional<Point> next;
+
+	auto containing = file_for (t);
+
+	// Previous sample might be in one of the earlier files:
+	for (auto it = std::next (containing); it != _files.begin() && !previous; )
+		previous = sample_at_or_before (--it, t);
+
+	for (auto it = containing; it != _files.end() && !next; ++it)
+		next = sample_at_or_after (it, t);
+
+	if (!previous || !next)
+		throw NoData ("no samples around requested timestamp");
+
+	double t_previous = previous->timestamp;
+	double t_next = next->timestamp;
+	double e_previous = previous->logged_energy;
+	double e_next = next->logged_energy;
+
+	Response response;
+	response.previous_sample_dt = t - t_previous;
+	response.next_sample_dt = t_next - t;
+	response.sample_timestamp = t;
+	response.energy_J = t_next > t_previous
+		? e_previous + (e_next - e_previous) * (t - t_previous) / (t_next - t_previous)
+		: e_previous;
+	return response;
+}
+
+
+RequestsHandler::AggregateResponse
+RequestsHandler::compute (AggregateRequest const& request)
+{
+	double const start = request.start_timestamp;
+	double const end = request.end_timestamp;
+
+	AggregateResponse response;
+	response.start_timestamp = end;
+	response.end_timestamp = start;
+	response.min_power_W = std::numeric_limits<double>::max();
+	response.max_power_W = std::numeric_limits<double>::lowest();
+
+	// The last non-empty day before the one being added:
+	boost::optional<Segment::Summary> previous_day;
+	auto it = file_for (start);
+
+	for (; it != _files.end() && it->first <= end; ++it)
+	{
+		auto const day = summary (it);
+
+		if (day.samples == 0)
+			continue;
+
+		// Interval since the last sample of the previous day:
+		if (start < day.first_timestamp)
+		{
+			if (!previous_day)
+				previous_day = previous_summary (it);
+
+			if (previous_day)
+				response.energy_J += energy_between (*previous_day, day, start, end);
+		}
+
+		previous_day = day;
+
+		Segment::Aggregate aggregate;
+
+		// Days entirely within the window don't need to be decoded:
+		if (start <= day.first_timestamp && day.last_timestamp <= end)
+		{
+			aggregate.samples = day.samples;
+			aggregate.energy_J = day.energy_J;
+			aggregate.min_power_W = day.min_power_W;
+			aggregate.max_power_W = day.max_power_W;
+		}
+		else
+			aggregate = this->aggregate (it, start, end);
+
+		response.energy_J += aggregate.energy_J;
+
+		if (aggregate.samples > 0)
+		{
+			response.start_timestamp = std::min (response.start_timestamp, std::max (start, day.first_timestamp));
+			response.end_timestamp = std::max (response.end_timestamp, std::min (end, day.last_timestamp));
+			response.samples += aggregate.samples;
+			response.min_power_W = std::min (response.min_power_W, aggregate.min_power_W);
+			response.max_power_W = std::max (response.max_power_W, aggregate.max_power_W);
+		}
+	}
+
+	// Interval before the first sample of the next day, if the window ends before it:
+	if (previous_day && end > previous_day->last_timestamp)
+		if (auto next_day = next_summary (it))
+			response.energy_J += energy_between (*previous_day, *next_day, start, end);
+
+	if (response.samples == 0)
+		throw NoData ("no samples in requested window");
+
+	double duration = response.end_timestamp - response.start_timestamp;
+	response.mean_power_W = duration > 0.0
+		? response.energy_J / duration
+		: response.max_power_W;
+	return response;
+}
+
+
+RequestsHandler::QuantilesResponse
+RequestsHandler::compute (QuantilesRequest const& request)
+{
+	double const start = request.start_timestamp;
+	double const end = request.end_timestamp;
+
+	QuantilesResponse response;
+	response.start_timestamp = end;
+	response.end_timestamp = start;
+
+	QuantileSketch sketch;
+
+	for (auto it = file_for (start); it != _files.end() && it->first <= end; ++it)
+	{
+		auto const day = summary (it);
+
+		if (day.samples == 0 || day.last_timestamp < start || day.first_timestamp > end)
+			continue;
+
+		auto const samples_before = sketch.count();
+		add_power_quantiles (it, start, end, sketch);
+
+		if (sketch.count() > samples_before)
+		{
+			response.start_timestamp = std::min (response.start_timestamp, std::max (start, day.first_timestamp));
+			response.end_timestamp = std::max (response.end_timestamp, std::min (end, day.last_timestamp));
+		}
+	}
+
+	if (sketch.count() == 0)
+		throw NoData ("no samples in requested window");
+
+	response.samples = sketch.count();
+	response.power_W.reserve (request.quantiles.size());
+
+	for (double q: request.quantiles)
+		response.power_W.push_back (sketch.quantile (q));
+
+	return response;
 }
 
@@ -16,11 +16,36 @@
 
 // Standard:
 #include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Boost:
+#include <boost/optional.hpp>
+#include <boost/variant.hpp>
+
+// Local:
+#include <utility/file_db.h>
+#include <utility/lru_cache.h>
+#include <utility/rollups_file.h>
+#include <utility/segment.h>
 
 
 class RequestsHandler
 {
   public:
+	class NoData: public std::runtime_error
+	{
+	  public:
+		// Ctor:
+		using std::runtime_error::runtime_error;
+	};
+
 	class Request
 	{
 	  public:
@@ -36,14 +61,262 @@ class RequestsHandler
 		double energy_J				= 0.0;
 	};
 
+	class AggregateRequest
+	{
+	  public:
+		double start_timestamp		= 0.0;
+		double end_timestamp		= 0.0;
+	};
+
+	class AggregateResponse
+	{
+	  public:
+		// Part of the requested window actually covered by samples:
+		double start_timestamp		= 0.0;
+		double end_timestamp		= 0.0;
+		uint64_t samples			= 0;
+		double energy_J				= 0.0;
+		double mean_power_W			= 0.0;
+		double min_power_W			= 0.0;
+		double max_power_W			= 0.0;
+	};
+
+	class QuantilesRequest
+	{
+	  public:
+		double start_timestamp		= 0.0;
+		double end_timestamp		= 0.0;
+		// Requested quantiles, each in range 0…1:
+		std::vector<double> quantiles;
+	};
+
+	class QuantilesResponse
+	{
+	  public:
+		// Part of the requested window actually covered by samples:
+		double start_timestamp		= 0.0;
+		double end_timestamp		= 0.0;
+		uint64_t samples			= 0;
+		// Power values at requested quantiles, in the same order:
+		std::vector<double> power_W;
+	};
+
+	class CacheStatistics
+	{
+	  public:
+		uint64_t	hits			= 0;
+		uint64_t	misses			= 0;
+		uint64_t	evictions		= 0;
+		uint64_t	invalidations	= 0;
+		std::size_t	size			= 0;
+		std::size_t	capacity		= 0;
+	};
+
+	class Statistics
+	{
+	  public:
+		// Decoded blocks of past days, size in bytes:
+		CacheStatistics	blocks_cache;
+		// Stored rollups of past days:
+		CacheStatistics	rollups_cache;
+		// Responses keyed by normalized query:
+		CacheStatistics	results_cache;
+	};
+
   public:
+	// Ctor:
+	explicit RequestsHandler (FileDB& file_db);
+
 	/**
-	 * Add new connection.
-	 * This object takes ownership of the socket argument.
+	 * Return sample interpolated at requested timestamp.
 	 */
 	Response
 	handle_request (Request const& request);
+
+	/**
+	 * Return energy, mean power and power extremes over requested window.
+	 * Days and blocks entirely within the window are combined from their summaries,
+	 * only blocks at the window edges are decoded.
+	 */
+	AggregateResponse
+	handle_request (AggregateRequest const& request);
+
+	/**
+	 * Return approximate power quantiles over requested window by merging
+	 * rollup sketches. Rank error is about 1%, memory is bounded.
+	 * Past days use rollups stored next to their files and are not decoded.
+	 */
+	QuantilesResponse
+	handle_request (QuantilesRequest const& request);
+
+	/**
+	 * Return cache counters.
+	 */
+	Statistics
+	statistics() const;
+
+  private:
+	enum QueryType
+	{
+		kQueryGet,
+		kQueryAggregate,
+		kQueryQuantiles,
+	};
+
+	// Files keyed by the beginning of the day UNIX timestamp:
+	typedef std::map<double, QString> Files;
+	// Day key, block index:
+	typedef std::pair<double, std::size_t> BlockKey;
+	// Query type, window start, window end, quantiles:
+	typedef std::tuple<QueryType, double, double, std::vector<double>> QueryKey;
+	typedef boost::variant<Response, AggregateResponse, QuantilesResponse> CachedResponse;
+
+	/**
+	 * Summary and blocks of a day other than the latest one.
+	 */
+	class Day
+	{
+	  public:
+		Segment::Summary			summary;
+		std::vector<Segment::Block>	blocks;
+	};
+
+	class Point
+	{
+	  public:
+		double	timestamp;
+		double	logged_energy;
+	};
+
+  private:
+	/**
+	 * Pick up new files from FileDB and index samples appended to the latest one.
+	 * Invalidate cached results that depend on new samples.
+	 */
+	void
+	update_segments();
+
+	/**
+	 * Return iterator to the file containing given timestamp,
+	 * or the first one if timestamp is earlier than all files.
+	 */
+	Files::const_iterator
+	file_for (double unix_timestamp) const;
+
+	/**
+	 * Return true if the file is the one being appended to.
+	 */
+	bool
+	is_latest (Files::const_iterator file) const;
+
+	/**
+	 * Return decoded block of a file other than the latest one, loading it if it's not cached.
+	 */
+	std::shared_ptr<Segment>
+	block (Files::const_iterator file, std::size_t block_index);
+
+	/**
+	 * Return stored rollups of a file other than the latest one. If they haven't been stored yet,
+	 * decode the file and store them. Return nullptr if they can't be stored.
+	 */
+	std::shared_ptr<RollupsFile>
+	rollups (Files::const_iterator file);
+
+	/**
+	 * Return summary and blocks of a file other than the latest one.
+	 * They're taken from stored rollups and kept in memory.
+	 */
+	Day const&
+	day (Files::const_iterator file);
+
+	/**
+	 * Return summary of given file.
+	 */
+	Segment::Summary
+	summary (Files::const_iterator file);
+
+	/**
+	 * Return summary of the last non-empty file before given one, if any.
+	 */
+	boost::optional<Segment::Summary>
+	previous_summary (Files::const_iterator file);
+
+	/**
+	 * Return summary of the first non-empty file starting with given one, if any.
+	 */
+	boost::optional<Segment::Summary>
+	next_summary (Files::const_iterator file);
+
+	/**
+	 * Return the last sample of the file at or before given timestamp.
+	 */
+	boost::optional<Point>
+	sample_at_or_before (Files::const_iterator file, double unix_timestamp);
+
+	/**
+	 * Return the first sample of the file at or after given timestamp.
+	 */
+	boost::optional<Point>
+	sample_at_or_after (Files::const_iterator file, double unix_timestamp);
+
+	/**
+	 * Energy integrated from the first sample of the file up to given timestamp.
+	 */
+	double
+	energy_until (Files::const_iterator file, double unix_timestamp);
+
+	/**
+	 * Compute aggregates over samples of the file with timestamps in range [start, end].
+	 */
+	Segment::Aggregate
+	aggregate (Files::const_iterator file, double start_timestamp, double end_timestamp);
+
+	/**
+	 * Add power of samples of the file with timestamps in range [start, end] to the sketch.
+	 */
+	void
+	add_power_quantiles (Files::const_iterator file, double start_timestamp, double end_timestamp, QuantileSketch&);
+
+	/**
+	 * Drop cached results for windows ending at or after given timestamp.
+	 */
+	void
+	invalidate_results (double since_timestamp);
+
+	/**
+	 * Return cached response or compute and cache a new one.
+	 */
+	template<class pResponse, class Compute>
+		pResponse
+		cached (QueryKey const& key, Compute&& compute);
+
+	Response
+	compute (Request const& request);
+
+	AggregateResponse
+	compute (AggregateRequest const& request);
+
+	QuantilesResponse
+	compute (QuantilesRequest const& request);
+
+  private:
+	FileDB&					_file_db;
+	Files					_files;
+	std::chrono::steady_clock::time_point
+							_last_files_scan;
+	// The latest file is being appended to, so it's kept outside of the cache:
+	double					_latest_segment_key	= 0.0;
+	std::shared_ptr<Segment>
+							_latest_segment;
+	// Blocks of past days, bounded by bytes:
+	LRUCache<BlockKey, std::shared_ptr<Segment>>
+							_blocks_cache;
+	LRUCache<double, std::shared_ptr<RollupsFile>>
+							_rollups_cache;
+	// Days before the latest one, kept regardless of the caches:
+	std::map<double, Day>	_days;
+	LRUCache<QueryKey, CachedResponse>
+							_results_cache;
 };
 
 #endif
-
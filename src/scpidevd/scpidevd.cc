@@ -13,11 +13,13 @@
 
 // Standard:
 #include <cstddef>
+#include <array>
 #include <iostream>
 #include <memory>
 #include <cstdint>
 #include <atomic>
 #include <cctype>
+#include <chrono>
 
 // Linux:
 #include <signal.h>
@@ -30,15 +32,22 @@
 // Qt:
 #include <QTcpServer>
 #include <QTcpSocket>
+#include <QTimer>
+#include <QJsonDocument>
+#include <QCommandLineParser>
 #include <QCoreApplication>
 
 // SCPIDevD:
+#include <scpidevd/binary_protocol.h>
 #include <scpidevd/json_protocol.h>
+#include <scpidevd/metrics.h>
 #include <scpidevd/requests_handler.h>
+#include <utility/file_db.h>
 #include <utility/unix_signaller.h>
 
 
 constexpr uint16_t kTcpListenPort = 5026;
+constexpr char kDataDir[] = "scpidev.log";
 
 std::unique_ptr<UnixSignaller> g_unix_signaller;
 
@@ -53,16 +62,110 @@ catch_sigint (int signum)
 }
 
 
+/**
+ * Wait for the first bytes from the client and hand the connection over
+ * to the protocol it speaks. Connection is dropped if the client doesn't
+ * say anything within kIdleTimeout.
+ */
+void
+negotiate_protocol (QTcpSocket* socket, JSONProtocol& json_protocol, BinaryProtocol& binary_protocol, Metrics& metrics)
+{
+	auto negotiation = std::make_shared<std::array<QMetaObject::Connection, 2>>();
+	// Owned by the socket, so it goes away with it:
+	auto timer = new QTimer (socket);
+
+	metrics.negotiating_connections.fetch_add (1, std::memory_order_relaxed);
+
+	auto finish_negotiation = [negotiation, timer, &metrics] {
+		QObject::disconnect ((*negotiation)[0]);
+		QObject::disconnect ((*negotiation)[1]);
+		timer->stop();
+		timer->deleteLater();
+		metrics.negotiating_connections.fetch_sub (1, std::memory_order_relaxed);
+	};
+
+	(*negotiation)[0] = QObject::connect (socket, &QTcpSocket::readyRead, [=, &json_protocol, &binary_protocol] {
+		auto initial_data = socket->peek (BinaryProtocol::kMagicSize);
+
+		if (BinaryProtocol::matches_greeting (initial_data))
+		{
+			// Need the whole magic to decide:
+			if (initial_data.size() < static_cast<int> (BinaryProtocol::kMagicSize))
+				return;
+
+			finish_negotiation();
+			binary_protocol.new_connection (socket);
+		}
+		else
+		{
+			finish_negotiation();
+			json_protocol.new_connection (socket);
+		}
+	});
+
+	// Client might go away before saying anything:
+	(*negotiation)[1] = QObject::connect (socket, &QTcpSocket::disconnected, [=] {
+		finish_negotiation();
+		socket->deleteLater();
+	});
+
+	timer->setSingleShot (true);
+	QObject::connect (timer, &QTimer::timeout, [=] {
+		std::cout << "Connection from " << socket->peerAddress().toString().toStdString() << ":" << socket->peerPort()
+				  << " idle, closing." << std::endl;
+		finish_negotiation();
+		socket->abort();
+		socket->deleteLater();
+	});
+	timer->start (std::chrono::milliseconds (kIdleTimeout).count());
+}
+
+
 int main (int argc, char** argv)
 {
 	try {
 		auto event_loop = std::make_unique<QCoreApplication> (argc, argv);
-		RequestsHandler requests_handler;
-		JSONProtocol json_protocol (requests_handler);
+
+		QCommandLineParser options;
+		options.setApplicationDescription ("Serves energy samples logged by scpidev.");
+		options.addHelpOption();
+		QCommandLineOption data_dir_option ("data-dir", "Read CSV files from <directory>.", "directory", kDataDir);
+		QCommandLineOption port_option ("port", "Listen on TCP <port>.", "port", QString::number (kTcpListenPort));
+		QCommandLineOption stats_interval_option ("stats-interval", "Print server statistics as JSON to stdout every <seconds>.", "seconds");
+		options.addOptions ({ data_dir_option, port_option, stats_interval_option });
+		options.process (*event_loop);
+
+		bool port_ok = false;
+		uint16_t port = options.value (port_option).toUShort (&port_ok);
+
+		if (!port_ok)
+			throw std::runtime_error ("invalid --port value");
+
+		FileDB file_db { QDir (options.value (data_dir_option)) };
+		RequestsHandler requests_handler (file_db);
+		Metrics metrics;
+		JSONProtocol json_protocol (requests_handler, metrics);
+		BinaryProtocol binary_protocol (requests_handler, metrics);
+		QTimer stats_timer;
+
+		if (options.isSet (stats_interval_option))
+		{
+			bool ok = false;
+			double stats_interval = options.value (stats_interval_option).toDouble (&ok);
+
+			if (!ok || stats_interval <= 0.0)
+				throw std::runtime_error ("invalid --stats-interval value");
+
+			QObject::connect (&stats_timer, &QTimer::timeout, [&] {
+				std::cout << QJsonDocument (json_protocol.statistics()).toJson (QJsonDocument::Compact).constData() << std::endl;
+			});
+			stats_timer.start (static_cast<int> (stats_interval * 1000.0));
+		}
+
 		auto server = std::make_unique<QTcpServer>();
 
-		if (!server->listen (QHostAddress::Any, kTcpListenPort))
-			throw std::runtime_error ("could not bind to port " + boost::lexical_cast<std::string> (kTcpListenPort) +
+		if (!server->listen (QHostAddress::Any, port))
+			throw std::runtime_error ("could not bind to port " + boost::lexical_cast<std::string> (port) +
 									  "; reason: " + server->errorString().toStdString());
 
 		std::cout << "Listening on port " << server->serverAddress().toString().toStdString() << ":" << server->serverPort()
@@ -71,7 +174,19 @@ int main (int argc, char** argv)
 		QObject::connect (server.get(), &QTcpServer::newConnection, [&] {
 			auto socket = server->nextPendingConnection();
 			std::cout << "Connection from " << socket->peerAddress().toString().toStdString() << ":" << socket->peerPort() << "." << std::endl;
-			json_protocol.new_connection (socket);
+
+			// Connections still negotiating count against the limit too, so that clients
+			// that never say anything can't exhaust descriptors:
+			if (metrics.connections.load (std::memory_order_relaxed) +
+				metrics.negotiating_connections.load (std::memory_order_relaxed) >= static_cast<int64_t> (kMaxConnections))
+			{
+				std::cout << "Too many connections, closing." << std::endl;
+				socket->abort();
+				socket->deleteLater();
+				return;
+			}
+
+			negotiate_protocol (socket, json_protocol, binary_protocol, metrics);
 		});
 
 		QObject::connect (server.get(), &QTcpServer::acceptError, [&](QAbstractSocket::SocketError error) {
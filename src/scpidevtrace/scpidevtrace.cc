@@ -0,0 +1,93 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+#include <iostream>
+
+// Boost:
+#include <boost/format.hpp>
+
+// Qt:
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+// Local:
+#include <utility/device_trace.h>
+
+
+int main (int argc, char** argv)
+{
+	try {
+		QCoreApplication app (argc, argv);
+
+		QCommandLineParser options;
+		options.setApplicationDescription ("Prints messages exchanged with meters, recorded by scpidev --device-trace.");
+		options.addHelpOption();
+		options.addPositionalArgument ("trace-file", "Device trace file to read.");
+		QCommandLineOption last_option ("last", "Print only last <seconds> of the trace.", "seconds");
+		QCommandLineOption device_option ("device", "Print only messages of <name> device.", "name");
+		options.addOptions ({ last_option, device_option });
+		options.process (app);
+
+		if (options.positionalArguments().size() != 1)
+			options.showHelp (EXIT_FAILURE);
+
+		auto const events = DeviceTrace::read (options.positionalArguments()[0]);
+
+		if (events.empty())
+		{
+			std::cout << "Trace is empty." << std::endl;
+			return EXIT_SUCCESS;
+		}
+
+		auto first = events.begin();
+
+		if (options.isSet (last_option))
+		{
+			int64_t const since = events.back().timestamp - static_cast<int64_t> (options.value (last_option).toDouble() * 1e9);
+			first = std::find_if (events.begin(), events.end(), [&](DeviceTrace::Event const& e) { return e.timestamp >= since; });
+		}
+
+		bool const filter_device = options.isSet (device_option);
+		QString const device = options.value (device_option);
+		int64_t previous_timestamp = first->timestamp;
+
+		for (auto e = first; e != events.end(); ++e)
+		{
+			if (filter_device && e->source != device)
+				continue;
+
+			// Time since the previous printed message, to make stalls stand out:
+			double const delta_ms = (e->timestamp - previous_timestamp) / 1e6;
+			previous_timestamp = e->timestamp;
+
+			if (e->type == DeviceTrace::kDropped)
+				std::cout << boost::format ("%.6f %+10.3f ms  %-12s (%u records dropped)\n") % e->unix_time % delta_ms % e->source.toStdString() % e->dropped;
+			else
+				std::cout << boost::format ("%.6f %+10.3f ms  %-12s %s %s\n") % e->unix_time % delta_ms % e->source.toStdString()
+					% DeviceTrace::type_name (e->type) % e->text.constData();
+		}
+
+		std::cout << std::flush;
+	}
+	catch (std::exception& e)
+	{
+		std::cout << "Fatal error: " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
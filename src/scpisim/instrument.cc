@@ -0,0 +1,799 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Boost:
+#include <boost/format.hpp>
+
+// Local:
+#include "instrument.h"
+
+
+namespace {
+
+constexpr int kMaxInputSize = 64 * 1024;
+constexpr std::size_t kMaxErrors = 20;
+// Returned by FETCH? when there's nothing to fetch:
+constexpr double kOverload = 9.91e37;
+
+
+/**
+ * Thrown by handlers; ends up in the error queue.
+ */
+class CommandError
+{
+  public:
+	int		code;
+	QString	message;
+};
+
+
+Instrument::Clock::duration
+to_duration (double seconds)
+{
+	return std::chrono::duration_cast<Instrument::Clock::duration> (std::chrono::duration<double> (seconds));
+}
+
+
+/**
+ * Split on separator, except inside double-quoted strings.
+ */
+QStringList
+split_unquoted (QString const& string, QChar separator)
+{
+	QStringList result;
+	QString current;
+	bool quoted = false;
+
+	for (int i = 0; i < string.size(); ++i)
+	{
+		if (string[i] == '"')
+			quoted = !quoted;
+
+		if (string[i] == separator && !quoted)
+		{
+			result << current;
+			current.clear();
+		}
+		else
+			current += string[i];
+	}
+
+	result << current;
+	return result;
+}
+
+
+QString
+single_argument (QStringList const& arguments)
+{
+	if (arguments.size() != 1)
+		throw CommandError { -109, "Missing parameter" };
+
+	return arguments[0].trimmed().toUpper();
+}
+
+
+double
+to_number (QStringList const& arguments, double minimum, double maximum, double default_value)
+{
+	QString argument = single_argument (arguments);
+
+	if (argument == "MIN" || argument == "MINIMUM")
+		return minimum;
+	else if (argument == "MAX" || argument == "MAXIMUM")
+		return maximum;
+	else if (argument == "DEF" || argument == "DEFAULT")
+		return default_value;
+
+	bool ok = false;
+	double result = argument.toDouble (&ok);
+
+	if (!ok)
+		throw CommandError { -104, "Data type error" };
+
+	if (result < minimum || result > maximum)
+		throw CommandError { -222, "Data out of range" };
+
+	return result;
+}
+
+
+bool
+to_boolean (QStringList const& arguments)
+{
+	QString argument = single_argument (arguments);
+
+	if (argument == "ON" || argument == "1")
+		return true;
+	else if (argument == "OFF" || argument == "0")
+		return false;
+	else
+		throw CommandError { -224, "Illegal parameter value" };
+}
+
+} // namespace
+
+
+Instrument::Instrument (Identity const& identity, Timing const& timing, Inputs const& inputs, Clock::time_point epoch):
+	_identity (identity),
+	_timing (timing),
+	_inputs (inputs),
+	_epoch (epoch),
+	_server (std::make_unique<QTcpServer>())
+{
+	_handlers = {
+		{ "*IDN?",				&Instrument::handle_idn },
+		{ "*RST",				&Instrument::handle_rst },
+		{ "*CLS",				&Instrument::handle_cls },
+		{ "*OPC?",				&Instrument::handle_opc },
+		{ "ABOR",				&Instrument::handle_abort },
+		{ "INIT",				&Instrument::handle_initiate },
+		{ "INIT:IMM",			&Instrument::handle_initiate },
+		{ "FETC?",				&Instrument::handle_fetch },
+		{ "READ?",				&Instrument::handle_read },
+		{ "R?",					&Instrument::handle_r },
+		{ "DATA:REM?",			&Instrument::handle_data_remove },
+		{ "DATA:POIN?",			&Instrument::handle_data_points },
+		{ "CONF:VOLT",			&Instrument::handle_configure_voltage },
+		{ "CONF:CURR",			&Instrument::handle_configure_current },
+		{ "FUNC:ZERO:AUTO",		&Instrument::handle_zero_auto },
+		{ "FUNC:NPLC",			&Instrument::handle_nplc },
+		{ "FUNC:NPLC?",			&Instrument::handle_nplc_query },
+		{ "FUNC:IMP:AUTO",		&Instrument::handle_ignored },
+		{ "TRIG:COUN",			&Instrument::handle_trigger_count },
+		{ "TRIG:DEL:AUTO",		&Instrument::handle_ignored },
+		{ "TRIG:SOUR",			&Instrument::handle_ignored },
+		{ "SAMP:COUN",			&Instrument::handle_sample_count },
+		{ "SYST:IDEN?",			&Instrument::handle_system_identify },
+		{ "SYST:TEMP?",			&Instrument::handle_system_temperature },
+		{ "SYST:ERR?",			&Instrument::handle_system_error },
+		{ "SYST:LAB",			&Instrument::handle_ignored },
+		{ "SYST:COMM:LAN:HOST?",	&Instrument::handle_hostname },
+		{ "UNIT:TEMP",			&Instrument::handle_ignored },
+		{ "UNIT:TEMP?",			&Instrument::handle_unit_temperature },
+		{ "CAL:DATE?",			&Instrument::handle_calibration_date },
+		{ "CAL:TIME?",			&Instrument::handle_calibration_time },
+		{ "CAL:TEMP?",			&Instrument::handle_calibration_temperature },
+		{ "DISP:TEXT",			&Instrument::handle_ignored },
+		{ "DISP:TEXT:CLE",		&Instrument::handle_ignored },
+	};
+
+	QObject::connect (_server.get(), &QTcpServer::newConnection, [this] {
+		handle_new_connection();
+	});
+}
+
+
+Instrument::~Instrument()
+{
+	for (auto& session: _sessions)
+		session.first->disconnect();
+
+	_sessions.clear();
+}
+
+
+void
+Instrument::listen (QHostAddress const& address, uint16_t port)
+{
+	if (!_server->listen (address, port))
+		throw ListenError ("could not bind " + _identity.name.toStdString() + " to port " + std::to_string (port) +
+						   "; reason: " + _server->errorString().toStdString());
+}
+
+
+void
+Instrument::handle_new_connection()
+{
+	while (auto socket = _server->nextPendingConnection())
+	{
+		auto& session = _sessions[socket];
+		session = std::make_unique<Session>();
+		session->socket = socket;
+		session->busy_until = Clock::now();
+		session->last_reply_due = session->busy_until;
+		session->reply_timer.setSingleShot (true);
+		session->reply_timer.setTimerType (Qt::PreciseTimer);
+		socket->setSocketOption (QAbstractSocket::LowDelayOption, 1);
+		++_statistics.connections;
+
+		auto session_ptr = session.get();
+
+		QObject::connect (&session->reply_timer, &QTimer::timeout, [this, session_ptr] {
+			send_due_replies (*session_ptr);
+		});
+
+		QObject::connect (socket, &QTcpSocket::readyRead, [this, session_ptr] {
+			handle_ready_read (*session_ptr);
+		});
+
+		QObject::connect (socket, &QTcpSocket::disconnected, [this, socket] {
+			socket->disconnect();
+			socket->deleteLater();
+			// Signal might have been emitted while session is in use, so defer:
+			QTimer::singleShot (0, _server.get(), [this, socket] {
+				_sessions.erase (socket);
+			});
+		});
+	}
+}
+
+
+void
+Instrument::handle_ready_read (Session& session)
+{
+	auto const arrival = Clock::now();
+	session.input += session.socket->readAll();
+
+	int p = 0;
+	int n = 0;
+
+	for (; (n = session.input.indexOf ('\n', p)) != -1; p = n + 1)
+	{
+		int line_end = n;
+
+		if (line_end > p && session.input[line_end - 1] == '\r')
+			--line_end;
+
+		++_statistics.messages;
+		execute (session, QString::fromLatin1 (session.input.constData() + p, line_end - p), arrival);
+	}
+
+	session.input.remove (0, p);
+
+	if (session.input.size() > kMaxInputSize)
+	{
+		session.input.clear();
+		error (-363, "Input buffer overrun");
+	}
+}
+
+
+void
+Instrument::execute (Session& session, QString const& message, Clock::time_point arrival)
+{
+	Clock::time_point time = std::max (arrival + to_duration (_timing.latency), session.busy_until);
+	QStringList replies;
+	// Commands without leading colon are relative to the subsystem of the previous one:
+	QStringList path;
+
+	for (QString command_string: split_unquoted (message, ';'))
+	{
+		command_string = command_string.trimmed();
+
+		if (command_string.isEmpty())
+			continue;
+
+		int header_end = 0;
+		while (header_end < command_string.size() && !command_string[header_end].isSpace())
+			++header_end;
+
+		QString header_string = command_string.left (header_end);
+		QString arguments_string = command_string.mid (header_end).trimmed();
+		bool common_command = header_string.startsWith ("*");
+		bool absolute = header_string.startsWith (":") || common_command;
+
+		QStringList nodes;
+		for (auto const& node: header_string.split (':'))
+			if (!node.isEmpty())
+				nodes << node;
+
+		if (!absolute)
+			nodes = path + nodes;
+
+		if (!common_command && !nodes.isEmpty())
+		{
+			path = nodes;
+			path.pop_back();
+		}
+
+		Command command;
+		command.header = canonical_header (nodes);
+
+		if (!arguments_string.isEmpty())
+			for (auto const& argument: split_unquoted (arguments_string, ','))
+				command.arguments << argument.trimmed();
+
+		auto handler = _handlers.find (command.header);
+
+		if (handler == _handlers.end())
+		{
+			error (-113, "Undefined header");
+			continue;
+		}
+
+		try {
+			auto reply = (this->*handler->second) (session, command, time);
+
+			if (reply)
+				replies << *reply;
+		}
+		catch (CommandError const& e)
+		{
+			error (e.code, e.message);
+		}
+	}
+
+	session.busy_until = time;
+
+	if (!replies.isEmpty())
+		schedule_reply (session, replies.join (";").toLatin1() + "\n", time);
+}
+
+
+void
+Instrument::schedule_reply (Session& session, QByteArray const& data, Clock::time_point completion)
+{
+	double jitter = 0.0;
+
+	if (_timing.jitter > 0.0)
+		jitter = std::exponential_distribution<double> (1.0 / _timing.jitter) (_random);
+
+	auto due = std::max (completion, Clock::now()) + to_duration (_timing.latency + jitter);
+	// Replies can't overtake each other on a TCP stream:
+	due = std::max (due, session.last_reply_due);
+	session.last_reply_due = due;
+	session.replies.push_back ({ due, data });
+
+	if (!session.reply_timer.isActive())
+		send_due_replies (session);
+}
+
+
+void
+Instrument::send_due_replies (Session& session)
+{
+	auto const now = Clock::now();
+
+	while (!session.replies.empty() && session.replies.front().due <= now)
+	{
+		session.socket->write (session.replies.front().data);
+		session.replies.pop_front();
+	}
+
+	if (!session.replies.empty())
+	{
+		auto wait = std::chrono::duration_cast<std::chrono::microseconds> (session.replies.front().due - now);
+		// QTimer has millisecond resolution; round up, so replies are never early:
+		session.reply_timer.start ((wait.count() + 999) / 1000);
+	}
+}
+
+
+QString
+Instrument::canonical_header (QStringList const& nodes)
+{
+	QStringList result;
+
+	for (auto const& node: nodes)
+	{
+		QString keyword = short_form (node);
+
+		// Optional nodes:
+		if ((result.isEmpty() && keyword == "SENS") || keyword == "DC")
+			continue;
+
+		// Function subsystems share handlers:
+		if (result.isEmpty() && (keyword == "VOLT" || keyword == "CURR"))
+			keyword = "FUNC";
+		else if (result.isEmpty() && (keyword == "VOLT?" || keyword == "CURR?"))
+			keyword = "FUNC?";
+
+		result << keyword;
+	}
+
+	return result.join (":");
+}
+
+
+QString
+Instrument::short_form (QString const& keyword)
+{
+	QString result = keyword.toUpper();
+	bool query = result.endsWith ("?");
+
+	if (query)
+		result.chop (1);
+
+	// Common commands and short keywords are used verbatim. Otherwise short form are the first
+	// four characters, or first three if the fourth one is a vowel:
+	if (!result.startsWith ("*") && result.size() > 4)
+	{
+		result = result.left (4);
+
+		if (QString ("AEIOU").contains (result[3]))
+			result.chop (1);
+	}
+
+	return query ? result + "?" : result;
+}
+
+
+void
+Instrument::error (int code, QString const& message)
+{
+	++_statistics.errors;
+	std::cerr << _identity.name.toStdString() << ": SCPI error " << code << ", " << message.toStdString() << std::endl;
+
+	if (_errors.size() < kMaxErrors)
+		_errors.push_back (QString ("%1,\"%2\"").arg (code).arg (message));
+	else
+		_errors.back() = "-350,\"Error queue overflow\"";
+}
+
+
+double
+Instrument::seconds (Clock::time_point time) const
+{
+	return std::chrono::duration<double> (time - _epoch).count();
+}
+
+
+double
+Instrument::aperture() const
+{
+	return _nplc / _timing.line_frequency;
+}
+
+
+void
+Instrument::reset_settings()
+{
+	_nplc = 10.0;
+	_auto_zero = true;
+	_trigger_count = 1;
+	_sample_count = 1;
+	_readings.clear();
+	_last_measurement.clear();
+}
+
+
+boost::optional<QString>
+Instrument::handle_idn (Session&, Command const&, Clock::time_point&)
+{
+	return "Keysight Technologies,34461A," + _identity.serial_number + ",A.02.14-02.40-02.14-00.49-01-01";
+}
+
+
+boost::optional<QString>
+Instrument::handle_rst (Session&, Command const&, Clock::time_point&)
+{
+	_measuring_current = false;
+	reset_settings();
+	return boost::none;
+}
+
+
+boost::optional<QString>
+Instrument::handle_cls (Session&, Command const&, Clock::time_point&)
+{
+	_errors.clear();
+	return boost::none;
+}
+
+
+boost::optional<QString>
+Instrument::handle_opc (Session&, Command const&, Clock::time_point& time)
+{
+	// Wait for pending measurement:
+	if (!_last_measurement.empty())
+		time = std::max (time, _last_measurement.back().ready);
+
+	return QString ("1");
+}
+
+
+boost::optional<QString>
+Instrument::handle_abort (Session&, Command const&, Clock::time_point& time)
+{
+	auto not_ready = [&](Reading const& reading) { return reading.ready > time; };
+
+	_readings.erase (std::remove_if (_readings.begin(), _readings.end(), not_ready), _readings.end());
+	_last_measurement.erase (std::remove_if (_last_measurement.begin(), _last_measurement.end(), not_ready), _last_measurement.end());
+	return boost::none;
+}
+
+
+boost::optional<QString>
+Instrument::handle_initiate (Session&, Command const&, Clock::time_point& time)
+{
+	if (!_last_measurement.empty() && _last_measurement.back().ready > time)
+		throw CommandError { -213, "INIT ignored" };
+
+	Waveform const& input = _measuring_current ? _inputs.current : _inputs.voltage;
+	double const aperture = this->aperture();
+	// With auto-zero on, every reading is followed by a zero reading:
+	double const reading_time = _auto_zero ? 2.0 * aperture : aperture;
+	double t = seconds (time);
+
+	_readings.clear();
+	_last_measurement.clear();
+
+	for (unsigned int trigger = 0; trigger < _trigger_count; ++trigger)
+	{
+		t += _timing.trigger_delay;
+
+		for (unsigned int sample = 0; sample < _sample_count; ++sample)
+		{
+			Reading reading;
+			reading.value = input.measure (t, aperture, _random);
+			t += reading_time;
+			reading.ready = _epoch + to_duration (t);
+
+			_readings.push_back (reading);
+			_last_measurement.push_back (reading);
+		}
+	}
+
+	_statistics.readings += _last_measurement.size();
+	return boost::none;
+}
+
+
+boost::optional<QString>
+Instrument::handle_fetch (Session&, Command const&, Clock::time_point& time)
+{
+	if (_last_measurement.empty())
+	{
+		error (-230, "Data stale");
+		return format_reading (kOverload);
+	}
+
+	time = std::max (time, _last_measurement.back().ready);
+
+	QStringList result;
+	for (auto const& reading: _last_measurement)
+		result << format_reading (reading.value);
+
+	return result.join (",");
+}
+
+
+boost::optional<QString>
+Instrument::handle_read (Session& session, Command const& command, Clock::time_point& time)
+{
+	handle_abort (session, command, time);
+	handle_initiate (session, command, time);
+	return handle_fetch (session, command, time);
+}
+
+
+boost::optional<QString>
+Instrument::handle_r (Session&, Command const& command, Clock::time_point& time)
+{
+	std::size_t max_count = _readings.size();
+
+	if (!command.arguments.isEmpty())
+		max_count = to_number (command.arguments, 1, 2'000'000, max_count);
+
+	// Definite-length block: #<digits><length><data>
+	QString data = take_readings (max_count, time);
+	QString length = QString::number (data.size());
+	return "#" + QString::number (length.size()) + length + data;
+}
+
+
+boost::optional<QString>
+Instrument::handle_data_remove (Session&, Command const& command, Clock::time_point& time)
+{
+	// DATA:REMOVE? <count>[,WAIT]:
+	QStringList count_argument { command.arguments.value (0) };
+	std::size_t count = to_number (count_argument, 1, 2'000'000, 1);
+
+	if (count > _readings.size())
+	{
+		// The real meter doesn't reply here; return what's there so the client doesn't hang:
+		error (-222, "Data out of range");
+		count = _readings.size();
+	}
+
+	if (count > 0)
+		time = std::max (time, _readings[count - 1].ready);
+
+	return take_readings (count, time);
+}
+
+
+boost::optional<QString>
+Instrument::handle_data_points (Session&, Command const&, Clock::time_point& time)
+{
+	auto ready = std::count_if (_readings.begin(), _readings.end(), [&](Reading const& reading) {
+		return reading.ready <= time;
+	});
+
+	return QString::number (static_cast<qint64> (ready));
+}
+
+
+boost::optional<QString>
+Instrument::handle_configure_voltage (Session&, Command const&, Clock::time_point&)
+{
+	_measuring_current = false;
+	reset_settings();
+	return boost::none;
+}
+
+
+boost::optional<QString>
+Instrument::handle_configure_current (Session&, Command const&, Clock::time_point&)
+{
+	_measuring_current = true;
+	reset_settings();
+	return boost::none;
+}
+
+
+boost::optional<QString>
+Instrument::handle_zero_auto (Session&, Command const& command, Clock::time_point& time)
+{
+	if (single_argument (command.arguments) == "ONCE")
+	{
+		// Takes single zero reading now and disables auto-zero:
+		time += to_duration (aperture());
+		_auto_zero = false;
+	}
+	else
+		_auto_zero = to_boolean (command.arguments);
+
+	return boost::none;
+}
+
+
+boost::optional<QString>
+Instrument::handle_nplc (Session&, Command const& command, Clock::time_point&)
+{
+	constexpr double kSupportedNPLCs[] = { 0.02, 0.2, 1.0, 10.0, 100.0 };
+
+	double requested = to_number (command.arguments, 0.02, 100.0, 10.0);
+
+	// Meter selects the smallest supported value not less than requested:
+	for (double nplc: kSupportedNPLCs)
+	{
+		if (nplc >= requested * (1.0 - 1e-9))
+		{
+			_nplc = nplc;
+			break;
+		}
+	}
+
+	return boost::none;
+}
+
+
+boost::optional<QString>
+Instrument::handle_nplc_query (Session&, Command const&, Clock::time_point&)
+{
+	return format_reading (_nplc);
+}
+
+
+boost::optional<QString>
+Instrument::handle_trigger_count (Session&, Command const& command, Clock::time_point&)
+{
+	_trigger_count = to_number (command.arguments, 1, 1'000'000, 1);
+	return boost::none;
+}
+
+
+boost::optional<QString>
+Instrument::handle_sample_count (Session&, Command const& command, Clock::time_point&)
+{
+	_sample_count = to_number (command.arguments, 1, 1'000'000, 1);
+	return boost::none;
+}
+
+
+boost::optional<QString>
+Instrument::handle_ignored (Session&, Command const&, Clock::time_point&)
+{
+	return boost::none;
+}
+
+
+boost::optional<QString>
+Instrument::handle_system_identify (Session&, Command const&, Clock::time_point&)
+{
+	return QString ("AT34461A");
+}
+
+
+boost::optional<QString>
+Instrument::handle_system_temperature (Session&, Command const&, Clock::time_point& time)
+{
+	constexpr double kTemperature = 32.0;
+	constexpr double kDrift = 0.3;
+	constexpr double kDriftPeriod = 1800.0;
+
+	time += to_duration (_timing.temperature_read_time);
+
+	double t = seconds (time);
+	double value = kTemperature + kDrift * std::sin (2.0 * M_PI * t / kDriftPeriod) + std::normal_distribution<double> (0.0, 0.005) (_random);
+	return format_reading (value);
+}
+
+
+boost::optional<QString>
+Instrument::handle_system_error (Session&, Command const&, Clock::time_point&)
+{
+	if (_errors.empty())
+		return QString ("+0,\"No error\"");
+
+	QString result = _errors.front();
+	_errors.pop_front();
+	return result;
+}
+
+
+boost::optional<QString>
+Instrument::handle_hostname (Session&, Command const&, Clock::time_point&)
+{
+	return "\"" + _identity.hostname + "\"";
+}
+
+
+boost::optional<QString>
+Instrument::handle_unit_temperature (Session&, Command const&, Clock::time_point&)
+{
+	return QString ("C");
+}
+
+
+boost::optional<QString>
+Instrument::handle_calibration_date (Session&, Command const&, Clock::time_point&)
+{
+	return QString ("2016,03,14");
+}
+
+
+boost::optional<QString>
+Instrument::handle_calibration_time (Session&, Command const&, Clock::time_point&)
+{
+	return QString ("12,00,00.000");
+}
+
+
+boost::optional<QString>
+Instrument::handle_calibration_temperature (Session&, Command const&, Clock::time_point&)
+{
+	return format_reading (23.5);
+}
+
+
+QString
+Instrument::format_reading (double value)
+{
+	return QString::fromStdString ((boost::format ("%+.8E") % value).str());
+}
+
+
+QString
+Instrument::take_readings (std::size_t count, Clock::time_point time)
+{
+	QStringList result;
+
+	while (count > 0 && !_readings.empty() && _readings.front().ready <= time)
+	{
+		result << format_reading (_readings.front().value);
+		_readings.pop_front();
+		--count;
+	}
+
+	return result.join (",");
+}
+
@@ -0,0 +1,350 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPISIM__INSTRUMENT_H__INCLUDED
+#define SCPISIM__INSTRUMENT_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+// Qt:
+#include <QByteArray>
+#include <QHostAddress>
+#include <QStringList>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+// Boost:
+#include <boost/optional.hpp>
+
+// Local:
+#include "waveform.h"
+
+
+/**
+ * Simulated Keysight 34461A DMM, reachable over TCP like the real one (SCPI over raw socket).
+ * Implements the subset of SCPI used by scpidev.
+ *
+ * Timing is modelled in virtual time: each program message starts executing after it arrives and
+ * the request leg of network latency passes, but not before the previous one has completed.
+ * INITIATE schedules readings at trigger delay + NPLC-derived aperture intervals; FETCH?, R?
+ * and DATA:REMOVE? complete when their readings are ready. Replies are sent after completion,
+ * plus the reply leg of latency and random jitter.
+ */
+class Instrument
+{
+  public:
+	typedef std::chrono::steady_clock Clock;
+
+	class Timing
+	{
+	  public:
+		double	line_frequency			= 50.0;
+		// Delay between trigger and start of the measurement:
+		double	trigger_delay			= 0.001;
+		// One-way network latency:
+		double	latency					= 0.0002;
+		// Mean of exponentially distributed extra reply delay:
+		double	jitter					= 0.0001;
+		double	temperature_read_time	= 0.002;
+	};
+
+	class Identity
+	{
+	  public:
+		QString	name;
+		QString	hostname;
+		QString	serial_number;
+	};
+
+	/**
+	 * Signals seen by the meter, depending on configured function.
+	 */
+	class Inputs
+	{
+	  public:
+		Waveform	voltage;
+		Waveform	current;
+	};
+
+	class Statistics
+	{
+	  public:
+		uint64_t	connections	= 0;
+		uint64_t	messages	= 0;
+		uint64_t	readings	= 0;
+		uint64_t	errors		= 0;
+	};
+
+	class ListenError: public std::runtime_error
+	{
+	  public:
+		// Ctor:
+		ListenError (std::string const& reason):
+			std::runtime_error (reason)
+		{ }
+	};
+
+  private:
+	class Reading
+	{
+	  public:
+		Clock::time_point	ready;
+		double				value;
+	};
+
+	class Reply
+	{
+	  public:
+		Clock::time_point	due;
+		QByteArray			data;
+	};
+
+	class Session
+	{
+	  public:
+		QTcpSocket*			socket;
+		QByteArray			input;
+		// Virtual time at which previous message completed:
+		Clock::time_point	busy_until;
+		Clock::time_point	last_reply_due;
+		std::deque<Reply>	replies;
+		QTimer				reply_timer;
+	};
+
+	class Command
+	{
+	  public:
+		// Canonical header, eg. "FUNC:ZERO:AUTO" or "SYST:TEMP?":
+		QString				header;
+		QStringList			arguments;
+	};
+
+	typedef boost::optional<QString> (Instrument::*Handler) (Session&, Command const&, Clock::time_point& time);
+
+  public:
+	// Ctor
+	Instrument (Identity const&, Timing const&, Inputs const&, Clock::time_point epoch);
+
+	// Dtor
+	~Instrument();
+
+	/**
+	 * Start accepting connections.
+	 * Throw ListenError on failure.
+	 */
+	void
+	listen (QHostAddress const& address, uint16_t port);
+
+	Identity const&
+	identity() const noexcept;
+
+	Statistics const&
+	statistics() const noexcept;
+
+  private:
+	void
+	handle_new_connection();
+
+	void
+	handle_ready_read (Session&);
+
+	/**
+	 * Execute single program message (semicolon-separated commands) and schedule reply, if any.
+	 */
+	void
+	execute (Session&, QString const& message, Clock::time_point arrival);
+
+	void
+	schedule_reply (Session&, QByteArray const& data, Clock::time_point completion);
+
+	void
+	send_due_replies (Session&);
+
+	/**
+	 * Return canonical header for given header nodes. Long and short forms are reduced to short forms,
+	 * optional SENSe and DC nodes are dropped and measurement function node is replaced with "FUNC".
+	 */
+	static QString
+	canonical_header (QStringList const& nodes);
+
+	/**
+	 * Return SCPI short form of a keyword (eg. CONFIGURE → CONF, CALIBRATION → CAL).
+	 */
+	static QString
+	short_form (QString const& keyword);
+
+	void
+	error (int code, QString const& message);
+
+	double
+	seconds (Clock::time_point) const;
+
+	/**
+	 * Integration time of single reading.
+	 */
+	double
+	aperture() const;
+
+	/**
+	 * Restore settings set by CONFIGURE and *RST.
+	 */
+	void
+	reset_settings();
+
+	// Handlers. Each one executes at virtual time passed in 'time' and advances it
+	// if command takes time to complete. Queries return reply:
+
+	boost::optional<QString>
+	handle_idn (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_rst (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_cls (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_opc (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_abort (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_initiate (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_fetch (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_read (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_r (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_data_remove (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_data_points (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_configure_voltage (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_configure_current (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_zero_auto (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_nplc (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_nplc_query (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_trigger_count (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_sample_count (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_ignored (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_system_identify (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_system_temperature (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_system_error (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_hostname (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_unit_temperature (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_calibration_date (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_calibration_time (Session&, Command const&, Clock::time_point& time);
+
+	boost::optional<QString>
+	handle_calibration_temperature (Session&, Command const&, Clock::time_point& time);
+
+	/**
+	 * Format reading like the meter does, eg. "+1.23456789E+01".
+	 */
+	static QString
+	format_reading (double value);
+
+	/**
+	 * Remove up to count readings ready at given time and return them comma-separated.
+	 */
+	QString
+	take_readings (std::size_t count, Clock::time_point time);
+
+  private:
+	Identity							_identity;
+	Timing								_timing;
+	Inputs								_inputs;
+	Clock::time_point					_epoch;
+	std::minstd_rand					_random;
+	std::unique_ptr<QTcpServer>			_server;
+	std::map<QTcpSocket*, std::unique_ptr<Session>>
+										_sessions;
+	std::map<QString, Handler>			_handlers;
+	Statistics							_statistics;
+
+	// Instrument state:
+	bool								_measuring_current		= false;
+	double								_nplc					= 10.0;
+	bool								_auto_zero				= true;
+	unsigned int						_trigger_count			= 1;
+	unsigned int						_sample_count			= 1;
+	// Reading memory:
+	std::deque<Reading>					_readings;
+	// Readings of the last INITIATE (for FETCH?):
+	std::vector<Reading>				_last_measurement;
+	std::deque<QString>					_errors;
+};
+
+
+inline Instrument::Identity const&
+Instrument::identity() const noexcept
+{
+	return _identity;
+}
+
+
+inline Instrument::Statistics const&
+Instrument::statistics() const noexcept
+{
+	return _statistics;
+}
+
+#endif
+
@@ -0,0 +1,168 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// Linux:
+#include <signal.h>
+
+// Boost:
+#include <boost/format.hpp>
+
+// Qt:
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTimer>
+
+// SCPISim:
+#include <scpisim/instrument.h>
+#include <scpisim/waveform.h>
+#include <utility/unix_signaller.h>
+
+
+std::unique_ptr<UnixSignaller> g_unix_signaller;
+
+
+void
+catch_sigint (int signum)
+{
+	g_unix_signaller->post (signum);
+	::signal (SIGINT, SIG_DFL);
+}
+
+
+double
+to_non_negative (QString const& string, char const* option_name)
+{
+	bool ok = false;
+	double result = string.toDouble (&ok);
+
+	if (!ok || result < 0.0)
+		throw std::runtime_error (std::string ("invalid --") + option_name + " value");
+
+	return result;
+}
+
+
+void
+print_statistics (std::vector<Instrument const*> const& instruments, double elapsed)
+{
+	for (auto const* instrument: instruments)
+	{
+		auto const& statistics = instrument->statistics();
+		std::cout << boost::format ("%-10s %10u readings (%8.1f/s), %10u messages, %u connections, %u errors\n")
+			% instrument->identity().name.toStdString() % statistics.readings % (statistics.readings / elapsed)
+			% statistics.messages % statistics.connections % statistics.errors;
+	}
+
+	std::cout << std::flush;
+}
+
+
+int main (int argc, char** argv)
+{
+	try {
+		auto event_loop = std::make_unique<QCoreApplication> (argc, argv);
+
+		QCommandLineParser options;
+		options.setApplicationDescription ("Simulates the pair of 34461A meters used by scpidev.");
+		options.addHelpOption();
+		QCommandLineOption listen_option ("listen", "Listen on <address>.", "address", "127.0.0.1");
+		QCommandLineOption voltmeter_port_option ("voltmeter-port", "TCP port of the voltmeter.", "port", "5025");
+		QCommandLineOption ammeter_port_option ("ammeter-port", "TCP port of the ammeter.", "port", "5026");
+		QCommandLineOption latency_option ("latency", "One-way network latency.", "ms", "0.2");
+		QCommandLineOption jitter_option ("jitter", "Mean of exponentially distributed extra reply delay.", "ms", "0.1");
+		QCommandLineOption trigger_delay_option ("trigger-delay", "Delay between trigger and measurement.", "ms", "1");
+		QCommandLineOption line_frequency_option ("line-frequency", "Power line frequency for NPLC.", "Hz", "50");
+		QCommandLineOption voltage_option ("voltage", "Voltage waveform: shape:offset[:amplitude[:period[:noise]]].", "waveform", "constant:12:0:1:0.0005");
+		QCommandLineOption current_option ("current", "Current waveform: shape:offset[:amplitude[:period[:noise]]].", "waveform", "square:2:1.5:5:0.002");
+		QCommandLineOption stats_interval_option ("stats-interval", "Print statistics every <seconds>.", "seconds");
+		options.addOptions ({
+			listen_option, voltmeter_port_option, ammeter_port_option, latency_option, jitter_option, trigger_delay_option,
+			line_frequency_option, voltage_option, current_option, stats_interval_option,
+		});
+		options.process (*event_loop);
+
+		QHostAddress listen_address;
+		if (!listen_address.setAddress (options.value (listen_option)))
+			throw std::runtime_error ("invalid --listen address");
+
+		Instrument::Timing timing;
+		timing.latency = to_non_negative (options.value (latency_option), "latency") / 1000.0;
+		timing.jitter = to_non_negative (options.value (jitter_option), "jitter") / 1000.0;
+		timing.trigger_delay = to_non_negative (options.value (trigger_delay_option), "trigger-delay") / 1000.0;
+		timing.line_frequency = to_non_negative (options.value (line_frequency_option), "line-frequency");
+
+		if (timing.line_frequency == 0.0)
+			throw std::runtime_error ("invalid --line-frequency value");
+
+		Instrument::Inputs inputs;
+		inputs.voltage = Waveform::parse (options.value (voltage_option));
+		inputs.current = Waveform::parse (options.value (current_option));
+
+		// Identities match what scpidev verifies:
+		auto const epoch = Instrument::Clock::now();
+		Instrument voltmeter ({ "voltmeter", "A-34461A-09358", "MY53209358" }, timing, inputs, epoch);
+		Instrument ammeter ({ "ammeter", "K-34461A-18230", "MY57218230" }, timing, inputs, epoch);
+
+		voltmeter.listen (listen_address, to_non_negative (options.value (voltmeter_port_option), "voltmeter-port"));
+		ammeter.listen (listen_address, to_non_negative (options.value (ammeter_port_option), "ammeter-port"));
+
+		std::cout << "Simulating voltmeter on port " << options.value (voltmeter_port_option).toStdString()
+				  << " and ammeter on port " << options.value (ammeter_port_option).toStdString() << "." << std::endl;
+
+		auto elapsed = [&] {
+			return std::chrono::duration<double> (Instrument::Clock::now() - epoch).count();
+		};
+
+		QTimer stats_timer;
+
+		if (options.isSet (stats_interval_option))
+		{
+			double stats_interval = to_non_negative (options.value (stats_interval_option), "stats-interval");
+
+			QObject::connect (&stats_timer, &QTimer::timeout, [&] {
+				print_statistics ({ &voltmeter, &ammeter }, elapsed());
+			});
+			stats_timer.start (std::max (1.0, stats_interval * 1000.0));
+		}
+
+		g_unix_signaller = std::make_unique<UnixSignaller>();
+		::signal (SIGINT, catch_sigint);
+
+		QObject::connect (g_unix_signaller.get(), &UnixSignaller::got_signal, [&](int signum) {
+			if (signum == SIGINT)
+				event_loop->quit();
+		});
+
+		event_loop->exec();
+
+		std::cout << "\n";
+		print_statistics ({ &voltmeter, &ammeter }, elapsed());
+		std::cout << "Quitting.\n";
+	}
+	catch (std::exception& e)
+	{
+		std::cout << "Fatal error: " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,107 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <cmath>
+
+// Qt:
+#include <QStringList>
+
+// Local:
+#include "waveform.h"
+
+
+Waveform
+Waveform::parse (QString const& specification)
+{
+	QStringList parts = specification.split (':');
+
+	if (parts.size() < 2 || parts.size() > 5)
+		throw InvalidSpecification (specification);
+
+	Waveform result;
+	QString shape = parts[0].toLower();
+
+	if (shape == "constant")
+		result.shape = kConstant;
+	else if (shape == "sine")
+		result.shape = kSine;
+	else if (shape == "square")
+		result.shape = kSquare;
+	else if (shape == "sawtooth")
+		result.shape = kSawtooth;
+	else
+		throw InvalidSpecification (specification);
+
+	double* fields[] = { &result.offset, &result.amplitude, &result.period, &result.noise };
+
+	for (int i = 1; i < parts.size(); ++i)
+	{
+		bool ok = false;
+		*fields[i - 1] = parts[i].toDouble (&ok);
+
+		if (!ok)
+			throw InvalidSpecification (specification);
+	}
+
+	if (result.period <= 0.0 || result.noise < 0.0)
+		throw InvalidSpecification (specification);
+
+	return result;
+}
+
+
+double
+Waveform::measure (double start, double aperture, std::minstd_rand& random) const
+{
+	// Few points are enough, since periods are much longer than apertures in practice:
+	constexpr int kIntegrationPoints = 8;
+
+	double sum = 0.0;
+
+	for (int i = 0; i < kIntegrationPoints; ++i)
+		sum += value (start + aperture * (i + 0.5) / kIntegrationPoints);
+
+	double result = sum / kIntegrationPoints;
+
+	if (noise > 0.0)
+		result += std::normal_distribution<double> (0.0, noise) (random);
+
+	return result;
+}
+
+
+double
+Waveform::value (double t) const
+{
+	double phase = std::fmod (t, period) / period;
+
+	switch (shape)
+	{
+		case kConstant:
+			return offset;
+
+		case kSine:
+			return offset + amplitude * std::sin (2.0 * M_PI * phase);
+
+		case kSquare:
+			return offset + (phase < 0.5 ? amplitude : -amplitude);
+
+		case kSawtooth:
+			return offset + amplitude * (2.0 * phase - 1.0);
+	}
+
+	return offset;
+}
+
@@ -0,0 +1,81 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef SCPISIM__WAVEFORM_H__INCLUDED
+#define SCPISIM__WAVEFORM_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <random>
+#include <stdexcept>
+
+// Qt:
+#include <QString>
+
+
+/**
+ * Synthetic signal seen by a simulated meter.
+ */
+class Waveform
+{
+  public:
+	enum Shape
+	{
+		kConstant,
+		kSine,
+		kSquare,
+		kSawtooth,
+	};
+
+	class InvalidSpecification: public std::invalid_argument
+	{
+	  public:
+		// Ctor:
+		InvalidSpecification (QString const& specification):
+			std::invalid_argument ("invalid waveform specification '" + specification.toStdString() + "', "
+								   "expected shape:offset[:amplitude[:period[:noise]]]")
+		{ }
+	};
+
+  public:
+	/**
+	 * Parse waveform from "shape:offset[:amplitude[:period[:noise]]]", where shape is one of
+	 * constant, sine, square or sawtooth, period is in seconds and noise is gaussian standard deviation.
+	 */
+	static Waveform
+	parse (QString const& specification);
+
+	/**
+	 * Average value of the signal over [start, start + aperture], plus noise.
+	 * Averaging approximates what an integrating ADC returns.
+	 */
+	double
+	measure (double start, double aperture, std::minstd_rand& random) const;
+
+  private:
+	/**
+	 * Noiseless value at given time.
+	 */
+	double
+	value (double t) const;
+
+  public:
+	Shape	shape		= kConstant;
+	double	offset		= 0.0;
+	double	amplitude	= 0.0;
+	double	period		= 1.0;
+	double	noise		= 0.0;
+};
+
+#endif
+
@@ -0,0 +1,334 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Qt:
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+
+// SCPIDev:
+#include <scpidev/pipeline.h>
+#include <scpidev/replay.h>
+#include <utility/file_db.h>
+#include <utility/slice_statistics.h>
+
+
+using namespace scpidev;
+
+// Slices are computed in batches of about this many values, which bounds memory use:
+constexpr std::size_t kBatchValues = 1 << 20;
+constexpr std::size_t kMaxLineLength = 64 * 1024;
+constexpr std::size_t kDefaultSliceRows = 100;
+
+
+/**
+ * Source of rows, either a CSV log or a SampleRecorder recording.
+ */
+class RowReader
+{
+  public:
+	/**
+	 * \param	max_column
+	 *			The highest column index that will be read.
+	 */
+	RowReader (QIODevice& input, QString const& name, std::size_t max_column);
+
+	/**
+	 * Read next row into given array of max_column + 1 values.
+	 * Return false at the end of input. Throw std::runtime_error on malformed input.
+	 */
+	bool
+	next (double* row);
+
+  private:
+	bool
+	next_csv (double* row);
+
+	bool
+	next_recording (double* row);
+
+  private:
+	QIODevice&					_input;
+	QString						_name;
+	std::size_t					_max_column;
+	bool						_recording			= false;
+	uint64_t					_line				= 0;
+	std::vector<char>			_line_buffer;
+	// Recording only:
+	SampleRecorder::Header		_header;
+	std::unique_ptr<SampleProcessor>
+								_processor;
+};
+
+
+RowReader::RowReader (QIODevice& input, QString const& name, std::size_t max_column):
+	_input (input),
+	_name (name),
+	_max_column (max_column),
+	_line_buffer (kMaxLineLength)
+{
+	QByteArray const magic = _input.peek (sizeof (SampleRecorder::kMagic));
+
+	if (magic.size() == sizeof (SampleRecorder::kMagic) && std::memcmp (magic.constData(), SampleRecorder::kMagic, sizeof (SampleRecorder::kMagic)) == 0)
+	{
+		if (max_column >= FileDB::kColumnsCount)
+			throw std::runtime_error ("recordings have only " + std::to_string (FileDB::kColumnsCount) + " columns");
+
+		_recording = true;
+		_header = read_recording_header (_input, _name);
+		_processor = std::make_unique<SampleProcessor> (_header.initial_voltage, _header.initial_current, _header.burden_resistance);
+	}
+}
+
+
+inline bool
+RowReader::next (double* row)
+{
+	return _recording ? next_recording (row) : next_csv (row);
+}
+
+
+bool
+RowReader::next_csv (double* row)
+{
+	while (true)
+	{
+		qint64 const length = _input.readLine (_line_buffer.data(), _line_buffer.size());
+
+		if (length <= 0)
+			return false;
+
+		++_line;
+
+		if (static_cast<std::size_t> (length) == _line_buffer.size() - 1 && _line_buffer[length - 1] != '\n')
+			throw std::runtime_error (_name.toStdString() + ":" + std::to_string (_line) + ": line too long");
+
+		char const* p = _line_buffer.data();
+
+		while (*p == ' ' || *p == '\t')
+			++p;
+
+		if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+			continue;
+
+		for (std::size_t column = 0; column <= _max_column; ++column)
+		{
+			char* end = nullptr;
+			row[column] = std::strtod (p, &end);
+
+			if (end == p || (column < _max_column && *end != ','))
+				throw std::runtime_error (_name.toStdString() + ":" + std::to_string (_line) + ": expected at least " +
+										  std::to_string (_max_column + 1) + " numeric columns");
+
+			p = end + 1;
+		}
+
+		return true;
+	}
+}
+
+
+bool
+RowReader::next_recording (double* row)
+{
+	SampleRecorder::Record record;
+
+	// A partially written last record (eg. after a crash) is ignored:
+	if (_input.read (reinterpret_cast<char*> (&record), sizeof (record)) != sizeof (record))
+		return false;
+
+	Sample sample;
+	decode_record (record, _header.start_timestamp, sample);
+	_processor->process (sample);
+
+	auto const columns = sample_columns (sample);
+
+	std::copy (columns.begin(), columns.begin() + _max_column + 1, row);
+	return true;
+}
+
+
+/**
+ * Append shortest representation of value that reads back exactly, followed by a comma.
+ */
+void
+append_number (std::string& output, double value)
+{
+	char buffer[32];
+
+	for (int precision = 15; precision <= 17; ++precision)
+	{
+		std::snprintf (buffer, sizeof (buffer), "%.*g", precision, value);
+
+		if (std::strtod (buffer, nullptr) == value)
+			break;
+	}
+
+	output += buffer;
+	output += ',';
+}
+
+
+/**
+ * Compute and print statistics of given slices and clear them.
+ * Output format is the same as of tools/make_stats:
+ * mean timestamp, then min, p25, mean, p75, max of each column, each followed by a comma.
+ */
+void
+flush (std::vector<Slice>& slices, unsigned int threads)
+{
+	std::string output;
+
+	for (auto const& statistics: compute_statistics (slices, threads))
+	{
+		append_number (output, statistics.mean_timestamp);
+
+		for (auto const& column: statistics.columns)
+		{
+			append_number (output, column.min);
+			append_number (output, column.p25);
+			append_number (output, column.mean);
+			append_number (output, column.p75);
+			append_number (output, column.max);
+		}
+
+		output += '\n';
+	}
+
+	std::fwrite (output.data(), 1, output.size(), stdout);
+	slices.clear();
+}
+
+
+int main (int argc, char** argv)
+{
+	try {
+		QCoreApplication app (argc, argv);
+
+		QCommandLineParser options;
+		options.setApplicationDescription ("Prints min, p25, mean, p75 and max of selected columns over slices of a scpidev log.\n"
+										   "Reads CSV or a recording made with scpidev --record, streaming, in a single pass.");
+		options.addHelpOption();
+		options.addPositionalArgument ("columns", "Comma-separated indexes of columns to summarize (timestamp is column 0).");
+		options.addPositionalArgument ("rows", "Number of rows in each slice (default " + QString::number (kDefaultSliceRows) + ").", "[rows]");
+		QCommandLineOption input_option ("input", "Read <file> instead of standard input.", "file");
+		QCommandLineOption timebox_option ("timebox", "Slice by time instead of rows: each slice ends with the first row more than <seconds> after its first one.", "seconds");
+		QCommandLineOption threads_option ("threads", "Compute columns in <n> threads (default: number of CPUs).", "n");
+		options.addOptions ({ input_option, timebox_option, threads_option });
+		options.process (app);
+
+		auto const arguments = options.positionalArguments();
+
+		if (arguments.size() < 1 || arguments.size() > 2)
+			options.showHelp (EXIT_FAILURE);
+
+		std::vector<std::size_t> columns;
+
+		for (auto const& column: arguments[0].split (','))
+		{
+			bool ok = false;
+			columns.push_back (column.toUInt (&ok));
+
+			if (!ok)
+				throw std::runtime_error ("invalid column index '" + column.toStdString() + "'");
+		}
+
+		std::size_t slice_rows = kDefaultSliceRows;
+
+		if (arguments.size() > 1)
+		{
+			bool ok = false;
+			slice_rows = arguments[1].toUInt (&ok);
+
+			if (!ok || slice_rows == 0)
+				throw std::runtime_error ("invalid number of rows per slice");
+		}
+
+		bool const timeboxed = options.isSet (timebox_option);
+		double const timebox = options.value (timebox_option).toDouble();
+		unsigned int const threads = options.isSet (threads_option)
+			? std::max (1u, options.value (threads_option).toUInt())
+			: std::max (1u, std::thread::hardware_concurrency());
+
+		QFile input;
+		QString name = "stdin";
+
+		if (options.isSet (input_option))
+		{
+			name = options.value (input_option);
+			input.setFileName (name);
+
+			if (!input.open (QIODevice::ReadOnly))
+				throw std::runtime_error ("couldn't open " + name.toStdString() + ": " + input.errorString().toStdString());
+		}
+		else if (!input.open (stdin, QIODevice::ReadOnly))
+			throw std::runtime_error ("couldn't open stdin: " + input.errorString().toStdString());
+
+		std::size_t const max_column = *std::max_element (columns.begin(), columns.end());
+		RowReader reader (input, name, max_column);
+		std::vector<double> row (max_column + 1);
+		std::vector<double> values (columns.size());
+		std::vector<Slice> slices;
+		std::size_t batch_values = 0;
+		Slice slice (columns.size());
+
+		while (reader.next (row.data()))
+		{
+			for (std::size_t c = 0; c < columns.size(); ++c)
+				values[c] = row[columns[c]];
+
+			slice.append (row[0], values.data());
+
+			if (timeboxed ? slice.duration() > timebox : slice.rows() == slice_rows)
+			{
+				batch_values += slice.rows() * columns.size();
+				slices.push_back (std::move (slice));
+				slice = Slice (columns.size());
+
+				if (batch_values >= kBatchValues)
+				{
+					flush (slices, threads);
+					batch_values = 0;
+				}
+			}
+		}
+
+		// The last slice may be shorter:
+		if (slice.rows() > 0)
+			slices.push_back (std::move (slice));
+
+		flush (slices, threads);
+		std::fflush (stdout);
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << "Fatal error: " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,236 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <array>
+#include <iostream>
+#include <vector>
+
+// Boost:
+#include <boost/format.hpp>
+
+// Qt:
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+// Local:
+#include <utility/latency_histogram.h>
+#include <utility/stage_trace.h>
+
+
+namespace {
+
+typedef StageTrace::Record Record;
+
+/**
+ * Interval between two stage timestamps. If from_previous is set, the 'from' stage is taken
+ * from the previous sample.
+ */
+class Segment
+{
+  public:
+	char const*			name;
+	bool				from_previous;
+	StageTrace::Stage	from;
+	StageTrace::Stage	to;
+	// Whether it lies between two consecutive INITIATEs, so it can cause timing errors:
+	bool				in_dt;
+};
+
+
+constexpr std::array<Segment, 9> kSegments {{
+	{ "dt",					true,	StageTrace::kInitiated,			StageTrace::kInitiated,			false },
+	{ "loop",				true,	StageTrace::kQueued,			StageTrace::kLoopStart,			true },
+	// Meters are queried concurrently, so this is the slowest meter's round trip:
+	{ "fetch",				false,	StageTrace::kLoopStart,			StageTrace::kFetched,			true },
+	{ "housekeeping",		false,	StageTrace::kFetched,			StageTrace::kHousekeepingDone,	true },
+	{ "initiate",			false,	StageTrace::kHousekeepingDone,	StageTrace::kInitiated,			true },
+	{ "compute",			false,	StageTrace::kInitiated,			StageTrace::kComputed,			false },
+	{ "queue-push",			false,	StageTrace::kComputed,			StageTrace::kQueued,			false },
+	{ "queue-wait",			false,	StageTrace::kQueued,			StageTrace::kDequeued,			false },
+	{ "log-write",			false,	StageTrace::kDequeued,			StageTrace::kLogged,			false },
+}};
+
+// Compute and queue-push of the previous sample also fall between two INITIATEs:
+constexpr std::size_t kPreviousCompute = 5;
+constexpr std::size_t kPreviousQueuePush = 6;
+
+
+/**
+ * Return segment duration in ns, or -1 if it can't be computed.
+ */
+int64_t
+duration (Segment const& segment, Record const& record, Record const* previous)
+{
+	Record const* from_record = segment.from_previous ? previous : &record;
+
+	if (!from_record)
+		return -1;
+
+	int64_t from = from_record->stamps[segment.from];
+	int64_t to = record.stamps[segment.to];
+
+	if (from == 0 || to == 0 || to < from)
+		return -1;
+
+	return to - from;
+}
+
+
+double
+ms (double ns)
+{
+	return ns / 1e6;
+}
+
+} // namespace
+
+
+int main (int argc, char** argv)
+{
+	try {
+		QCoreApplication app (argc, argv);
+
+		QCommandLineParser options;
+		options.setApplicationDescription ("Summarizes stage trace recorded by scpidev --trace.");
+		options.addHelpOption();
+		options.addPositionalArgument ("trace-file", "Trace file to read.");
+		QCommandLineOption list_option ("list", "List first <n> timing errors.", "n", "20");
+		options.addOption (list_option);
+		options.process (app);
+
+		if (options.positionalArguments().size() != 1)
+			options.showHelp (EXIT_FAILURE);
+
+		auto const records = StageTrace::read (options.positionalArguments()[0]);
+
+		if (records.empty())
+		{
+			std::cout << "Trace is empty." << std::endl;
+			return EXIT_SUCCESS;
+		}
+
+		std::array<LatencyHistogram, kSegments.size()> histograms;
+
+		for (std::size_t i = 0; i < records.size(); ++i)
+		{
+			Record const* previous = (i > 0 && records[i - 1].sample_number + 1 == records[i].sample_number) ? &records[i - 1] : nullptr;
+
+			for (std::size_t s = 0; s < kSegments.size(); ++s)
+			{
+				auto d = duration (kSegments[s], records[i], previous);
+				if (d >= 0)
+					histograms[s].record (d);
+			}
+		}
+
+		// Attribute each timing error to the segment with the largest excess over its median:
+		std::array<uint64_t, kSegments.size()> causes {};
+		uint64_t timing_errors = 0;
+		uint64_t unattributed = 0;
+		std::size_t const list_limit = options.value (list_option).toULongLong();
+		std::vector<std::string> listed;
+
+		for (std::size_t i = 0; i < records.size(); ++i)
+		{
+			Record const& record = records[i];
+
+			if (!(record.flags & StageTrace::kTimingError))
+				continue;
+
+			++timing_errors;
+			Record const* previous = (i > 0 && records[i - 1].sample_number + 1 == record.sample_number) ? &records[i - 1] : nullptr;
+
+			std::size_t worst = kSegments.size();
+			double worst_excess = 0.0;
+
+			auto consider = [&](std::size_t s, Record const& r, Record const* p) {
+				auto d = duration (kSegments[s], r, p);
+				if (d < 0)
+					return;
+
+				double excess = d - static_cast<double> (histograms[s].quantile (0.5));
+				if (worst == kSegments.size() || excess > worst_excess)
+				{
+					worst = s;
+					worst_excess = excess;
+				}
+			};
+
+			for (std::size_t s = 0; s < kSegments.size(); ++s)
+				if (kSegments[s].in_dt)
+					consider (s, record, previous);
+
+			if (previous)
+			{
+				consider (kPreviousCompute, *previous, nullptr);
+				consider (kPreviousQueuePush, *previous, nullptr);
+			}
+
+			if (worst == kSegments.size())
+			{
+				++unattributed;
+				continue;
+			}
+
+			++causes[worst];
+
+			if (listed.size() < list_limit)
+			{
+				auto dt = duration (kSegments[0], record, previous);
+				listed.push_back ((boost::format ("  sample %10u   dt %9.3f ms   cause %-16s (+%.3f ms over median)")
+								   % record.sample_number % ms (dt) % kSegments[worst].name % ms (worst_excess)).str());
+			}
+		}
+
+		std::cout << boost::format ("Samples: %u (numbers %u…%u), timing errors: %u\n\n")
+			% records.size() % records.front().sample_number % records.back().sample_number % timing_errors;
+
+		std::cout << boost::format ("%-18s %10s %10s %10s %10s %10s %10s\n") % "Segment [ms]" % "count" % "p50" % "p90" % "p99" % "p999" % "max";
+
+		for (std::size_t s = 0; s < kSegments.size(); ++s)
+		{
+			auto const& h = histograms[s];
+			std::cout << boost::format ("%-18s %10u %10.3f %10.3f %10.3f %10.3f %10.3f\n")
+				% kSegments[s].name % h.count() % ms (h.quantile (0.5)) % ms (h.quantile (0.9))
+				% ms (h.quantile (0.99)) % ms (h.quantile (0.999)) % ms (h.max());
+		}
+
+		if (timing_errors > 0)
+		{
+			std::cout << "\nTiming errors by root cause:\n";
+
+			for (std::size_t s = 0; s < kSegments.size(); ++s)
+				if (causes[s] > 0)
+					std::cout << boost::format ("  %-16s %10u (%5.1f%%)\n") % kSegments[s].name % causes[s] % (100.0 * causes[s] / timing_errors);
+
+			if (unattributed > 0)
+				std::cout << boost::format ("  %-16s %10u\n") % "unknown" % unattributed;
+
+			std::cout << "\nTiming errors:\n";
+			for (auto const& line: listed)
+				std::cout << line << "\n";
+		}
+
+		std::cout << std::flush;
+	}
+	catch (std::exception& e)
+	{
+		std::cout << "Fatal error: " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,133 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+// Qt:
+#include <QCoreApplication>
+#include <QDate>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QTime>
+
+// SCPIDev:
+#include <scpidev/pipeline.h>
+#include <scpidevd/requests_handler.h>
+#include <loadgen/dataset.h>
+#include <utility/file_db.h>
+
+
+using namespace scpidev;
+
+constexpr double kDatasetSamplePeriod = 0.1;
+
+
+/**
+ * Sample with all fields filled in, as log_sample() gets it.
+ */
+Sample
+make_sample (double timestamp)
+{
+	Sample sample;
+	sample.initiate_timestamp = timestamp;
+	sample.voltage = 12.003456789;
+	sample.current = 3.141592653;
+	sample.dt = kDatasetSamplePeriod;
+
+	SampleProcessor processor (sample.voltage, sample.current);
+	processor.process (sample);
+	return sample;
+}
+
+
+/**
+ * Check that samples appended to the latest file change cached results of windows
+ * ending after the previous last sample (but before the new ones).
+ * Return true if the check passed.
+ */
+bool
+check_appended_samples()
+{
+	QTemporaryDir data_dir;
+
+	if (!data_dir.isValid())
+		throw std::runtime_error ("could not create temporary directory");
+
+	// Keep all samples within a single day file:
+	double const noon = QDateTime (QDate::currentDate(), QTime (12, 0)).toMSecsSinceEpoch() / 1000.0;
+	Dataset const dataset = generate_dataset (QDir (data_dir.path()), noon, 600.0, kDatasetSamplePeriod);
+
+	FileDB data_db { QDir (data_dir.path()) };
+	RequestsHandler requests_handler (data_db);
+
+	RequestsHandler::AggregateRequest request;
+	request.start_timestamp = dataset.end_timestamp - 60.0;
+	request.end_timestamp = dataset.end_timestamp + 2.0;
+
+	auto const before = requests_handler.handle_request (request);
+
+	for (double t = dataset.end_timestamp + 5.0; t < dataset.end_timestamp + 6.0; t += kDatasetSamplePeriod)
+		log_sample (make_sample (t), data_db);
+
+	data_db.get_file_for_timestamp (dataset.end_timestamp + 5.0)->flush();
+
+	auto const after = requests_handler.handle_request (request);
+	return after.energy_J != before.energy_J;
+}
+
+
+int main (int argc, char** argv)
+{
+	struct Check
+	{
+		char const*				name;
+		std::function<bool()>	run;
+	};
+
+	try {
+		QCoreApplication app (argc, argv);
+
+		std::vector<Check> const checks {
+			{ "requests/appended-samples", check_appended_samples },
+		};
+
+		std::size_t failed = 0;
+
+		for (auto const& check: checks)
+		{
+			bool const passed = check.run();
+			std::cout << QJsonDocument (QJsonObject { { "check", check.name }, { "passed", passed } }).toJson (QJsonDocument::Compact).constData() << std::endl;
+
+			if (!passed)
+				++failed;
+		}
+
+		if (failed > 0)
+			return EXIT_FAILURE;
+	}
+	catch (std::exception& e)
+	{
+		std::cout << "Fatal error: " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,444 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+// Linux:
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+// Qt:
+#include <QFile>
+
+// Local:
+#include "device_trace.h"
+#include "stage_trace.h"
+
+
+constexpr char DeviceTrace::kMagic[8];
+constexpr uint32_t DeviceTrace::kVersion;
+constexpr std::size_t DeviceTrace::kDataSize;
+
+static_assert (sizeof (DeviceTrace::Record) == 64, "DeviceTrace::Record should fill a cache line");
+
+// Records per device ring; 64 KiB per ring covers seconds of traffic even at 1 kHz:
+constexpr std::size_t kRingCapacity = 1024;
+constexpr std::chrono::milliseconds kDrainPeriod { 100 };
+
+
+DeviceTrace::Source::Source (uint16_t id, QString const& name, std::size_t capacity):
+	_id (id),
+	_name (name),
+	_ring (capacity),
+	_mask (capacity - 1)
+{ }
+
+
+void
+DeviceTrace::Source::sent (char const* data, std::size_t size)
+{
+	// fromRawData() doesn't copy, so lookups of known commands don't allocate:
+	uint32_t id = _commands.value (QByteArray::fromRawData (data, size), 0);
+
+	if (id == 0)
+	{
+		id = _commands.size() + 1;
+
+		// Intern only if the definition made it to the ring, otherwise retry next time:
+		if (push (kDefinition, id, data, size))
+			_commands.insert (QByteArray (data, size), id);
+		else
+			return;
+	}
+
+	push (kSent, id, nullptr, 0);
+}
+
+
+void
+DeviceTrace::Source::received (char const* data, std::size_t size) noexcept
+{
+	push (kReceived, 0, data, size);
+}
+
+
+bool
+DeviceTrace::Source::push (Type type, uint32_t id, char const* data, std::size_t size) noexcept
+{
+	std::size_t const count = std::max<std::size_t> (1, (size + kDataSize - 1) / kDataSize);
+	uint64_t const head = _head.load (std::memory_order_relaxed);
+	uint64_t const tail = _tail.load (std::memory_order_acquire);
+
+	if (head - tail + count > _ring.size())
+	{
+		_dropped.store (_dropped.load (std::memory_order_relaxed) + count, std::memory_order_relaxed);
+		return false;
+	}
+
+	int64_t const timestamp = monotonic_raw_ns();
+
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		Record& record = _ring[(head + i) & _mask];
+		std::size_t const offset = i * kDataSize;
+		std::size_t const length = std::min (kDataSize, size - std::min (size, offset));
+
+		record.timestamp = timestamp;
+		record.id = id;
+		record.source = _id;
+		record.type = type;
+		record.flags = (i + 1 < count) ? kContinued : 0;
+		record.length = length;
+
+		if (length > 0)
+			std::memcpy (record.data, data + offset, length);
+	}
+
+	// Publish all parts at once, so that the writer never sees half of a message:
+	_head.store (head + count, std::memory_order_release);
+	return true;
+}
+
+
+DeviceTrace::DeviceTrace (QString const& path, double keep_seconds):
+	_path (path),
+	_keep_ns (static_cast<int64_t> (std::max (0.0, keep_seconds) * 1e9))
+{
+	open_file();
+	_thread = std::thread (&DeviceTrace::run, this);
+}
+
+
+DeviceTrace::~DeviceTrace()
+{
+	{
+		std::lock_guard<std::mutex> lock (_mutex);
+		_quit = true;
+	}
+	_quit_condition.notify_all();
+	_thread.join();
+
+	if (_fd != -1)
+		::close (_fd);
+}
+
+
+DeviceTrace::Source*
+DeviceTrace::add_source (QString const& name)
+{
+	std::lock_guard<std::mutex> lock (_mutex);
+	_sources.push_back (std::unique_ptr<Source> (new Source (_sources.size(), name, kRingCapacity)));
+	return _sources.back().get();
+}
+
+
+void
+DeviceTrace::run()
+{
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock (_mutex);
+
+			if (_quit_condition.wait_for (lock, kDrainPeriod, [&] { return _quit; }))
+				break;
+		}
+
+		drain();
+	}
+
+	// Whatever was logged before the devices went away:
+	drain();
+}
+
+
+void
+DeviceTrace::drain()
+{
+	std::lock_guard<std::mutex> lock (_mutex);
+	bool rotated = false;
+
+	if (_keep_ns > 0 && monotonic_raw_ns() - _file_start_ns >= _keep_ns)
+	{
+		if (_fd != -1)
+			::close (_fd);
+
+		if (std::rename (_path.toLocal8Bit().constData(), (_path + ".1").toLocal8Bit().constData()) != 0)
+			std::fprintf (stderr, "device trace: couldn't rotate %s: %s\n", _path.toLocal8Bit().constData(), ::strerror (errno));
+
+		try {
+			open_file();
+			rotated = true;
+		}
+		catch (Error const& e)
+		{
+			std::fprintf (stderr, "%s\n", e.what());
+			_fd = -1;
+			// Try again after another keep period:
+			_file_start_ns = monotonic_raw_ns();
+		}
+	}
+
+	// Each file must be decodable on its own, so a new one starts with all sources and definitions:
+	for (; _announced_sources < _sources.size(); ++_announced_sources)
+	{
+		auto const name = _sources[_announced_sources]->_name.toUtf8();
+		append_text (kSource, _announced_sources, name.constData(), name.size());
+	}
+
+	if (rotated)
+		_buffer.insert (_buffer.end(), _definitions.begin(), _definitions.end());
+
+	for (auto& source: _sources)
+	{
+		uint64_t const head = source->_head.load (std::memory_order_acquire);
+		uint64_t tail = source->_tail.load (std::memory_order_relaxed);
+
+		for (; tail != head; ++tail)
+		{
+			Record const& record = source->_ring[tail & source->_mask];
+
+			if (record.type == kDefinition)
+				_definitions.push_back (record);
+
+			append (record);
+		}
+
+		source->_tail.store (tail, std::memory_order_release);
+
+		uint64_t const dropped = source->_dropped.load (std::memory_order_relaxed);
+
+		if (dropped != source->_reported_dropped)
+		{
+			Record record;
+			record.timestamp = monotonic_raw_ns();
+			record.id = dropped - source->_reported_dropped;
+			record.source = source->_id;
+			record.type = kDropped;
+			append (record);
+			source->_reported_dropped = dropped;
+		}
+	}
+
+	write_buffer();
+}
+
+
+void
+DeviceTrace::open_file()
+{
+	_fd = ::open (_path.toLocal8Bit().constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (_fd == -1)
+		throw Error ("couldn't open " + _path.toStdString() + ": " + ::strerror (errno));
+
+	struct timespec now;
+	::clock_gettime (CLOCK_REALTIME, &now);
+	_file_start_ns = monotonic_raw_ns();
+
+	Header header;
+	std::memcpy (header.magic, kMagic, sizeof (kMagic));
+	header.version = kVersion;
+	header.record_size = sizeof (Record);
+	header.keep_ns = _keep_ns;
+	header.anchor_monotonic_ns = _file_start_ns;
+	header.anchor_unix_time = now.tv_sec + now.tv_nsec / 1e9;
+
+	if (::write (_fd, &header, sizeof (header)) != sizeof (header))
+		throw Error ("couldn't write " + _path.toStdString() + ": " + ::strerror (errno));
+
+	_announced_sources = 0;
+}
+
+
+void
+DeviceTrace::append (Record const& record)
+{
+	_buffer.push_back (record);
+}
+
+
+void
+DeviceTrace::append_text (Type type, uint16_t source, char const* data, std::size_t size)
+{
+	int64_t const timestamp = monotonic_raw_ns();
+	std::size_t offset = 0;
+
+	do {
+		Record record;
+		record.timestamp = timestamp;
+		record.source = source;
+		record.type = type;
+		record.length = std::min (kDataSize, size - offset);
+		record.flags = (offset + kDataSize < size) ? kContinued : 0;
+		std::memcpy (record.data, data + offset, record.length);
+		append (record);
+		offset += kDataSize;
+	} while (offset < size);
+}
+
+
+void
+DeviceTrace::write_buffer()
+{
+	if (_fd == -1)
+	{
+		_buffer.clear();
+		return;
+	}
+
+	auto const* bytes = reinterpret_cast<char const*> (_buffer.data());
+	std::size_t const size = _buffer.size() * sizeof (Record);
+	std::size_t written = 0;
+
+	while (written < size)
+	{
+		auto n = ::write (_fd, bytes + written, size - written);
+
+		if (n > 0)
+			written += n;
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else
+		{
+			std::fprintf (stderr, "device trace: couldn't write %s: %s\n", _path.toLocal8Bit().constData(), ::strerror (errno));
+			break;
+		}
+	}
+
+	_buffer.clear();
+}
+
+
+std::vector<DeviceTrace::Event>
+DeviceTrace::read (QString const& path)
+{
+	std::vector<Event> result;
+	int64_t keep_ns = 0;
+	std::map<uint16_t, QString> sources;
+	std::map<std::pair<uint16_t, uint32_t>, QByteArray> commands;
+
+	auto read_file = [&](QString const& file_path) {
+		QFile file (file_path);
+
+		if (!file.open (QIODevice::ReadOnly))
+			throw Error ("couldn't open " + file_path.toStdString() + ": " + file.errorString().toStdString());
+
+		Header header;
+
+		if (file.read (reinterpret_cast<char*> (&header), sizeof (header)) != sizeof (header) ||
+			std::memcmp (header.magic, kMagic, sizeof (kMagic)) != 0)
+		{
+			throw Error (file_path.toStdString() + " is not a device trace file");
+		}
+
+		if (header.version != kVersion || header.record_size != sizeof (Record))
+			throw Error (file_path.toStdString() + " has unsupported version or record layout");
+
+		keep_ns = header.keep_ns;
+
+		// A partially written last record (eg. after a crash) is ignored:
+		std::vector<Record> records ((file.size() - sizeof (header)) / sizeof (Record));
+		auto bytes = static_cast<qint64> (records.size() * sizeof (Record));
+
+		if (file.read (reinterpret_cast<char*> (records.data()), bytes) != bytes)
+			throw Error ("couldn't read " + file_path.toStdString() + ": " + file.errorString().toStdString());
+
+		// Text of records continued by the next ones, per source:
+		std::map<uint16_t, QByteArray> pending;
+
+		for (auto const& record: records)
+		{
+			QByteArray& text = pending[record.source];
+			text.append (record.data, std::min<std::size_t> (record.length, kDataSize));
+
+			if (record.flags & kContinued)
+				continue;
+
+			Event event;
+			event.timestamp = record.timestamp;
+			event.unix_time = header.anchor_unix_time + (record.timestamp - header.anchor_monotonic_ns) / 1e9;
+			event.type = record.type;
+
+			switch (record.type)
+			{
+				case kSource:
+					sources[record.source] = QString::fromUtf8 (text);
+					break;
+
+				case kDefinition:
+					commands[{ record.source, record.id }] = text;
+					break;
+
+				case kSent:
+					event.text = commands[{ record.source, record.id }];
+					break;
+
+				case kReceived:
+					event.text = text.trimmed();
+					break;
+
+				case kDropped:
+					event.dropped = record.id;
+					break;
+			}
+
+			if (record.type == kSent || record.type == kReceived || record.type == kDropped)
+			{
+				event.source = sources[record.source];
+				result.push_back (event);
+			}
+
+			text.clear();
+		}
+	};
+
+	if (QFile::exists (path + ".1"))
+		read_file (path + ".1");
+
+	read_file (path);
+
+	if (keep_ns > 0 && !result.empty())
+	{
+		int64_t const since = result.back().timestamp - keep_ns;
+		auto first = std::find_if (result.begin(), result.end(), [&](Event const& e) { return e.timestamp >= since; });
+		result.erase (result.begin(), first);
+	}
+
+	return result;
+}
+
+
+char const*
+DeviceTrace::type_name (Type type)
+{
+	switch (type)
+	{
+		case kSource:		return "source";
+		case kDefinition:	return "definition";
+		case kSent:			return "<<";
+		case kReceived:		return ">>";
+		case kDropped:		return "dropped";
+	}
+
+	return "unknown";
+}
+
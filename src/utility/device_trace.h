@@ -0,0 +1,251 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef UTILITY__DEVICE_TRACE_H__INCLUDED
+#define UTILITY__DEVICE_TRACE_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Qt:
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+
+/**
+ * Binary log of everything sent to and received from SCPI devices.
+ *
+ * Each device (Source) has its own lock-free single-producer ring of fixed-size records, so
+ * logging a command is a couple of memory copies and never touches the filesystem. Commands are
+ * interned: the text of a command is stored once, later sends store only its id. A background
+ * thread drains the rings to the file a few times a second.
+ *
+ * If keep_seconds is positive, the file is rotated to "<path>.1" every keep_seconds and read()
+ * returns only the last keep_seconds of events, so disk usage stays bounded on long runs.
+ *
+ * File layout: Header, followed by Records until the end of file. All fields are native-endian.
+ */
+class DeviceTrace
+{
+  public:
+	static constexpr char			kMagic[8]	= "SCPIDTR";
+	static constexpr uint32_t		kVersion	= 1;
+	static constexpr std::size_t	kDataSize	= 46;
+
+	enum Type: uint8_t
+	{
+		// Source name (data), announced at the beginning of each file:
+		kSource,
+		// Text (data) of interned command with given id:
+		kDefinition,
+		// Command with given id was sent:
+		kSent,
+		// Response (data) was received:
+		kReceived,
+		// Given number of records were lost because the ring was full:
+		kDropped,
+	};
+
+	enum Flags: uint8_t
+	{
+		// Data continues in the next record of the same source:
+		kContinued		= 1u << 0,
+	};
+
+	class Record
+	{
+	  public:
+		// CLOCK_MONOTONIC_RAW nanoseconds:
+		int64_t		timestamp			= 0;
+		// Command id for kDefinition/kSent, count for kDropped:
+		uint32_t	id					= 0;
+		uint16_t	source				= 0;
+		Type		type				= kSource;
+		uint8_t		flags				= 0;
+		uint16_t	length				= 0;
+		char		data[kDataSize]		= {};
+	};
+
+	class Header
+	{
+	  public:
+		char		magic[8];
+		uint32_t	version;
+		uint32_t	record_size;
+		// 0 means everything is kept:
+		int64_t		keep_ns;
+		// Wall time of a CLOCK_MONOTONIC_RAW instant, for converting timestamps:
+		int64_t		anchor_monotonic_ns;
+		double		anchor_unix_time;
+	};
+
+	/**
+	 * Decoded record (or a sequence of continued records).
+	 */
+	class Event
+	{
+	  public:
+		int64_t		timestamp	= 0;
+		double		unix_time	= 0.0;
+		QString		source;
+		Type		type		= kSent;
+		QByteArray	text;
+		// Number of lost records for kDropped:
+		uint64_t	dropped		= 0;
+	};
+
+	class Error: public std::runtime_error
+	{
+	  public:
+		// Ctor:
+		Error (std::string const& message):
+			std::runtime_error ("device trace: " + message)
+		{ }
+	};
+
+	/**
+	 * Per-device producer side. All calls must come from a single thread at a time.
+	 */
+	class Source
+	{
+		friend class DeviceTrace;
+
+	  public:
+		/**
+		 * Log a command (without trailing newline).
+		 */
+		void
+		sent (char const* data, std::size_t size);
+
+		/**
+		 * Log a response (without trailing newline).
+		 */
+		void
+		received (char const* data, std::size_t size) noexcept;
+
+	  private:
+		// Ctor
+		Source (uint16_t id, QString const& name, std::size_t capacity);
+
+		/**
+		 * Push record of given type with data split into as many records as needed.
+		 * Either all records are published at once or, if there's not enough space, none.
+		 *
+		 * \return	false if records were dropped.
+		 */
+		bool
+		push (Type, uint32_t id, char const* data, std::size_t size) noexcept;
+
+	  private:
+		uint16_t					_id;
+		QString						_name;
+		std::vector<Record>			_ring;
+		uint64_t					_mask;
+		// Written by producer:
+		std::atomic<uint64_t>		_head		{ 0 };
+		std::atomic<uint64_t>		_dropped	{ 0 };
+		// Written by the writer thread:
+		std::atomic<uint64_t>		_tail		{ 0 };
+		// Producer only:
+		QHash<QByteArray, uint32_t>	_commands;
+		// Writer thread only:
+		uint64_t					_reported_dropped	= 0;
+	};
+
+  public:
+	/**
+	 * Create (or truncate) trace file and start the writer thread.
+	 * Throw Error on failure.
+	 */
+	DeviceTrace (QString const& path, double keep_seconds);
+
+	// Dtor
+	~DeviceTrace();
+
+	/**
+	 * Register a device. Returned object is owned by the DeviceTrace.
+	 */
+	Source*
+	add_source (QString const& name);
+
+	/**
+	 * Read and decode trace file (including the rotated one), oldest first. If the trace was
+	 * written with a keep limit, only events within keep_seconds of the last one are returned.
+	 * Throw Error on failure.
+	 */
+	static std::vector<Event>
+	read (QString const& path);
+
+	static char const*
+	type_name (Type);
+
+  private:
+	void
+	run();
+
+	/**
+	 * Move all published records from the rings to the file.
+	 */
+	void
+	drain();
+
+	/**
+	 * Create (or truncate) the file and write its header.
+	 */
+	void
+	open_file();
+
+	void
+	append (Record const&);
+
+	/**
+	 * Append a writer-generated record carrying text (source name).
+	 */
+	void
+	append_text (Type, uint16_t source, char const* data, std::size_t size);
+
+	void
+	write_buffer();
+
+  private:
+	QString									_path;
+	int64_t									_keep_ns;
+	int										_fd					= -1;
+	int64_t									_file_start_ns		= 0;
+
+	std::mutex								_mutex;
+	std::condition_variable					_quit_condition;
+	bool									_quit				= false;
+	// Guarded by _mutex:
+	std::vector<std::unique_ptr<Source>>	_sources;
+
+	// Writer thread only:
+	std::size_t								_announced_sources	= 0;
+	// All definition records, repeated at the beginning of each rotated file:
+	std::vector<Record>						_definitions;
+	std::vector<Record>						_buffer;
+
+	std::thread								_thread;
+};
+
+#endif
+
@@ -22,8 +22,14 @@
 #include "file_db.h"
 
 
-FileDB::FileDB (QDir location):
-	_location (location)
+constexpr char FileDB::kSamplesPrefix[];
+constexpr char FileDB::kHeader[];
+
+
+FileDB::FileDB (QDir location, QString const& prefix, QByteArray const& header):
+	_location (location),
+	_prefix (prefix),
+	_header (header)
 {
 	_location.mkpath (".");
 }
@@ -32,23 +38,63 @@ FileDB::FileDB (QDir location):
 std::shared_ptr<QFile>
 FileDB::get_file_for_timestamp (double unix_timestamp)
 {
-	std::shared_ptr<QFile>& output_log = _files[0];
-
-	auto start_of_day = QDateTime::fromMSecsSinceEpoch (1000.0 * unix_timestamp);
-	start_of_day.setTime (QTime());
+	auto day = start_of_day (unix_timestamp);
+	std::shared_ptr<QFile>& output_log = _files[day.toMSecsSinceEpoch() / 1000];
 
 	if (!output_log)
 	{
-		QString filestamp = start_of_day.toString (Qt::ISODate);
-		output_log = std::make_shared<QFile> (_location.absolutePath() + "/samples." + filestamp + ".csv");
+		// Close files from previous days:
+		for (auto it = _files.begin(); it != _files.end(); )
+		{
+			if (it->second)
+				it = _files.erase (it);
+			else
+				++it;
+		}
+
+		output_log = std::make_shared<QFile> (file_path (day));
 
 		output_log->open (QIODevice::Append);
-		output_log->write ("#timestamp,#voltage,#voltmeter_temperature,#current,#ammeter_temperature,#power,"
-						   "#energy,#voltage_corrected,#power_corrected,#energy_corrected,#voltage_corrected_filtered,"
-						   "#current_filtered,#power_corrected_filtered,#energy_corrected_filtered\n");
+		output_log->write (_header);
 		output_log->flush();
 	}
 
 	return output_log;
 }
 
+
+
+std::map<double, QString>
+FileDB::files() const
+{
+	std::map<double, QString> result;
+
+	int const prefix_length = _prefix.size() + 1;
+
+	for (auto const& name: _location.entryList ({ _prefix + ".*.csv" }, QDir::Files))
+	{
+		QString filestamp = name.mid (prefix_length, name.size() - prefix_length - 4);
+		auto day = QDateTime::fromString (filestamp, Qt::ISODate);
+
+		if (day.isValid())
+			result[day.toMSecsSinceEpoch() / 1000.0] = _location.absoluteFilePath (name);
+	}
+
+	return result;
+}
+
+
+QDateTime
+FileDB::start_of_day (double unix_timestamp)
+{
+	auto result = QDateTime::fromMSecsSinceEpoch (1000.0 * unix_timestamp);
+	result.setTime (QTime());
+	return result;
+}
+
+
+QString
+FileDB::file_path (QDateTime const& start_of_day) const
+{
+	return _location.absolutePath() + "/" + _prefix + "." + start_of_day.toString (Qt::ISODate) + ".csv";
+}
@@ -17,22 +17,59 @@
 // Standard:
 #include <cstddef>
 #include <memory>
+#include <map>
 
 // Qt:
+#include <QByteArray>
+#include <QDateTime>
 #include <QDir>
 #include <QFile>
+#include <QString>
 
 
 class FileDB
 {
+  public:
+	// Columns of CSV files:
+	enum Column
+	{
+		kTimestamp = 0,
+		kVoltage,
+		kVoltmeterTemperature,
+		kCurrent,
+		kAmmeterTemperature,
+		kPower,
+		kEnergy,
+		kVoltageCorrected,
+		kPowerCorrected,
+		kEnergyCorrected,
+		kVoltageCorrectedFiltered,
+		kCurrentFiltered,
+		kPowerCorrectedFiltered,
+		kEnergyCorrectedFiltered,
+		kColumnsCount,
+	};
+
+	// Name prefix of sample files:
+	static constexpr char kSamplesPrefix[] = "samples";
+
+	// First line of each samples CSV file:
+	static constexpr char kHeader[] =
+		"#timestamp,#voltage,#voltmeter_temperature,#current,#ammeter_temperature,#power,"
+		"#energy,#voltage_corrected,#power_corrected,#energy_corrected,#voltage_corrected_filtered,"
+		"#current_filtered,#power_corrected_filtered,#energy_corrected_filtered\n";
+
   public:
 	/**
 	 * Ctor
 	 *
 	 * \param	location
 	 * 			Location of CSV files.
+	 * \param	prefix, header
+	 *			Name prefix of daily files ("<prefix>.<date>.csv") and the first line of each file,
+	 *			so that other series can be stored next to samples.
 	 */
-	explicit FileDB (QDir location);
+	explicit FileDB (QDir location, QString const& prefix = kSamplesPrefix, QByteArray const& header = kHeader);
 
 	/**
 	 * Return QFile to use for given timestamp.
@@ -40,11 +77,29 @@ class FileDB
 	std::shared_ptr<QFile>
 	get_file_for_timestamp (double unix_timestamp);
 
+	/**
+	 * Return all existing CSV files, keyed by the beginning of the day UNIX timestamp.
+	 */
+	std::map<double, QString>
+	files() const;
+
+  private:
+	/**
+	 * Return beginning of the day (local time) for given timestamp.
+	 */
+	static QDateTime
+	start_of_day (double unix_timestamp);
+
+	QString
+	file_path (QDateTime const& start_of_day) const;
+
   private:
-	QDir	_location;
+	QDir		_location;
+	QString		_prefix;
+	QByteArray	_header;
 	// Key is the beginning of the day UNIX timestamp:
 	std::map<uint64_t, std::shared_ptr<QFile>>
-			_files;
+				_files;
 };
 
 #endif
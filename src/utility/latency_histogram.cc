@@ -0,0 +1,137 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+
+// Local:
+#include "latency_histogram.h"
+
+
+constexpr unsigned int LatencyHistogram::kSubBucketBits;
+constexpr uint64_t LatencyHistogram::kSubBuckets;
+constexpr unsigned int LatencyHistogram::kMaxValueBits;
+constexpr std::size_t LatencyHistogram::kBuckets;
+
+
+void
+LatencyHistogram::record (uint64_t value) noexcept
+{
+	_buckets[bucket_for (value)].fetch_add (1, std::memory_order_relaxed);
+	_count.fetch_add (1, std::memory_order_relaxed);
+	_sum.fetch_add (value, std::memory_order_relaxed);
+
+	uint64_t current_max = _max.load (std::memory_order_relaxed);
+	while (value > current_max && !_max.compare_exchange_weak (current_max, value, std::memory_order_relaxed))
+		continue;
+}
+
+
+uint64_t
+LatencyHistogram::count() const noexcept
+{
+	return _count.load (std::memory_order_relaxed);
+}
+
+
+double
+LatencyHistogram::mean() const noexcept
+{
+	auto n = count();
+	return n > 0 ? static_cast<double> (_sum.load (std::memory_order_relaxed)) / n : 0.0;
+}
+
+
+uint64_t
+LatencyHistogram::max() const noexcept
+{
+	return _max.load (std::memory_order_relaxed);
+}
+
+
+uint64_t
+LatencyHistogram::quantile (double q) const noexcept
+{
+	// Sum buckets instead of using _count, they might be slightly out of sync:
+	uint64_t total = 0;
+	for (auto const& bucket: _buckets)
+		total += bucket.load (std::memory_order_relaxed);
+
+	if (total == 0)
+		return 0;
+
+	uint64_t rank = std::max<uint64_t> (1, std::ceil (std::min (std::max (q, 0.0), 1.0) * total));
+	uint64_t cumulative = 0;
+
+	for (std::size_t i = 0; i < kBuckets; ++i)
+	{
+		cumulative += _buckets[i].load (std::memory_order_relaxed);
+
+		if (cumulative >= rank)
+			return std::min (bucket_upper_bound (i), max());
+	}
+
+	return max();
+}
+
+
+uint64_t
+LatencyHistogram::bucket_count (std::size_t bucket) const noexcept
+{
+	return _buckets[bucket].load (std::memory_order_relaxed);
+}
+
+
+std::size_t
+LatencyHistogram::bucket_for (uint64_t value) noexcept
+{
+	// Values below 2 * kSubBuckets have their own buckets:
+	if (value < 2 * kSubBuckets)
+		return value;
+
+	unsigned int msb = 63 - __builtin_clzll (value);
+
+	if (msb >= kMaxValueBits)
+		return kBuckets - 1;
+
+	// Range [2^msb, 2^(msb+1)) is split into kSubBuckets by the bits just below MSB:
+	unsigned int shift = msb - kSubBucketBits;
+	return (shift + 1) * kSubBuckets + ((value >> shift) - kSubBuckets);
+}
+
+
+uint64_t
+LatencyHistogram::bucket_upper_bound (std::size_t bucket) noexcept
+{
+	if (bucket < 2 * kSubBuckets)
+		return bucket;
+
+	unsigned int shift = bucket / kSubBuckets - 1;
+	uint64_t sub_bucket = bucket % kSubBuckets;
+	return ((kSubBuckets + sub_bucket + 1) << shift) - 1;
+}
+
+
+void
+LatencyHistogram::reset() noexcept
+{
+	for (auto& bucket: _buckets)
+		bucket.store (0, std::memory_order_relaxed);
+
+	_count.store (0, std::memory_order_relaxed);
+	_sum.store (0, std::memory_order_relaxed);
+	_max.store (0, std::memory_order_relaxed);
+}
+
@@ -0,0 +1,105 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef UTILITY__LATENCY_HISTOGRAM_H__INCLUDED
+#define UTILITY__LATENCY_HISTOGRAM_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <atomic>
+
+
+/**
+ * Log-linear (HDR-style) histogram of non-negative integer values, eg. latencies in nanoseconds.
+ * Each power-of-two range is split into kSubBuckets linear buckets, so relative error
+ * of reported values is below 1/kSubBuckets (about 3%).
+ *
+ * Recording is lock-free and wait-free (relaxed atomic increments), so it can be
+ * done from any thread while another one reads the histogram.
+ */
+class LatencyHistogram
+{
+  public:
+	static constexpr unsigned int	kSubBucketBits	= 5;
+	static constexpr uint64_t		kSubBuckets		= 1u << kSubBucketBits;
+	// Values up to 2^kMaxValueBits - 1 are recorded exactly to bucket precision, larger are clamped:
+	static constexpr unsigned int	kMaxValueBits	= 48;
+	static constexpr std::size_t	kBuckets		= (kMaxValueBits - kSubBucketBits + 1) * kSubBuckets;
+
+  public:
+	/**
+	 * Record single value.
+	 */
+	void
+	record (uint64_t value) noexcept;
+
+	/**
+	 * Number of recorded values.
+	 */
+	uint64_t
+	count() const noexcept;
+
+	/**
+	 * Mean of recorded values.
+	 */
+	double
+	mean() const noexcept;
+
+	/**
+	 * Largest recorded value.
+	 */
+	uint64_t
+	max() const noexcept;
+
+	/**
+	 * Return value at given quantile (0…1). The value is the upper bound of the bucket,
+	 * so it's never under-reported. Return 0 if histogram is empty.
+	 */
+	uint64_t
+	quantile (double q) const noexcept;
+
+	/**
+	 * Number of values recorded in given bucket.
+	 */
+	uint64_t
+	bucket_count (std::size_t bucket) const noexcept;
+
+	/**
+	 * Index of the bucket for given value.
+	 */
+	static std::size_t
+	bucket_for (uint64_t value) noexcept;
+
+	/**
+	 * Largest value that falls into given bucket.
+	 */
+	static uint64_t
+	bucket_upper_bound (std::size_t bucket) noexcept;
+
+	/**
+	 * Clear all counters. Not atomic with respect to concurrent record() calls.
+	 */
+	void
+	reset() noexcept;
+
+  private:
+	std::array<std::atomic<uint64_t>, kBuckets>	_buckets	{ };
+	std::atomic<uint64_t>						_count		{ 0 };
+	std::atomic<uint64_t>						_sum		{ 0 };
+	std::atomic<uint64_t>						_max		{ 0 };
+};
+
+#endif
+
@@ -0,0 +1,128 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef UTILITY__LRU_CACHE_H__INCLUDED
+#define UTILITY__LRU_CACHE_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <utility>
+
+
+/**
+ * Bounded cache that evicts least recently used entries.
+ * Each entry has a cost (1 by default), capacity limits the total cost,
+ * so that the cache can be bounded by count or by bytes.
+ *
+ * \param	pKey
+ *			Key type; must be less-than comparable.
+ */
+template<class pKey, class pValue>
+	class LRUCache
+	{
+	  public:
+		typedef pKey	Key;
+		typedef pValue	Value;
+
+		class Statistics
+		{
+		  public:
+			uint64_t	hits			= 0;
+			uint64_t	misses			= 0;
+			uint64_t	evictions		= 0;
+			uint64_t	invalidations	= 0;
+		};
+
+	  public:
+		/**
+		 * \param	capacity
+		 *			Maximum total cost of entries.
+		 */
+		explicit LRUCache (std::size_t capacity);
+
+		/**
+		 * Return pointer to cached value or nullptr.
+		 * Counts a hit or a miss and marks the entry as most recently used.
+		 */
+		Value*
+		find (Key const& key);
+
+		/**
+		 * Insert or replace value, evicting least recently used entries until it fits.
+		 * An entry costing more than the capacity is still inserted, as the only one.
+		 */
+		Value&
+		insert (Key const& key, Value value, std::size_t cost = 1);
+
+		/**
+		 * Remove all entries for which predicate (key, value) returns true.
+		 */
+		template<class pPredicate>
+			void
+			invalidate_if (pPredicate&& predicate);
+
+		/**
+		 * Total cost of cached entries.
+		 */
+		std::size_t
+		size() const noexcept;
+
+		std::size_t
+		capacity() const noexcept;
+
+		Statistics const&
+		statistics() const noexcept;
+
+	  private:
+		class Entry
+		{
+		  public:
+			// Ctor
+			Entry (Key const& key, Value&& value, std::size_t cost):
+				key (key),
+				value (std::move (value)),
+				cost (cost)
+			{ }
+
+		  public:
+			Key			key;
+			Value		value;
+			std::size_t	cost;
+		};
+
+		typedef std::list<Entry> Entries;
+
+	  private:
+		/**
+		 * Remove the least recently used entry.
+		 */
+		void
+		evict();
+
+	  private:
+		std::size_t		_capacity;
+		std::size_t		_size			= 0;
+		// Most recently used first:
+		Entries			_entries;
+		std::map<Key, typename Entries::iterator>
+						_index;
+		Statistics		_statistics;
+	};
+
+#endif
+
+#include "lru_cache.tcc"
+
@@ -0,0 +1,125 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef UTILITY__LRU_CACHE_TCC__INCLUDED
+#define UTILITY__LRU_CACHE_TCC__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+
+
+template<class pKey, class pValue>
+	inline
+	LRUCache<pKey, pValue>::LRUCache (std::size_t capacity):
+		_capacity (std::max<std::size_t> (capacity, 1))
+	{ }
+
+
+template<class pKey, class pValue>
+	inline typename LRUCache<pKey, pValue>::Value*
+	LRUCache<pKey, pValue>::find (Key const& key)
+	{
+		auto it = _index.find (key);
+
+		if (it == _index.end())
+		{
+			++_statistics.misses;
+			return nullptr;
+		}
+
+		++_statistics.hits;
+		_entries.splice (_entries.begin(), _entries, it->second);
+		return &it->second->value;
+	}
+
+
+template<class pKey, class pValue>
+	inline typename LRUCache<pKey, pValue>::Value&
+	LRUCache<pKey, pValue>::insert (Key const& key, Value value, std::size_t cost)
+	{
+		auto it = _index.find (key);
+
+		if (it != _index.end())
+		{
+			_size -= it->second->cost;
+			_entries.erase (it->second);
+			_index.erase (it);
+		}
+
+		while (!_entries.empty() && _size + cost > _capacity)
+			evict();
+
+		_entries.emplace_front (key, std::move (value), cost);
+		_index[key] = _entries.begin();
+		_size += cost;
+		return _entries.front().value;
+	}
+
+
+template<class pKey, class pValue>
+	template<class pPredicate>
+		inline void
+		LRUCache<pKey, pValue>::invalidate_if (pPredicate&& predicate)
+		{
+			for (auto it = _entries.begin(); it != _entries.end(); )
+			{
+				if (predicate (it->key, it->value))
+				{
+					_index.erase (it->key);
+					_size -= it->cost;
+					it = _entries.erase (it);
+					++_statistics.invalidations;
+				}
+				else
+					++it;
+			}
+		}
+
+
+template<class pKey, class pValue>
+	inline std::size_t
+	LRUCache<pKey, pValue>::size() const noexcept
+	{
+		return _size;
+	}
+
+
+template<class pKey, class pValue>
+	inline std::size_t
+	LRUCache<pKey, pValue>::capacity() const noexcept
+	{
+		return _capacity;
+	}
+
+
+template<class pKey, class pValue>
+	inline typename LRUCache<pKey, pValue>::Statistics const&
+	LRUCache<pKey, pValue>::statistics() const noexcept
+	{
+		return _statistics;
+	}
+
+
+template<class pKey, class pValue>
+	inline void
+	LRUCache<pKey, pValue>::evict()
+	{
+		_index.erase (_entries.back().key);
+		_size -= _entries.back().cost;
+		_entries.pop_back();
+		++_statistics.evictions;
+	}
+
+#endif
+
@@ -0,0 +1,90 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef UTILITY__MIN_MAX_TREE_H__INCLUDED
+#define UTILITY__MIN_MAX_TREE_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+
+/**
+ * Append-only segment tree answering min/max queries over index ranges in O(log n).
+ * Appending is O(log n) amortized.
+ *
+ * \param	pValue
+ *			Value type; must have std::numeric_limits specialization.
+ */
+template<class pValue>
+	class MinMaxTree
+	{
+	  public:
+		typedef pValue Value;
+
+		class Extremes
+		{
+		  public:
+			Value	min;
+			Value	max;
+		};
+
+	  public:
+		/**
+		 * Append value at index size().
+		 */
+		void
+		push_back (Value value);
+
+		/**
+		 * Return number of values in the tree.
+		 */
+		std::size_t
+		size() const noexcept;
+
+		/**
+		 * Return bytes allocated for the tree.
+		 */
+		std::size_t
+		memory_size() const noexcept;
+
+		/**
+		 * Return min and max of values in range [begin, end).
+		 * For an empty range min is the largest and max is the lowest representable value.
+		 */
+		Extremes
+		query (std::size_t begin, std::size_t end) const;
+
+	  private:
+		/**
+		 * Double the capacity and rebuild the tree.
+		 */
+		void
+		grow();
+
+		void
+		update_parents (std::size_t node);
+
+	  private:
+		std::size_t			_size		= 0;
+		std::size_t			_capacity	= 0;
+		// Implicit binary trees; leaves start at index _capacity:
+		std::vector<Value>	_min;
+		std::vector<Value>	_max;
+	};
+
+#endif
+
+#include "min_max_tree.tcc"
+
@@ -0,0 +1,118 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef UTILITY__MIN_MAX_TREE_TCC__INCLUDED
+#define UTILITY__MIN_MAX_TREE_TCC__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+#include <limits>
+
+
+template<class pValue>
+	inline void
+	MinMaxTree<pValue>::push_back (Value value)
+	{
+		if (_size == _capacity)
+			grow();
+
+		auto leaf = _capacity + _size;
+		_min[leaf] = value;
+		_max[leaf] = value;
+		++_size;
+		update_parents (leaf);
+	}
+
+
+template<class pValue>
+	inline std::size_t
+	MinMaxTree<pValue>::size() const noexcept
+	{
+		return _size;
+	}
+
+
+template<class pValue>
+	inline std::size_t
+	MinMaxTree<pValue>::memory_size() const noexcept
+	{
+		return (_min.capacity() + _max.capacity()) * sizeof (Value);
+	}
+
+
+template<class pValue>
+	inline typename MinMaxTree<pValue>::Extremes
+	MinMaxTree<pValue>::query (std::size_t begin, std::size_t end) const
+	{
+		Extremes result { std::numeric_limits<Value>::max(), std::numeric_limits<Value>::lowest() };
+
+		end = std::min (end, _size);
+
+		for (begin += _capacity, end += _capacity; begin < end; begin /= 2, end /= 2)
+		{
+			if (begin & 1)
+			{
+				result.min = std::min (result.min, _min[begin]);
+				result.max = std::max (result.max, _max[begin]);
+				++begin;
+			}
+
+			if (end & 1)
+			{
+				--end;
+				result.min = std::min (result.min, _min[end]);
+				result.max = std::max (result.max, _max[end]);
+			}
+		}
+
+		return result;
+	}
+
+
+template<class pValue>
+	inline void
+	MinMaxTree<pValue>::grow()
+	{
+		auto new_capacity = std::max<std::size_t> (2 * _capacity, 1024);
+		std::vector<Value> new_min (2 * new_capacity, std::numeric_limits<Value>::max());
+		std::vector<Value> new_max (2 * new_capacity, std::numeric_limits<Value>::lowest());
+
+		std::copy (_min.begin() + _capacity, _min.begin() + _capacity + _size, new_min.begin() + new_capacity);
+		std::copy (_max.begin() + _capacity, _max.begin() + _capacity + _size, new_max.begin() + new_capacity);
+
+		for (std::size_t node = new_capacity - 1; node > 0; --node)
+		{
+			new_min[node] = std::min (new_min[2 * node], new_min[2 * node + 1]);
+			new_max[node] = std::max (new_max[2 * node], new_max[2 * node + 1]);
+		}
+
+		_min.swap (new_min);
+		_max.swap (new_max);
+		_capacity = new_capacity;
+	}
+
+
+template<class pValue>
+	inline void
+	MinMaxTree<pValue>::update_parents (std::size_t node)
+	{
+		for (node /= 2; node > 0; node /= 2)
+		{
+			_min[node] = std::min (_min[2 * node], _min[2 * node + 1]);
+			_max[node] = std::max (_max[2 * node], _max[2 * node + 1]);
+		}
+	}
+
+#endif
+
@@ -0,0 +1,232 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <utility>
+
+// Local:
+#include "quantile_sketch.h"
+
+
+constexpr std::size_t QuantileSketch::kDefaultK;
+
+
+namespace {
+
+bool
+read_raw (QIODevice& device, void* data, std::size_t size)
+{
+	return device.read (reinterpret_cast<char*> (data), size) == static_cast<qint64> (size);
+}
+
+} // namespace
+
+
+QuantileSketch::QuantileSketch (std::size_t k):
+	_k (std::max<std::size_t> (k, 8)),
+	_levels (1)
+{ }
+
+
+void
+QuantileSketch::insert (double value)
+{
+	if (_count == 0)
+		_min = _max = value;
+	else
+	{
+		_min = std::min (_min, value);
+		_max = std::max (_max, value);
+	}
+
+	++_count;
+	_levels[0].push_back (value);
+
+	if (_levels[0].size() > level_capacity (0))
+		compress();
+}
+
+
+void
+QuantileSketch::merge (QuantileSketch const& other)
+{
+	if (other._count == 0)
+		return;
+
+	if (_count == 0)
+	{
+		_min = other._min;
+		_max = other._max;
+	}
+	else
+	{
+		_min = std::min (_min, other._min);
+		_max = std::max (_max, other._max);
+	}
+
+	_count += other._count;
+
+	if (_levels.size() < other._levels.size())
+		_levels.resize (other._levels.size());
+
+	for (std::size_t h = 0; h < other._levels.size(); ++h)
+		_levels[h].insert (_levels[h].end(), other._levels[h].begin(), other._levels[h].end());
+
+	compress();
+}
+
+
+double
+QuantileSketch::quantile (double q) const
+{
+	if (_count == 0)
+		throw std::domain_error ("quantile of an empty sketch");
+
+	if (q <= 0.0)
+		return _min;
+	else if (q >= 1.0)
+		return _max;
+
+	std::vector<std::pair<double, uint64_t>> weighted;
+	uint64_t total_weight = 0;
+
+	for (std::size_t h = 0; h < _levels.size(); ++h)
+	{
+		for (double value: _levels[h])
+			weighted.emplace_back (value, uint64_t (1) << h);
+
+		total_weight += _levels[h].size() << h;
+	}
+
+	std::sort (weighted.begin(), weighted.end());
+
+	double const rank = q * total_weight;
+	uint64_t cumulative_weight = 0;
+
+	for (auto const& pair: weighted)
+	{
+		cumulative_weight += pair.second;
+
+		if (cumulative_weight >= rank)
+			return pair.first;
+	}
+
+	return _max;
+}
+
+
+void
+QuantileSketch::write (QIODevice& device) const
+{
+	uint64_t const header[] = { _k, _count, _levels.size() };
+	double const extremes[] = { _min, _max };
+
+	device.write (reinterpret_cast<char const*> (header), sizeof (header));
+	device.write (reinterpret_cast<char const*> (extremes), sizeof (extremes));
+
+	for (auto const& level: _levels)
+	{
+		uint64_t const size = level.size();
+		device.write (reinterpret_cast<char const*> (&size), sizeof (size));
+		device.write (reinterpret_cast<char const*> (level.data()), size * sizeof (double));
+	}
+}
+
+
+bool
+QuantileSketch::read (QIODevice& device)
+{
+	uint64_t header[3];
+	double extremes[2];
+
+	if (!read_raw (device, header, sizeof (header)) || !read_raw (device, extremes, sizeof (extremes)))
+		return false;
+
+	// Weights are 2^level, so a valid sketch never has that many levels:
+	if (header[2] == 0 || header[2] > 64)
+		return false;
+
+	std::vector<std::vector<double>> levels (header[2]);
+
+	for (auto& level: levels)
+	{
+		uint64_t size;
+
+		// Levels never hold more than their capacity, which is at most k:
+		if (!read_raw (device, &size, sizeof (size)) || size > header[0])
+			return false;
+
+		level.resize (size);
+
+		if (!read_raw (device, level.data(), size * sizeof (double)))
+			return false;
+	}
+
+	_k = std::max<std::size_t> (header[0], 8);
+	_count = header[1];
+	_min = extremes[0];
+	_max = extremes[1];
+	_levels = std::move (levels);
+	return true;
+}
+
+
+std::size_t
+QuantileSketch::level_capacity (std::size_t level) const
+{
+	// Capacities decrease geometrically (by 2/3) towards lower levels:
+	auto depth = _levels.size() - 1 - level;
+	return std::max<std::size_t> (2, std::ceil (_k * std::pow (2.0 / 3.0, depth)));
+}
+
+
+void
+QuantileSketch::compress()
+{
+	for (std::size_t h = 0; h < _levels.size(); ++h)
+	{
+		if (_levels[h].size() <= level_capacity (h))
+			continue;
+
+		if (h + 1 == _levels.size())
+			_levels.emplace_back();
+
+		auto& level = _levels[h];
+		auto& upper = _levels[h + 1];
+
+		std::sort (level.begin(), level.end());
+
+		// With odd number of items, leave one at this level:
+		double leftover = level.back();
+		bool has_leftover = level.size() % 2 == 1;
+		if (has_leftover)
+			level.pop_back();
+
+		// Promote either even or odd items, each now carries twice the weight.
+		// Generator is shared so that choices in merged sketches are not correlated:
+		static thread_local std::minstd_rand random;
+
+		for (std::size_t i = random() % 2; i < level.size(); i += 2)
+			upper.push_back (level[i]);
+
+		level.clear();
+		if (has_leftover)
+			level.push_back (leftover);
+	}
+}
+
@@ -0,0 +1,111 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef UTILITY__QUANTILE_SKETCH_H__INCLUDED
+#define UTILITY__QUANTILE_SKETCH_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Qt:
+#include <QIODevice>
+
+
+/**
+ * Mergeable KLL quantile sketch.
+ *
+ * Memory is O(k log(n/k)) and the rank error is about 1.7/k with high probability,
+ * independently of the number of values. Sketches built over disjoint sets of values
+ * can be merged and the result has the same error bound.
+ */
+class QuantileSketch
+{
+  public:
+	static constexpr std::size_t kDefaultK = 200;
+
+  public:
+	// Ctor
+	explicit QuantileSketch (std::size_t k = kDefaultK);
+
+	/**
+	 * Add single value to the sketch.
+	 */
+	void
+	insert (double value);
+
+	/**
+	 * Add all values represented by other sketch.
+	 */
+	void
+	merge (QuantileSketch const& other);
+
+	/**
+	 * Return number of values inserted into the sketch.
+	 */
+	uint64_t
+	count() const noexcept;
+
+	/**
+	 * Return approximate value at given quantile (0…1).
+	 * Quantiles 0 and 1 return exact minimum and maximum.
+	 * Throws std::domain_error if sketch is empty.
+	 */
+	double
+	quantile (double q) const;
+
+	/**
+	 * Write the sketch in native-endian binary form, so that it can be stored and merged later.
+	 */
+	void
+	write (QIODevice&) const;
+
+	/**
+	 * Replace the sketch with one written by write().
+	 * Return false if data is truncated or malformed; the sketch is left unchanged then.
+	 */
+	bool
+	read (QIODevice&);
+
+  private:
+	/**
+	 * Maximum number of items at given level.
+	 */
+	std::size_t
+	level_capacity (std::size_t level) const;
+
+	/**
+	 * Compact levels that exceed their capacity.
+	 */
+	void
+	compress();
+
+  private:
+	std::size_t							_k;
+	uint64_t							_count		= 0;
+	double								_min		= 0.0;
+	double								_max		= 0.0;
+	// Items at level h have weight 2^h:
+	std::vector<std::vector<double>>	_levels;
+};
+
+
+inline uint64_t
+QuantileSketch::count() const noexcept
+{
+	return _count;
+}
+
+#endif
+
@@ -0,0 +1,255 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <cmath>
+#include <cstring>
+
+// Qt:
+#include <QBuffer>
+#include <QByteArray>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+// Local:
+#include "rollups_file.h"
+
+
+constexpr char RollupsFile::kSuffix[];
+constexpr char RollupsFile::kMagic[8];
+constexpr uint32_t RollupsFile::kVersion;
+
+// Levels of Segment rollups stored in the file:
+constexpr std::size_t kMinutesLevel = 0;
+constexpr std::size_t kHoursLevel = 1;
+
+static_assert (Segment::kRollupPeriods.size() == 2, "RollupsFile stores minute and hour rollups only");
+
+
+RollupsFile::RollupsFile (QString const& csv_path):
+	_csv_path (csv_path)
+{ }
+
+
+void
+RollupsFile::save (Segment const& segment)
+{
+	auto const& minutes = segment._rollups[kMinutesLevel];
+	auto const& hours = segment._rollups[kHoursLevel];
+
+	// Minute buckets go after hour buckets, but hour buckets refer to their positions:
+	QBuffer minutes_data;
+	minutes_data.open (QIODevice::WriteOnly);
+	std::vector<int64_t> minute_offsets;
+
+	for (std::size_t i = 0; i < minutes.size(); ++i)
+	{
+		minute_offsets.push_back (minutes_data.pos());
+		write_bucket (minutes_data, segment, kMinutesLevel, i, 0, 0);
+	}
+
+	QString const path = segment._path + kSuffix;
+	// Writes to a temporary file and renames it over the old one on commit():
+	QSaveFile file (path);
+
+	if (!file.open (QIODevice::WriteOnly))
+		throw Error ("couldn't open " + path.toStdString() + ": " + file.errorString().toStdString());
+
+	Header header;
+	std::memcpy (header.magic, kMagic, sizeof (kMagic));
+	header.version = kVersion;
+	header.bucket_header_size = sizeof (BucketHeader);
+	header.block_size = sizeof (Segment::Block);
+	header.csv_size = segment._offset;
+	header.blocks = segment._blocks.size();
+	header.hours = hours.size();
+	header.summary = segment.summary();
+
+	file.write (reinterpret_cast<char const*> (&header), sizeof (header));
+	file.write (reinterpret_cast<char const*> (segment._blocks.data()), segment._blocks.size() * sizeof (Segment::Block));
+
+	std::size_t minute = 0;
+
+	for (std::size_t i = 0; i < hours.size(); ++i)
+	{
+		std::size_t const first_minute = minute;
+		std::size_t const hour_end = segment.bucket_end (hours, i);
+
+		while (minute < minutes.size() && minutes[minute].begin < hour_end)
+			++minute;
+
+		int64_t const offset = first_minute < minute_offsets.size() ? minute_offsets[first_minute] : 0;
+		write_bucket (file, segment, kHoursLevel, i, offset, minute - first_minute);
+	}
+
+	file.write (minutes_data.data());
+
+	if (!file.commit())
+		throw Error ("couldn't write " + path.toStdString() + ": " + file.errorString().toStdString());
+}
+
+
+bool
+RollupsFile::load()
+{
+	QFile file (_csv_path + kSuffix);
+
+	if (!file.open (QIODevice::ReadOnly))
+		return false;
+
+	Header header;
+
+	if (file.read (reinterpret_cast<char*> (&header), sizeof (header)) != sizeof (header) ||
+		std::memcmp (header.magic, kMagic, sizeof (kMagic)) != 0 ||
+		header.version != kVersion ||
+		header.bucket_header_size != sizeof (BucketHeader) ||
+		header.block_size != sizeof (Segment::Block) ||
+		header.csv_size != QFileInfo (_csv_path).size() ||
+		header.blocks > static_cast<uint64_t> (header.csv_size))
+	{
+		return false;
+	}
+
+	std::vector<Segment::Block> blocks (header.blocks);
+	int64_t const blocks_size = blocks.size() * sizeof (Segment::Block);
+
+	if (file.read (reinterpret_cast<char*> (blocks.data()), blocks_size) != blocks_size)
+		return false;
+
+	std::vector<Bucket> hours (header.hours);
+
+	for (auto& bucket: hours)
+		if (!read_bucket (file, bucket))
+			return false;
+
+	_summary = header.summary;
+	_blocks = std::move (blocks);
+	_hours = std::move (hours);
+	_minutes_offset = file.pos();
+	return true;
+}
+
+
+void
+RollupsFile::add_power_quantiles (double start_timestamp, double end_timestamp, QuantileSketch& sketch) const
+{
+	auto overlaps = [&](BucketHeader const& header) {
+		return header.first_timestamp <= end_timestamp && header.last_timestamp >= start_timestamp;
+	};
+
+	auto covered = [&](BucketHeader const& header) {
+		return start_timestamp <= header.first_timestamp && header.last_timestamp <= end_timestamp;
+	};
+
+	QFile file (_csv_path + kSuffix);
+
+	for (auto const& hour: _hours)
+	{
+		if (!overlaps (hour.header))
+			continue;
+
+		if (covered (hour.header))
+		{
+			sketch.merge (hour.power_sketch);
+			continue;
+		}
+
+		// Partially covered hour, go down to its minutes:
+		if (!file.isOpen() && !file.open (QIODevice::ReadOnly))
+			throw Error ("couldn't open " + file.fileName().toStdString() + ": " + file.errorString().toStdString());
+
+		if (!file.seek (_minutes_offset + hour.header.minutes_offset))
+			throw Error ("couldn't read " + file.fileName().toStdString());
+
+		for (uint64_t i = 0; i < hour.header.minutes; ++i)
+		{
+			Bucket minute;
+
+			if (!read_bucket (file, minute))
+				throw Error ("couldn't read " + file.fileName().toStdString());
+
+			if (!overlaps (minute.header))
+				continue;
+
+			if (covered (minute.header))
+				sketch.merge (minute.power_sketch);
+			else
+				add_csv_samples (minute.header.csv_begin, minute.header.csv_end, start_timestamp, end_timestamp, sketch);
+		}
+	}
+}
+
+
+void
+RollupsFile::write_bucket (QIODevice& device, Segment const& segment, std::size_t level, std::size_t index, int64_t minutes_offset, uint64_t minutes)
+{
+	auto const& rollup = segment._rollups[level];
+	auto const& bucket = rollup[index];
+	std::size_t const end = segment.bucket_end (rollup, index);
+
+	BucketHeader header;
+	header.first_timestamp = segment.timestamp (bucket.begin);
+	header.last_timestamp = segment.timestamp (end - 1);
+	header.samples = end - bucket.begin;
+	header.csv_begin = bucket.offset;
+	header.csv_end = index + 1 < rollup.size() ? rollup[index + 1].offset : segment._offset;
+	header.minutes_offset = minutes_offset;
+	header.minutes = minutes;
+
+	device.write (reinterpret_cast<char const*> (&header), sizeof (header));
+	bucket.power_sketch.write (device);
+}
+
+
+bool
+RollupsFile::read_bucket (QIODevice& device, Bucket& bucket)
+{
+	return device.read (reinterpret_cast<char*> (&bucket.header), sizeof (bucket.header)) == sizeof (bucket.header)
+		&& bucket.power_sketch.read (device);
+}
+
+
+void
+RollupsFile::add_csv_samples (int64_t csv_begin, int64_t csv_end, double start_timestamp, double end_timestamp, QuantileSketch& sketch) const
+{
+	QFile file (_csv_path);
+
+	if (!file.open (QIODevice::ReadOnly) || !file.seek (csv_begin))
+		throw Error ("couldn't read " + _csv_path.toStdString() + ": " + file.errorString().toStdString());
+
+	QByteArray data = file.read (csv_end - csv_begin);
+	Segment::Values values;
+
+	for (int p = 0, n = 0; p < data.size(); p = n + 1)
+	{
+		n = data.indexOf ('\n', p);
+		if (n == -1)
+			n = data.size();
+
+		if (!Segment::parse_line (data, p, n, values))
+			continue;
+
+		double const timestamp = values[FileDB::kTimestamp];
+		double power = values[FileDB::kPowerCorrected];
+
+		// Same as Segment::index_sample():
+		if (!std::isfinite (power))
+			power = 0.0;
+
+		if (timestamp >= start_timestamp && timestamp <= end_timestamp)
+			sketch.insert (power);
+	}
+}
+
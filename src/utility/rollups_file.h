@@ -0,0 +1,179 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef UTILITY__ROLLUPS_FILE_H__INCLUDED
+#define UTILITY__ROLLUPS_FILE_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Qt:
+#include <QIODevice>
+#include <QString>
+
+// Local:
+#include "quantile_sketch.h"
+#include "segment.h"
+
+
+/**
+ * Summary and rollup sketches of a complete FileDB CSV file, stored next to it as
+ * "<file>.rollups", so that past days don't have to be decoded again.
+ *
+ * Hour buckets are loaded with the summary; minute buckets are read only for hours partially
+ * covered by a window, and samples are read from the CSV file only for partially covered minutes,
+ * using byte ranges stored with the buckets.
+ *
+ * Segment's blocks are stored too, so that parts of the file can be decoded without reading
+ * it all first.
+ *
+ * File layout: Header, blocks, hour buckets, minute buckets. Each bucket is a BucketHeader
+ * followed by its QuantileSketch. All fields are native-endian.
+ */
+class RollupsFile
+{
+  public:
+	static constexpr char		kSuffix[]	= ".rollups";
+	static constexpr char		kMagic[8]	= "SCPIRUP";
+	static constexpr uint32_t	kVersion	= 2;
+
+	class Header
+	{
+	  public:
+		char				magic[8];
+		uint32_t			version;
+		uint32_t			bucket_header_size;
+		uint32_t			block_size;
+		// Size of the CSV file the rollups were computed from:
+		int64_t				csv_size;
+		uint64_t			blocks;
+		uint64_t			hours;
+		Segment::Summary	summary;
+	};
+
+	class BucketHeader
+	{
+	  public:
+		double		first_timestamp;
+		double		last_timestamp;
+		uint64_t	samples;
+		// Byte range of the bucket's lines in the CSV file:
+		int64_t		csv_begin;
+		int64_t		csv_end;
+		// For hour buckets, position of the first minute bucket relative to the first one,
+		// and number of minute buckets:
+		int64_t		minutes_offset;
+		uint64_t	minutes;
+	};
+
+	class Error: public std::runtime_error
+	{
+	  public:
+		// Ctor:
+		Error (std::string const& message):
+			std::runtime_error ("rollups: " + message)
+		{ }
+	};
+
+  public:
+	/**
+	 * Ctor
+	 *
+	 * \param	csv_path
+	 *			Path to the CSV file. Nothing is read until load() is called.
+	 */
+	explicit RollupsFile (QString const& csv_path);
+
+	/**
+	 * Store rollups of a segment that has indexed its whole file.
+	 * Throw Error on failure.
+	 */
+	static void
+	save (Segment const&);
+
+	/**
+	 * Read the summary and hour buckets. Return false if rollups weren't stored
+	 * or the CSV file has changed since.
+	 */
+	bool
+	load();
+
+	/**
+	 * Valid after successful load().
+	 */
+	Segment::Summary const&
+	summary() const noexcept;
+
+	/**
+	 * Valid after successful load().
+	 */
+	std::vector<Segment::Block> const&
+	blocks() const noexcept;
+
+	/**
+	 * Add power of samples with timestamps in range [start, end] to the sketch.
+	 * Throw Error if stored files can't be read.
+	 */
+	void
+	add_power_quantiles (double start_timestamp, double end_timestamp, QuantileSketch&) const;
+
+  private:
+	class Bucket
+	{
+	  public:
+		BucketHeader	header;
+		QuantileSketch	power_sketch;
+	};
+
+  private:
+	static void
+	write_bucket (QIODevice&, Segment const&, std::size_t level, std::size_t index, int64_t minutes_offset, uint64_t minutes);
+
+	static bool
+	read_bucket (QIODevice&, Bucket&);
+
+	/**
+	 * Add power of samples from given byte range of the CSV file.
+	 */
+	void
+	add_csv_samples (int64_t csv_begin, int64_t csv_end, double start_timestamp, double end_timestamp, QuantileSketch&) const;
+
+  private:
+	QString					_csv_path;
+	Segment::Summary		_summary;
+	std::vector<Segment::Block>
+							_blocks;
+	std::vector<Bucket>		_hours;
+	// Position of the first minute bucket in the rollups file:
+	int64_t					_minutes_offset	= 0;
+};
+
+
+inline Segment::Summary const&
+RollupsFile::summary() const noexcept
+{
+	return _summary;
+}
+
+
+inline std::vector<Segment::Block> const&
+RollupsFile::blocks() const noexcept
+{
+	return _blocks;
+}
+
+#endif
+
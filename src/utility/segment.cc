@@ -0,0 +1,359 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+// Qt:
+#include <QByteArray>
+#include <QFile>
+
+// Local:
+#include "segment.h"
+
+
+constexpr std::array<double, 2> Segment::kRollupPeriods;
+constexpr std::size_t Segment::kBlockSamples;
+
+// Relative tolerance of logged energy compared with energy integrated from printed values:
+constexpr double kLoggedEnergyTolerance = 1e-9;
+// Timestamps are printed with microsecond resolution:
+constexpr double kTimestampResolution = 1e-6;
+// Files are read in chunks of this size, so that a cold load doesn't hold the whole file:
+constexpr int64_t kReadChunkSize = 4 * 1024 * 1024;
+
+
+Segment::Segment (QString const& path):
+	_path (path)
+{ }
+
+
+Segment::Segment (QString const& path, Block const& block):
+	_path (path),
+	_offset (block.csv_begin),
+	_end_offset (block.csv_end)
+{ }
+
+
+double
+Segment::interval_energy (double dt, double power, double previous_logged_energy, double logged_energy)
+{
+	double const energy = power * dt;
+	double const tolerance = kLoggedEnergyTolerance * (1.0 + std::abs (previous_logged_energy) + std::abs (energy))
+						   + std::abs (power) * kTimestampResolution;
+
+	// A running scpidev logs previous energy plus the same power × dt, a restarted one starts from zero:
+	if (logged_energy < previous_logged_energy + energy - tolerance)
+		return logged_energy;
+
+	return energy;
+}
+
+
+bool
+Segment::update()
+{
+	QFile file (_path);
+
+	if (!file.open (QIODevice::ReadOnly))
+		return false;
+
+	int64_t const file_end = std::min<int64_t> (file.size(), _end_offset);
+
+	if (file_end <= _offset || !file.seek (_offset))
+		return false;
+
+	auto const old_size = size();
+	Values values;
+	// Unprocessed data, starting at _offset:
+	QByteArray data;
+
+	for (int64_t read_offset = _offset; read_offset < file_end; )
+	{
+		QByteArray chunk = file.read (std::min (kReadChunkSize, file_end - read_offset));
+
+		if (chunk.isEmpty())
+			break;
+
+		read_offset += chunk.size();
+		// Appended to incomplete line carried over from the previous chunk:
+		data += chunk;
+
+		// Only process complete lines, the last one might be still being written:
+		int end = data.lastIndexOf ('\n');
+
+		if (end == -1)
+			continue;
+
+		for (int p = 0, n = 0; p < end; p = n + 1)
+		{
+			n = data.indexOf ('\n', p);
+
+			if (parse_line (data, p, n, values))
+				index_sample (values[FileDB::kTimestamp], values[FileDB::kPowerCorrected], values[FileDB::kEnergyCorrected], _offset + p);
+		}
+
+		_offset += end + 1;
+		data.remove (0, end + 1);
+	}
+
+	if (!_blocks.empty())
+		_blocks.back().csv_end = _offset;
+
+	return size() != old_size;
+}
+
+
+bool
+Segment::parse_line (QByteArray const& data, int begin, int end, Values& values)
+{
+	if (data[begin] == '#')
+		return false;
+
+	std::size_t column = 0;
+	bool ok = true;
+
+	for (int f = begin, c = 0; f <= end && column < values.size(); f = c + 1, ++column)
+	{
+		c = data.indexOf (',', f);
+		if (c == -1 || c > end)
+			c = end;
+
+		values[column] = QByteArray::fromRawData (data.constData() + f, c - f).toDouble (&ok);
+		if (!ok)
+			break;
+	}
+
+	return ok && column == values.size();
+}
+
+
+Segment::Neighbours
+Segment::neighbours (double unix_timestamp) const
+{
+	Neighbours result;
+
+	auto upper = std::upper_bound (_timestamps.begin(), _timestamps.end(), unix_timestamp);
+	if (upper != _timestamps.begin())
+		result.previous = std::distance (_timestamps.begin(), upper) - 1;
+
+	auto lower = std::lower_bound (_timestamps.begin(), _timestamps.end(), unix_timestamp);
+	if (lower != _timestamps.end())
+		result.next = std::distance (_timestamps.begin(), lower);
+
+	return result;
+}
+
+
+double
+Segment::energy_until (double unix_timestamp) const
+{
+	auto upper = std::upper_bound (_timestamps.begin(), _timestamps.end(), unix_timestamp);
+	std::size_t i = std::distance (_timestamps.begin(), upper);
+
+	if (i == 0)
+		return 0.0;
+	else if (i == size())
+		return _energy_prefix.back();
+	else
+	{
+		double const fraction = (unix_timestamp - _timestamps[i - 1]) / (_timestamps[i] - _timestamps[i - 1]);
+		return _energy_prefix[i - 1] + (_energy_prefix[i] - _energy_prefix[i - 1]) * fraction;
+	}
+}
+
+
+Segment::Aggregate
+Segment::aggregate (double start_timestamp, double end_timestamp) const
+{
+	Aggregate result;
+
+	auto lower = std::lower_bound (_timestamps.begin(), _timestamps.end(), start_timestamp);
+	auto upper = std::upper_bound (_timestamps.begin(), _timestamps.end(), end_timestamp);
+
+	if (lower < upper)
+	{
+		std::size_t begin = std::distance (_timestamps.begin(), lower);
+		std::size_t end = std::distance (_timestamps.begin(), upper);
+		auto extremes = _power_extremes.query (begin, end);
+
+		result.samples = end - begin;
+		result.min_power_W = extremes.min;
+		result.max_power_W = extremes.max;
+	}
+
+	result.energy_J = energy_until (end_timestamp) - energy_until (start_timestamp);
+	return result;
+}
+
+
+Segment::Summary
+Segment::summary() const
+{
+	Summary result;
+
+	if (size() > 0)
+	{
+		auto extremes = _power_extremes.query (0, size());
+
+		result.samples = size();
+		result.first_timestamp = _timestamps.front();
+		result.last_timestamp = _timestamps.back();
+		result.first_power_W = _power.front();
+		result.first_logged_energy = _logged_energy.front();
+		result.last_logged_energy = _logged_energy.back();
+		result.energy_J = _energy_prefix.back();
+		result.min_power_W = extremes.min;
+		result.max_power_W = extremes.max;
+	}
+
+	return result;
+}
+
+
+void
+Segment::add_power_quantiles (double start_timestamp, double end_timestamp, QuantileSketch& sketch) const
+{
+	auto lower = std::lower_bound (_timestamps.begin(), _timestamps.end(), start_timestamp);
+	auto upper = std::upper_bound (_timestamps.begin(), _timestamps.end(), end_timestamp);
+
+	if (lower < upper)
+		add_power_quantiles (std::distance (_timestamps.begin(), lower), std::distance (_timestamps.begin(), upper), _rollups.size(), sketch);
+}
+
+
+void
+Segment::add_power_quantiles (std::size_t begin, std::size_t end, std::size_t rollup_level, QuantileSketch& sketch) const
+{
+	if (begin >= end)
+		return;
+
+	if (rollup_level == 0)
+	{
+		for (std::size_t i = begin; i < end; ++i)
+			sketch.insert (_power[i]);
+
+		return;
+	}
+
+	auto const& rollup = _rollups[rollup_level - 1];
+
+	// First bucket starting at or after begin:
+	auto first = std::lower_bound (rollup.begin(), rollup.end(), begin, [](Bucket const& bucket, std::size_t index) {
+		return bucket.begin < index;
+	});
+
+	std::size_t i = std::distance (rollup.begin(), first);
+	std::size_t full_begin = end;
+	std::size_t full_end = end;
+
+	for (; i < rollup.size() && bucket_end (rollup, i) <= end; ++i)
+	{
+		if (full_begin == end)
+			full_begin = rollup[i].begin;
+
+		sketch.merge (rollup[i].power_sketch);
+		full_end = bucket_end (rollup, i);
+	}
+
+	if (full_begin == end)
+		add_power_quantiles (begin, end, rollup_level - 1, sketch);
+	else
+	{
+		add_power_quantiles (begin, full_begin, rollup_level - 1, sketch);
+		add_power_quantiles (full_end, end, rollup_level - 1, sketch);
+	}
+}
+
+
+std::size_t
+Segment::memory_size() const noexcept
+{
+	std::size_t result = (_timestamps.capacity() + _power.capacity() + _logged_energy.capacity() + _energy_prefix.capacity()) * sizeof (double)
+					   + _power_extremes.memory_size()
+					   + _blocks.capacity() * sizeof (Block);
+
+	for (auto const& rollup: _rollups)
+		result += rollup.capacity() * sizeof (Bucket);
+
+	return result;
+}
+
+
+std::size_t
+Segment::bucket_end (Rollup const& rollup, std::size_t bucket_index) const
+{
+	return bucket_index + 1 < rollup.size()
+		? rollup[bucket_index + 1].begin
+		: size();
+}
+
+
+void
+Segment::index_sample (double timestamp, double power, double logged_energy, int64_t offset)
+{
+	// Skip samples that went back in time, binary searches depend on ordering:
+	if (!_timestamps.empty() && !(timestamp > _timestamps.back()))
+		return;
+
+	if (!std::isfinite (power))
+		power = 0.0;
+
+	double energy = _energy_prefix.empty()
+		? 0.0
+		: _energy_prefix.back() + interval_energy (timestamp - _timestamps.back(), power, _logged_energy.back(), logged_energy);
+
+	_timestamps.push_back (timestamp);
+	_power.push_back (power);
+	_logged_energy.push_back (logged_energy);
+	_energy_prefix.push_back (energy);
+	_power_extremes.push_back (power);
+
+	std::size_t const index = size() - 1;
+
+	if (index % kBlockSamples == 0)
+	{
+		if (!_blocks.empty())
+			_blocks.back().csv_end = offset;
+
+		// Decoding starts with the previous sample, so that the interval before the first one is known:
+		_blocks.push_back ({
+			index == 0 ? offset : _last_offset,
+			offset,
+			index == 0 ? 0.0 : _energy_prefix[index - 1],
+			timestamp, timestamp, 0, power, power,
+		});
+	}
+
+	auto& block = _blocks.back();
+	block.last_timestamp = timestamp;
+	block.samples += 1;
+	block.min_power_W = std::min (block.min_power_W, power);
+	block.max_power_W = std::max (block.max_power_W, power);
+	_last_offset = offset;
+
+	for (std::size_t level = 0; level < _rollups.size(); ++level)
+	{
+		auto& rollup = _rollups[level];
+		double bucket_start = std::floor (timestamp / kRollupPeriods[level]) * kRollupPeriods[level];
+
+		if (rollup.empty() || rollup.back().start_timestamp != bucket_start)
+			rollup.push_back ({ size() - 1, bucket_start, offset, QuantileSketch() });
+
+		rollup.back().power_sketch.insert (power);
+	}
+}
+
@@ -0,0 +1,295 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef UTILITY__SEGMENT_H__INCLUDED
+#define UTILITY__SEGMENT_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Boost:
+#include <boost/optional.hpp>
+
+// Qt:
+#include <QByteArray>
+#include <QString>
+
+// Local:
+#include "file_db.h"
+#include "min_max_tree.h"
+#include "quantile_sketch.h"
+
+
+/**
+ * In-memory index of a single FileDB CSV file (one day of samples).
+ * Keeps prefix sums of energy and a min/max tree of power, so that
+ * aggregates over any time window are answered in O(log n).
+ *
+ * Power used is the corrected power column; energy is integrated the same way
+ * scpidev does it: power of a sample times dt from the previous sample.
+ *
+ * Power values are also rolled up into minute and hour buckets, each with
+ * a quantile sketch, so quantiles over long windows only merge a handful of sketches.
+ *
+ * Samples are also grouped into blocks of kBlockSamples, so that a part of a file
+ * can be decoded on its own later, see Block.
+ */
+class Segment
+{
+	friend class RollupsFile;
+
+  public:
+	// Rollup bucket lengths, from the shortest:
+	static constexpr std::array<double, 2> kRollupPeriods { { 60.0, 3600.0 } };
+
+	// Samples per block:
+	static constexpr std::size_t kBlockSamples = 4096;
+
+	// Column values of a CSV line:
+	typedef std::array<double, FileDB::kColumnsCount> Values;
+
+	class Neighbours
+	{
+	  public:
+		boost::optional<std::size_t>	previous;
+		boost::optional<std::size_t>	next;
+	};
+
+	class Aggregate
+	{
+	  public:
+		uint64_t	samples		= 0;
+		double		energy_J	= 0.0;
+		double		min_power_W	= 0.0;
+		double		max_power_W	= 0.0;
+	};
+
+	/**
+	 * Aggregates over the whole segment, and its first and last samples,
+	 * so that whole days can be combined without decoding them.
+	 */
+	class Summary
+	{
+	  public:
+		uint64_t	samples				= 0;
+		double		first_timestamp		= 0.0;
+		double		last_timestamp		= 0.0;
+		double		first_power_W		= 0.0;
+		double		first_logged_energy	= 0.0;
+		double		last_logged_energy	= 0.0;
+		double		energy_J			= 0.0;
+		double		min_power_W			= 0.0;
+		double		max_power_W			= 0.0;
+	};
+
+	/**
+	 * Location and aggregates of kBlockSamples consecutive samples of the file.
+	 * Decoded range starts with the last sample of the previous block, so that energy
+	 * and neighbours of timestamps between two blocks are answered by the later one.
+	 */
+	class Block
+	{
+	  public:
+		// Byte range of lines to decode, starting with the previous block's last sample:
+		int64_t		csv_begin;
+		int64_t		csv_end;
+		// Energy integrated from the first sample of the file up to the first decoded one:
+		double		energy_base;
+		// Aggregates of the block's own samples:
+		double		first_timestamp;
+		double		last_timestamp;
+		uint64_t	samples;
+		double		min_power_W;
+		double		max_power_W;
+	};
+
+  public:
+	/**
+	 * Ctor
+	 *
+	 * \param	path
+	 *			Path to the CSV file. File is not read until update() is called.
+	 */
+	explicit Segment (QString const& path);
+
+	/**
+	 * Ctor
+	 * Segment of a single block of the file. Energy is integrated from the first
+	 * decoded sample, add Block::energy_base to get energy since the start of the file.
+	 */
+	Segment (QString const& path, Block const&);
+
+	/**
+	 * Return energy of the interval between two consecutive samples, integrated the way scpidev
+	 * does it: power of the later sample times dt. If scpidev was restarted in between (logged
+	 * energy went back), the time it wasn't running is not integrated, only the energy the new
+	 * process logged with its first sample.
+	 */
+	static double
+	interval_energy (double dt, double power, double previous_logged_energy, double logged_energy);
+
+	/**
+	 * Parse CSV line data[begin, end), end being the position of its newline.
+	 * Return false for comments and malformed lines.
+	 */
+	static bool
+	parse_line (QByteArray const& data, int begin, int end, Values&);
+
+	/**
+	 * Read samples appended to the file since last call.
+	 * Return true if new samples were indexed.
+	 */
+	bool
+	update();
+
+	/**
+	 * Number of indexed samples.
+	 */
+	std::size_t
+	size() const noexcept;
+
+	double
+	timestamp (std::size_t index) const;
+
+	/**
+	 * Cumulative energy as logged by scpidev (energy_corrected column).
+	 */
+	double
+	logged_energy (std::size_t index) const;
+
+	/**
+	 * Return indices of the last sample at or before and first sample at or after
+	 * given timestamp.
+	 */
+	Neighbours
+	neighbours (double unix_timestamp) const;
+
+	/**
+	 * Energy integrated from the first sample in the segment up to given timestamp.
+	 */
+	double
+	energy_until (double unix_timestamp) const;
+
+	/**
+	 * Compute aggregates over samples with timestamps in range [start, end].
+	 */
+	Aggregate
+	aggregate (double start_timestamp, double end_timestamp) const;
+
+	/**
+	 * Return aggregates over all indexed samples.
+	 */
+	Summary
+	summary() const;
+
+	/**
+	 * Add power of samples with timestamps in range [start, end] to the sketch.
+	 * Full rollup buckets are merged, only samples in partially covered
+	 * minute buckets at the window edges are added one by one.
+	 */
+	void
+	add_power_quantiles (double start_timestamp, double end_timestamp, QuantileSketch& sketch) const;
+
+	/**
+	 * Blocks of indexed samples.
+	 */
+	std::vector<Block> const&
+	blocks() const noexcept;
+
+	/**
+	 * Return approximate number of bytes allocated for indexed samples.
+	 */
+	std::size_t
+	memory_size() const noexcept;
+
+  private:
+	class Bucket
+	{
+	  public:
+		// Index of the first sample in the bucket:
+		std::size_t		begin;
+		double			start_timestamp;
+		// Position of the first sample's line in the CSV file:
+		int64_t			offset;
+		QuantileSketch	power_sketch;
+	};
+
+	typedef std::vector<Bucket> Rollup;
+
+  private:
+	void
+	index_sample (double timestamp, double power, double logged_energy, int64_t offset);
+
+	/**
+	 * Add samples [begin, end) to the sketch using rollups at given level and below.
+	 */
+	void
+	add_power_quantiles (std::size_t begin, std::size_t end, std::size_t rollup_level, QuantileSketch& sketch) const;
+
+	/**
+	 * Index one past the last sample of given bucket.
+	 */
+	std::size_t
+	bucket_end (Rollup const&, std::size_t bucket_index) const;
+
+  private:
+	QString					_path;
+	int64_t					_offset			= 0;
+	int64_t					_end_offset		= std::numeric_limits<int64_t>::max();
+	// Position of the last indexed sample's line:
+	int64_t					_last_offset	= 0;
+	std::vector<double>		_timestamps;
+	std::vector<double>		_power;
+	std::vector<double>		_logged_energy;
+	// _energy_prefix[i] is energy integrated from sample 0 up to sample i:
+	std::vector<double>		_energy_prefix;
+	MinMaxTree<double>		_power_extremes;
+	std::array<Rollup, kRollupPeriods.size()>
+							_rollups;
+	std::vector<Block>		_blocks;
+};
+
+
+inline std::size_t
+Segment::size() const noexcept
+{
+	return _timestamps.size();
+}
+
+
+inline double
+Segment::timestamp (std::size_t index) const
+{
+	return _timestamps[index];
+}
+
+
+inline double
+Segment::logged_energy (std::size_t index) const
+{
+	return _logged_energy[index];
+}
+
+
+inline std::vector<Segment::Block> const&
+Segment::blocks() const noexcept
+{
+	return _blocks;
+}
+
+#endif
+
@@ -0,0 +1,131 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <utility>
+
+// Local:
+#include "slice_statistics.h"
+
+
+Slice::Slice (std::size_t columns):
+	columns (columns)
+{ }
+
+
+void
+Slice::append (double timestamp, double const* values)
+{
+	if (_rows == 0)
+		first_timestamp = timestamp;
+
+	last_timestamp = timestamp;
+	timestamps_sum += timestamp;
+
+	for (std::size_t c = 0; c < columns.size(); ++c)
+		columns[c].push_back (values[c]);
+
+	++_rows;
+}
+
+
+ColumnStatistics
+compute_statistics (std::vector<double>& values)
+{
+	ColumnStatistics result;
+	std::size_t const n = values.size();
+
+	result.min = values.front();
+	result.max = values.front();
+	double sum = 0.0;
+
+	for (double value: values)
+	{
+		result.min = std::min (result.min, value);
+		result.max = std::max (result.max, value);
+		sum += value;
+	}
+
+	result.mean = sum / n;
+
+	// Select k-th smallest value among values[first…] and return it with the next one.
+	// Everything before first must already be not greater than anything after it:
+	auto select = [&](std::size_t first, std::size_t k) -> std::pair<double, double> {
+		std::nth_element (values.begin() + first, values.begin() + k, values.end());
+		double const next = k + 1 < n ? *std::min_element (values.begin() + k + 1, values.end()) : values[k];
+		return { values[k], next };
+	};
+
+	// Rank position as in tools/make_stats, 1-based:
+	auto position = [n](double p) {
+		return p * (n - 1) + 1;
+	};
+
+	double const position25 = position (0.25);
+	double const position75 = position (0.75);
+	std::size_t const k25 = static_cast<std::size_t> (std::floor (position25)) - 1;
+	std::size_t const k75 = static_cast<std::size_t> (std::floor (position75)) - 1;
+
+	auto const v25 = select (0, k25);
+	// After the first selection values above k25 are the greater ones, so the second one can skip the rest:
+	auto const v75 = k75 > k25 ? select (k25 + 1, k75) : v25;
+
+	result.p25 = v25.first + std::fmod (position25, 1.0) * (v25.second - v25.first);
+	result.p75 = v75.first + std::fmod (position75, 1.0) * (v75.second - v75.first);
+	return result;
+}
+
+
+std::vector<SliceStatistics>
+compute_statistics (std::vector<Slice>& slices, unsigned int threads)
+{
+	std::vector<SliceStatistics> result (slices.size());
+	std::size_t const columns = slices.empty() ? 0 : slices.front().columns.size();
+
+	for (std::size_t s = 0; s < slices.size(); ++s)
+	{
+		result[s].mean_timestamp = slices[s].timestamps_sum / slices[s].rows();
+		result[s].columns.resize (columns);
+	}
+
+	// Each task is a column of a slice; tasks write to distinct elements of result:
+	std::size_t const tasks = slices.size() * columns;
+	std::atomic<std::size_t> next_task { 0 };
+
+	auto worker = [&] {
+		for (std::size_t task; (task = next_task.fetch_add (1, std::memory_order_relaxed)) < tasks; )
+		{
+			std::size_t const s = task / columns;
+			std::size_t const c = task % columns;
+			result[s].columns[c] = compute_statistics (slices[s].columns[c]);
+		}
+	};
+
+	std::vector<std::thread> pool;
+
+	for (unsigned int i = 1; i < std::min<std::size_t> (threads, tasks); ++i)
+		pool.emplace_back (worker);
+
+	worker();
+
+	for (auto& thread: pool)
+		thread.join();
+
+	return result;
+}
+
@@ -0,0 +1,113 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef UTILITY__SLICE_STATISTICS_H__INCLUDED
+#define UTILITY__SLICE_STATISTICS_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <vector>
+
+
+/**
+ * Consecutive rows of the log. Only the selected columns are kept, one vector per column,
+ * so that each column can be processed on its own.
+ */
+class Slice
+{
+  public:
+	// Ctor
+	explicit Slice (std::size_t columns);
+
+	/**
+	 * Append a row.
+	 *
+	 * \param	values
+	 *			Value of each selected column, in order.
+	 */
+	void
+	append (double timestamp, double const* values);
+
+	std::size_t
+	rows() const noexcept;
+
+	/**
+	 * Return time between the first and the last row.
+	 */
+	double
+	duration() const noexcept;
+
+  public:
+	double								first_timestamp	= 0.0;
+	double								last_timestamp	= 0.0;
+	double								timestamps_sum	= 0.0;
+	std::vector<std::vector<double>>	columns;
+
+  private:
+	std::size_t							_rows			= 0;
+};
+
+
+/**
+ * Summary of one column of a slice.
+ */
+class ColumnStatistics
+{
+  public:
+	double	min		= 0.0;
+	double	p25		= 0.0;
+	double	mean	= 0.0;
+	double	p75		= 0.0;
+	double	max		= 0.0;
+};
+
+
+class SliceStatistics
+{
+  public:
+	double							mean_timestamp	= 0.0;
+	std::vector<ColumnStatistics>	columns;
+};
+
+
+/**
+ * Compute statistics of non-empty values. Percentiles are interpolated between closest ranks,
+ * the same way tools/make_stats did, but found by selection in O(n) instead of sorting.
+ * Values are reordered.
+ */
+ColumnStatistics
+compute_statistics (std::vector<double>& values);
+
+/**
+ * Compute statistics of all columns of given slices, in order. Columns are distributed among
+ * given number of threads. Slices are left reordered.
+ */
+std::vector<SliceStatistics>
+compute_statistics (std::vector<Slice>& slices, unsigned int threads);
+
+
+inline std::size_t
+Slice::rows() const noexcept
+{
+	return _rows;
+}
+
+
+inline double
+Slice::duration() const noexcept
+{
+	return last_timestamp - first_timestamp;
+}
+
+#endif
+
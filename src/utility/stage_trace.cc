@@ -0,0 +1,147 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+// Standard:
+#include <cstddef>
+#include <cstring>
+
+// Linux:
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Qt:
+#include <QFile>
+
+// Local:
+#include "stage_trace.h"
+
+
+constexpr char StageTrace::kMagic[8];
+constexpr uint32_t StageTrace::kVersion;
+
+
+StageTrace::StageTrace (QString const& path, uint64_t capacity)
+{
+	if (capacity == 0)
+		throw Error ("capacity must be positive");
+
+	_fd = ::open (path.toLocal8Bit().constData(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (_fd == -1)
+		throw Error ("couldn't open " + path.toStdString() + ": " + ::strerror (errno));
+
+	_mapping_size = sizeof (Header) + capacity * sizeof (Record);
+
+	if (::ftruncate (_fd, _mapping_size) != 0)
+	{
+		::close (_fd);
+		throw Error ("couldn't resize " + path.toStdString() + ": " + ::strerror (errno));
+	}
+
+	void* mapping = ::mmap (nullptr, _mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+
+	if (mapping == MAP_FAILED)
+	{
+		::close (_fd);
+		throw Error ("couldn't map " + path.toStdString() + ": " + ::strerror (errno));
+	}
+
+	_header = static_cast<Header*> (mapping);
+	_records = reinterpret_cast<Record*> (static_cast<char*> (mapping) + sizeof (Header));
+
+	std::memcpy (_header->magic, kMagic, sizeof (kMagic));
+	_header->version = kVersion;
+	_header->record_size = sizeof (Record);
+	_header->capacity = capacity;
+	_header->records_written = 0;
+}
+
+
+StageTrace::~StageTrace()
+{
+	::msync (_header, _mapping_size, MS_ASYNC);
+	::munmap (_header, _mapping_size);
+	::close (_fd);
+}
+
+
+void
+StageTrace::append (Record const& record) noexcept
+{
+	_records[_header->records_written % _header->capacity] = record;
+	// Readers of a live file use records_written to find the oldest record, so publish the record first:
+	__atomic_store_n (&_header->records_written, _header->records_written + 1, __ATOMIC_RELEASE);
+}
+
+
+std::vector<StageTrace::Record>
+StageTrace::read (QString const& path)
+{
+	QFile file (path);
+
+	if (!file.open (QIODevice::ReadOnly))
+		throw Error ("couldn't open " + path.toStdString() + ": " + file.errorString().toStdString());
+
+	Header header;
+
+	if (file.read (reinterpret_cast<char*> (&header), sizeof (header)) != sizeof (header) ||
+		std::memcmp (header.magic, kMagic, sizeof (kMagic)) != 0)
+	{
+		throw Error (path.toStdString() + " is not a stage trace file");
+	}
+
+	if (header.version != kVersion || header.record_size != sizeof (Record))
+		throw Error (path.toStdString() + " has unsupported version or record layout");
+
+	std::vector<Record> ring (header.capacity);
+	auto ring_bytes = static_cast<qint64> (header.capacity * sizeof (Record));
+
+	if (file.read (reinterpret_cast<char*> (ring.data()), ring_bytes) != ring_bytes)
+		throw Error (path.toStdString() + " is truncated");
+
+	std::vector<Record> result;
+
+	if (header.records_written <= header.capacity)
+		result.assign (ring.begin(), ring.begin() + header.records_written);
+	else
+	{
+		auto oldest = ring.begin() + header.records_written % header.capacity;
+		result.assign (oldest, ring.end());
+		result.insert (result.end(), ring.begin(), oldest);
+	}
+
+	return result;
+}
+
+
+char const*
+StageTrace::stage_name (Stage stage)
+{
+	switch (stage)
+	{
+		case kLoopStart:			return "loop-start";
+		case kFetched:				return "fetched";
+		case kHousekeepingDone:		return "housekeeping-done";
+		case kInitiated:			return "initiated";
+		case kComputed:				return "computed";
+		case kQueued:				return "queued";
+		case kDequeued:				return "dequeued";
+		case kLogged:				return "logged";
+		case kStagesCount:			break;
+	}
+
+	return "unknown";
+}
+
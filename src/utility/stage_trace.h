@@ -0,0 +1,158 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2016  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef UTILITY__STAGE_TRACE_H__INCLUDED
+#define UTILITY__STAGE_TRACE_H__INCLUDED
+
+// Standard:
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Linux:
+#include <time.h>
+
+// Qt:
+#include <QString>
+
+
+/**
+ * Return CLOCK_MONOTONIC_RAW time in nanoseconds. Not affected by NTP slewing or wall-clock changes.
+ */
+inline int64_t
+monotonic_raw_ns() noexcept
+{
+	struct timespec ts;
+	::clock_gettime (CLOCK_MONOTONIC_RAW, &ts);
+	return static_cast<int64_t> (ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+
+/**
+ * Per-sample timestamps of acquisition loop stages, stored in a fixed-size binary ring file.
+ * The file is memory-mapped, so appending a record is a plain memory copy; when the ring is full,
+ * oldest records are overwritten.
+ *
+ * File layout: Header, followed by Header::capacity Records. All fields are native-endian.
+ */
+class StageTrace
+{
+  public:
+	static constexpr char		kMagic[8]	= "SCPITRC";
+	static constexpr uint32_t	kVersion	= 2;
+
+	enum Stage
+	{
+		// Measure thread:
+		kLoopStart,
+		// Replies of all meters received:
+		kFetched,
+		kHousekeepingDone,
+		kInitiated,
+		kComputed,
+		kQueued,
+		// Log thread:
+		kDequeued,
+		kLogged,
+		kStagesCount,
+	};
+
+	enum Flags: uint32_t
+	{
+		kTimingError	= 1u << 0,
+		kAutoZero		= 1u << 1,
+		// Measured in trigger burst mode:
+		kBurst			= 1u << 2,
+	};
+
+	class Record
+	{
+	  public:
+		/**
+		 * Store current time for given stage.
+		 */
+		void
+		mark (Stage stage) noexcept;
+
+	  public:
+		uint64_t	sample_number				= 0;
+		uint32_t	flags						= 0;
+		uint32_t	reserved					= 0;
+		// CLOCK_MONOTONIC_RAW nanoseconds; 0 if stage wasn't reached:
+		int64_t		stamps[kStagesCount]		= {};
+	};
+
+	class Header
+	{
+	  public:
+		char		magic[8];
+		uint32_t	version;
+		uint32_t	record_size;
+		uint64_t	capacity;
+		// Total number of records ever appended; next one goes to records_written % capacity:
+		uint64_t	records_written;
+	};
+
+	class Error: public std::runtime_error
+	{
+	  public:
+		// Ctor:
+		Error (std::string const& message):
+			std::runtime_error ("stage trace: " + message)
+		{ }
+	};
+
+  public:
+	/**
+	 * Create (or truncate) trace file able to hold capacity records.
+	 * Throw Error on failure.
+	 */
+	StageTrace (QString const& path, uint64_t capacity);
+
+	// Dtor
+	~StageTrace();
+
+	/**
+	 * Append record, overwriting the oldest one if the ring is full.
+	 * Not thread-safe: there should be a single writer.
+	 */
+	void
+	append (Record const&) noexcept;
+
+	/**
+	 * Read all records stored in a trace file, oldest first.
+	 * Throw Error on failure.
+	 */
+	static std::vector<Record>
+	read (QString const& path);
+
+	static char const*
+	stage_name (Stage);
+
+  private:
+	int			_fd;
+	std::size_t	_mapping_size;
+	Header*		_header;
+	Record*		_records;
+};
+
+
+inline void
+StageTrace::Record::mark (Stage stage) noexcept
+{
+	stamps[stage] = monotonic_raw_ns();
+}
+
+#endif
+
@@ -1,5 +1,4 @@
-system('tail -n 1000 log > visualize-power-last.dat')
-system('tail -n 1000 log | ./make_stats 8 20 > visualize-power-last-candlesticks.dat')
+# Data files are kept up to date by scpidev: run it with --plot-dir pointing to this directory.
 
 set key autotitle columnhead
 set xlabel "time (UTC)"